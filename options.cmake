@@ -4,6 +4,9 @@
 # ------------------------------------------------------------------------------
 
 option(SQ_FORCE_COLOR "Force coloured compiler output" FALSE)
+
+# Compression needs zlib and libzstd from the system.
+option(SQ_COMPRESSION "Support compressing the output with --compress" TRUE)
 set(SQ_COLOR_FLAGS)
 if("${SQ_FORCE_COLOR}" OR "$ENV{CLICOLOR_FORCE}")
     if ("${CMAKE_CXX_COMPILER_ID}" STREQUAL GNU)
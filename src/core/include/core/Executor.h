@@ -0,0 +1,100 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_core_Executor_h_
+#define SQ_INCLUDE_GUARD_core_Executor_h_
+
+#include "core/typeutil.h"
+
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace sq {
+
+/**
+ * Runs tasks on a fixed number of worker threads.
+ *
+ * Each worker has its own deque of tasks, and takes tasks from the back of
+ * its own deque first. Tasks submitted by a worker are added to the back of
+ * its own deque, so related tasks tend to run next on the same thread. Tasks
+ * submitted from other threads are shared between the workers' deques and
+ * are added to the front, so each worker starts them in the order that they
+ * were submitted. Workers with nothing to do steal tasks from the front of
+ * other workers' deques.
+ */
+class Executor {
+public:
+  /**
+   * Start an executor with the given number of worker threads.
+   */
+  explicit Executor(std::size_t threads);
+
+  Executor(const Executor &) = delete;
+  Executor(Executor &&) = delete;
+  Executor &operator=(const Executor &) = delete;
+  Executor &operator=(Executor &&) = delete;
+
+  /**
+   * Discard the tasks that haven't started and wait for the tasks that are
+   * running to finish.
+   */
+  ~Executor() noexcept;
+
+  /**
+   * Submit a task.
+   *
+   * Returns a future for the task's result. If the task throws, the
+   * exception is rethrown from the future's get(). If the executor is
+   * destroyed before the task starts then the task is discarded and the
+   * future's get() throws std::future_error(broken_promise).
+   */
+  template <std::invocable F>
+  SQ_ND std::future<std::invoke_result_t<F>> submit(F &&f);
+
+  /**
+   * Get the number of worker threads.
+   */
+  SQ_ND std::size_t size() const noexcept;
+
+private:
+  using Task = std::function<void()>;
+
+  struct Worker {
+    std::deque<Task> tasks_;
+  };
+
+  void post(Task task);
+  // Take the next task for a worker, which must hold mutex_. There must be a
+  // queued task.
+  SQ_ND Task take(std::size_t worker);
+  void run(std::size_t worker);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  // Guards the workers' deques as well as the members below. A worker that
+  // sees a non-zero count of queued tasks can take one without retrying.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::size_t queued_ = 0;
+  std::size_t next_worker_ = 0;
+  bool stopping_ = false;
+
+  std::vector<std::jthread> threads_;
+};
+
+} // namespace sq
+
+#include "core/Executor.inl.h"
+
+#endif // SQ_INCLUDE_GUARD_core_Executor_h_
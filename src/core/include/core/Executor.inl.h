@@ -0,0 +1,25 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_core_Executor_inl_h_
+#define SQ_INCLUDE_GUARD_core_Executor_inl_h_
+
+#include <utility>
+
+namespace sq {
+
+template <std::invocable F>
+std::future<std::invoke_result_t<F>> Executor::submit(F &&f) {
+  // std::function needs a copyable target, but packaged_task is move-only.
+  auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(
+      SQ_FWD(f));
+  auto future = task->get_future();
+  post([task = std::move(task)] { (*task)(); });
+  return future;
+}
+
+} // namespace sq
+
+#endif // SQ_INCLUDE_GUARD_core_Executor_inl_h_
@@ -60,6 +60,47 @@ public:
    */
   SQ_ND virtual Primitive to_primitive() const = 0;
 
+  /**
+   * Get a view of the representation of the system object as a Primitive
+   * type, without copying a string that the object already holds.
+   *
+   * A representation that has to be built is put in storage. The view may
+   * refer to the field or to storage, so both must outlive it. By default,
+   * the result of to_primitive() is put in storage.
+   */
+  SQ_ND virtual PrimitiveRef to_primitive_ref(Primitive &storage) const {
+    storage = to_primitive();
+    return primitive_ref(storage);
+  }
+
+  /**
+   * Get whether the field must only be used on the thread that created it.
+   *
+   * Fields that aren't thread affine may be used on other threads, as long as
+   * they are only used by one thread at a time. This allows e.g. the elements
+   * of an array to be evaluated in parallel.
+   */
+  SQ_ND virtual bool is_thread_affine() const noexcept { return false; }
+
+  /**
+   * Get whether the field's members may be accessed by more than one thread
+   * at once.
+   *
+   * This allows e.g. sibling subtrees of a query to be evaluated in parallel.
+   */
+  SQ_ND virtual bool allows_concurrent_access() const noexcept {
+    return false;
+  }
+
+  /**
+   * Get whether evaluating the field's members is likely to spend most of
+   * its time waiting, e.g. for filesystem metadata or user database lookups.
+   *
+   * The elements of arrays of latency-bound fields may be evaluated ahead of
+   * time so that the waits overlap.
+   */
+  SQ_ND virtual bool is_latency_bound() const noexcept { return false; }
+
   Field(const Field &) = delete;
   Field(Field &&) = delete;
   Field &operator=(const Field &) = delete;
@@ -0,0 +1,108 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_core_FieldCallHints_h_
+#define SQ_INCLUDE_GUARD_core_FieldCallHints_h_
+
+#include "core/typeutil.h"
+
+#include <functional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sq {
+
+/**
+ * Describes how the results of a field access are going to be used.
+ *
+ * Hints allow a Field to avoid doing work that isn't needed. E.g. if only the
+ * names of the entries in a directory are going to be used then there is no
+ * need to stat() each entry.
+ *
+ * Hints must not change the results of a field access: a Field that ignores
+ * them must still produce correct results.
+ *
+ * A default constructed FieldCallHints means that the usage of the results is
+ * unknown, so any field of the results may be accessed.
+ */
+class FieldCallHints {
+public:
+  using StringPredicate = std::function<bool(std::string_view)>;
+
+  /**
+   * A condition that results must satisfy in order to be used.
+   */
+  struct StringFilter {
+    /**
+     * The field of a result that the condition is on.
+     */
+    std::string field_;
+
+    /**
+     * Gets whether a value of the field satisfies the condition.
+     *
+     * The predicate takes the value that the field's to_primitive() would
+     * return, which must be a PrimitiveString.
+     */
+    StringPredicate predicate_;
+  };
+  using StringFilters = std::vector<StringFilter>;
+
+  /**
+   * Record that the given field will be accessed on the results.
+   */
+  void add_field(std::string_view name);
+
+  /**
+   * Record that to_primitive() will be called on the results.
+   */
+  void add_primitive();
+
+  /**
+   * Record that results will be discarded unless the given field satisfies a
+   * predicate.
+   *
+   * A Field may use the filter to avoid creating results that will be
+   * discarded, but only if it knows that the field's value is a
+   * PrimitiveString.
+   */
+  void add_string_filter(std::string_view field, StringPredicate predicate);
+
+  /**
+   * Get the filters that results must satisfy in order to be used.
+   */
+  SQ_ND const StringFilters &string_filters() const noexcept;
+
+  /**
+   * Get whether the usage of the results has been recorded.
+   */
+  SQ_ND bool known() const noexcept;
+
+  /**
+   * Get whether the given field may be accessed on the results.
+   *
+   * Returns true if the usage of the results is not known.
+   */
+  SQ_ND bool may_use_field(std::string_view name) const;
+
+  /**
+   * Get whether to_primitive() may be called on the results.
+   *
+   * Returns true if the usage of the results is not known.
+   */
+  SQ_ND bool may_use_primitive() const noexcept;
+
+private:
+  bool known_ = false;
+  bool primitive_ = false;
+  std::set<std::string, std::less<>> fields_;
+  StringFilters string_filters_;
+};
+
+} // namespace sq
+
+#endif // SQ_INCLUDE_GUARD_core_FieldCallHints_h_
@@ -6,6 +6,7 @@
 #ifndef SQ_INCLUDE_GUARD_core_FieldCallParams_h_
 #define SQ_INCLUDE_GUARD_core_FieldCallParams_h_
 
+#include "core/FieldCallHints.h"
 #include "core/Primitive.h"
 #include "core/typeutil.h"
 
@@ -14,6 +15,7 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <vector>
 
 namespace sq {
@@ -53,6 +55,16 @@ public:
   SQ_ND const NamedParams &named_params() const;
   ///@}
 
+  ///@{
+  /**
+   * Get hints about how the results of the field access will be used.
+   *
+   * Hints are not considered when comparing FieldCallParams.
+   */
+  SQ_ND FieldCallHints &hints();
+  SQ_ND const FieldCallHints &hints() const;
+  ///@}
+
   /**
    * Get a required parameter given its name, index and type.
    *
@@ -84,11 +96,20 @@ public:
   SQ_ND ParamType get_or(size_t index, std::string_view name,
                          const ParamType &default_value) const;
 
-  SQ_ND auto operator<=>(const FieldCallParams &rhs) const = default;
+  SQ_ND auto operator<=>(const FieldCallParams &rhs) const {
+    return std::tie(pos_params_, named_params_) <=>
+           std::tie(rhs.pos_params_, rhs.named_params_);
+  }
+
+  SQ_ND bool operator==(const FieldCallParams &rhs) const {
+    return std::tie(pos_params_, named_params_) ==
+           std::tie(rhs.pos_params_, rhs.named_params_);
+  }
 
 private:
   PosParams pos_params_;
   NamedParams named_params_;
+  FieldCallHints hints_;
 };
 
 std::ostream &operator<<(std::ostream &os, const FieldCallParams &params);
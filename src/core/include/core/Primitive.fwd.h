@@ -8,6 +8,7 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <variant>
 
 namespace sq {
@@ -21,6 +22,12 @@ struct PrimitiveNull;
 using Primitive = std::variant<PrimitiveString, PrimitiveInt, PrimitiveFloat,
                                PrimitiveBool, PrimitiveNull>;
 
+/**
+ * A view of a Primitive that refers to its string rather than holding a copy.
+ */
+using PrimitiveRef = std::variant<std::string_view, PrimitiveInt,
+                                  PrimitiveFloat, PrimitiveBool, PrimitiveNull>;
+
 } // namespace sq
 
 #endif // SQ_INCLUDE_GUARD_core_Primitive_fwd_h_
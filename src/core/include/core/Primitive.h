@@ -26,6 +26,19 @@ inline constexpr std::string_view primitive_type_name_v =
     PrimitiveTypeName<P>::value;
 
 SQ_ND std::string_view primitive_type_name(const Primitive &value);
+
+/**
+ * Get a view of a Primitive. The view refers to the Primitive's string, so the
+ * Primitive must outlive it.
+ */
+SQ_ND PrimitiveRef primitive_ref(const Primitive &value) noexcept;
+
+/**
+ * Get a Primitive that holds a copy of the value that a PrimitiveRef refers
+ * to.
+ */
+SQ_ND Primitive primitive_from_ref(const PrimitiveRef &value);
+
 SQ_ND std::string primitive_to_str(const Primitive &value);
 SQ_ND std::string primitive_to_str(const PrimitiveAlternative auto &value);
 
@@ -0,0 +1,88 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_core_SpscQueue_h_
+#define SQ_INCLUDE_GUARD_core_SpscQueue_h_
+
+#include "core/typeutil.h"
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+namespace sq {
+
+/**
+ * A lock-free ring buffer for passing elements from exactly one producer
+ * thread to exactly one consumer thread.
+ *
+ * push() and pop() wait (using std::atomic::wait) while the queue is full or
+ * empty respectively; try_push() and try_pop() never wait.
+ */
+template <typename T> class SpscQueue {
+public:
+  /**
+   * Create a queue. The capacity is rounded up to a power of two.
+   */
+  explicit SpscQueue(std::size_t capacity);
+
+  SpscQueue(const SpscQueue &) = delete;
+  SpscQueue(SpscQueue &&) = delete;
+  SpscQueue &operator=(const SpscQueue &) = delete;
+  SpscQueue &operator=(SpscQueue &&) = delete;
+  ~SpscQueue() noexcept = default;
+
+  /**
+   * Add an element if the queue isn't full.
+   *
+   * The value is moved from only if it is added. Returns whether it was
+   * added. Must only be called by the producer.
+   */
+  SQ_ND bool try_push(T &value);
+
+  /**
+   * Add an element, waiting while the queue is full.
+   *
+   * Must only be called by the producer.
+   */
+  void push(T value);
+
+  /**
+   * Take the next element if the queue isn't empty.
+   *
+   * Must only be called by the consumer.
+   */
+  SQ_ND std::optional<T> try_pop();
+
+  /**
+   * Take the next element, waiting while the queue is empty.
+   *
+   * Must only be called by the consumer.
+   */
+  SQ_ND T pop();
+
+  SQ_ND std::size_t capacity() const noexcept;
+
+private:
+  // Keep the indices on separate cache lines so that the producer and
+  // consumer don't contend for them.
+  static constexpr auto cache_line_size = std::size_t{64};
+
+  std::vector<T> slots_;
+  std::size_t mask_;
+
+  // The number of elements that have been popped.
+  alignas(cache_line_size) std::atomic<std::size_t> head_ = 0;
+
+  // The number of elements that have been pushed.
+  alignas(cache_line_size) std::atomic<std::size_t> tail_ = 0;
+};
+
+} // namespace sq
+
+#include "core/SpscQueue.inl.h"
+
+#endif // SQ_INCLUDE_GUARD_core_SpscQueue_h_
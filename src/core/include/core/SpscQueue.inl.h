@@ -0,0 +1,73 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_core_SpscQueue_inl_h_
+#define SQ_INCLUDE_GUARD_core_SpscQueue_inl_h_
+
+#include <bit>
+#include <gsl/gsl>
+#include <utility>
+
+namespace sq {
+
+template <typename T>
+SpscQueue<T>::SpscQueue(std::size_t capacity)
+    : slots_(std::bit_ceil(capacity)), mask_{slots_.size() - 1} {
+  Expects(capacity > 0);
+}
+
+template <typename T> bool SpscQueue<T>::try_push(T &value) {
+  const auto tail = tail_.load(std::memory_order_relaxed);
+  if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+    return false;
+  }
+  slots_[tail & mask_] = std::move(value);
+  tail_.store(tail + 1, std::memory_order_release);
+  tail_.notify_one();
+  return true;
+}
+
+template <typename T> void SpscQueue<T>::push(T value) {
+  const auto tail = tail_.load(std::memory_order_relaxed);
+  for (auto head = head_.load(std::memory_order_acquire);
+       tail - head == slots_.size();
+       head = head_.load(std::memory_order_acquire)) {
+    head_.wait(head, std::memory_order_acquire);
+  }
+  slots_[tail & mask_] = std::move(value);
+  tail_.store(tail + 1, std::memory_order_release);
+  tail_.notify_one();
+}
+
+template <typename T> std::optional<T> SpscQueue<T>::try_pop() {
+  const auto head = head_.load(std::memory_order_relaxed);
+  if (tail_.load(std::memory_order_acquire) == head) {
+    return std::nullopt;
+  }
+  auto value = std::optional<T>{std::move(slots_[head & mask_])};
+  head_.store(head + 1, std::memory_order_release);
+  head_.notify_one();
+  return value;
+}
+
+template <typename T> T SpscQueue<T>::pop() {
+  const auto head = head_.load(std::memory_order_relaxed);
+  for (auto tail = tail_.load(std::memory_order_acquire); tail == head;
+       tail = tail_.load(std::memory_order_acquire)) {
+    tail_.wait(tail, std::memory_order_acquire);
+  }
+  auto value = std::move(slots_[head & mask_]);
+  head_.store(head + 1, std::memory_order_release);
+  head_.notify_one();
+  return value;
+}
+
+template <typename T> std::size_t SpscQueue<T>::capacity() const noexcept {
+  return slots_.size();
+}
+
+} // namespace sq
+
+#endif // SQ_INCLUDE_GUARD_core_SpscQueue_inl_h_
@@ -0,0 +1,66 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_core_cancellation_h_
+#define SQ_INCLUDE_GUARD_core_cancellation_h_
+
+#include "core/typeutil.h"
+
+#include <chrono>
+#include <stop_token>
+#include <thread>
+
+namespace sq {
+
+/**
+ * Sets the process-wide stop token while in scope.
+ *
+ * Long-running producers (e.g. directory walks) get the token with
+ * current_stop_token() when they start, and finish early, as if they had
+ * run out of results, once a stop is requested.
+ */
+class ScopedStopToken {
+public:
+  explicit ScopedStopToken(std::stop_token token);
+
+  ScopedStopToken(const ScopedStopToken &) = delete;
+  ScopedStopToken(ScopedStopToken &&) = delete;
+  ScopedStopToken &operator=(const ScopedStopToken &) = delete;
+  ScopedStopToken &operator=(ScopedStopToken &&) = delete;
+  ~ScopedStopToken() noexcept;
+
+private:
+  std::stop_token previous_;
+};
+
+/**
+ * Get the current process-wide stop token.
+ *
+ * If no ScopedStopToken is in scope then a token on which a stop can never
+ * be requested is returned.
+ */
+SQ_ND std::stop_token current_stop_token();
+
+/**
+ * Requests a stop on a stop source when a timeout expires, unless the
+ * StopTimer is destroyed first.
+ */
+class StopTimer {
+public:
+  StopTimer(std::stop_source source, std::chrono::milliseconds timeout);
+
+  StopTimer(const StopTimer &) = delete;
+  StopTimer(StopTimer &&) = delete;
+  StopTimer &operator=(const StopTimer &) = delete;
+  StopTimer &operator=(StopTimer &&) = delete;
+  ~StopTimer() noexcept = default;
+
+private:
+  std::jthread thread_;
+};
+
+} // namespace sq
+
+#endif // SQ_INCLUDE_GUARD_core_cancellation_h_
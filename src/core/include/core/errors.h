@@ -53,6 +53,21 @@ public:
   ArgumentTypeError(const Primitive &received, std::string_view type_expected);
 };
 
+/**
+ * Indicates that a file is not a valid metadata index.
+ */
+class IndexFormatError : public Exception {
+public:
+  using Exception::Exception;
+
+  /**
+   * @param file the path of the index file.
+   * @param message details about the problem with the file.
+   */
+  IndexFormatError(const std::filesystem::path &file,
+                   std::string_view message);
+};
+
 /**
  * Indicates a programming error in SQ.
  *
@@ -191,6 +206,13 @@ class UdevError : public SystemError {
   using SystemError::SystemError;
 };
 
+/**
+ * Indicates that a compression library returned an error.
+ */
+class CompressionError : public SystemError {
+  using SystemError::SystemError;
+};
+
 /**
  * Indicates that a filesystem error occurred.
  */
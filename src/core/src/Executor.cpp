@@ -0,0 +1,112 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "core/Executor.h"
+
+#include "core/ASSERT.h"
+
+#include <algorithm>
+#include <gsl/gsl>
+#include <iterator>
+#include <utility>
+
+namespace sq {
+
+namespace {
+
+// The executor and worker index of the current thread, if it is a worker.
+thread_local const Executor *current_executor = nullptr;
+thread_local std::size_t current_worker = 0;
+
+} // namespace
+
+Executor::Executor(std::size_t threads) {
+  Expects(threads > 0);
+  workers_.reserve(threads);
+  for (auto i = std::size_t{0}; i < threads; ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  threads_.reserve(threads);
+  for (auto i = std::size_t{0}; i < threads; ++i) {
+    threads_.emplace_back([this, i] { run(i); });
+  }
+}
+
+Executor::~Executor() noexcept {
+  auto discarded = std::vector<Task>{};
+  {
+    const auto lock = std::scoped_lock{mutex_};
+    stopping_ = true;
+    for (auto &worker : workers_) {
+      std::move(worker->tasks_.begin(), worker->tasks_.end(),
+                std::back_inserter(discarded));
+      worker->tasks_.clear();
+    }
+    queued_ = 0;
+  }
+  cv_.notify_all();
+  // Destroy the discarded tasks, breaking their promises, without holding the
+  // lock.
+  discarded.clear();
+  threads_.clear();
+}
+
+std::size_t Executor::size() const noexcept { return threads_.size(); }
+
+void Executor::post(Task task) {
+  {
+    const auto lock = std::scoped_lock{mutex_};
+    if (stopping_) {
+      return;
+    }
+    if (current_executor == this) {
+      workers_[current_worker]->tasks_.push_back(std::move(task));
+    } else {
+      workers_[next_worker_++ % workers_.size()]->tasks_.push_front(
+          std::move(task));
+    }
+    ++queued_;
+  }
+  cv_.notify_one();
+}
+
+Executor::Task Executor::take(std::size_t worker) {
+  auto &own = workers_[worker]->tasks_;
+  if (!own.empty()) {
+    auto task = std::move(own.back());
+    own.pop_back();
+    return task;
+  }
+  for (auto i = std::size_t{1}; i < workers_.size(); ++i) {
+    auto &victim = workers_[(worker + i) % workers_.size()]->tasks_;
+    if (!victim.empty()) {
+      auto task = std::move(victim.front());
+      victim.pop_front();
+      return task;
+    }
+  }
+  ASSERT(false);
+  return {};
+}
+
+void Executor::run(std::size_t worker) {
+  current_executor = this;
+  current_worker = worker;
+  for (;;) {
+    auto task = Task{};
+    {
+      auto lock = std::unique_lock{mutex_};
+      cv_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+      if (stopping_) {
+        return;
+      }
+      task = take(worker);
+      --queued_;
+    }
+    task();
+  }
+}
+
+} // namespace sq
@@ -0,0 +1,43 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "core/FieldCallHints.h"
+
+#include <utility>
+
+namespace sq {
+
+void FieldCallHints::add_field(std::string_view name) {
+  known_ = true;
+  fields_.emplace(name);
+}
+
+void FieldCallHints::add_primitive() {
+  known_ = true;
+  primitive_ = true;
+}
+
+void FieldCallHints::add_string_filter(std::string_view field,
+                                       StringPredicate predicate) {
+  string_filters_.push_back(
+      StringFilter{std::string{field}, std::move(predicate)});
+}
+
+const FieldCallHints::StringFilters &
+FieldCallHints::string_filters() const noexcept {
+  return string_filters_;
+}
+
+bool FieldCallHints::known() const noexcept { return known_; }
+
+bool FieldCallHints::may_use_field(std::string_view name) const {
+  return !known_ || fields_.contains(name);
+}
+
+bool FieldCallHints::may_use_primitive() const noexcept {
+  return !known_ || primitive_;
+}
+
+} // namespace sq
@@ -29,6 +29,10 @@ const FieldCallParams::NamedParams &FieldCallParams::named_params() const {
   return named_params_;
 }
 
+FieldCallHints &FieldCallParams::hints() { return hints_; }
+
+const FieldCallHints &FieldCallParams::hints() const { return hints_; }
+
 std::ostream &operator<<(std::ostream &os, const FieldCallParams &params) {
 
   auto named_param_to_str = [](const auto &np) {
@@ -7,6 +7,10 @@
 
 #include "core/typeutil.h"
 
+#include <string_view>
+#include <type_traits>
+#include <variant>
+
 namespace sq {
 namespace {
 
@@ -23,6 +27,23 @@ std::string_view primitive_type_name(const Primitive &value) {
   return std::visit(PrimitiveTypeNameVisitor{}, value);
 }
 
+PrimitiveRef primitive_ref(const Primitive &value) noexcept {
+  return std::visit([](const auto &v) { return PrimitiveRef{v}; }, value);
+}
+
+Primitive primitive_from_ref(const PrimitiveRef &value) {
+  return std::visit(
+      [](const auto &v) {
+        if constexpr (std::is_same_v<std::remove_cvref_t<decltype(v)>,
+                                     std::string_view>) {
+          return Primitive{PrimitiveString{v}};
+        } else {
+          return Primitive{v};
+        }
+      },
+      value);
+}
+
 std::string primitive_to_str(const Primitive &value) {
   return std::visit(detail::PrimitiveToStrVisitor{}, value);
 }
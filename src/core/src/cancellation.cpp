@@ -0,0 +1,58 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "core/cancellation.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+
+namespace sq {
+
+namespace {
+
+std::mutex &token_mutex() {
+  static auto mutex = std::mutex{};
+  return mutex;
+}
+
+std::stop_token &process_token() {
+  static auto token = std::stop_token{};
+  return token;
+}
+
+std::stop_token exchange_token(std::stop_token token) {
+  const auto lock = std::scoped_lock{token_mutex()};
+  return std::exchange(process_token(), std::move(token));
+}
+
+} // namespace
+
+ScopedStopToken::ScopedStopToken(std::stop_token token)
+    : previous_{exchange_token(std::move(token))} {}
+
+ScopedStopToken::~ScopedStopToken() noexcept {
+  (void)exchange_token(std::move(previous_));
+}
+
+std::stop_token current_stop_token() {
+  const auto lock = std::scoped_lock{token_mutex()};
+  return process_token();
+}
+
+StopTimer::StopTimer(std::stop_source source,
+                     std::chrono::milliseconds timeout)
+    : thread_{[source = std::move(source),
+               timeout](const std::stop_token &cancelled) mutable {
+        auto mutex = std::mutex{};
+        auto cv = std::condition_variable_any{};
+        auto lock = std::unique_lock{mutex};
+        (void)cv.wait_for(lock, cancelled, timeout, [] { return false; });
+        if (!cancelled.stop_requested()) {
+          (void)source.request_stop();
+        }
+      }} {}
+
+} // namespace sq
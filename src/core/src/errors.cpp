@@ -46,6 +46,10 @@ ArgumentTypeError::ArgumentTypeError(const Primitive &received,
                             primitive_to_str(received),
                             primitive_type_name(received), type_expected)} {}
 
+IndexFormatError::IndexFormatError(const std::filesystem::path &file,
+                                   std::string_view message)
+    : Exception{fmt::format("invalid index file {}: {}", file, message)} {}
+
 InvalidConversionError::InvalidConversionError(std::string_view from,
                                                std::string_view to)
     : Exception{fmt::format("cannot convert {} to {}", from, to)} {}
@@ -0,0 +1,90 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "core/Executor.h"
+
+#include <chrono>
+#include <future>
+#include <gtest/gtest.h>
+#include <latch>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace sq::test {
+namespace {
+
+TEST(ExecutorTest, TestResults) {
+  auto executor = Executor{4};
+  EXPECT_EQ(executor.size(), 4U);
+  auto futures = std::vector<std::future<int>>{};
+  for (auto i = 0; i < 100; ++i) {
+    futures.push_back(executor.submit([i] { return i * 2; }));
+  }
+  for (auto i = 0; i < 100; ++i) {
+    EXPECT_EQ(futures[static_cast<std::size_t>(i)].get(), i * 2);
+  }
+}
+
+TEST(ExecutorTest, TestException) {
+  auto executor = Executor{1};
+  auto future =
+      executor.submit([]() -> int { throw std::runtime_error{"oops"}; });
+  EXPECT_THROW((void)future.get(), std::runtime_error);
+}
+
+TEST(ExecutorTest, TestTasksStartInOrder) {
+  auto order = std::vector<int>{};
+  auto futures = std::vector<std::future<void>>{};
+  {
+    auto executor = Executor{1};
+    for (auto i = 0; i < 10; ++i) {
+      futures.push_back(executor.submit([&order, i] { order.push_back(i); }));
+    }
+    for (auto &future : futures) {
+      future.get();
+    }
+  }
+  EXPECT_EQ(order, (std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+}
+
+TEST(ExecutorTest, TestNestedTasksAreStolen) {
+  // The nested task is added to the deque of the worker that is waiting for
+  // it, so it can only run if the other worker steals it.
+  auto executor = Executor{2};
+  auto future = executor.submit([&executor] {
+    auto nested = executor.submit([] { return 42; });
+    return nested.get();
+  });
+  EXPECT_EQ(future.get(), 42);
+}
+
+TEST(ExecutorTest, TestPendingTasksAreDiscarded) {
+  auto started = std::latch{1};
+  auto release = std::promise<void>{};
+  auto running = std::future<int>{};
+  auto pending = std::future<int>{};
+  auto releaser = std::jthread{};
+  {
+    auto executor = Executor{1};
+    running = executor.submit([&, released = release.get_future()] {
+      started.count_down();
+      released.wait();
+      return 1;
+    });
+    started.wait();
+    pending = executor.submit([] { return 2; });
+    // Let the running task finish once the executor is being destroyed.
+    releaser = std::jthread{[&release] {
+      std::this_thread::sleep_for(std::chrono::milliseconds{50});
+      release.set_value();
+    }};
+  }
+  EXPECT_EQ(running.get(), 1);
+  EXPECT_THROW((void)pending.get(), std::future_error);
+}
+
+} // namespace
+} // namespace sq::test
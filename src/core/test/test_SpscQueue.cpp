@@ -0,0 +1,51 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "core/SpscQueue.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+
+namespace sq::test {
+namespace {
+
+TEST(SpscQueueTest, TestCapacityIsRoundedUp) {
+  EXPECT_EQ(SpscQueue<int>{3}.capacity(), 4U);
+  EXPECT_EQ(SpscQueue<int>{4}.capacity(), 4U);
+}
+
+TEST(SpscQueueTest, TestTryPushAndTryPop) {
+  auto queue = SpscQueue<std::string>{2};
+  EXPECT_EQ(queue.try_pop(), std::nullopt);
+  auto a = std::string{"a"};
+  auto b = std::string{"b"};
+  auto c = std::string{"c"};
+  EXPECT_TRUE(queue.try_push(a));
+  EXPECT_TRUE(queue.try_push(b));
+  EXPECT_FALSE(queue.try_push(c));
+  EXPECT_EQ(c, "c");
+  EXPECT_EQ(queue.try_pop(), "a");
+  EXPECT_TRUE(queue.try_push(c));
+  EXPECT_EQ(queue.try_pop(), "b");
+  EXPECT_EQ(queue.try_pop(), "c");
+  EXPECT_EQ(queue.try_pop(), std::nullopt);
+}
+
+TEST(SpscQueueTest, TestElementsArePoppedInOrder) {
+  static constexpr auto count = 100000;
+  auto queue = SpscQueue<int>{8};
+  auto producer = std::jthread{[&queue] {
+    for (auto i = 0; i < count; ++i) {
+      queue.push(i);
+    }
+  }};
+  for (auto i = 0; i < count; ++i) {
+    ASSERT_EQ(queue.pop(), i);
+  }
+}
+
+} // namespace
+} // namespace sq::test
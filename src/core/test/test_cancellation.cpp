@@ -0,0 +1,47 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "core/cancellation.h"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <stop_token>
+#include <thread>
+
+namespace sq::test {
+namespace {
+
+using namespace std::chrono_literals;
+
+TEST(CancellationTest, TestScopedStopToken) {
+  EXPECT_FALSE(current_stop_token().stop_possible());
+  auto source = std::stop_source{};
+  {
+    const auto scoped = ScopedStopToken{source.get_token()};
+    EXPECT_TRUE(current_stop_token().stop_possible());
+    (void)source.request_stop();
+    EXPECT_TRUE(current_stop_token().stop_requested());
+  }
+  EXPECT_FALSE(current_stop_token().stop_possible());
+}
+
+TEST(CancellationTest, TestStopTimerExpires) {
+  auto source = std::stop_source{};
+  const auto timer = StopTimer{source, 10ms};
+  const auto start = std::chrono::steady_clock::now();
+  while (!source.stop_requested()) {
+    ASSERT_LT(std::chrono::steady_clock::now() - start, 10s);
+    std::this_thread::sleep_for(1ms);
+  }
+}
+
+TEST(CancellationTest, TestStopTimerDestroyedBeforeExpiry) {
+  auto source = std::stop_source{};
+  { const auto timer = StopTimer{source, 1h}; }
+  EXPECT_FALSE(source.stop_requested());
+}
+
+} // namespace
+} // namespace sq::test
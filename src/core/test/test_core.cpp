@@ -12,6 +12,8 @@
 
 #include <gtest/gtest.h>
 #include <initializer_list>
+#include <string_view>
+#include <variant>
 
 namespace sq::test {
 
@@ -49,6 +51,30 @@ TEST(CommonTypesTest, TestPrimitiveToStr) {
   EXPECT_EQ(primitive_to_str(Primitive{primitive_null}), "null");
 }
 
+TEST(CommonTypesTest, TestPrimitiveRef) {
+  const auto str = Primitive{PrimitiveString{"a string"}};
+  const auto ref = primitive_ref(str);
+  ASSERT_TRUE(std::holds_alternative<std::string_view>(ref));
+  EXPECT_EQ(std::get<std::string_view>(ref).data(),
+            std::get<PrimitiveString>(str).data());
+  EXPECT_EQ(primitive_from_ref(ref), str);
+
+  for (const auto &value :
+       {Primitive{PrimitiveInt{-1234}}, Primitive{PrimitiveFloat{1.1}},
+        Primitive{PrimitiveBool{true}}, Primitive{primitive_null}}) {
+    EXPECT_EQ(primitive_from_ref(primitive_ref(value)), value);
+  }
+}
+
+TEST(CommonTypesTest, TestPrimitiveRefOrder) {
+  const auto a = Primitive{PrimitiveString{"a"}};
+  const auto b = Primitive{PrimitiveString{"b"}};
+  const auto one = Primitive{PrimitiveInt{1}};
+  EXPECT_LT(primitive_ref(a), primitive_ref(b));
+  EXPECT_EQ(primitive_ref(a) < primitive_ref(one), a < one);
+  EXPECT_EQ(primitive_ref(one) == primitive_ref(one), true);
+}
+
 class FieldCallParamsTest : public testing::Test {
 protected:
   void SetUp() override {
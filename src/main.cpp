@@ -3,37 +3,399 @@
  * SPDX-License-Identifier: MIT
  * ---------------------------------------------------------------------------*/
 
+#include "core/cancellation.h"
 #include "core/narrow.h"
 #include "core/typeutil.h"
 #include "parser/Parser.h"
 #include "parser/TokenView.h"
+#include "results/Compressor.h"
+#include "results/Delta.h"
+#include "results/LimitedSerializer.h"
+#include "results/OutputPipeline.h"
+#include "results/ResultRecorder.h"
 #include "results/Serializer.h"
 #include "results/results.h"
 #include "system/root.h"
+#include "system/watch.h"
 
+#include <charconv>
+#include <chrono>
 #include <cstddef>
 #include <gsl/gsl>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
 
 namespace {
-int run_sq(int argc, char **argv) {
+
+struct Options {
+  std::string query_;
+  bool watch_ = false;
+  std::optional<std::chrono::seconds> poll_;
+  std::optional<std::chrono::seconds> timeout_;
+  bool delta_ = false;
+  bool pipeline_ = false;
+  sq::results::FlushPolicy flush_ = sq::results::FlushPolicy::WhenFull;
+  sq::results::OutputFormat format_ = sq::results::OutputFormat::Json;
+  std::vector<std::string> ndjson_path_;
+  std::optional<std::chrono::milliseconds> flush_interval_;
+  sq::results::Compression compression_;
+  sq::results::OutputLimits limits_;
+  sq::results::ResultOptions result_options_;
+};
+
+// Parse an integer option value that must be at least the given minimum.
+template <typename T>
+std::optional<T> parse_integer(std::string_view arg, T minimum) {
+  auto value = T{};
+  const auto *const end = arg.data() + arg.size();
+  const auto [ptr, ec] = std::from_chars(arg.data(), end, value);
+  if (ec != std::errc{} || ptr != end || value < minimum) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+// Split a list path like "a.b.c" into its keys.
+std::vector<std::string> split_path(std::string_view path) {
+  auto keys = std::vector<std::string>{};
+  while (!path.empty()) {
+    const auto dot = path.find('.');
+    keys.emplace_back(path.substr(0, dot));
+    if (dot == std::string_view::npos) {
+      break;
+    }
+    path.remove_prefix(dot + 1);
+  }
+  return keys;
+}
+
+std::optional<Options> parse_args(int argc, char **argv) {
+  static constexpr auto poll_prefix = std::string_view{"--poll="};
+  static constexpr auto jobs_prefix = std::string_view{"--jobs="};
+  static constexpr auto prefetch_prefix = std::string_view{"--prefetch="};
+  static constexpr auto timeout_prefix = std::string_view{"--timeout="};
+  static constexpr auto ndjson_path_prefix =
+      std::string_view{"--ndjson-path="};
+  static constexpr auto flush_interval_prefix =
+      std::string_view{"--flush-interval="};
+  static constexpr auto compress_level_prefix =
+      std::string_view{"--compress-level="};
+  static constexpr auto max_output_bytes_prefix =
+      std::string_view{"--max-output-bytes="};
+  static constexpr auto max_elements_prefix =
+      std::string_view{"--max-elements="};
   const auto args = gsl::span{argv, sq::to_size(argc)};
-  if (args.size() < 2) {
+  auto options = Options{};
+  auto have_query = false;
+  for (const auto *arg : args.subspan(1)) {
+    const auto arg_sv = std::string_view{arg};
+    if (arg_sv == "--watch") {
+      options.watch_ = true;
+    } else if (arg_sv == "--delta") {
+      options.delta_ = true;
+    } else if (arg_sv == "--pipeline") {
+      options.pipeline_ = true;
+    } else if (arg_sv == "--flush=element") {
+      options.flush_ = sq::results::FlushPolicy::EveryTopLevelElement;
+    } else if (arg_sv == "--flush=full") {
+      options.flush_ = sq::results::FlushPolicy::WhenFull;
+    } else if (arg_sv == "--format=json") {
+      options.format_ = sq::results::OutputFormat::Json;
+    } else if (arg_sv == "--format=cbor") {
+      options.format_ = sq::results::OutputFormat::Cbor;
+    } else if (arg_sv == "--format=msgpack") {
+      // Unless stdout is a regular file, lists of results are held in memory
+      // until they end: see OutputFormat::MessagePack.
+      options.format_ = sq::results::OutputFormat::MessagePack;
+    } else if (arg_sv == "--format=ndjson") {
+      options.format_ = sq::results::OutputFormat::Ndjson;
+    } else if (arg_sv == "--format=arrow") {
+      options.format_ = sq::results::OutputFormat::Arrow;
+    } else if (arg_sv == "--compress=gzip") {
+      options.compression_.algorithm_ =
+          sq::results::CompressionAlgorithm::Gzip;
+    } else if (arg_sv == "--compress=zstd") {
+      options.compression_.algorithm_ =
+          sq::results::CompressionAlgorithm::Zstd;
+    } else if (arg_sv == "--unordered") {
+      options.result_options_.unordered_ = true;
+    } else if (arg_sv.starts_with(poll_prefix)) {
+      const auto seconds = parse_integer<std::chrono::seconds::rep>(
+          arg_sv.substr(poll_prefix.size()), 1);
+      if (!seconds) {
+        std::cerr << "Invalid poll interval\n";
+        return std::nullopt;
+      }
+      options.poll_ = std::chrono::seconds{*seconds};
+    } else if (arg_sv.starts_with(timeout_prefix)) {
+      const auto seconds = parse_integer<std::chrono::seconds::rep>(
+          arg_sv.substr(timeout_prefix.size()), 1);
+      if (!seconds) {
+        std::cerr << "Invalid timeout\n";
+        return std::nullopt;
+      }
+      options.timeout_ = std::chrono::seconds{*seconds};
+    } else if (arg_sv.starts_with(ndjson_path_prefix)) {
+      options.ndjson_path_ =
+          split_path(arg_sv.substr(ndjson_path_prefix.size()));
+    } else if (arg_sv.starts_with(flush_interval_prefix)) {
+      const auto milliseconds = parse_integer<std::chrono::milliseconds::rep>(
+          arg_sv.substr(flush_interval_prefix.size()), 0);
+      if (!milliseconds) {
+        std::cerr << "Invalid flush interval\n";
+        return std::nullopt;
+      }
+      options.flush_interval_ = std::chrono::milliseconds{*milliseconds};
+    } else if (arg_sv.starts_with(compress_level_prefix)) {
+      // The range of levels depends on the algorithm, so it's checked when
+      // the compressor is created.
+      const auto level =
+          parse_integer<int>(arg_sv.substr(compress_level_prefix.size()),
+                             std::numeric_limits<int>::min());
+      if (!level) {
+        std::cerr << "Invalid compression level\n";
+        return std::nullopt;
+      }
+      options.compression_.level_ = *level;
+    } else if (arg_sv.starts_with(max_output_bytes_prefix)) {
+      const auto bytes = parse_integer<std::size_t>(
+          arg_sv.substr(max_output_bytes_prefix.size()), 1);
+      if (!bytes) {
+        std::cerr << "Invalid output byte limit\n";
+        return std::nullopt;
+      }
+      options.limits_.max_bytes_ = *bytes;
+    } else if (arg_sv.starts_with(max_elements_prefix)) {
+      const auto elements = parse_integer<std::size_t>(
+          arg_sv.substr(max_elements_prefix.size()), 1);
+      if (!elements) {
+        std::cerr << "Invalid element limit\n";
+        return std::nullopt;
+      }
+      options.limits_.max_elements_ = *elements;
+    } else if (arg_sv.starts_with(jobs_prefix)) {
+      const auto jobs =
+          parse_integer<std::size_t>(arg_sv.substr(jobs_prefix.size()), 1);
+      if (!jobs) {
+        std::cerr << "Invalid number of jobs\n";
+        return std::nullopt;
+      }
+      options.result_options_.jobs_ = *jobs;
+    } else if (arg_sv.starts_with(prefetch_prefix)) {
+      const auto depth = parse_integer<std::size_t>(
+          arg_sv.substr(prefetch_prefix.size()), 0);
+      if (!depth) {
+        std::cerr << "Invalid prefetch depth\n";
+        return std::nullopt;
+      }
+      options.result_options_.prefetch_depth_ = *depth;
+    } else if (have_query) {
+      std::cerr << "Too many args\n";
+      return std::nullopt;
+    } else {
+      options.query_ = arg_sv;
+      have_query = true;
+    }
+  }
+  if (!have_query) {
     std::cerr << "Not enough args\n";
-    return 1;
+    return std::nullopt;
   }
-  if (args.size() > 2) {
-    std::cerr << "Too many args\n";
+  if (options.watch_ && options.poll_) {
+    std::cerr << "Cannot use --watch with --poll\n";
+    return std::nullopt;
+  }
+  if (options.delta_ && !options.watch_ && !options.poll_) {
+    std::cerr << "Cannot use --delta without --watch or --poll\n";
+    return std::nullopt;
+  }
+  // With --delta, results are recorded before they're written.
+  if (options.delta_ && options.limits_.max_bytes_) {
+    std::cerr << "Cannot use --max-output-bytes with --delta\n";
+    return std::nullopt;
+  }
+  if (options.delta_ && options.format_ == sq::results::OutputFormat::Arrow) {
+    std::cerr << "Cannot use --delta with --format=arrow\n";
+    return std::nullopt;
+  }
+  // Arrow output has nowhere to put a truncation marker.
+  if (options.format_ == sq::results::OutputFormat::Arrow &&
+      (options.timeout_ || options.limits_.max_bytes_ ||
+       options.limits_.max_elements_)) {
+    std::cerr << "Cannot use --timeout, --max-output-bytes or --max-elements "
+                 "with --format=arrow\n";
+    return std::nullopt;
+  }
+  const auto compressed = options.compression_.algorithm_ !=
+                          sq::results::CompressionAlgorithm::None;
+  if (compressed && !sq::results::compression_supported) {
+    std::cerr << "Cannot use --compress: sq was built without compression "
+                 "support\n";
+    return std::nullopt;
+  }
+  if (options.compression_.level_ && !compressed) {
+    std::cerr << "Cannot use --compress-level without --compress\n";
+    return std::nullopt;
+  }
+  // Repeated results are separated by uncompressed newlines.
+  if (compressed && (options.watch_ || options.poll_)) {
+    std::cerr << "Cannot use --compress with --watch or --poll\n";
+    return std::nullopt;
+  }
+  if ((!options.ndjson_path_.empty() || options.flush_interval_) &&
+      options.format_ != sq::results::OutputFormat::Ndjson) {
+    std::cerr << "Cannot use --ndjson-path or --flush-interval without "
+                 "--format=ndjson\n";
+    return std::nullopt;
+  }
+  return options;
+}
+
+// Generate the results of the query. With --timeout, --max-output-bytes or
+// --max-elements, the results are stopped early, and closed off with a
+// truncation marker, if the timeout expires or the output reaches a limit.
+// Returns whether the results are complete.
+bool generate(const sq::results::QueryPlan &plan,
+              sq::results::Serializer &serializer, const Options &options) {
+  auto result_options = options.result_options_;
+  auto source = std::stop_source{};
+  auto timer = std::optional<sq::StopTimer>{};
+  if (options.timeout_) {
+    result_options.stop_token_ = source.get_token();
+    timer.emplace(source, *options.timeout_);
+  }
+  auto limited = std::optional<sq::results::LimitedSerializer>{};
+  if (options.limits_.max_bytes_ || options.limits_.max_elements_) {
+    result_options.stop_token_ = source.get_token();
+    limited.emplace(serializer, options.limits_, source);
+  }
+  const auto complete = sq::results::generate_results(
+      plan, sq::system::root(), limited ? *limited : serializer,
+      result_options);
+  if (!complete) {
+    std::cerr << (limited && limited->limit_reached() ? "Output limit reached"
+                                                      : "Timeout expired")
+              << ": results are truncated\n";
+  }
+  return complete;
+}
+
+// Get the interval at which complete NDJSON lines are written: the
+// --flush-interval, or otherwise every line with --flush=element and only when
+// the buffer is full with --flush=full.
+std::chrono::milliseconds ndjson_flush_interval(const Options &options) {
+  if (options.flush_interval_) {
+    return *options.flush_interval_;
+  }
+  if (options.flush_ == sq::results::FlushPolicy::EveryTopLevelElement) {
+    return std::chrono::milliseconds::zero();
+  }
+  return std::chrono::milliseconds::max();
+}
+
+// Get a serializer for the output format that writes to a stream.
+std::unique_ptr<sq::results::Serializer>
+get_stream_serializer(std::ostream &os, const Options &options) {
+  if (options.format_ == sq::results::OutputFormat::Ndjson) {
+    return sq::results::get_ndjson_serializer(
+        os, options.ndjson_path_, ndjson_flush_interval(options),
+        options.compression_);
+  }
+  return sq::results::get_serializer(os, options.format_, options.flush_,
+                                     options.compression_);
+}
+
+// Print the results of the query. With --pipeline, the results are written
+// to stdout by a separate thread so that generating them isn't held up by
+// writing them. Otherwise they're buffered and written straight to the stdout
+// file descriptor. Either way, they're written when the buffer fills, or after
+// each element of a top-level array with --flush=element (or for NDJSON, see
+// ndjson_flush_interval()).
+// With --compress, the output is compressed on its way out and the compressed
+// stream is synced at those element boundaries.
+// Returns whether the results are complete.
+bool print_results(const sq::results::QueryPlan &plan,
+                   const Options &options) {
+  if (!options.pipeline_) {
+    std::cout.flush();
+    auto serializer =
+        options.format_ == sq::results::OutputFormat::Ndjson
+            ? sq::results::get_ndjson_serializer(
+                  STDOUT_FILENO, options.ndjson_path_,
+                  ndjson_flush_interval(options), options.compression_)
+            : sq::results::get_serializer(STDOUT_FILENO, options.format_,
+                                          options.flush_,
+                                          options.compression_);
+    return generate(plan, *serializer, options);
+  }
+  auto pipeline = sq::results::OutputPipeline{std::cout};
+  auto serializer = get_stream_serializer(pipeline.stream(), options);
+  return generate(plan, *serializer, options);
+}
+
+// Print the results of the query, or with --delta the differences from the
+// previous results, each time the parts of the system that were read to
+// generate them change (with --watch) or after each poll interval (with
+// --poll). Each set of results is printed on its own line (for JSON, binary
+// formats are just concatenated); with --delta nothing is printed if nothing
+// has changed.
+[[noreturn]] void repeat_results(const sq::results::QueryPlan &plan,
+                                 const Options &options) {
+  auto watch = sq::system::Watch{};
+  auto delta = sq::results::DeltaWriter{};
+  const auto end_results = [&] {
+    if (options.format_ == sq::results::OutputFormat::Json) {
+      std::cout << '\n';
+    }
+    std::cout.flush();
+  };
+  const auto print = [&] {
+    if (!options.delta_) {
+      (void)print_results(plan, options);
+      end_results();
+      return;
+    }
+    auto recorder = sq::results::ResultRecorder{};
+    (void)generate(plan, recorder, options);
+    auto serializer = get_stream_serializer(std::cout, options);
+    if (delta.write_delta(recorder.take(), *serializer)) {
+      end_results();
+    }
+  };
+  for (;;) {
+    if (options.watch_) {
+      watch.record(print);
+      (void)watch.wait();
+    } else {
+      print();
+      std::this_thread::sleep_for(options.poll_.value());
+    }
+  }
+}
+
+int run_sq(int argc, char **argv) {
+  const auto options = parse_args(argc, argv);
+  if (!options) {
     return 1;
   }
-  const auto sq_command = std::string{args[1]};
-  auto tokens = sq::parser::TokenView{sq_command};
+  auto tokens = sq::parser::TokenView{options->query_};
   auto parser = sq::parser::Parser(tokens);
   const auto ast = parser.parse();
-  auto serializer = sq::results::get_serializer(std::cout);
-  sq::results::generate_results(ast, sq::system::root(), *serializer);
-
-  return 0;
+  const auto plan = sq::results::QueryPlan{ast};
+  if (options->watch_ || options->poll_) {
+    repeat_results(plan, *options);
+  }
+  return print_results(plan, *options) ? 0 : 1;
 }
 } // namespace
 
@@ -0,0 +1,172 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_results_ArrowSerializer_h_
+#define SQ_INCLUDE_GUARD_results_ArrowSerializer_h_
+
+#include "core/Primitive.h"
+#include "core/typeutil.h"
+#include "results/OutputBuffer.h"
+#include "results/Serializer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sq::results {
+
+/**
+ * A Serializer that writes a list of results as an Apache Arrow IPC stream.
+ *
+ * The elements of the outermost list in the results are the rows; anything
+ * outside that list isn't written. Each row must be an object whose leaves
+ * are primitives, or a primitive (written in a column called "value").
+ * Nested objects are flattened into columns named with the keys that lead to
+ * them, e.g. "file.size". Lists within rows aren't supported.
+ *
+ * The columns are the leaves of the first row. The type of each column is
+ * the type of its first non-null value. Values are accumulated by column and
+ * written as a record batch for every batch_size rows. Output is written, and
+ * any compressed stream synced, after each batch.
+ *
+ * The schema has to be written before the first batch, so batches are held
+ * back while there are columns with only null values, up to
+ * max_pending_batches batches. Columns that still have only null values
+ * after that are written as strings, and their later values are converted to
+ * strings; columns with only null values at the end of the stream have the
+ * Arrow null type. Memory use is therefore bounded by max_pending_batches
+ * batches.
+ *
+ * Truncation markers can't be represented in the stream, so they're dropped
+ * and the sq command line doesn't allow Arrow output for results that can be
+ * truncated.
+ *
+ * Throws NotAnArrayError if the results don't contain a list, or contain
+ * more than one outermost list, NotAScalarError if a row contains a list, and
+ * InvalidConversionError if the rows don't all have the same fields or a
+ * column's values don't all have the same type.
+ */
+class ArrowSerializer : public Serializer {
+public:
+  using Serializer::start_array;
+  using Serializer::start_object;
+  using Serializer::write_key;
+  using Serializer::write_value;
+
+  static constexpr auto default_batch_size = std::size_t{65536};
+  static constexpr auto max_pending_batches = std::size_t{16};
+
+  ArrowSerializer(std::ostream &os, std::size_t batch_size,
+                  const Compression &compression = {});
+  ArrowSerializer(int fd, std::size_t batch_size,
+                  const Compression &compression = {});
+
+  void start_array() override;
+  void end_array() override;
+  void start_object() override;
+  void end_object() override;
+  void write_key(std::string_view key) override;
+  void write_value(const PrimitiveRef &value) override;
+
+  // Includes the values of rows in batches that haven't been written yet, but
+  // not the metadata that will be written with them.
+  SQ_ND std::size_t output_size() const noexcept override;
+
+private:
+  enum class ColumnType { Null, Int, Float, Bool, String };
+
+  // The values of a column in the current batch.
+  struct Column {
+    explicit Column(std::string_view name) : name_{name} {}
+
+    void append(const PrimitiveRef &value, bool types_fixed);
+    void append_null();
+    void set_type(ColumnType type);
+    void clear();
+    SQ_ND std::size_t size() const noexcept;
+
+    std::string name_;
+    ColumnType type_ = ColumnType::Null;
+
+    // Whether values of any type are converted to strings, because the
+    // column's type wasn't known when the schema was written.
+    bool stringify_ = false;
+
+    std::size_t null_count_ = 0;
+    std::size_t values_ = 0;
+
+    // Bit i is set if value i isn't null.
+    std::vector<char> validity_;
+
+    // Fixed-size values, bools as bits, or the bytes of strings.
+    std::vector<char> data_;
+
+    // The start offset of each string in data_, then the end of the last.
+    std::vector<std::int32_t> offsets_;
+  };
+
+  // A complete batch of rows.
+  struct Batch {
+    std::vector<Column> columns_;
+    std::size_t rows_;
+  };
+
+  void start_row();
+  void end_row();
+  void add_value(std::string_view name, const PrimitiveRef &value);
+  void end_batch();
+  void start_stream(bool finished);
+  void write_schema();
+  void write_batch(const std::vector<Column> &columns, std::size_t rows);
+  void clear_batch();
+  void write_message(std::string_view metadata);
+  void finish();
+
+  OutputBuffer out_;
+  std::size_t batch_size_;
+  std::vector<Column> columns_;
+
+  // Batches that are held back until the schema is written, and the size of
+  // their values.
+  std::vector<Batch> pending_;
+  std::size_t pending_size_ = 0;
+
+  // Whether the columns have been set by the first row.
+  bool columns_fixed_ = false;
+  bool schema_written_ = false;
+
+  // The number of complete rows in the current batch.
+  std::size_t rows_ = 0;
+
+  // The number of objects open outside of the list of rows.
+  std::size_t outer_depth_ = 0;
+
+  // Whether the list of rows is open, or has been closed.
+  bool in_rows_ = false;
+  bool rows_done_ = false;
+
+  // The number of objects open within the current row.
+  std::size_t row_depth_ = 0;
+
+  // The name of the column for the next value in the current row, and the
+  // lengths of the names of the objects open within the row.
+  std::string name_;
+  std::vector<std::size_t> prefix_sizes_;
+
+  // The index of the column expected next in the current row.
+  std::size_t next_column_ = 0;
+
+  // Whether the current row, or the next value, is a truncation marker,
+  // which isn't written.
+  bool skip_row_ = false;
+  bool skip_value_ = false;
+};
+
+} // namespace sq::results
+
+#endif // SQ_INCLUDE_GUARD_results_ArrowSerializer_h_
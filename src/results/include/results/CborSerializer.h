@@ -0,0 +1,77 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_results_CborSerializer_h_
+#define SQ_INCLUDE_GUARD_results_CborSerializer_h_
+
+#include "core/Primitive.h"
+#include "core/typeutil.h"
+#include "results/OutputBuffer.h"
+#include "results/Serializer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string_view>
+#include <vector>
+
+namespace sq::results {
+
+/**
+ * A Serializer that writes CBOR (RFC 8949).
+ *
+ * Arrays and objects started with a size are written as definite-length
+ * arrays and maps; others are written with indefinite lengths. Strings are
+ * written as text strings, ints as integers, floats as 64 bit floats and
+ * null and bools as simple values.
+ */
+class CborSerializer : public Serializer {
+public:
+  using Serializer::write_key;
+  using Serializer::write_value;
+
+  CborSerializer(std::ostream &os, FlushPolicy policy,
+                 const Compression &compression = {});
+  CborSerializer(int fd, FlushPolicy policy,
+                 const Compression &compression = {});
+
+  void start_array() override;
+  void start_array(std::size_t size) override;
+  void end_array() override;
+  void start_object() override;
+  void start_object(std::size_t size) override;
+  void end_object() override;
+  void write_key(std::string_view key) override;
+  void write_value(const PrimitiveRef &value) override;
+
+  SQ_ND std::size_t output_size() const noexcept override {
+    return out_.size();
+  }
+
+private:
+  struct Container {
+    bool array_;
+    bool indefinite_;
+  };
+
+  void write_head(std::uint8_t major_type, std::uint64_t value);
+  void write_primitive(std::string_view str);
+  void write_primitive(PrimitiveInt i);
+  void write_primitive(PrimitiveFloat f);
+  void write_primitive(PrimitiveBool b);
+  void write_primitive(const PrimitiveNull &null);
+  void start_container(Container container, std::uint8_t major_type,
+                       std::uint64_t size);
+  void end_container(bool array);
+  void end_call();
+
+  OutputBuffer out_;
+  FlushPolicy policy_;
+  std::vector<Container> containers_;
+};
+
+} // namespace sq::results
+
+#endif // SQ_INCLUDE_GUARD_results_CborSerializer_h_
@@ -0,0 +1,99 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_results_Compressor_h_
+#define SQ_INCLUDE_GUARD_results_Compressor_h_
+
+#include <fmt/format.h>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+namespace sq::results {
+
+/**
+ * Whether sq was built with compression support (the SQ_COMPRESSION CMake
+ * option). Without it, only CompressionAlgorithm::None can be used.
+ */
+#ifdef SQ_COMPRESSION
+inline constexpr bool compression_supported = true;
+#else
+inline constexpr bool compression_supported = false;
+#endif
+
+enum class CompressionAlgorithm {
+  None,
+
+  /**
+   * gzip (RFC 1952), using zlib.
+   */
+  Gzip,
+
+  /**
+   * Zstandard (RFC 8878), using libzstd.
+   */
+  Zstd,
+};
+
+struct Compression {
+  CompressionAlgorithm algorithm_ = CompressionAlgorithm::None;
+
+  // The compression level, or the algorithm's default level if not set.
+  std::optional<int> level_;
+};
+
+/**
+ * Incrementally compresses a stream of output.
+ */
+class Compressor {
+public:
+  enum class Flush {
+    /**
+     * Compressed output may be held back to compress later input better.
+     */
+    None,
+
+    /**
+     * Produce all of the compressed output for the input so far, so that a
+     * reader can decompress everything up to this point.
+     */
+    Sync,
+
+    /**
+     * End the compressed stream (a gzip member or a zstd frame). Later input
+     * starts a new stream, and decompressors treat the streams as one.
+     */
+    End,
+  };
+
+  Compressor(const Compressor &) = delete;
+  Compressor(Compressor &&) = delete;
+  Compressor &operator=(const Compressor &) = delete;
+  Compressor &operator=(Compressor &&) = delete;
+
+  Compressor() = default;
+  virtual ~Compressor() noexcept = default;
+
+  /**
+   * Compress input, appending the compressed output to out.
+   *
+   * Throws CompressionError if the compression library reports an error.
+   */
+  virtual void compress(std::string_view input, Flush flush,
+                        fmt::memory_buffer &out) = 0;
+};
+
+/**
+ * Get a compressor for the given compression settings, or nullptr for
+ * CompressionAlgorithm::None.
+ *
+ * Throws OutOfRangeError if the level isn't supported by the algorithm, or
+ * CompressionError if sq was built without compression support.
+ */
+std::unique_ptr<Compressor> make_compressor(const Compression &compression);
+
+} // namespace sq::results
+
+#endif // SQ_INCLUDE_GUARD_results_Compressor_h_
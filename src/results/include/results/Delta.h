@@ -0,0 +1,71 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_results_Delta_h_
+#define SQ_INCLUDE_GUARD_results_Delta_h_
+
+#include "core/Primitive.h"
+#include "core/typeutil.h"
+#include "results/ResultRecorder.h"
+#include "results/Serializer.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace sq::results {
+
+/**
+ * Writes the differences between successive results.
+ *
+ * Only a hashed summary of the previous results is kept. The differences are
+ * written as an array of changes, each of which is an object with members:
+ * - "op": "add", "remove" or "change";
+ * - "path": an array of the identities of the elements leading from the
+ *   root of the results to the added, removed or changed element;
+ * - "value": the new value of the element (not present for "remove").
+ *
+ * The identity of an object member is its key. The identity of an array
+ * element is:
+ * - the element itself, if it is a primitive;
+ * - the value of its first member, if it is an object whose first member is
+ *   a primitive (e.g. the inode of a file for a query like
+ *   "path.children{inode size}");
+ * - otherwise, its position in the array.
+ * If the elements of an array don't have distinct identities then all of its
+ * elements are identified by their positions.
+ *
+ * The first results are written as a single "add" with an empty path.
+ */
+class DeltaWriter {
+public:
+  /**
+   * Write the differences between the given results and the results given
+   * to the previous call.
+   *
+   * Nothing is written if there are no differences. Returns whether anything
+   * was written.
+   */
+  bool write_delta(const ResultValue &current, Serializer &serializer);
+
+  enum class Kind { Primitive, Array, Object };
+
+  /**
+   * A hashed summary of a result and its elements.
+   */
+  struct Node {
+    Primitive id_;
+    std::uint64_t hash_;
+    Kind kind_;
+    std::vector<Node> children_;
+  };
+
+private:
+  std::optional<Node> previous_;
+};
+
+} // namespace sq::results
+
+#endif // SQ_INCLUDE_GUARD_results_Delta_h_
@@ -7,6 +7,7 @@
 #define SQ_INCLUDE_GUARD_results_Filter_h_
 
 #include "core/Field.h"
+#include "core/FieldCallHints.h"
 #include "core/typeutil.h"
 #include "parser/FilterSpec.h"
 
@@ -37,6 +38,16 @@ struct Filter {
   Filter &operator=(Filter &&) = delete;
 };
 
+/**
+ * Get a predicate that gives the same result as a comparison filter for an
+ * element whose compared value is a PrimitiveString.
+ *
+ * The predicate takes the string value directly so that it can be used
+ * before any Field has been created for the element.
+ */
+SQ_ND FieldCallHints::StringPredicate
+string_comparison_predicate(const parser::ComparisonSpec &spec);
+
 } // namespace sq::results
 
 #endif // SQ_INCLUDE_GUARD_results_Filter_h_
@@ -0,0 +1,116 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_results_JsonWriter_h_
+#define SQ_INCLUDE_GUARD_results_JsonWriter_h_
+
+#include "core/Primitive.h"
+#include "core/typeutil.h"
+#include "results/OutputBuffer.h"
+#include "results/Serializer.h"
+
+#include <cstddef>
+#include <fmt/format.h>
+#include <string_view>
+#include <vector>
+
+namespace sq::results {
+
+/**
+ * Writes the JSON for a sequence of serializer calls to an OutputBuffer, or
+ * to a memory buffer.
+ *
+ * The writer doesn't flush the buffer; that's up to the serializers that use
+ * it. The order of calls is only checked in debug builds.
+ */
+class JsonWriter {
+public:
+  explicit JsonWriter(OutputBuffer &out) noexcept : out_{&out.buffer()} {}
+  explicit JsonWriter(fmt::memory_buffer &out) noexcept : out_{&out} {}
+
+  void start_array();
+  void end_array();
+  void start_object();
+  void end_object();
+  void write_key(std::string_view key);
+  void write_key(const PreparedKey &key);
+  void write_value(const PrimitiveRef &value);
+
+  /**
+   * Write a complete value that was rendered by another JsonWriter.
+   *
+   * The output is the same as if the calls that rendered the value had been
+   * made to this writer: only the separator before the value depends on what
+   * has already been written.
+   */
+  void write_rendered(std::string_view json);
+
+  /**
+   * Get the number of open arrays and objects.
+   */
+  SQ_ND std::size_t depth() const noexcept { return depth_; }
+
+  /**
+   * Get whether a complete value has been written.
+   */
+  SQ_ND bool done() const noexcept { return done_; }
+
+  /**
+   * Get whether the last call completed an element of a top-level array.
+   */
+  SQ_ND bool at_top_level_element_boundary() const noexcept {
+    return top_level_array_ && depth_ == 1 && nonempty_;
+  }
+
+  /**
+   * Start writing a new value after a complete value has been written.
+   */
+  void reset() noexcept;
+
+  /**
+   * Append a string to a buffer as a quoted, escaped JSON string.
+   */
+  static void append_string(fmt::memory_buffer &buffer, std::string_view str);
+
+private:
+  // The kinds of the open containers, only tracked to check the order of
+  // calls in debug builds.
+  enum class State { Array, Object };
+
+  void write_primitive(std::string_view str);
+  void write_primitive(PrimitiveInt i);
+  void write_primitive(PrimitiveBool b);
+  void write_primitive(PrimitiveFloat f);
+  void write_primitive(const PrimitiveNull &null);
+  void prepare_for_value();
+  void after_key() noexcept;
+  void after_value() noexcept;
+  void open_container(State state);
+  void close_container(State state);
+  void check_key() const;
+  void check_value() const;
+
+  fmt::memory_buffer *out_;
+
+  // The number of open containers.
+  std::size_t depth_ = 0;
+
+  // Whether the innermost open container has any elements or members.
+  bool nonempty_ = false;
+
+  // Whether a key has been written without its value.
+  bool after_key_ = false;
+
+  bool top_level_array_ = false;
+  bool done_ = false;
+
+#ifndef NDEBUG
+  std::vector<State> states_;
+#endif
+};
+
+} // namespace sq::results
+
+#endif // SQ_INCLUDE_GUARD_results_JsonWriter_h_
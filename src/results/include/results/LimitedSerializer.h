@@ -0,0 +1,108 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_results_LimitedSerializer_h_
+#define SQ_INCLUDE_GUARD_results_LimitedSerializer_h_
+
+#include "core/Primitive.h"
+#include "core/typeutil.h"
+#include "results/Serializer.h"
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <string_view>
+#include <vector>
+
+namespace sq::results {
+
+/**
+ * Limits on the size of a set of results.
+ */
+struct OutputLimits {
+  /**
+   * The maximum number of bytes of output, before any compression. See
+   * Serializer::output_size().
+   */
+  std::optional<std::size_t> max_bytes_;
+
+  /**
+   * The maximum number of array elements, including the elements of nested
+   * arrays.
+   */
+  std::optional<std::size_t> max_elements_;
+};
+
+/**
+ * A serializer that passes its calls on to another serializer, and requests
+ * a stop on a stop source once the output reaches its limits.
+ *
+ * When results are generated with the stop source's token (see
+ * ResultOptions::stop_token_), they stop at the next element boundary and are
+ * closed off with a truncation marker, and long-running producers such as
+ * directory walks finish early. The output can go over the limits by the
+ * rest of the element that was being written when a limit was reached, plus
+ * the truncation marker and the ends of the open arrays and objects.
+ */
+class LimitedSerializer : public Serializer {
+public:
+  using Serializer::start_array;
+  using Serializer::start_object;
+  using Serializer::write_value;
+
+  LimitedSerializer(Serializer &serializer, const OutputLimits &limits,
+                    std::stop_source source);
+
+  void start_array() override;
+  void start_array(std::size_t size) override;
+  void end_array() override;
+  void start_object() override;
+  void start_object(std::size_t size) override;
+  void end_object() override;
+  void write_key(std::string_view key) override;
+  void write_key(const PreparedKey &key) override;
+  void write_value(const PrimitiveRef &value) override;
+
+  /**
+   * Get a capture of the other serializer that counts the array elements
+   * written to it, so that they're counted when the value is spliced.
+   */
+  SQ_ND std::unique_ptr<ValueCapture> capture() override;
+
+  SQ_ND std::size_t output_size() const noexcept override;
+
+  /**
+   * Get the number of complete array elements that have been written.
+   */
+  SQ_ND std::size_t elements() const noexcept { return elements_; }
+
+  /**
+   * Get whether the output has reached a limit.
+   */
+  SQ_ND bool limit_reached() const noexcept { return limit_reached_; }
+
+private:
+  class Capture;
+
+  void open(bool array);
+  void close();
+  void after_value();
+  void check_limits();
+
+  Serializer *serializer_;
+  OutputLimits limits_;
+  std::stop_source source_;
+
+  // Whether each open container is an array.
+  std::vector<bool> arrays_;
+
+  std::size_t elements_ = 0;
+  bool limit_reached_ = false;
+};
+
+} // namespace sq::results
+
+#endif // SQ_INCLUDE_GUARD_results_LimitedSerializer_h_
@@ -0,0 +1,94 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_results_MessagePackSerializer_h_
+#define SQ_INCLUDE_GUARD_results_MessagePackSerializer_h_
+
+#include "core/Primitive.h"
+#include "core/typeutil.h"
+#include "results/OutputBuffer.h"
+#include "results/Serializer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace sq::results {
+
+/**
+ * A Serializer that writes MessagePack.
+ *
+ * Arrays and objects started with a size are written with the smallest
+ * header for the size. MessagePack has no indefinite-length containers, so
+ * other arrays and objects are written with 32 bit size headers that are
+ * filled in when they end. When writing uncompressed output to a regular
+ * file, output is flushed as usual and headers that have already been
+ * written are filled in with pwrite(2). Otherwise (e.g. for a pipe) output
+ * isn't flushed while such a container is open, so a long list of results
+ * is held in memory until it ends.
+ *
+ * Strings are written as str, ints with the smallest int encoding, floats as
+ * float 64 and null and bools as nil, true and false.
+ */
+class MessagePackSerializer : public Serializer {
+public:
+  using Serializer::write_key;
+  using Serializer::write_value;
+
+  MessagePackSerializer(std::ostream &os, FlushPolicy policy,
+                        const Compression &compression = {});
+  MessagePackSerializer(int fd, FlushPolicy policy,
+                        const Compression &compression = {});
+
+  void start_array() override;
+  void start_array(std::size_t size) override;
+  void end_array() override;
+  void start_object() override;
+  void start_object(std::size_t size) override;
+  void end_object() override;
+  void write_key(std::string_view key) override;
+  void write_value(const PrimitiveRef &value) override;
+
+  SQ_ND std::size_t output_size() const noexcept override {
+    return out_.size();
+  }
+
+private:
+  struct Container {
+    bool array_;
+
+    // The position in the output (see OutputBuffer::size()) of the
+    // container's header, if its size must be filled in when it ends.
+    std::optional<std::size_t> header_pos_;
+
+    // The number of elements, or members, written so far.
+    std::uint64_t size_;
+  };
+
+  void write_string(std::string_view str);
+  void write_primitive(std::string_view str);
+  void write_primitive(PrimitiveInt i);
+  void write_primitive(PrimitiveFloat f);
+  void write_primitive(PrimitiveBool b);
+  void write_primitive(const PrimitiveNull &null);
+  void start_container(bool array, std::optional<std::size_t> size);
+  void end_container(bool array);
+  void count_element();
+  void end_call();
+
+  OutputBuffer out_;
+  FlushPolicy policy_;
+  std::vector<Container> containers_;
+
+  // The number of open containers whose sizes must be filled in.
+  std::size_t unsized_containers_ = 0;
+};
+
+} // namespace sq::results
+
+#endif // SQ_INCLUDE_GUARD_results_MessagePackSerializer_h_
@@ -0,0 +1,100 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_results_NdjsonSerializer_h_
+#define SQ_INCLUDE_GUARD_results_NdjsonSerializer_h_
+
+#include "core/Primitive.h"
+#include "results/JsonWriter.h"
+#include "results/OutputBuffer.h"
+#include "results/Serializer.h"
+
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sq::results {
+
+/**
+ * A Serializer that writes newline-delimited JSON: the elements of a list
+ * each written as a self-contained JSON value on its own line.
+ *
+ * Without a list path, the elements of each outermost list (a list that
+ * isn't inside another list) are written; a top-level primitive is written
+ * as a single line. With a list path, only the value reached by following
+ * the path's keys from the top-level object is written: one line per element
+ * if it's a list, or a single line otherwise. Nothing else is written.
+ *
+ * Buffered output is written when the buffer is full, when the results are
+ * complete and, after a line, if at least the flush interval has passed
+ * since the last write. A zero flush interval writes every line as soon as
+ * it's complete. With compression, the compressed stream is synced at those
+ * line boundaries, so a reader can decompress every line that's written.
+ */
+class NdjsonSerializer : public Serializer {
+public:
+  using Serializer::start_array;
+  using Serializer::start_object;
+  using Serializer::write_value;
+
+  NdjsonSerializer(std::ostream &os, std::vector<std::string> list_path,
+                   std::chrono::milliseconds flush_interval,
+                   const Compression &compression = {});
+  NdjsonSerializer(int fd, std::vector<std::string> list_path,
+                   std::chrono::milliseconds flush_interval,
+                   const Compression &compression = {});
+
+  void start_array() override;
+  void end_array() override;
+  void start_object() override;
+  void end_object() override;
+  void write_key(std::string_view key) override;
+  void write_key(const PreparedKey &key) override;
+  void write_value(const PrimitiveRef &value) override;
+
+  SQ_ND std::size_t output_size() const noexcept override {
+    return out_.size();
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  // The kinds of the containers that are open outside of a line.
+  enum class Kind { Array, Object, Lines };
+
+  struct Container {
+    Kind kind_;
+
+    // The number of components of the list path that lead to this
+    // container, or no_match if it isn't on the path.
+    std::size_t matched_;
+  };
+
+  static constexpr auto no_match = static_cast<std::size_t>(-1);
+
+  SQ_ND bool in_line() const noexcept;
+  SQ_ND bool selected() const noexcept;
+  SQ_ND std::size_t next_matched() const noexcept;
+  void start_container(Kind kind);
+  void end_container();
+  void end_line_call();
+
+  OutputBuffer out_;
+  JsonWriter writer_{out_};
+  std::vector<std::string> path_;
+  std::chrono::milliseconds flush_interval_;
+  Clock::time_point last_flush_ = Clock::now();
+  std::vector<Container> containers_;
+
+  // Whether the last key outside of a line continued the list path.
+  bool key_matched_ = false;
+};
+
+} // namespace sq::results
+
+#endif // SQ_INCLUDE_GUARD_results_NdjsonSerializer_h_
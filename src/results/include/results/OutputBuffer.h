@@ -0,0 +1,189 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_results_OutputBuffer_h_
+#define SQ_INCLUDE_GUARD_results_OutputBuffer_h_
+
+#include "core/typeutil.h"
+#include "results/Compressor.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fmt/format.h>
+#include <iosfwd>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <sys/types.h>
+#include <variant>
+
+namespace sq::results {
+
+/**
+ * Buffers serialized output in memory and writes it to a file descriptor or a
+ * stream when flushed.
+ *
+ * Output to a file descriptor is written with write(2), bypassing iostreams
+ * and stdio. Formatted output can be appended in place with e.g.
+ * fmt::format_to(std::back_inserter(buffer.buffer()), ...).
+ *
+ * Output can be compressed on its way to the destination. The compressor
+ * works on whole buffers of output, and its output is collected in a second
+ * buffer that's written when it fills or when the compressed stream is
+ * synced or finished.
+ */
+class OutputBuffer {
+public:
+  static constexpr auto default_capacity = std::size_t{64 * 1024};
+
+  /**
+   * Throws OutOfRangeError if the compression level isn't supported.
+   */
+  explicit OutputBuffer(int fd, const Compression &compression = {},
+                        std::size_t capacity = default_capacity);
+  explicit OutputBuffer(std::ostream &os, const Compression &compression = {},
+                        std::size_t capacity = default_capacity);
+
+  OutputBuffer(const OutputBuffer &) = delete;
+  OutputBuffer(OutputBuffer &&) = delete;
+  OutputBuffer &operator=(const OutputBuffer &) = delete;
+  OutputBuffer &operator=(OutputBuffer &&) = delete;
+
+  /**
+   * Finishes the output, ignoring any errors.
+   */
+  ~OutputBuffer() noexcept;
+
+  void append(char c) { buffer_.push_back(c); }
+  void append(std::string_view str) {
+    buffer_.append(str.data(), str.data() + str.size());
+  }
+
+  /**
+   * Append the low `size` bytes of an integer in big-endian order, as used
+   * by binary formats like CBOR and MessagePack.
+   */
+  void append_big_endian(std::uint64_t value, std::size_t size) {
+    for (auto i = size; i > 0; --i) {
+      buffer_.push_back(static_cast<char>((value >> ((i - 1) * 8)) & 0xFF));
+    }
+  }
+
+  /**
+   * Append the low `size` bytes of an integer in little-endian order, as used
+   * by binary formats like Arrow.
+   */
+  void append_little_endian(std::uint64_t value, std::size_t size) {
+    for (auto i = std::size_t{0}; i < size; ++i) {
+      buffer_.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+    }
+  }
+
+  /**
+   * Get the underlying buffer, for appending formatted output.
+   */
+  SQ_ND fmt::memory_buffer &buffer() noexcept { return buffer_; }
+
+  /**
+   * Get whether the buffer has reached its capacity.
+   *
+   * The buffer grows beyond its capacity rather than flushing automatically,
+   * so the owner decides when output is written.
+   */
+  SQ_ND bool full() const noexcept { return buffer_.size() >= capacity_; }
+
+  /**
+   * Get the number of bytes of output so far, including buffered output,
+   * before any compression.
+   */
+  SQ_ND std::size_t size() const noexcept {
+    return flushed_ + buffer_.size();
+  }
+
+  /**
+   * Get whether output that is written from now on can be changed with
+   * patch(): true for uncompressed output to a regular file that isn't open
+   * for appending, until something else is found to have written to the file
+   * through the same file description (e.g. with 2>&1).
+   *
+   * Once that has been found, the buffered output is held back from the next
+   * flush() or sync(), so that a caller that still needs to patch it can keep
+   * it in memory until it has.
+   */
+  SQ_ND bool can_patch() const noexcept {
+    return file_offset_.has_value() && !shared_;
+  }
+
+  /**
+   * Overwrite output at a position counted as by size().
+   *
+   * Buffered output can always be patched, but output that has been written
+   * can only be patched if can_patch() was true when it was written.
+   *
+   * Throws SystemError if writing to the file descriptor fails.
+   */
+  void patch(std::size_t pos, std::string_view bytes);
+
+  /**
+   * Write the buffered output to the destination.
+   *
+   * With compression, the compressor may hold back some of its output to
+   * compress later output better, so a reader can't necessarily decompress
+   * everything written so far.
+   *
+   * Throws SystemError if writing to a file descriptor fails, or
+   * CompressionError if compressing the output fails.
+   */
+  void flush();
+
+  /**
+   * Write the buffered output to the destination so that a reader can
+   * decompress all of it, e.g. at the end of a top-level element or an NDJSON
+   * line. A stream destination is flushed as well. Without compression and
+   * with a file descriptor destination this is the same as flush().
+   */
+  void sync();
+
+  /**
+   * Write the buffered output to the destination and end the compressed
+   * stream, when the output is complete. Any later output starts a new
+   * compressed stream, which decompressors treat as a continuation. Without
+   * compression this is the same as flush().
+   */
+  void finish();
+
+private:
+  void compress(Compressor::Flush flush);
+  void write_uncompressed(bool hold_if_shared);
+  void write(fmt::memory_buffer &buffer);
+
+  std::variant<int, std::ostream *> destination_;
+  std::size_t capacity_;
+  fmt::memory_buffer buffer_;
+  std::unique_ptr<Compressor> compressor_;
+  fmt::memory_buffer compressed_;
+
+  // The number of bytes that have been taken from the buffer to be written
+  // or compressed.
+  std::size_t flushed_ = 0;
+
+  // The offset in the destination file of the start of the output, if
+  // written output can be patched.
+  std::optional<off_t> file_offset_;
+
+  // Whether something else has written to the destination file since this
+  // buffer started writing to it, and the number of bytes of output that were
+  // written before that was found, which are still where file_offset_ says.
+  bool shared_ = false;
+  std::size_t patchable_size_ = 0;
+
+  // Whether the compressor has been given output since the compressed stream
+  // was last ended.
+  bool compressing_ = false;
+};
+
+} // namespace sq::results
+
+#endif // SQ_INCLUDE_GUARD_results_OutputBuffer_h_
@@ -0,0 +1,90 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_results_OutputPipeline_h_
+#define SQ_INCLUDE_GUARD_results_OutputPipeline_h_
+
+#include "core/SpscQueue.h"
+#include "core/typeutil.h"
+
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+namespace sq::results {
+
+/**
+ * A stream whose data is written to another stream by a dedicated writer
+ * thread.
+ *
+ * Data written to stream() is collected into chunks, which are passed to the
+ * writer thread through a lock-free single-producer single-consumer queue.
+ * This lets the thread that generates results carry on while the writer
+ * waits for the output, and vice versa. Flushing stream() passes on any
+ * partial chunk and makes the writer flush the output stream once it gets
+ * that far, but doesn't wait for the writer.
+ */
+class OutputPipeline : private std::streambuf {
+public:
+  static constexpr auto default_chunk_size = std::size_t{64 * 1024};
+  static constexpr auto default_max_chunks = std::size_t{16};
+
+  explicit OutputPipeline(std::ostream &os,
+                          std::size_t chunk_size = default_chunk_size,
+                          std::size_t max_chunks = default_max_chunks);
+
+  OutputPipeline(const OutputPipeline &) = delete;
+  OutputPipeline(OutputPipeline &&) = delete;
+  OutputPipeline &operator=(const OutputPipeline &) = delete;
+  OutputPipeline &operator=(OutputPipeline &&) = delete;
+
+  /**
+   * Calls finish().
+   */
+  ~OutputPipeline() noexcept override;
+
+  /**
+   * Get the stream to write data to.
+   */
+  SQ_ND std::ostream &stream() noexcept;
+
+  /**
+   * Pass on any buffered data and wait for the writer thread to write all of
+   * the data to the output stream.
+   *
+   * Nothing more can be written to stream() afterwards.
+   */
+  void finish() noexcept;
+
+private:
+  int_type overflow(int_type ch) override;
+  int sync() override;
+
+  void send_chunk();
+  void reset_put_area();
+  void write_chunks();
+
+  std::ostream &os_;
+  std::size_t chunk_size_;
+  std::string chunk_;
+
+  // Chunks of data for the writer. An empty chunk means that the output
+  // stream should be flushed; std::nullopt means that there is no more data.
+  SpscQueue<std::optional<std::string>> chunks_;
+
+  // Chunks that have been written, returned so that their memory can be
+  // reused.
+  SpscQueue<std::string> free_chunks_;
+
+  std::ostream stream_;
+  std::jthread writer_;
+};
+
+} // namespace sq::results
+
+#endif // SQ_INCLUDE_GUARD_results_OutputPipeline_h_
@@ -0,0 +1,73 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_results_ResultRecorder_h_
+#define SQ_INCLUDE_GUARD_results_ResultRecorder_h_
+
+#include "core/Primitive.h"
+#include "core/typeutil.h"
+#include "results/Serializer.h"
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace sq::results {
+
+/**
+ * A recorded result: a primitive, an array or an object.
+ */
+struct ResultValue {
+  using Array = std::vector<ResultValue>;
+  using Object = std::vector<std::pair<std::string, ResultValue>>;
+
+  std::variant<Primitive, Array, Object> value_;
+};
+
+/**
+ * A Serializer that records the results written to it rather than writing
+ * them out.
+ */
+class ResultRecorder : public Serializer {
+public:
+  using Serializer::start_array;
+  using Serializer::start_object;
+  using Serializer::write_key;
+  using Serializer::write_value;
+
+  void start_array() override;
+  void end_array() override;
+  void start_object() override;
+  void end_object() override;
+  void write_key(std::string_view key) override;
+  void write_value(const PrimitiveRef &value) override;
+
+  /**
+   * Get the recorded results and start recording again.
+   *
+   * A complete value must have been recorded.
+   */
+  SQ_ND ResultValue take();
+
+private:
+  ResultValue &next_slot();
+  void open(ResultValue value);
+
+  ResultValue root_;
+  std::vector<ResultValue *> stack_;
+  bool have_key_ = false;
+  bool done_ = false;
+};
+
+/**
+ * Write a recorded result to a Serializer.
+ */
+void write_result_value(const ResultValue &value, Serializer &serializer);
+
+} // namespace sq::results
+
+#endif // SQ_INCLUDE_GUARD_results_ResultRecorder_h_
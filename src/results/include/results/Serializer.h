@@ -6,14 +6,45 @@
 #ifndef SQ_INCLUDE_GUARD_results_Serializer_h_
 #define SQ_INCLUDE_GUARD_results_Serializer_h_
 
+#include "core/Primitive.h"
+#include "core/typeutil.h"
+#include "results/Compressor.h"
 #include "results/results.h"
 
+#include <chrono>
+#include <cstddef>
 #include <iosfwd>
 #include <memory>
+#include <string>
 #include <string_view>
+#include <vector>
 
 namespace sq::results {
 
+/**
+ * An object key that has been prepared for writing ahead of time, e.g. when a
+ * query plan is created, so that serializers don't have to convert it each
+ * time it's written.
+ */
+class PreparedKey {
+public:
+  explicit PreparedKey(std::string_view name);
+
+  SQ_ND std::string_view name() const noexcept { return name_; }
+
+  /**
+   * Get the escaped JSON for the key, preceded by a member separator and
+   * followed by a name separator: ,"name":
+   */
+  SQ_ND std::string_view json() const noexcept { return json_; }
+
+private:
+  std::string name_;
+  std::string json_;
+};
+
+class ValueCapture;
+
 class Serializer {
 public:
   Serializer(const Serializer &) = delete;
@@ -29,11 +60,204 @@ public:
   virtual void start_object() = 0;
   virtual void end_object() = 0;
   virtual void write_key(std::string_view key) = 0;
-  virtual void write_value(const Primitive &value) = 0;
+
+  /**
+   * Start an array with a known number of elements.
+   *
+   * Serializers for formats with length-prefixed arrays write the size up
+   * front. By default the same as start_array().
+   */
+  virtual void start_array(SQ_MU std::size_t size) { start_array(); }
+
+  /**
+   * Start an object with a known number of members.
+   *
+   * Serializers for formats with length-prefixed maps write the size up
+   * front. By default the same as start_object().
+   */
+  virtual void start_object(SQ_MU std::size_t size) { start_object(); }
+
+  /**
+   * Write a prepared key. By default the same as write_key(key.name()).
+   */
+  virtual void write_key(const PreparedKey &key) { write_key(key.name()); }
+
+  /**
+   * Write a primitive value.
+   *
+   * A string value is only referred to, not owned, so serializers must copy
+   * anything they keep from it before returning.
+   */
+  virtual void write_value(const PrimitiveRef &value) = 0;
+
+  void write_value(const Primitive &value) {
+    write_value(primitive_ref(value));
+  }
+
+  template <PrimitiveAlternative T> void write_value(const T &value) {
+    write_value(PrimitiveRef{value});
+  }
+
+  /**
+   * Get a serializer that captures a value to be written to this serializer
+   * later, with ValueCapture::splice().
+   *
+   * A capture doesn't share any state with this serializer, so it can be
+   * written to on another thread, e.g. when the elements of an array are
+   * evaluated in parallel. By default the captured value is recorded and
+   * written again when it's spliced. Serializers whose output for a value
+   * doesn't depend on what comes before it can render the value as it's
+   * captured instead, so that splicing it is just a copy.
+   */
+  SQ_ND virtual std::unique_ptr<ValueCapture> capture();
+
+  /**
+   * Get the number of bytes of output so far, including buffered output,
+   * before any compression. Zero for serializers that don't write output.
+   */
+  SQ_ND virtual std::size_t output_size() const noexcept { return 0; }
+};
+
+/**
+ * A serializer that captures a value for another serializer. See
+ * Serializer::capture().
+ */
+class ValueCapture : public Serializer {
+public:
+  /**
+   * Write the captured value to the serializer that the capture was made
+   * for, as if it had been written there directly, and start capturing
+   * again.
+   *
+   * A complete value must have been captured. Must be called on the thread
+   * that's using the other serializer, where it expects a value.
+   */
+  virtual void splice() = 0;
 };
 
+using ValueCapturePtr = std::unique_ptr<ValueCapture>;
+
+/**
+ * When a serializer writes its buffered output to its destination.
+ */
+enum class FlushPolicy {
+  /**
+   * After every call to the serializer.
+   */
+  EveryCall,
+
+  /**
+   * After each element of a top-level array, when the buffer is full and
+   * when the results are complete.
+   */
+  EveryTopLevelElement,
+
+  /**
+   * When the buffer is full and when the results are complete.
+   */
+  WhenFull,
+};
+
+/**
+ * The formats that serializers can write.
+ */
+enum class OutputFormat {
+  Json,
+
+  /**
+   * CBOR (RFC 8949). Containers are written with their sizes when they're
+   * known in advance, and with indefinite lengths otherwise.
+   */
+  Cbor,
+
+  /**
+   * MessagePack. MessagePack has no indefinite-length containers, so the
+   * sizes of containers that aren't known in advance are filled in when
+   * they end. Unless the output is an uncompressed regular file that nothing
+   * else is writing to, output isn't flushed while such a container is open,
+   * so e.g. a whole list of results is held in memory. See
+   * MessagePackSerializer.
+   */
+  MessagePack,
+
+  /**
+   * Newline-delimited JSON: the elements of the outermost lists, one per
+   * line. See NdjsonSerializer.
+   */
+  Ndjson,
+
+  /**
+   * An Apache Arrow IPC stream, with a row for each element of the outermost
+   * list. See ArrowSerializer.
+   */
+  Arrow,
+};
+
+/**
+ * Get a JSON serializer that writes to a stream.
+ *
+ * Output is flushed to the stream after every call (see
+ * FlushPolicy::EveryCall), so the stream's own buffering applies.
+ */
 std::unique_ptr<Serializer> get_serializer(std::ostream &os);
 
+/**
+ * Get a JSON serializer that writes directly to a file descriptor.
+ *
+ * Output is buffered and written with write(2) according to the flush policy.
+ * Any buffered output is also written when the serializer is destroyed.
+ */
+std::unique_ptr<Serializer>
+get_serializer(int fd, FlushPolicy policy = FlushPolicy::WhenFull);
+
+/**
+ * Get a serializer for the given format that writes to a stream.
+ *
+ * By default, output is written to the stream after every call, as far as the
+ * format allows, so the stream's own buffering applies. Where the flush policy
+ * writes output at a top-level element boundary the stream is flushed too.
+ * With compression, the compressor may hold back output until the results
+ * are complete or the stream is flushed.
+ */
+std::unique_ptr<Serializer>
+get_serializer(std::ostream &os, OutputFormat format,
+               FlushPolicy policy = FlushPolicy::EveryCall,
+               const Compression &compression = {});
+
+/**
+ * Get a serializer for the given format that writes directly to a file
+ * descriptor.
+ *
+ * With compression, the compressed stream is synced wherever the flush
+ * policy writes output at a top-level element boundary, so a reader can
+ * decompress each element as it's written.
+ */
+std::unique_ptr<Serializer>
+get_serializer(int fd, OutputFormat format,
+               FlushPolicy policy = FlushPolicy::WhenFull,
+               const Compression &compression = {});
+
+/**
+ * Get a newline-delimited JSON serializer that writes to a stream.
+ *
+ * Lines are the elements of the list at list_path, or of the outermost lists
+ * if list_path is empty. Complete lines are written at least every
+ * flush_interval, as well as when the buffer is full.
+ */
+std::unique_ptr<Serializer>
+get_ndjson_serializer(std::ostream &os, std::vector<std::string> list_path,
+                      std::chrono::milliseconds flush_interval,
+                      const Compression &compression = {});
+
+/**
+ * Get a newline-delimited JSON serializer that writes directly to a file
+ * descriptor. See the stream overload.
+ */
+std::unique_ptr<Serializer>
+get_ndjson_serializer(int fd, std::vector<std::string> list_path,
+                      std::chrono::milliseconds flush_interval,
+                      const Compression &compression = {});
+
 } // namespace sq::results
 
 #endif // SQ_INCLUDE_GUARD_results_Serializer_h_
@@ -0,0 +1,43 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_results_json_escape_h_
+#define SQ_INCLUDE_GUARD_results_json_escape_h_
+
+#include "core/typeutil.h"
+
+#include <cstddef>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace sq::results {
+
+/**
+ * Get the position of the first character of a string that must be escaped
+ * in a JSON string, or the size of the string if there isn't one.
+ *
+ * The characters that must be escaped are quotes, backslashes and control
+ * characters (U+0000 to U+001F). The string is scanned a block at a time
+ * with the widest vector instructions the CPU supports.
+ */
+SQ_ND std::size_t find_json_escape(std::string_view str) noexcept;
+
+namespace detail {
+
+using JsonEscapeFinder = std::size_t (*)(std::string_view) noexcept;
+
+/**
+ * Get the implementations of find_json_escape() that can run on this CPU,
+ * with their names. Used to test each implementation.
+ */
+SQ_ND std::vector<std::pair<std::string_view, JsonEscapeFinder>>
+json_escape_finders();
+
+} // namespace detail
+
+} // namespace sq::results
+
+#endif // SQ_INCLUDE_GUARD_results_json_escape_h_
@@ -7,11 +7,121 @@
 #define SQ_INCLUDE_GUARD_results_generate_results_h_
 
 #include "core/Field.h"
+#include "core/typeutil.h"
 #include "parser/Ast.h"
 
+#include <cstddef>
+#include <memory>
+#include <stop_token>
+#include <string_view>
+
 namespace sq::results {
 
 class Serializer;
+struct FieldAccess;
+
+/**
+ * A query that has been prepared for generating results.
+ *
+ * The params, hints and filters for each field access in the query are
+ * created when the plan is created, so a plan can be used to generate results
+ * repeatedly without preparing the query again.
+ *
+ * The plan refers to the AST that it was created from, so the AST must
+ * outlive the plan.
+ */
+class QueryPlan {
+public:
+  explicit QueryPlan(const parser::Ast &ast);
+
+  QueryPlan(const QueryPlan &) = delete;
+  QueryPlan(QueryPlan &&) noexcept;
+  QueryPlan &operator=(const QueryPlan &) = delete;
+  QueryPlan &operator=(QueryPlan &&) noexcept;
+  ~QueryPlan() noexcept;
+
+  SQ_ND const FieldAccess &root_access() const noexcept;
+
+private:
+  std::unique_ptr<const FieldAccess> root_access_;
+};
+
+/**
+ * Options for generating results.
+ */
+struct ResultOptions {
+  /**
+   * The number of threads to use to evaluate array elements.
+   *
+   * With more than one thread, the subtrees of the elements of an array are
+   * evaluated in parallel and captured (see Serializer::capture()), then
+   * spliced into the output in their original order. Elements that are
+   * thread affine (see Field::is_thread_affine()) are still evaluated on the
+   * calling thread. Arrays within the elements of an array that is being
+   * evaluated in parallel are evaluated sequentially.
+   */
+  std::size_t jobs_ = 1;
+
+  /**
+   * The maximum number of array elements that are buffered at once when
+   * evaluating elements in parallel.
+   *
+   * Zero means four times the number of threads.
+   */
+  std::size_t max_buffered_elements_ = 0;
+
+  /**
+   * Whether the elements of arrays that are evaluated in parallel may be
+   * written in the order that their evaluation completes, rather than in
+   * their original order.
+   *
+   * This avoids waiting for a slow element before writing the elements after
+   * it. Each element is still written as a whole.
+   */
+  bool unordered_ = false;
+
+  /**
+   * The number of elements to evaluate ahead of the element being written,
+   * for arrays of latency-bound fields (see Field::is_latency_bound()).
+   *
+   * Prefetching is only used when jobs_ is one. The prefetched elements are
+   * evaluated by prefetch_depth_ threads, which are only started if they are
+   * needed, and are written in their original order. Zero, the default,
+   * disables prefetching: the descendants of a latency-bound element may be
+   * thread affine, and they would be evaluated on the prefetching threads.
+   */
+  std::size_t prefetch_depth_ = 0;
+
+  /**
+   * A token for stopping the results early, e.g. when a deadline expires or
+   * the output reaches a limit (see LimitedSerializer).
+   *
+   * Once a stop is requested, no more array elements or object members are
+   * started, array elements that were evaluated in parallel ahead of the
+   * stop are dropped, and the arrays and objects that are open are closed. A
+   * truncation marker is written where the results stop: an element
+   * {"truncated": true} in an array, or a member "truncated": true in an
+   * object. The token is also made the current stop token (see
+   * ScopedStopToken) so that long-running producers, such as directory
+   * walks, finish early.
+   */
+  std::stop_token stop_token_;
+};
+
+/**
+ * The key of the truncation marker written when results are stopped early.
+ */
+inline constexpr auto truncation_marker_key = std::string_view{"truncated"};
+
+/**
+ * Generate the results of a query.
+ *
+ * Returns true if the results are complete, or false if they were stopped
+ * early by ResultOptions::stop_token_.
+ */
+bool generate_results(const QueryPlan &plan, const FieldPtr &system_root,
+                      Serializer &serializer,
+                      const ResultOptions &options = {});
 
 void generate_results(const parser::Ast &ast, const FieldPtr &system_root,
                       Serializer &serializer);
@@ -0,0 +1,689 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/ArrowSerializer.h"
+
+#include "core/ASSERT.h"
+#include "core/errors.h"
+#include "core/typeutil.h"
+#include "results/results.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fmt/format.h>
+#include <gsl/gsl>
+#include <initializer_list>
+#include <limits>
+#include <utility>
+#include <variant>
+
+namespace sq::results {
+
+namespace {
+
+// Values from the Arrow flatbuffer schemas (Message.fbs and Schema.fbs).
+constexpr auto metadata_version_v5 = std::uint64_t{4};
+constexpr auto schema_header = std::uint64_t{1};
+constexpr auto record_batch_header = std::uint64_t{3};
+constexpr auto null_type = std::uint64_t{1};
+constexpr auto int_type = std::uint64_t{2};
+constexpr auto floating_point_type = std::uint64_t{3};
+constexpr auto utf8_type = std::uint64_t{5};
+constexpr auto bool_type = std::uint64_t{6};
+constexpr auto double_precision = std::uint64_t{2};
+constexpr auto native_endianness =
+    std::uint64_t{std::endian::native == std::endian::little ? 0 : 1};
+
+constexpr auto continuation_marker = std::uint64_t{0xFFFFFFFF};
+constexpr auto alignment = std::size_t{8};
+constexpr auto max_offset =
+    std::size_t{std::numeric_limits<std::int32_t>::max()};
+
+SQ_ND std::size_t padded_to(std::size_t size, std::size_t boundary) noexcept {
+  return (size + boundary - 1) / boundary * boundary;
+}
+
+SQ_ND std::size_t padded(std::size_t size) noexcept {
+  return padded_to(size, alignment);
+}
+
+// A field of a flatbuffer table: either a scalar or an offset to another
+// object, which is filled in when the object is written.
+struct TableField {
+  std::uint16_t id_;
+  std::size_t size_;
+  std::uint64_t value_ = 0;
+  bool offset_ = false;
+};
+
+SQ_ND TableField offset_field(std::uint16_t id) {
+  return TableField{id, 4, 0, true};
+}
+
+// Writes a flatbuffer from the root down.
+//
+// Flatbuffers are usually built from the leaves up, but all that the format
+// needs is for offsets to objects to point forwards, so each object is
+// written after the object that refers to it. Each write function takes the
+// position of the offset that refers to the new object.
+class FlatbufferBuilder {
+public:
+  // Reserve the offset to the root table.
+  SQ_ND std::size_t root() {
+    ASSERT(data_.empty());
+    append(0, 4);
+    return 0;
+  }
+
+  // Write a table, returning the positions of its offset fields in the
+  // order they were given.
+  std::vector<std::size_t> table(std::size_t offset_pos,
+                                 std::initializer_list<TableField> fields) {
+    // Lay out the fields after the table's offset to its vtable, largest
+    // first so that they're aligned without padding.
+    auto sorted = std::vector<const TableField *>{};
+    for (const auto &field : fields) {
+      sorted.push_back(&field);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const auto *a, const auto *b) {
+                       return a->size_ > b->size_;
+                     });
+    auto vtable_entries = std::vector<std::size_t>{};
+    auto table_size = std::size_t{4};
+    auto table_alignment = std::size_t{4};
+    for (const auto *field : sorted) {
+      table_size = padded_to(table_size, field->size_);
+      if (vtable_entries.size() <= field->id_) {
+        vtable_entries.resize(field->id_ + std::size_t{1}, 0);
+      }
+      vtable_entries[field->id_] = table_size;
+      table_size += field->size_;
+      table_alignment = std::max(table_alignment, field->size_);
+    }
+
+    align(2);
+    const auto vtable_pos = data_.size();
+    append(4 + 2 * vtable_entries.size(), 2);
+    append(table_size, 2);
+    for (const auto entry : vtable_entries) {
+      append(entry, 2);
+    }
+
+    align(table_alignment);
+    const auto table_pos = data_.size();
+    patch_offset(offset_pos, table_pos);
+    append(table_pos - vtable_pos, 4);
+    auto positions = std::vector<std::size_t>(fields.size());
+    for (const auto *field : sorted) {
+      align(field->size_);
+      positions[to_size(field - fields.begin())] = data_.size();
+      append(field->value_, field->size_);
+    }
+    auto offsets = std::vector<std::size_t>{};
+    for (const auto &field : fields) {
+      if (field.offset_) {
+        offsets.push_back(positions[to_size(&field - fields.begin())]);
+      }
+    }
+    return offsets;
+  }
+
+  // Write a vector of offsets, returning the positions of the offsets.
+  std::vector<std::size_t> offset_vector(std::size_t offset_pos,
+                                         std::size_t size) {
+    align(4);
+    patch_offset(offset_pos, data_.size());
+    append(size, 4);
+    auto offsets = std::vector<std::size_t>{};
+    for (auto i = std::size_t{0}; i < size; ++i) {
+      offsets.push_back(data_.size());
+      append(0, 4);
+    }
+    return offsets;
+  }
+
+  // Write a vector of structs that each have two 64 bit fields.
+  void struct_vector(
+      std::size_t offset_pos,
+      const std::vector<std::pair<std::uint64_t, std::uint64_t>> &structs) {
+    // Align the elements rather than the size before them.
+    while ((data_.size() + 4) % alignment != 0) {
+      data_.push_back('\0');
+    }
+    patch_offset(offset_pos, data_.size());
+    append(structs.size(), 4);
+    for (const auto &[first, second] : structs) {
+      append(first, 8);
+      append(second, 8);
+    }
+  }
+
+  void string(std::size_t offset_pos, std::string_view str) {
+    align(4);
+    patch_offset(offset_pos, data_.size());
+    append(str.size(), 4);
+    data_.append(str);
+    data_.push_back('\0');
+  }
+
+  // Get the flatbuffer, padded for the body of a message that follows it.
+  SQ_ND std::string take() {
+    align(alignment);
+    return std::move(data_);
+  }
+
+private:
+  void align(std::size_t boundary) {
+    data_.resize(padded_to(data_.size(), boundary), '\0');
+  }
+
+  void append(std::uint64_t value, std::size_t size) {
+    for (auto i = std::size_t{0}; i < size; ++i) {
+      data_.push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+    }
+  }
+
+  void patch_offset(std::size_t offset_pos, std::size_t target) {
+    ASSERT(target > offset_pos);
+    auto offset = target - offset_pos;
+    for (auto i = std::size_t{0}; i < 4; ++i) {
+      data_[offset_pos + i] = static_cast<char>(offset & 0xFF);
+      offset >>= 8;
+    }
+  }
+
+  std::string data_;
+};
+
+template <typename T> void append_bytes(std::vector<char> &data, T value) {
+  const auto pos = data.size();
+  data.resize(pos + sizeof(value));
+  std::memcpy(data.data() + pos, &value, sizeof(value));
+}
+
+void set_bit(std::vector<char> &bits, std::size_t index) {
+  bits[index / 8] = static_cast<char>(
+      static_cast<unsigned char>(bits[index / 8]) | (1U << (index % 8)));
+}
+
+SQ_ND std::string_view bytes(const std::vector<char> &data) {
+  return std::string_view{data.data(), data.size()};
+}
+
+SQ_ND std::string_view bytes(const std::vector<std::int32_t> &data) {
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  return std::string_view{reinterpret_cast<const char *>(data.data()),
+                          data.size() * sizeof(std::int32_t)};
+}
+
+} // namespace
+
+ArrowSerializer::ArrowSerializer(std::ostream &os, std::size_t batch_size,
+                                 const Compression &compression)
+    : out_{os, compression}, batch_size_{batch_size} {
+  Expects(batch_size > 0);
+}
+
+ArrowSerializer::ArrowSerializer(int fd, std::size_t batch_size,
+                                 const Compression &compression)
+    : out_{fd, compression}, batch_size_{batch_size} {
+  Expects(batch_size > 0);
+}
+
+void ArrowSerializer::start_array() {
+  if (in_rows_) {
+    throw NotAScalarError{
+        "Arrow output can't contain lists within the elements of a list"};
+  }
+  if (rows_done_) {
+    throw NotAnArrayError{"Arrow output can only contain one list"};
+  }
+  in_rows_ = true;
+}
+
+void ArrowSerializer::end_array() {
+  ASSERT(in_rows_ && row_depth_ == 0);
+  in_rows_ = false;
+  rows_done_ = true;
+  if (outer_depth_ == 0) {
+    finish();
+  }
+}
+
+void ArrowSerializer::start_object() {
+  if (!in_rows_) {
+    ++outer_depth_;
+    return;
+  }
+  if (row_depth_ == 0) {
+    start_row();
+  } else {
+    name_.push_back('.');
+    prefix_sizes_.push_back(name_.size());
+  }
+  ++row_depth_;
+}
+
+void ArrowSerializer::end_object() {
+  if (!in_rows_) {
+    ASSERT(outer_depth_ > 0);
+    if (--outer_depth_ == 0) {
+      finish();
+    }
+    return;
+  }
+  ASSERT(row_depth_ > 0);
+  prefix_sizes_.pop_back();
+  if (--row_depth_ == 0) {
+    end_row();
+  }
+}
+
+void ArrowSerializer::write_key(std::string_view key) {
+  if (!in_rows_ || skip_row_) {
+    return;
+  }
+  if (key == truncation_marker_key) {
+    if (row_depth_ == 1 && next_column_ == 0) {
+      skip_row_ = true;
+    } else {
+      skip_value_ = true;
+    }
+    return;
+  }
+  name_.resize(prefix_sizes_.back());
+  name_.append(key);
+}
+
+void ArrowSerializer::write_value(const PrimitiveRef &value) {
+  if (!in_rows_) {
+    if (outer_depth_ == 0) {
+      finish();
+    }
+    return;
+  }
+  if (row_depth_ == 0) {
+    start_row();
+    add_value("value", value);
+    end_row();
+    return;
+  }
+  if (skip_value_) {
+    skip_value_ = false;
+    return;
+  }
+  if (!skip_row_) {
+    add_value(name_, value);
+  }
+}
+
+std::size_t ArrowSerializer::output_size() const noexcept {
+  auto size = out_.size() + pending_size_;
+  if (rows_ > 0) {
+    for (const auto &column : columns_) {
+      size += column.size();
+    }
+  }
+  return size;
+}
+
+void ArrowSerializer::start_row() {
+  name_.clear();
+  prefix_sizes_.assign(1, 0);
+  next_column_ = 0;
+}
+
+void ArrowSerializer::end_row() {
+  if (skip_row_) {
+    skip_row_ = false;
+    return;
+  }
+  // Leaves missing from the end of the row are null.
+  for (; next_column_ < columns_.size(); ++next_column_) {
+    columns_[next_column_].append_null();
+  }
+  columns_fixed_ = true;
+  if (++rows_ == batch_size_) {
+    end_batch();
+  }
+}
+
+void ArrowSerializer::add_value(std::string_view name,
+                                const PrimitiveRef &value) {
+  if (!columns_fixed_ && next_column_ == columns_.size()) {
+    columns_.emplace_back(name);
+  }
+  if (next_column_ < columns_.size() && columns_[next_column_].name_ == name) {
+    columns_[next_column_].append(value, schema_written_);
+    ++next_column_;
+    return;
+  }
+
+  // A null in place of an object is a null for each of its leaves.
+  if (std::holds_alternative<PrimitiveNull>(value)) {
+    const auto prefix = fmt::format("{}.", name);
+    const auto first = next_column_;
+    while (next_column_ < columns_.size() &&
+           columns_[next_column_].name_.starts_with(prefix)) {
+      columns_[next_column_].append_null();
+      ++next_column_;
+    }
+    if (next_column_ != first) {
+      return;
+    }
+  }
+
+  throw InvalidConversionError{fmt::format(
+      "Arrow output needs each element of a list to have the same fields: "
+      "found \"{}\" where {} was expected",
+      name,
+      next_column_ < columns_.size()
+          ? fmt::format("\"{}\"", columns_[next_column_].name_)
+          : std::string{"the end of the element"})};
+}
+
+void ArrowSerializer::end_batch() {
+  if (!schema_written_) {
+    const auto untyped =
+        std::any_of(columns_.begin(), columns_.end(), [](const auto &column) {
+          return column.type_ == ColumnType::Null;
+        });
+    if (untyped && pending_.size() < max_pending_batches) {
+      pending_.push_back(Batch{columns_, rows_});
+      for (const auto &column : columns_) {
+        pending_size_ += column.size();
+      }
+      clear_batch();
+      return;
+    }
+    start_stream(false);
+  }
+  write_batch(columns_, rows_);
+  clear_batch();
+  out_.sync();
+}
+
+// Write the schema and the batches that were held back until the types of
+// the columns were known. If the stream isn't finished then columns that
+// still have only nulls are given the string type, and any values they get
+// later are converted to strings.
+void ArrowSerializer::start_stream(bool finished) {
+  if (!finished) {
+    for (auto &column : columns_) {
+      if (column.type_ == ColumnType::Null) {
+        column.set_type(ColumnType::String);
+        column.stringify_ = true;
+      }
+    }
+  }
+  for (auto &batch : pending_) {
+    for (auto i = std::size_t{0}; i < columns_.size(); ++i) {
+      if (batch.columns_[i].type_ != columns_[i].type_) {
+        batch.columns_[i].set_type(columns_[i].type_);
+      }
+    }
+  }
+  write_schema();
+  for (const auto &batch : pending_) {
+    write_batch(batch.columns_, batch.rows_);
+  }
+  pending_.clear();
+  pending_size_ = 0;
+}
+
+void ArrowSerializer::write_schema() {
+  auto builder = FlatbufferBuilder{};
+  const auto message =
+      builder.table(builder.root(), {{0, 2, metadata_version_v5},
+                                     {1, 1, schema_header},
+                                     offset_field(2),
+                                     {3, 8, 0}});
+  const auto schema = builder.table(
+      message[0], {{0, 2, native_endianness}, offset_field(1)});
+  const auto fields = builder.offset_vector(schema[0], columns_.size());
+  for (auto i = std::size_t{0}; i < columns_.size(); ++i) {
+    const auto &column = columns_[i];
+    auto type = null_type;
+    switch (column.type_) {
+    case ColumnType::Null:
+      type = null_type;
+      break;
+    case ColumnType::Int:
+      type = int_type;
+      break;
+    case ColumnType::Float:
+      type = floating_point_type;
+      break;
+    case ColumnType::Bool:
+      type = bool_type;
+      break;
+    case ColumnType::String:
+      type = utf8_type;
+      break;
+    }
+    const auto field = builder.table(
+        fields[i], {offset_field(0),
+                    {1, 1, 1},
+                    {2, 1, type},
+                    offset_field(3),
+                    offset_field(5)});
+    builder.string(field[0], column.name_);
+    if (column.type_ == ColumnType::Int) {
+      (void)builder.table(field[1], {{0, 4, 64}, {1, 1, 1}});
+    } else if (column.type_ == ColumnType::Float) {
+      (void)builder.table(field[1], {{0, 2, double_precision}});
+    } else {
+      (void)builder.table(field[1], {});
+    }
+    (void)builder.offset_vector(field[2], 0);
+  }
+  write_message(builder.take());
+  schema_written_ = true;
+}
+
+void ArrowSerializer::write_batch(const std::vector<Column> &columns,
+                                  std::size_t rows) {
+  auto nodes = std::vector<std::pair<std::uint64_t, std::uint64_t>>{};
+  auto buffers = std::vector<std::string_view>{};
+  for (const auto &column : columns) {
+    nodes.emplace_back(rows, column.null_count_);
+    if (column.type_ == ColumnType::Null) {
+      continue;
+    }
+    buffers.push_back(column.null_count_ == 0 ? std::string_view{}
+                                              : bytes(column.validity_));
+    if (column.type_ == ColumnType::String) {
+      buffers.push_back(bytes(column.offsets_));
+    }
+    buffers.push_back(bytes(column.data_));
+  }
+
+  // Each buffer in the body starts on an aligned offset.
+  auto buffer_specs = std::vector<std::pair<std::uint64_t, std::uint64_t>>{};
+  auto body_size = std::size_t{0};
+  for (const auto buffer : buffers) {
+    buffer_specs.emplace_back(body_size, buffer.size());
+    body_size += padded(buffer.size());
+  }
+
+  auto builder = FlatbufferBuilder{};
+  const auto message =
+      builder.table(builder.root(), {{0, 2, metadata_version_v5},
+                                     {1, 1, record_batch_header},
+                                     offset_field(2),
+                                     {3, 8, body_size}});
+  const auto batch = builder.table(
+      message[0], {{0, 8, rows}, offset_field(1), offset_field(2)});
+  builder.struct_vector(batch[0], nodes);
+  builder.struct_vector(batch[1], buffer_specs);
+  write_message(builder.take());
+
+  for (const auto buffer : buffers) {
+    out_.append(buffer);
+    for (auto i = buffer.size(); i < padded(buffer.size()); ++i) {
+      out_.append('\0');
+    }
+  }
+}
+
+void ArrowSerializer::clear_batch() {
+  for (auto &column : columns_) {
+    column.clear();
+  }
+  rows_ = 0;
+}
+
+void ArrowSerializer::write_message(std::string_view metadata) {
+  out_.append_little_endian(continuation_marker, 4);
+  out_.append_little_endian(metadata.size(), 4);
+  out_.append(metadata);
+}
+
+// Write the last batch and the end of the stream.
+void ArrowSerializer::finish() {
+  if (!rows_done_) {
+    throw NotAnArrayError{"Arrow output needs the results to contain a list"};
+  }
+  if (!schema_written_) {
+    // Make sure that there's at least one batch.
+    if (rows_ > 0 || pending_.empty()) {
+      pending_.push_back(Batch{columns_, rows_});
+    }
+    start_stream(true);
+  } else if (rows_ > 0) {
+    write_batch(columns_, rows_);
+  }
+  out_.append_little_endian(continuation_marker, 4);
+  out_.append_little_endian(0, 4);
+  out_.finish();
+}
+
+void ArrowSerializer::Column::append(const PrimitiveRef &value,
+                                     bool types_fixed) {
+  if (std::holds_alternative<PrimitiveNull>(value)) {
+    append_null();
+    return;
+  }
+  if (stringify_ && !std::holds_alternative<std::string_view>(value)) {
+    const auto str = primitive_to_str(primitive_from_ref(value));
+    append(PrimitiveRef{std::string_view{str}}, types_fixed);
+    return;
+  }
+  auto type = ColumnType::String;
+  if (std::holds_alternative<PrimitiveInt>(value)) {
+    type = ColumnType::Int;
+  } else if (std::holds_alternative<PrimitiveFloat>(value)) {
+    type = ColumnType::Float;
+  } else if (std::holds_alternative<PrimitiveBool>(value)) {
+    type = ColumnType::Bool;
+  }
+  if (type != type_) {
+    if (type_ != ColumnType::Null || types_fixed) {
+      throw InvalidConversionError{
+          fmt::format("Arrow output needs the values of \"{}\" to all have "
+                      "the same type: found a {} value",
+                      name_, primitive_type_name(primitive_from_ref(value)))};
+    }
+    set_type(type);
+  }
+
+  if (values_ % 8 == 0) {
+    validity_.push_back('\0');
+  }
+  set_bit(validity_, values_);
+  switch (type_) {
+  case ColumnType::Int:
+    append_bytes(data_, std::get<PrimitiveInt>(value));
+    break;
+  case ColumnType::Float:
+    append_bytes(data_, std::get<PrimitiveFloat>(value));
+    break;
+  case ColumnType::Bool:
+    if (values_ % 8 == 0) {
+      data_.push_back('\0');
+    }
+    if (std::get<PrimitiveBool>(value)) {
+      set_bit(data_, values_);
+    }
+    break;
+  case ColumnType::String: {
+    const auto str = std::get<std::string_view>(value);
+    if (data_.size() + str.size() > max_offset) {
+      throw OutOfRangeError{
+          "Arrow output has more than 2GiB of strings in a column of a batch"};
+    }
+    data_.insert(data_.end(), str.begin(), str.end());
+    offsets_.push_back(static_cast<std::int32_t>(data_.size()));
+    break;
+  }
+  case ColumnType::Null:
+    ASSERT(false);
+    break;
+  }
+  ++values_;
+}
+
+void ArrowSerializer::Column::append_null() {
+  if (values_ % 8 == 0) {
+    validity_.push_back('\0');
+    if (type_ == ColumnType::Bool) {
+      data_.push_back('\0');
+    }
+  }
+  switch (type_) {
+  case ColumnType::Int:
+  case ColumnType::Float:
+    data_.resize(data_.size() + 8, '\0');
+    break;
+  case ColumnType::String:
+    offsets_.push_back(offsets_.back());
+    break;
+  case ColumnType::Bool:
+  case ColumnType::Null:
+    break;
+  }
+  ++null_count_;
+  ++values_;
+}
+
+// Set the type of a column that has only had nulls so far, filling in space
+// for the nulls.
+void ArrowSerializer::Column::set_type(ColumnType type) {
+  ASSERT(type_ == ColumnType::Null && null_count_ == values_);
+  type_ = type;
+  switch (type_) {
+  case ColumnType::Int:
+  case ColumnType::Float:
+    data_.assign(values_ * 8, '\0');
+    break;
+  case ColumnType::Bool:
+    data_.assign((values_ + 7) / 8, '\0');
+    break;
+  case ColumnType::String:
+    offsets_.assign(values_ + 1, 0);
+    break;
+  case ColumnType::Null:
+    break;
+  }
+}
+
+std::size_t ArrowSerializer::Column::size() const noexcept {
+  return validity_.size() + data_.size() +
+         offsets_.size() * sizeof(std::int32_t);
+}
+
+void ArrowSerializer::Column::clear() {
+  null_count_ = 0;
+  values_ = 0;
+  validity_.clear();
+  data_.clear();
+  if (type_ == ColumnType::String) {
+    offsets_.assign(1, 0);
+  }
+}
+
+} // namespace sq::results
@@ -0,0 +1,155 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/CborSerializer.h"
+
+#include "core/ASSERT.h"
+#include "core/typeutil.h"
+
+#include <bit>
+#include <variant>
+
+namespace sq::results {
+
+namespace {
+
+constexpr auto unsigned_int_type = std::uint8_t{0};
+constexpr auto negative_int_type = std::uint8_t{1};
+constexpr auto text_string_type = std::uint8_t{3};
+constexpr auto array_type = std::uint8_t{4};
+constexpr auto map_type = std::uint8_t{5};
+
+constexpr auto indefinite_length = std::uint8_t{31};
+constexpr auto false_byte = '\xF4';
+constexpr auto true_byte = '\xF5';
+constexpr auto null_byte = '\xF6';
+constexpr auto float64_byte = '\xFB';
+constexpr auto break_byte = '\xFF';
+
+} // namespace
+
+CborSerializer::CborSerializer(std::ostream &os, FlushPolicy policy,
+                               const Compression &compression)
+    : out_{os, compression}, policy_{policy} {}
+
+CborSerializer::CborSerializer(int fd, FlushPolicy policy,
+                               const Compression &compression)
+    : out_{fd, compression}, policy_{policy} {}
+
+void CborSerializer::start_array() {
+  start_container(Container{true, true}, array_type, 0);
+}
+
+void CborSerializer::start_array(std::size_t size) {
+  start_container(Container{true, false}, array_type, size);
+}
+
+void CborSerializer::end_array() { end_container(true); }
+
+void CborSerializer::start_object() {
+  start_container(Container{false, true}, map_type, 0);
+}
+
+void CborSerializer::start_object(std::size_t size) {
+  start_container(Container{false, false}, map_type, size);
+}
+
+void CborSerializer::end_object() { end_container(false); }
+
+void CborSerializer::write_key(std::string_view key) {
+  ASSERT(!containers_.empty() && !containers_.back().array_);
+  write_head(text_string_type, key.size());
+  out_.append(key);
+  end_call();
+}
+
+void CborSerializer::write_value(const PrimitiveRef &value) {
+  std::visit([this](const auto &v) { write_primitive(v); }, value);
+  end_call();
+}
+
+// Write the initial bytes of a data item: the major type and either the
+// value itself (if it's small) or the size of the value that follows.
+void CborSerializer::write_head(std::uint8_t major_type,
+                                std::uint64_t value) {
+  static constexpr auto max_immediate = std::uint64_t{23};
+  static constexpr auto one_byte = std::uint8_t{24};
+  const auto type_bits = static_cast<std::uint8_t>(major_type << 5U);
+  if (value <= max_immediate) {
+    out_.append(static_cast<char>(type_bits | value));
+    return;
+  }
+  // The additional info for 1, 2, 4 and 8 byte values is 24 to 27.
+  auto info = one_byte;
+  auto size = std::size_t{1};
+  while (size < sizeof(value) && (value >> (size * 8)) != 0) {
+    ++info;
+    size *= 2;
+  }
+  out_.append(static_cast<char>(type_bits | info));
+  out_.append_big_endian(value, size);
+}
+
+void CborSerializer::write_primitive(std::string_view str) {
+  write_head(text_string_type, str.size());
+  out_.append(str);
+}
+
+void CborSerializer::write_primitive(PrimitiveInt i) {
+  if (i >= 0) {
+    write_head(unsigned_int_type, static_cast<std::uint64_t>(i));
+  } else {
+    // Negative ints are encoded as -1 - i.
+    write_head(negative_int_type, ~static_cast<std::uint64_t>(i));
+  }
+}
+
+void CborSerializer::write_primitive(PrimitiveFloat f) {
+  out_.append(float64_byte);
+  out_.append_big_endian(std::bit_cast<std::uint64_t>(f), sizeof(f));
+}
+
+void CborSerializer::write_primitive(PrimitiveBool b) {
+  out_.append(b ? true_byte : false_byte);
+}
+
+void CborSerializer::write_primitive(SQ_MU const PrimitiveNull &null) {
+  out_.append(null_byte);
+}
+
+void CborSerializer::start_container(Container container,
+                                     std::uint8_t major_type,
+                                     std::uint64_t size) {
+  if (container.indefinite_) {
+    out_.append(static_cast<char>((major_type << 5U) | indefinite_length));
+  } else {
+    write_head(major_type, size);
+  }
+  containers_.push_back(container);
+  end_call();
+}
+
+void CborSerializer::end_container(SQ_MU bool array) {
+  ASSERT(!containers_.empty() && containers_.back().array_ == array);
+  if (containers_.back().indefinite_) {
+    out_.append(break_byte);
+  }
+  containers_.pop_back();
+  end_call();
+}
+
+// Write out the buffered output if the flush policy calls for it.
+void CborSerializer::end_call() {
+  if (containers_.empty()) {
+    out_.finish();
+  } else if (policy_ == FlushPolicy::EveryTopLevelElement &&
+             containers_.size() == 1 && containers_.front().array_) {
+    out_.sync();
+  } else if (policy_ == FlushPolicy::EveryCall || out_.full()) {
+    out_.flush();
+  }
+}
+
+} // namespace sq::results
@@ -0,0 +1,188 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/Compressor.h"
+
+#include "core/ASSERT.h"
+#include "core/errors.h"
+#include "core/narrow.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <fmt/format.h>
+
+#ifdef SQ_COMPRESSION
+#include <zlib.h>
+#include <zstd.h>
+#endif
+
+namespace sq::results {
+
+#ifdef SQ_COMPRESSION
+namespace {
+
+// Make room for at least size more bytes at the end of a buffer, and get a
+// pointer to them. The buffer's size includes the new bytes; shrink it back
+// to the bytes actually used with buffer.resize().
+char *extend(fmt::memory_buffer &buffer, std::size_t size) {
+  const auto old_size = buffer.size();
+  buffer.resize(old_size + size);
+  return buffer.data() + old_size;
+}
+
+class GzipCompressor : public Compressor {
+public:
+  explicit GzipCompressor(int level) {
+    // Adding 16 to the window bits makes zlib write a gzip header and
+    // trailer rather than a zlib wrapper.
+    static constexpr auto window_bits = 15 + 16;
+    static constexpr auto memory_level = 8;
+    const auto rc = deflateInit2(&stream_, level, Z_DEFLATED, window_bits,
+                                 memory_level, Z_DEFAULT_STRATEGY);
+    if (rc != Z_OK) {
+      throw CompressionError{
+          fmt::format("deflateInit2() failed with code {}", rc)};
+    }
+  }
+
+  GzipCompressor(const GzipCompressor &) = delete;
+  GzipCompressor(GzipCompressor &&) = delete;
+  GzipCompressor &operator=(const GzipCompressor &) = delete;
+  GzipCompressor &operator=(GzipCompressor &&) = delete;
+
+  ~GzipCompressor() noexcept override { deflateEnd(&stream_); }
+
+  void compress(std::string_view input, Flush flush,
+                fmt::memory_buffer &out) override {
+    // zlib doesn't modify the input, but only takes a const pointer if
+    // ZLIB_CONST is defined before zlib.h is included.
+    stream_.next_in = const_cast<Bytef *>(              // NOLINT
+        reinterpret_cast<const Bytef *>(input.data())); // NOLINT
+    stream_.avail_in = narrow<uInt>(input.size());
+    const auto mode = flush == Flush::None   ? Z_NO_FLUSH
+                      : flush == Flush::Sync ? Z_SYNC_FLUSH
+                                             : Z_FINISH;
+    for (;;) {
+      // Leave room for the markers that zlib writes when flushing.
+      static constexpr auto flush_overhead = std::size_t{32};
+      const auto space = deflateBound(&stream_, stream_.avail_in) +
+                         flush_overhead;
+      const auto old_size = out.size();
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+      stream_.next_out = reinterpret_cast<Bytef *>(extend(out, space));
+      stream_.avail_out = narrow<uInt>(space);
+      const auto rc = deflate(&stream_, mode);
+      out.resize(old_size + space - stream_.avail_out);
+      if (rc == Z_STREAM_ERROR) {
+        throw CompressionError{"deflate() failed"};
+      }
+      // zlib needs to be called again if it ran out of output space.
+      if (mode == Z_FINISH ? rc == Z_STREAM_END : stream_.avail_out != 0) {
+        break;
+      }
+    }
+    ASSERT(stream_.avail_in == 0);
+    if (flush == Flush::End) {
+      deflateReset(&stream_);
+    }
+  }
+
+private:
+  z_stream stream_{};
+};
+
+class ZstdCompressor : public Compressor {
+public:
+  explicit ZstdCompressor(int level) : context_{ZSTD_createCCtx()} {
+    if (context_ == nullptr) {
+      throw CompressionError{"ZSTD_createCCtx() failed"};
+    }
+    check(ZSTD_CCtx_setParameter(context_, ZSTD_c_compressionLevel, level),
+          "ZSTD_CCtx_setParameter()");
+  }
+
+  ZstdCompressor(const ZstdCompressor &) = delete;
+  ZstdCompressor(ZstdCompressor &&) = delete;
+  ZstdCompressor &operator=(const ZstdCompressor &) = delete;
+  ZstdCompressor &operator=(ZstdCompressor &&) = delete;
+
+  ~ZstdCompressor() noexcept override { ZSTD_freeCCtx(context_); }
+
+  void compress(std::string_view input, Flush flush,
+                fmt::memory_buffer &out) override {
+    auto in = ZSTD_inBuffer{input.data(), input.size(), 0};
+    const auto mode = flush == Flush::None   ? ZSTD_e_continue
+                      : flush == Flush::Sync ? ZSTD_e_flush
+                                             : ZSTD_e_end;
+    for (;;) {
+      const auto space = std::max(ZSTD_compressBound(in.size - in.pos),
+                                  ZSTD_CStreamOutSize());
+      const auto old_size = out.size();
+      auto zstd_out = ZSTD_outBuffer{extend(out, space), space, 0};
+      const auto remaining =
+          check(ZSTD_compressStream2(context_, &zstd_out, &in, mode),
+                "ZSTD_compressStream2()");
+      out.resize(old_size + zstd_out.pos);
+      // When flushing, the return value is the amount of data that zstd
+      // still has to write; otherwise it's just a hint.
+      const auto done = mode == ZSTD_e_continue ? in.pos == in.size
+                                                : remaining == 0;
+      if (done) {
+        break;
+      }
+    }
+  }
+
+private:
+  static std::size_t check(std::size_t rc, std::string_view operation) {
+    if (ZSTD_isError(rc) != 0) {
+      throw CompressionError{fmt::format("{} failed: {}", operation,
+                                         ZSTD_getErrorName(rc))};
+    }
+    return rc;
+  }
+
+  ZSTD_CCtx *context_;
+};
+
+void check_level(int level, int min, int max, std::string_view algorithm) {
+  if (level < min || level > max) {
+    throw OutOfRangeError{
+        fmt::format("{} compression level must be between {} and {}",
+                    algorithm, min, max)};
+  }
+}
+
+} // namespace
+#endif
+
+std::unique_ptr<Compressor> make_compressor(const Compression &compression) {
+  switch (compression.algorithm_) {
+  case CompressionAlgorithm::None:
+    return nullptr;
+#ifdef SQ_COMPRESSION
+  case CompressionAlgorithm::Gzip: {
+    const auto level = compression.level_.value_or(Z_DEFAULT_COMPRESSION);
+    if (compression.level_) {
+      check_level(level, Z_NO_COMPRESSION, Z_BEST_COMPRESSION, "gzip");
+    }
+    return std::make_unique<GzipCompressor>(level);
+  }
+  case CompressionAlgorithm::Zstd: {
+    const auto level = compression.level_.value_or(ZSTD_CLEVEL_DEFAULT);
+    check_level(level, ZSTD_minCLevel(), ZSTD_maxCLevel(), "zstd");
+    return std::make_unique<ZstdCompressor>(level);
+  }
+#else
+  case CompressionAlgorithm::Gzip:
+  case CompressionAlgorithm::Zstd:
+    throw CompressionError{"sq was built without compression support"};
+#endif
+  }
+  ASSERT(false);
+  return nullptr;
+}
+
+} // namespace sq::results
@@ -0,0 +1,247 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/Delta.h"
+
+#include "core/typeutil.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <unordered_map>
+
+namespace sq::results {
+
+namespace {
+
+using Kind = DeltaWriter::Kind;
+using Node = DeltaWriter::Node;
+using Path = std::vector<Primitive>;
+
+// 64 bit FNV-1a.
+class Hasher {
+public:
+  void add(std::uint64_t value) noexcept {
+    for (auto i = 0; i < 8; ++i) {
+      add_byte(static_cast<std::uint8_t>(value >> (i * 8)));
+    }
+  }
+
+  void add(std::string_view str) noexcept {
+    add(str.size());
+    for (const char c : str) {
+      add_byte(static_cast<std::uint8_t>(c));
+    }
+  }
+
+  void add(const Primitive &value) noexcept {
+    add(value.index());
+    std::visit([this](const auto &v) { add_alternative(v); }, value);
+  }
+
+  SQ_ND std::uint64_t value() const noexcept { return value_; }
+
+private:
+  void add_alternative(const PrimitiveString &s) noexcept {
+    add(std::string_view{s});
+  }
+  void add_alternative(PrimitiveInt i) noexcept {
+    add(static_cast<std::uint64_t>(i));
+  }
+  void add_alternative(PrimitiveFloat f) noexcept {
+    add(std::bit_cast<std::uint64_t>(f));
+  }
+  void add_alternative(PrimitiveBool b) noexcept {
+    add(static_cast<std::uint64_t>(b));
+  }
+  void add_alternative(SQ_MU const PrimitiveNull &pn) noexcept {}
+
+  void add_byte(std::uint8_t byte) noexcept {
+    static constexpr auto prime = std::uint64_t{0x100000001b3};
+    value_ = (value_ ^ byte) * prime;
+  }
+
+  static constexpr auto offset_basis = std::uint64_t{0xcbf29ce484222325};
+  std::uint64_t value_ = offset_basis;
+};
+
+struct PrimitiveHash {
+  std::size_t operator()(const Primitive &value) const noexcept {
+    auto hasher = Hasher{};
+    hasher.add(value);
+    return static_cast<std::size_t>(hasher.value());
+  }
+};
+
+// Map from the identities of a node's children to their positions.
+using ChildMap = std::unordered_map<Primitive, std::size_t, PrimitiveHash>;
+
+SQ_ND ChildMap map_children(const Node &node) {
+  auto map = ChildMap{};
+  map.reserve(node.children_.size());
+  for (auto i = std::size_t{0}; i < node.children_.size(); ++i) {
+    map.emplace(node.children_[i].id_, i);
+  }
+  return map;
+}
+
+SQ_ND Primitive element_id(const ResultValue &element, std::size_t pos) {
+  if (const auto *primitive = std::get_if<Primitive>(&element.value_)) {
+    return *primitive;
+  }
+  if (const auto *object = std::get_if<ResultValue::Object>(&element.value_)) {
+    if (!object->empty()) {
+      if (const auto *first =
+              std::get_if<Primitive>(&object->front().second.value_)) {
+        return *first;
+      }
+    }
+  }
+  return to_primitive_int(pos);
+}
+
+SQ_ND Node summarize(const ResultValue &value, Primitive id) {
+  auto node = Node{std::move(id), 0, Kind::Primitive, {}};
+  auto hasher = Hasher{};
+  if (const auto *primitive = std::get_if<Primitive>(&value.value_)) {
+    hasher.add(*primitive);
+  } else if (const auto *array =
+                 std::get_if<ResultValue::Array>(&value.value_)) {
+    node.kind_ = Kind::Array;
+    node.children_.reserve(array->size());
+    for (auto i = std::size_t{0}; i < array->size(); ++i) {
+      node.children_.push_back(
+          summarize((*array)[i], element_id((*array)[i], i)));
+    }
+    if (map_children(node).size() != node.children_.size()) {
+      for (auto i = std::size_t{0}; i < array->size(); ++i) {
+        node.children_[i].id_ = to_primitive_int(i);
+      }
+    }
+  } else {
+    node.kind_ = Kind::Object;
+    const auto &object = std::get<ResultValue::Object>(value.value_);
+    node.children_.reserve(object.size());
+    for (const auto &[key, element] : object) {
+      node.children_.push_back(summarize(element, key));
+    }
+  }
+  hasher.add(static_cast<std::uint64_t>(node.kind_));
+  for (const auto &child : node.children_) {
+    hasher.add(child.id_);
+    hasher.add(child.hash_);
+  }
+  node.hash_ = hasher.value();
+  return node;
+}
+
+SQ_ND const ResultValue &child_value(const ResultValue &value,
+                                     std::size_t pos) {
+  if (const auto *array = std::get_if<ResultValue::Array>(&value.value_)) {
+    return (*array)[pos];
+  }
+  return std::get<ResultValue::Object>(value.value_)[pos].second;
+}
+
+class DeltaBuilder {
+public:
+  struct Change {
+    std::string_view op_;
+    Path path_;
+    const ResultValue *value_;
+  };
+
+  void add(Path path, const ResultValue &value) {
+    changes_.push_back(Change{"add", std::move(path), &value});
+  }
+
+  void diff(const Node &previous, const Node &current,
+            const ResultValue &value, Path &path) {
+    if (previous.hash_ == current.hash_) {
+      return;
+    }
+    if (previous.kind_ != current.kind_ || current.kind_ == Kind::Primitive) {
+      changes_.push_back(Change{"change", path, &value});
+      return;
+    }
+
+    auto previous_children = map_children(previous);
+    for (auto i = std::size_t{0}; i < current.children_.size(); ++i) {
+      const auto &child = current.children_[i];
+      path.push_back(child.id_);
+      const auto it = previous_children.find(child.id_);
+      if (it == previous_children.end()) {
+        add(path, child_value(value, i));
+      } else {
+        diff(previous.children_[it->second], child, child_value(value, i),
+             path);
+        previous_children.erase(it);
+      }
+      path.pop_back();
+    }
+
+    // Write the removals in the order of the previous results.
+    auto removed = std::vector<std::size_t>{};
+    removed.reserve(previous_children.size());
+    for (const auto &entry : previous_children) {
+      removed.push_back(entry.second);
+    }
+    std::sort(removed.begin(), removed.end());
+    for (const auto pos : removed) {
+      path.push_back(previous.children_[pos].id_);
+      changes_.push_back(Change{"remove", path, nullptr});
+      path.pop_back();
+    }
+  }
+
+  SQ_ND bool empty() const noexcept { return changes_.empty(); }
+
+  void write(Serializer &serializer) const {
+    serializer.start_array();
+    for (const auto &change : changes_) {
+      serializer.start_object();
+      serializer.write_key("op");
+      serializer.write_value(PrimitiveString{change.op_});
+      serializer.write_key("path");
+      serializer.start_array();
+      for (const auto &id : change.path_) {
+        serializer.write_value(id);
+      }
+      serializer.end_array();
+      if (change.value_ != nullptr) {
+        serializer.write_key("value");
+        write_result_value(*change.value_, serializer);
+      }
+      serializer.end_object();
+    }
+    serializer.end_array();
+  }
+
+private:
+  std::vector<Change> changes_;
+};
+
+} // namespace
+
+bool DeltaWriter::write_delta(const ResultValue &current,
+                              Serializer &serializer) {
+  auto summary = summarize(current, primitive_null);
+  auto builder = DeltaBuilder{};
+  if (previous_) {
+    auto path = Path{};
+    builder.diff(*previous_, summary, current, path);
+  } else {
+    builder.add(Path{}, current);
+  }
+  previous_ = std::move(summary);
+
+  if (builder.empty()) {
+    return false;
+  }
+  builder.write(serializer);
+  return true;
+}
+
+} // namespace sq::results
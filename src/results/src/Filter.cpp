@@ -12,6 +12,7 @@
 #include "core/narrow.h"
 #include "core/typeutil.h"
 
+#include <compare>
 #include <fmt/format.h>
 #include <functional>
 #include <gsl/gsl>
@@ -24,6 +25,7 @@
 #include <range/v3/view/reverse.hpp>
 #include <range/v3/view/stride.hpp>
 #include <range/v3/view/take.hpp>
+#include <string_view>
 
 namespace sq::results {
 
@@ -38,6 +40,24 @@ SQ_ND Result to_result(ranges::cpp20::range auto &&rng) {
   return FieldRange<ranges::get_categories<decltype(rng)>()>{SQ_FWD(rng)};
 }
 
+SQ_ND bool satisfies(parser::ComparisonOperator op,
+                     std::strong_ordering ordering) {
+  switch (op) {
+  case parser::ComparisonOperator::GreaterThanOrEqualTo:
+    return ordering >= 0;
+  case parser::ComparisonOperator::GreaterThan:
+    return ordering > 0;
+  case parser::ComparisonOperator::LessThanOrEqualTo:
+    return ordering <= 0;
+  case parser::ComparisonOperator::LessThan:
+    return ordering < 0;
+  case parser::ComparisonOperator::Equals:
+    return ordering == 0;
+  }
+  ASSERT(false);
+  throw InternalError{"Invalid comparison operator"};
+}
+
 template <Alternative<parser::FilterSpec> Spec> struct FilterImpl;
 
 template <> struct FilterImpl<parser::NoFilterSpec> : Filter {
@@ -353,23 +373,26 @@ private:
   }
 
   SQ_ND bool compare(const FieldPtr &field) const {
-    auto member_value = get_member(field)->to_primitive();
+    const auto member = get_member(field);
+    auto storage = Primitive{};
+    const auto member_value = member->to_primitive_ref(storage);
+    const auto value = primitive_ref(spec_.value_);
     switch (spec_.op_) {
     case parser::ComparisonOperator::GreaterThanOrEqualTo:
       // https://bugs.llvm.org/show_bug.cgi?id=46235
       // NOLINTNEXTLINE(hicpp-use-nullptr,modernize-use-nullptr)
-      return member_value >= spec_.value_;
+      return member_value >= value;
     case parser::ComparisonOperator::GreaterThan:
       // NOLINTNEXTLINE(hicpp-use-nullptr,modernize-use-nullptr)
-      return member_value > spec_.value_;
+      return member_value > value;
     case parser::ComparisonOperator::LessThanOrEqualTo:
       // NOLINTNEXTLINE(hicpp-use-nullptr,modernize-use-nullptr)
-      return member_value <= spec_.value_;
+      return member_value <= value;
     case parser::ComparisonOperator::LessThan:
       // NOLINTNEXTLINE(hicpp-use-nullptr,modernize-use-nullptr)
-      return member_value < spec_.value_;
+      return member_value < value;
     case parser::ComparisonOperator::Equals:
-      return member_value == spec_.value_;
+      return member_value == value;
     }
     ASSERT(false);
     throw InternalError{"Invalid comparison operator"};
@@ -391,4 +414,20 @@ FilterPtr Filter::create(const parser::FilterSpec &spec) {
   return std::visit(FilterCreatorVisitor{}, spec);
 }
 
+FieldCallHints::StringPredicate
+string_comparison_predicate(const parser::ComparisonSpec &spec) {
+  const auto op = spec.op_;
+  if (const auto *value = std::get_if<PrimitiveString>(&spec.value_)) {
+    return [op, value = *value](std::string_view str) {
+      return satisfies(op, str <=> std::string_view{value});
+    };
+  }
+
+  // Primitives holding different types are ordered by the index of the type
+  // in the Primitive variant, so the result doesn't depend on the string.
+  const auto string_index = Primitive{PrimitiveString{}}.index();
+  const auto result = satisfies(op, string_index <=> spec.value_.index());
+  return [result](SQ_MU std::string_view str) { return result; };
+}
+
 } // namespace sq::results
@@ -0,0 +1,222 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/JsonWriter.h"
+
+#include "core/ASSERT.h"
+#include "results/json_escape.h"
+
+#include <iterator>
+#include <variant>
+
+namespace sq::results {
+
+namespace {
+
+// Get the escape sequence for a character found by find_json_escape(), or
+// "\\u" if it must be written as a \u escape with its code point.
+SQ_ND std::string_view json_escape_sequence(char c) noexcept {
+  switch (c) {
+  case '"':
+    return "\\\"";
+  case '\\':
+    return "\\\\";
+  case '\b':
+    return "\\b";
+  case '\f':
+    return "\\f";
+  case '\n':
+    return "\\n";
+  case '\r':
+    return "\\r";
+  case '\t':
+    return "\\t";
+  default:
+    return "\\u";
+  }
+}
+
+void append(fmt::memory_buffer &buffer, std::string_view str) {
+  buffer.append(str.data(), str.data() + str.size());
+}
+
+} // namespace
+
+void JsonWriter::start_array() {
+  prepare_for_value();
+  open_container(State::Array);
+  out_->push_back('[');
+}
+
+void JsonWriter::end_array() {
+  close_container(State::Array);
+  out_->push_back(']');
+}
+
+void JsonWriter::start_object() {
+  prepare_for_value();
+  open_container(State::Object);
+  out_->push_back('{');
+}
+
+void JsonWriter::end_object() {
+  close_container(State::Object);
+  out_->push_back('}');
+}
+
+void JsonWriter::write_key(std::string_view key) {
+  check_key();
+  if (nonempty_) {
+    out_->push_back(',');
+  }
+  append_string(*out_, key);
+  out_->push_back(':');
+  after_key();
+}
+
+void JsonWriter::write_key(const PreparedKey &key) {
+  check_key();
+  // The prepared key starts with the separator from the previous member.
+  auto json = key.json();
+  if (!nonempty_) {
+    json.remove_prefix(1);
+  }
+  append(*out_, json);
+  after_key();
+}
+
+void JsonWriter::write_value(const PrimitiveRef &value) {
+  prepare_for_value();
+  std::visit([this](const auto &v) { write_primitive(v); }, value);
+  after_value();
+}
+
+void JsonWriter::write_rendered(std::string_view json) {
+  prepare_for_value();
+  append(*out_, json);
+  after_value();
+}
+
+void JsonWriter::reset() noexcept {
+  ASSERT(done_);
+  nonempty_ = false;
+  top_level_array_ = false;
+  done_ = false;
+}
+
+void JsonWriter::append_string(fmt::memory_buffer &buffer,
+                               std::string_view str) {
+  buffer.push_back('\"');
+  // Copy runs of characters that don't need escaping in one go.
+  for (;;) {
+    const auto pos = find_json_escape(str);
+    append(buffer, str.substr(0, pos));
+    if (pos == str.size()) {
+      break;
+    }
+    const auto escaped = json_escape_sequence(str[pos]);
+    if (escaped == "\\u") {
+      fmt::format_to(std::back_inserter(buffer), "\\u{:04x}",
+                     static_cast<unsigned>(str[pos]));
+    } else {
+      append(buffer, escaped);
+    }
+    str.remove_prefix(pos + 1);
+  }
+  buffer.push_back('\"');
+}
+
+void JsonWriter::write_primitive(std::string_view str) {
+  append_string(*out_, str);
+}
+
+void JsonWriter::write_primitive(PrimitiveInt i) {
+  fmt::format_to(std::back_inserter(*out_), "{}", i);
+}
+
+void JsonWriter::write_primitive(PrimitiveBool b) {
+  append(*out_, b ? "true" : "false");
+}
+
+void JsonWriter::write_primitive(PrimitiveFloat f) {
+  auto &buffer = *out_;
+  const auto start = buffer.size();
+  fmt::format_to(std::back_inserter(buffer), "{}", f);
+  // Make sure we always either:
+  // * use scientific notation; or
+  // * have at least one digit after the decimal point.
+  // This hints to consumers that the number should be interpreted as a
+  // real number rather than an integer.
+  const auto formatted =
+      std::string_view{buffer.data() + start, buffer.size() - start};
+  if (formatted.find_first_of("e.") == std::string_view::npos) {
+    append(*out_, ".0");
+  }
+}
+
+void JsonWriter::write_primitive(SQ_MU const PrimitiveNull &null) {
+  append(*out_, "null");
+}
+
+// Write the separator before a value: a comma if it isn't the first element
+// of an array. The separator before an object member's value is part of the
+// key.
+void JsonWriter::prepare_for_value() {
+  check_value();
+  if (after_key_) {
+    after_key_ = false;
+  } else if (nonempty_) {
+    out_->push_back(',');
+  }
+  nonempty_ = true;
+}
+
+void JsonWriter::after_key() noexcept {
+  nonempty_ = true;
+  after_key_ = true;
+}
+
+void JsonWriter::after_value() noexcept {
+  if (depth_ == 0) {
+    done_ = true;
+  }
+}
+
+void JsonWriter::open_container(State state) {
+  if (depth_ == 0) {
+    top_level_array_ = (state == State::Array);
+  }
+  ++depth_;
+  nonempty_ = false;
+#ifndef NDEBUG
+  states_.push_back(state);
+#endif
+}
+
+// Close a container. Whatever contains it is now nonempty.
+void JsonWriter::close_container(SQ_MU State state) {
+#ifndef NDEBUG
+  ASSERT(!states_.empty() && states_.back() == state && !after_key_);
+  states_.pop_back();
+#endif
+  --depth_;
+  nonempty_ = true;
+  after_value();
+}
+
+void JsonWriter::check_key() const {
+#ifndef NDEBUG
+  ASSERT(!states_.empty() && states_.back() == State::Object && !after_key_);
+#endif
+}
+
+void JsonWriter::check_value() const {
+#ifndef NDEBUG
+  ASSERT(!done_);
+  ASSERT(states_.empty() || states_.back() == State::Array || after_key_);
+#endif
+}
+
+} // namespace sq::results
@@ -0,0 +1,145 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/LimitedSerializer.h"
+
+#include "core/ASSERT.h"
+
+#include <utility>
+
+namespace sq::results {
+
+// Passes calls on to a capture of the other serializer, counting the array
+// elements in the captured value.
+class LimitedSerializer::Capture : public ValueCapture {
+public:
+  using Serializer::start_array;
+  using Serializer::start_object;
+  using Serializer::write_value;
+
+  Capture(LimitedSerializer &target, std::unique_ptr<ValueCapture> capture)
+      : target_{&target}, capture_{std::move(capture)} {}
+
+  void start_array() override { counter_.start_array(); }
+  void start_array(std::size_t size) override { counter_.start_array(size); }
+  void end_array() override { counter_.end_array(); }
+  void start_object() override { counter_.start_object(); }
+  void start_object(std::size_t size) override {
+    counter_.start_object(size);
+  }
+  void end_object() override { counter_.end_object(); }
+  void write_key(std::string_view key) override { counter_.write_key(key); }
+  void write_key(const PreparedKey &key) override { counter_.write_key(key); }
+
+  void write_value(const PrimitiveRef &value) override {
+    counter_.write_value(value);
+  }
+
+  void splice() override {
+    capture_->splice();
+    target_->elements_ += std::exchange(counter_.elements_, 0);
+    target_->after_value();
+  }
+
+private:
+  LimitedSerializer *target_;
+  std::unique_ptr<ValueCapture> capture_;
+  LimitedSerializer counter_{*capture_, OutputLimits{},
+                             std::stop_source{std::nostopstate}};
+};
+
+LimitedSerializer::LimitedSerializer(Serializer &serializer,
+                                     const OutputLimits &limits,
+                                     std::stop_source source)
+    : serializer_{&serializer}, limits_{limits}, source_{std::move(source)} {}
+
+void LimitedSerializer::start_array() {
+  serializer_->start_array();
+  open(true);
+}
+
+void LimitedSerializer::start_array(std::size_t size) {
+  serializer_->start_array(size);
+  open(true);
+}
+
+void LimitedSerializer::end_array() {
+  serializer_->end_array();
+  close();
+}
+
+void LimitedSerializer::start_object() {
+  serializer_->start_object();
+  open(false);
+}
+
+void LimitedSerializer::start_object(std::size_t size) {
+  serializer_->start_object(size);
+  open(false);
+}
+
+void LimitedSerializer::end_object() {
+  serializer_->end_object();
+  close();
+}
+
+void LimitedSerializer::write_key(std::string_view key) {
+  serializer_->write_key(key);
+  check_limits();
+}
+
+void LimitedSerializer::write_key(const PreparedKey &key) {
+  serializer_->write_key(key);
+  check_limits();
+}
+
+void LimitedSerializer::write_value(const PrimitiveRef &value) {
+  serializer_->write_value(value);
+  after_value();
+}
+
+std::unique_ptr<ValueCapture> LimitedSerializer::capture() {
+  return std::make_unique<Capture>(*this, serializer_->capture());
+}
+
+std::size_t LimitedSerializer::output_size() const noexcept {
+  return serializer_->output_size();
+}
+
+void LimitedSerializer::open(bool array) {
+  arrays_.push_back(array);
+  check_limits();
+}
+
+void LimitedSerializer::close() {
+  ASSERT(!arrays_.empty());
+  arrays_.pop_back();
+  after_value();
+}
+
+// Count the value that has just been completed if it's an array element.
+void LimitedSerializer::after_value() {
+  if (!arrays_.empty() && arrays_.back()) {
+    ++elements_;
+  }
+  check_limits();
+}
+
+void LimitedSerializer::check_limits() {
+  if (limit_reached_) {
+    return;
+  }
+  const auto reached = [](const std::optional<std::size_t> &limit,
+                          std::size_t value) {
+    return limit && value >= *limit;
+  };
+  if (reached(limits_.max_elements_, elements_) ||
+      reached(limits_.max_bytes_, serializer_->output_size())) {
+    limit_reached_ = true;
+    (void)source_.request_stop();
+  }
+}
+
+} // namespace sq::results
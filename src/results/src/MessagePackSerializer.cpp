@@ -0,0 +1,249 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/MessagePackSerializer.h"
+
+#include "core/ASSERT.h"
+#include "core/errors.h"
+#include "core/typeutil.h"
+
+#include <array>
+#include <bit>
+#include <limits>
+#include <string_view>
+#include <variant>
+
+namespace sq::results {
+
+namespace {
+
+constexpr auto max_positive_fixint = PrimitiveInt{0x7F};
+constexpr auto min_negative_fixint = PrimitiveInt{-32};
+constexpr auto max_fixstr_size = std::size_t{31};
+constexpr auto max_fixcontainer_size = std::size_t{15};
+constexpr auto max_uint8 =
+    std::uint64_t{std::numeric_limits<std::uint8_t>::max()};
+constexpr auto max_uint16 =
+    std::uint64_t{std::numeric_limits<std::uint16_t>::max()};
+constexpr auto max_uint32 =
+    std::uint64_t{std::numeric_limits<std::uint32_t>::max()};
+
+constexpr auto fixarray_byte = std::uint8_t{0x90};
+constexpr auto fixmap_byte = std::uint8_t{0x80};
+constexpr auto fixstr_byte = std::uint8_t{0xA0};
+constexpr auto nil_byte = '\xC0';
+constexpr auto false_byte = '\xC2';
+constexpr auto true_byte = '\xC3';
+constexpr auto float64_byte = '\xCB';
+constexpr auto uint8_byte = '\xCC';
+constexpr auto uint16_byte = '\xCD';
+constexpr auto uint32_byte = '\xCE';
+constexpr auto uint64_byte = '\xCF';
+constexpr auto int8_byte = '\xD0';
+constexpr auto int16_byte = '\xD1';
+constexpr auto int32_byte = '\xD2';
+constexpr auto int64_byte = '\xD3';
+constexpr auto str8_byte = '\xD9';
+constexpr auto str16_byte = '\xDA';
+constexpr auto str32_byte = '\xDB';
+constexpr auto array16_byte = '\xDC';
+constexpr auto array32_byte = '\xDD';
+constexpr auto map16_byte = '\xDE';
+constexpr auto map32_byte = '\xDF';
+
+constexpr auto size32_header_size = std::size_t{5};
+
+SQ_ND std::uint64_t checked_size(std::uint64_t size) {
+  if (size > max_uint32) {
+    throw OutOfRangeError{
+        "MessagePack containers and strings are limited to 2^32-1 elements"};
+  }
+  return size;
+}
+
+} // namespace
+
+MessagePackSerializer::MessagePackSerializer(std::ostream &os,
+                                             FlushPolicy policy,
+                                             const Compression &compression)
+    : out_{os, compression}, policy_{policy} {}
+
+MessagePackSerializer::MessagePackSerializer(int fd, FlushPolicy policy,
+                                             const Compression &compression)
+    : out_{fd, compression}, policy_{policy} {}
+
+void MessagePackSerializer::start_array() {
+  start_container(true, std::nullopt);
+}
+
+void MessagePackSerializer::start_array(std::size_t size) {
+  start_container(true, size);
+}
+
+void MessagePackSerializer::end_array() { end_container(true); }
+
+void MessagePackSerializer::start_object() {
+  start_container(false, std::nullopt);
+}
+
+void MessagePackSerializer::start_object(std::size_t size) {
+  start_container(false, size);
+}
+
+void MessagePackSerializer::end_object() { end_container(false); }
+
+void MessagePackSerializer::write_key(std::string_view key) {
+  ASSERT(!containers_.empty() && !containers_.back().array_);
+  ++containers_.back().size_;
+  write_string(key);
+  end_call();
+}
+
+void MessagePackSerializer::write_value(const PrimitiveRef &value) {
+  count_element();
+  std::visit([this](const auto &v) { write_primitive(v); }, value);
+  end_call();
+}
+
+void MessagePackSerializer::write_string(std::string_view str) {
+  const auto size = checked_size(str.size());
+  if (size <= max_fixstr_size) {
+    out_.append(static_cast<char>(fixstr_byte | size));
+  } else if (size <= max_uint8) {
+    out_.append(str8_byte);
+    out_.append_big_endian(size, 1);
+  } else if (size <= max_uint16) {
+    out_.append(str16_byte);
+    out_.append_big_endian(size, 2);
+  } else {
+    out_.append(str32_byte);
+    out_.append_big_endian(size, 4);
+  }
+  out_.append(str);
+}
+
+void MessagePackSerializer::write_primitive(std::string_view str) {
+  write_string(str);
+}
+
+void MessagePackSerializer::write_primitive(PrimitiveInt i) {
+  const auto bits = static_cast<std::uint64_t>(i);
+  if (min_negative_fixint <= i && i <= max_positive_fixint) {
+    out_.append(static_cast<char>(bits & 0xFF));
+  } else if (i >= 0) {
+    if (bits <= max_uint8) {
+      out_.append(uint8_byte);
+      out_.append_big_endian(bits, 1);
+    } else if (bits <= max_uint16) {
+      out_.append(uint16_byte);
+      out_.append_big_endian(bits, 2);
+    } else if (bits <= max_uint32) {
+      out_.append(uint32_byte);
+      out_.append_big_endian(bits, 4);
+    } else {
+      out_.append(uint64_byte);
+      out_.append_big_endian(bits, 8);
+    }
+  } else if (i >= std::numeric_limits<std::int8_t>::min()) {
+    out_.append(int8_byte);
+    out_.append_big_endian(bits, 1);
+  } else if (i >= std::numeric_limits<std::int16_t>::min()) {
+    out_.append(int16_byte);
+    out_.append_big_endian(bits, 2);
+  } else if (i >= std::numeric_limits<std::int32_t>::min()) {
+    out_.append(int32_byte);
+    out_.append_big_endian(bits, 4);
+  } else {
+    out_.append(int64_byte);
+    out_.append_big_endian(bits, 8);
+  }
+}
+
+void MessagePackSerializer::write_primitive(PrimitiveFloat f) {
+  out_.append(float64_byte);
+  out_.append_big_endian(std::bit_cast<std::uint64_t>(f), sizeof(f));
+}
+
+void MessagePackSerializer::write_primitive(PrimitiveBool b) {
+  out_.append(b ? true_byte : false_byte);
+}
+
+void MessagePackSerializer::write_primitive(SQ_MU const PrimitiveNull &null) {
+  out_.append(nil_byte);
+}
+
+void MessagePackSerializer::start_container(bool array,
+                                            std::optional<std::size_t> size) {
+  count_element();
+  if (!size) {
+    // Leave space for a 32 bit size, to be filled in by end_container().
+    containers_.push_back(Container{array, out_.size(), 0});
+    out_.append_big_endian(0, size32_header_size);
+    ++unsized_containers_;
+    end_call();
+    return;
+  }
+
+  const auto checked = checked_size(*size);
+  if (checked <= max_fixcontainer_size) {
+    out_.append(
+        static_cast<char>((array ? fixarray_byte : fixmap_byte) | checked));
+  } else if (checked <= max_uint16) {
+    out_.append(array ? array16_byte : map16_byte);
+    out_.append_big_endian(checked, 2);
+  } else {
+    out_.append(array ? array32_byte : map32_byte);
+    out_.append_big_endian(checked, 4);
+  }
+  containers_.push_back(Container{array, std::nullopt, 0});
+  end_call();
+}
+
+void MessagePackSerializer::end_container(SQ_MU bool array) {
+  ASSERT(!containers_.empty() && containers_.back().array_ == array);
+  const auto container = containers_.back();
+  containers_.pop_back();
+  if (container.header_pos_) {
+    // Fill in the header at the start of the container.
+    auto header = std::array<char, size32_header_size>{};
+    header[0] = container.array_ ? array32_byte : map32_byte;
+    const auto size = checked_size(container.size_);
+    for (auto i = std::size_t{1}; i < size32_header_size; ++i) {
+      header[i] = static_cast<char>(
+          (size >> ((size32_header_size - 1 - i) * 8)) & 0xFF);
+    }
+    out_.patch(*container.header_pos_,
+               std::string_view{header.data(), header.size()});
+    --unsized_containers_;
+  }
+  end_call();
+}
+
+// Count an element of the current container, if it's an array. Members of
+// objects are counted by their keys.
+void MessagePackSerializer::count_element() {
+  if (!containers_.empty() && containers_.back().array_) {
+    ++containers_.back().size_;
+  }
+}
+
+// Write out the buffered output if the flush policy calls for it. Unless
+// written output can be patched, output can't be written while the header of
+// a container might still be filled in.
+void MessagePackSerializer::end_call() {
+  if (unsized_containers_ != 0 && !out_.can_patch()) {
+    return;
+  }
+  if (containers_.empty()) {
+    out_.finish();
+  } else if (policy_ == FlushPolicy::EveryTopLevelElement &&
+             containers_.size() == 1 && containers_.front().array_) {
+    out_.sync();
+  } else if (policy_ == FlushPolicy::EveryCall || out_.full()) {
+    out_.flush();
+  }
+}
+
+} // namespace sq::results
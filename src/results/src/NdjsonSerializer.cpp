@@ -0,0 +1,153 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/NdjsonSerializer.h"
+
+#include "core/ASSERT.h"
+
+#include <utility>
+
+namespace sq::results {
+
+NdjsonSerializer::NdjsonSerializer(std::ostream &os,
+                                   std::vector<std::string> list_path,
+                                   std::chrono::milliseconds flush_interval,
+                                   const Compression &compression)
+    : out_{os, compression}, path_{std::move(list_path)},
+      flush_interval_{flush_interval} {}
+
+NdjsonSerializer::NdjsonSerializer(int fd, std::vector<std::string> list_path,
+                                   std::chrono::milliseconds flush_interval,
+                                   const Compression &compression)
+    : out_{fd, compression}, path_{std::move(list_path)},
+      flush_interval_{flush_interval} {}
+
+void NdjsonSerializer::start_array() {
+  if (in_line()) {
+    writer_.start_array();
+    end_line_call();
+    return;
+  }
+  start_container(path_.empty() || selected() ? Kind::Lines : Kind::Array);
+}
+
+void NdjsonSerializer::end_array() {
+  if (writer_.depth() > 0) {
+    writer_.end_array();
+    end_line_call();
+    return;
+  }
+  end_container();
+}
+
+void NdjsonSerializer::start_object() {
+  // Without a list path, objects outside of lists are searched for lists
+  // rather than written.
+  if (in_line() || (!path_.empty() && selected())) {
+    writer_.start_object();
+    end_line_call();
+    return;
+  }
+  start_container(Kind::Object);
+}
+
+void NdjsonSerializer::end_object() {
+  if (writer_.depth() > 0) {
+    writer_.end_object();
+    end_line_call();
+    return;
+  }
+  end_container();
+}
+
+void NdjsonSerializer::write_key(std::string_view key) {
+  if (writer_.depth() > 0) {
+    writer_.write_key(key);
+    end_line_call();
+    return;
+  }
+  ASSERT(!containers_.empty() && containers_.back().kind_ == Kind::Object);
+  const auto matched = containers_.back().matched_;
+  key_matched_ = matched < path_.size() && key == path_[matched];
+}
+
+void NdjsonSerializer::write_key(const PreparedKey &key) {
+  if (writer_.depth() > 0) {
+    writer_.write_key(key);
+    end_line_call();
+    return;
+  }
+  write_key(key.name());
+}
+
+void NdjsonSerializer::write_value(const PrimitiveRef &value) {
+  if (in_line() || selected()) {
+    writer_.write_value(value);
+    end_line_call();
+  }
+}
+
+// Get whether the next value is part of a line.
+bool NdjsonSerializer::in_line() const noexcept {
+  return writer_.depth() > 0 ||
+         (!containers_.empty() && containers_.back().kind_ == Kind::Lines);
+}
+
+// Get whether the next value is the one at the end of the list path.
+bool NdjsonSerializer::selected() const noexcept {
+  return next_matched() == path_.size();
+}
+
+// Get the number of components of the list path that lead to the next
+// value, or no_match if it isn't on the path.
+std::size_t NdjsonSerializer::next_matched() const noexcept {
+  if (containers_.empty()) {
+    return 0;
+  }
+  const auto &container = containers_.back();
+  if (container.kind_ == Kind::Object && key_matched_) {
+    return container.matched_ + 1;
+  }
+  return no_match;
+}
+
+void NdjsonSerializer::start_container(Kind kind) {
+  containers_.push_back(Container{kind, next_matched()});
+}
+
+void NdjsonSerializer::end_container() {
+  ASSERT(!containers_.empty());
+  containers_.pop_back();
+  if (containers_.empty()) {
+    out_.finish();
+  }
+}
+
+// End a line if the last call completed one, and write out the buffered
+// output if it's full, if the results are complete or if the flush interval
+// has passed.
+void NdjsonSerializer::end_line_call() {
+  if (!writer_.done()) {
+    if (out_.full()) {
+      out_.flush();
+    }
+    return;
+  }
+  out_.append('\n');
+  writer_.reset();
+  const auto now = Clock::now();
+  const auto since_flush =
+      std::chrono::duration_cast<std::chrono::milliseconds>(now - last_flush_);
+  if (containers_.empty()) {
+    out_.finish();
+  } else if (since_flush >= flush_interval_) {
+    out_.sync();
+    last_flush_ = now;
+  } else if (out_.full()) {
+    out_.flush();
+  }
+}
+
+} // namespace sq::results
@@ -0,0 +1,188 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/OutputBuffer.h"
+
+#include "core/ASSERT.h"
+#include "core/errors.h"
+#include "core/narrow.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <ios>
+#include <ostream>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sq::results {
+
+namespace {
+
+// Get the current offset of a file descriptor if it's a regular file that
+// isn't open for appending, so that pwrite(2) can change what's been written.
+std::optional<off_t> patchable_offset(int fd) {
+  struct stat s = {};
+  if (fstat(fd, &s) == -1 || !S_ISREG(s.st_mode)) {
+    return std::nullopt;
+  }
+  const auto flags = fcntl(fd, F_GETFL);
+  if (flags == -1 || (flags & O_APPEND) != 0) {
+    return std::nullopt;
+  }
+  const auto offset = lseek(fd, 0, SEEK_CUR);
+  if (offset == -1) {
+    return std::nullopt;
+  }
+  return offset;
+}
+
+} // namespace
+
+OutputBuffer::OutputBuffer(int fd, const Compression &compression,
+                           std::size_t capacity)
+    : destination_{fd}, capacity_{capacity},
+      compressor_{make_compressor(compression)} {
+  buffer_.reserve(capacity);
+  if (!compressor_) {
+    file_offset_ = patchable_offset(fd);
+  }
+}
+
+OutputBuffer::OutputBuffer(std::ostream &os, const Compression &compression,
+                           std::size_t capacity)
+    : destination_{&os}, capacity_{capacity},
+      compressor_{make_compressor(compression)} {
+  buffer_.reserve(capacity);
+}
+
+OutputBuffer::~OutputBuffer() noexcept {
+  try {
+    finish();
+  } catch (...) {
+    // There's nowhere to report the error.
+  }
+}
+
+void OutputBuffer::flush() {
+  if (!compressor_) {
+    write_uncompressed(true);
+    return;
+  }
+  if (buffer_.size() != 0) {
+    compress(Compressor::Flush::None);
+  }
+  if (compressed_.size() >= capacity_) {
+    write(compressed_);
+  }
+}
+
+void OutputBuffer::sync() {
+  if (!compressor_) {
+    write_uncompressed(true);
+  } else {
+    if (compressing_ || buffer_.size() != 0) {
+      compress(Compressor::Flush::Sync);
+    }
+    write(compressed_);
+  }
+  // Pass the output on from the stream's own buffer too, e.g. to the writer
+  // thread of an OutputPipeline.
+  if (auto *const *os = std::get_if<std::ostream *>(&destination_)) {
+    (*os)->flush();
+  }
+}
+
+void OutputBuffer::finish() {
+  if (!compressor_) {
+    write_uncompressed(false);
+    return;
+  }
+  if (compressing_ || buffer_.size() != 0) {
+    compress(Compressor::Flush::End);
+    compressing_ = false;
+  }
+  write(compressed_);
+}
+
+void OutputBuffer::patch(std::size_t pos, std::string_view bytes) {
+  ASSERT(pos + bytes.size() <= size());
+  while (pos < flushed_ && !bytes.empty()) {
+    const auto size = std::min(bytes.size(), flushed_ - pos);
+    ASSERT(file_offset_ && pos + size <= patchable_size_);
+    const auto written =
+        pwrite(std::get<int>(destination_), bytes.data(), size,
+               *file_offset_ + narrow<off_t>(pos));
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw SystemError{"pwrite()", make_error_code(errno)};
+    }
+    pos += to_size(written);
+    bytes.remove_prefix(to_size(written));
+  }
+  std::copy(bytes.begin(), bytes.end(), buffer_.data() + (pos - flushed_));
+}
+
+void OutputBuffer::compress(Compressor::Flush flush) {
+  compressor_->compress(std::string_view{buffer_.data(), buffer_.size()},
+                        flush, compressed_);
+  flushed_ += buffer_.size();
+  buffer_.clear();
+  compressing_ = true;
+}
+
+void OutputBuffer::write_uncompressed(bool hold_if_shared) {
+  if (can_patch() && buffer_.size() != 0) {
+    // If the file offset isn't where this buffer left it then something else
+    // is writing to the file through the same file description, and the
+    // output from here on won't be where file_offset_ says.
+    const auto offset = lseek(std::get<int>(destination_), 0, SEEK_CUR);
+    if (offset != *file_offset_ + narrow<off_t>(flushed_)) {
+      shared_ = true;
+      if (hold_if_shared) {
+        return;
+      }
+    }
+  }
+  flushed_ += buffer_.size();
+  write(buffer_);
+  if (can_patch()) {
+    patchable_size_ = flushed_;
+  }
+}
+
+void OutputBuffer::write(fmt::memory_buffer &buffer) {
+  if (buffer.size() == 0) {
+    return;
+  }
+  if (auto *const *os = std::get_if<std::ostream *>(&destination_)) {
+    (*os)->write(buffer.data(), narrow<std::streamsize>(buffer.size()));
+    buffer.clear();
+    return;
+  }
+
+  const auto fd = std::get<int>(destination_);
+  const auto *data = buffer.data();
+  auto remaining = buffer.size();
+  while (remaining > 0) {
+    const auto written = ::write(fd, data, remaining);
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      const auto error = errno;
+      buffer.clear();
+      throw SystemError{"write()", make_error_code(error)};
+    }
+    data += written;
+    remaining -= to_size(written);
+  }
+  buffer.clear();
+}
+
+} // namespace sq::results
@@ -0,0 +1,96 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/OutputPipeline.h"
+
+#include "core/narrow.h"
+
+#include <gsl/gsl>
+#include <ios>
+#include <utility>
+
+namespace sq::results {
+
+OutputPipeline::OutputPipeline(std::ostream &os, std::size_t chunk_size,
+                               std::size_t max_chunks)
+    : os_{os}, chunk_size_{chunk_size}, chunks_{max_chunks},
+      free_chunks_{max_chunks}, stream_{this} {
+  Expects(chunk_size > 0);
+  reset_put_area();
+  writer_ = std::jthread{[this] { write_chunks(); }};
+}
+
+OutputPipeline::~OutputPipeline() noexcept { finish(); }
+
+std::ostream &OutputPipeline::stream() noexcept { return stream_; }
+
+void OutputPipeline::finish() noexcept {
+  if (!writer_.joinable()) {
+    return;
+  }
+  // Shrinking the chunk doesn't allocate, so this can't throw.
+  const auto size = to_size(pptr() - pbase());
+  if (size > 0) {
+    chunk_.resize(size);
+    chunks_.push(std::move(chunk_));
+  }
+  setp(nullptr, nullptr);
+  chunks_.push(std::nullopt);
+  writer_.join();
+}
+
+OutputPipeline::int_type OutputPipeline::overflow(int_type ch) {
+  if (!writer_.joinable()) {
+    return traits_type::eof();
+  }
+  send_chunk();
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(ch);
+}
+
+int OutputPipeline::sync() {
+  if (writer_.joinable()) {
+    send_chunk();
+    chunks_.push(std::string{});
+  }
+  return 0;
+}
+
+void OutputPipeline::send_chunk() {
+  const auto size = to_size(pptr() - pbase());
+  if (size == 0) {
+    return;
+  }
+  chunk_.resize(size);
+  chunks_.push(std::move(chunk_));
+  chunk_ = free_chunks_.try_pop().value_or(std::string{});
+  reset_put_area();
+}
+
+void OutputPipeline::reset_put_area() {
+  chunk_.resize(chunk_size_);
+  setp(chunk_.data(), chunk_.data() + chunk_.size());
+}
+
+void OutputPipeline::write_chunks() {
+  for (;;) {
+    auto chunk = chunks_.pop();
+    if (!chunk) {
+      os_.flush();
+      return;
+    }
+    if (chunk->empty()) {
+      os_.flush();
+      continue;
+    }
+    os_.write(chunk->data(), narrow<std::streamsize>(chunk->size()));
+    (void)free_chunks_.try_push(*chunk);
+  }
+}
+
+} // namespace sq::results
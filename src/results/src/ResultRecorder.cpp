@@ -0,0 +1,93 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/ResultRecorder.h"
+
+#include <gsl/gsl>
+
+namespace sq::results {
+
+void ResultRecorder::start_array() { open(ResultValue{ResultValue::Array{}}); }
+
+void ResultRecorder::end_array() {
+  Expects(!stack_.empty());
+  Expects(std::holds_alternative<ResultValue::Array>(stack_.back()->value_));
+  stack_.pop_back();
+}
+
+void ResultRecorder::start_object() {
+  open(ResultValue{ResultValue::Object{}});
+}
+
+void ResultRecorder::end_object() {
+  Expects(!stack_.empty());
+  Expects(std::holds_alternative<ResultValue::Object>(stack_.back()->value_));
+  Expects(!have_key_);
+  stack_.pop_back();
+}
+
+void ResultRecorder::write_key(std::string_view key) {
+  Expects(!stack_.empty());
+  Expects(!have_key_);
+  auto &object = std::get<ResultValue::Object>(stack_.back()->value_);
+  object.emplace_back(std::string{key}, ResultValue{});
+  have_key_ = true;
+}
+
+void ResultRecorder::write_value(const PrimitiveRef &value) {
+  next_slot() = ResultValue{primitive_from_ref(value)};
+}
+
+ResultValue ResultRecorder::take() {
+  Expects(done_ && stack_.empty());
+  done_ = false;
+  return std::exchange(root_, ResultValue{});
+}
+
+ResultValue &ResultRecorder::next_slot() {
+  if (stack_.empty()) {
+    Expects(!done_);
+    done_ = true;
+    return root_;
+  }
+  auto &top = *stack_.back();
+  if (auto *array = std::get_if<ResultValue::Array>(&top.value_)) {
+    return array->emplace_back();
+  }
+  Expects(have_key_);
+  have_key_ = false;
+  return std::get<ResultValue::Object>(top.value_).back().second;
+}
+
+void ResultRecorder::open(ResultValue value) {
+  auto &slot = next_slot();
+  slot = std::move(value);
+  // The slot won't move while it's on the stack because nothing is added to
+  // its parent until it has been closed.
+  stack_.push_back(&slot);
+}
+
+void write_result_value(const ResultValue &value, Serializer &serializer) {
+  if (const auto *primitive = std::get_if<Primitive>(&value.value_)) {
+    serializer.write_value(*primitive);
+  } else if (const auto *array =
+                 std::get_if<ResultValue::Array>(&value.value_)) {
+    serializer.start_array(array->size());
+    for (const auto &element : *array) {
+      write_result_value(element, serializer);
+    }
+    serializer.end_array();
+  } else {
+    const auto &object = std::get<ResultValue::Object>(value.value_);
+    serializer.start_object(object.size());
+    for (const auto &[key, element] : object) {
+      serializer.write_key(key);
+      write_result_value(element, serializer);
+    }
+    serializer.end_object();
+  }
+}
+
+} // namespace sq::results
@@ -7,208 +7,261 @@
 
 #include "core/ASSERT.h"
 #include "core/typeutil.h"
+#include "results/ArrowSerializer.h"
+#include "results/CborSerializer.h"
+#include "results/Compressor.h"
+#include "results/JsonWriter.h"
+#include "results/MessagePackSerializer.h"
+#include "results/NdjsonSerializer.h"
+#include "results/OutputBuffer.h"
+#include "results/ResultRecorder.h"
 #include "results/results.h"
 
+#include <fmt/format.h>
 #include <iostream>
-#include <stack>
-#include <vector>
+#include <memory>
+#include <string_view>
+#include <utility>
 
 namespace sq::results {
 
-class JsonSerializer : public Serializer {
+PreparedKey::PreparedKey(std::string_view name) : name_{name} {
+  auto buffer = fmt::memory_buffer{};
+  buffer.push_back(',');
+  JsonWriter::append_string(buffer, name);
+  buffer.push_back(':');
+  json_ = fmt::to_string(buffer);
+}
+
+namespace {
+
+// Records a value and writes it again when it's spliced.
+class RecordingCapture : public ValueCapture {
+public:
+  using Serializer::start_array;
+  using Serializer::start_object;
+  using Serializer::write_key;
+  using Serializer::write_value;
+
+  explicit RecordingCapture(Serializer &target) noexcept : target_{&target} {}
+
+  void start_array() override { recorder_.start_array(); }
+  void end_array() override { recorder_.end_array(); }
+  void start_object() override { recorder_.start_object(); }
+  void end_object() override { recorder_.end_object(); }
+  void write_key(std::string_view key) override { recorder_.write_key(key); }
+
+  void write_value(const PrimitiveRef &value) override {
+    recorder_.write_value(value);
+  }
+
+  void splice() override { write_result_value(recorder_.take(), *target_); }
+
 private:
-  enum class State {
-    EmptyArray,
-    NonemptyArray,
-    EmptyObject,
-    NonemptyObject,
-    Done
-  };
-  using StateStack = std::stack<State, std::vector<State>>;
+  Serializer *target_;
+  ResultRecorder recorder_;
+};
 
+} // namespace
+
+std::unique_ptr<ValueCapture> Serializer::capture() {
+  return std::make_unique<RecordingCapture>(*this);
+}
+
+class JsonSerializer : public Serializer {
 public:
-  explicit JsonSerializer(std::ostream &os) : os_{os} {}
+  using Serializer::start_array;
+  using Serializer::start_object;
+  using Serializer::write_value;
+
+  JsonSerializer(std::ostream &os, FlushPolicy policy,
+                 const Compression &compression = {})
+      : out_{os, compression}, policy_{policy} {}
+  JsonSerializer(int fd, FlushPolicy policy,
+                 const Compression &compression = {})
+      : out_{fd, compression}, policy_{policy} {}
 
   void start_array() override {
-    prepare_for_value();
-    state_stack_.push(State::EmptyArray);
-    os_ << '[';
+    writer_.start_array();
+    end_call();
   }
 
   void end_array() override {
-    Expects(in_array());
-    os_ << ']';
-    state_stack_.pop();
+    writer_.end_array();
+    end_call();
   }
 
   void start_object() override {
-    prepare_for_value();
-    state_stack_.push(State::EmptyObject);
-    os_ << '{';
+    writer_.start_object();
+    end_call();
   }
 
   void end_object() override {
-    Expects(in_object());
-    os_ << '}';
-    state_stack_.pop();
+    writer_.end_object();
+    end_call();
   }
 
   void write_key(std::string_view key) override {
-    prepare_for_key();
-    write_string(key);
-    os_ << ':';
-  }
-
-  void write_value(const Primitive &value) override {
-    std::visit([this](const auto &v) { write_value(v); }, value);
+    writer_.write_key(key);
+    end_call();
   }
 
-  void write_value(const PrimitiveString &str) {
-    prepare_for_value();
-    write_string(str);
+  void write_key(const PreparedKey &key) override {
+    writer_.write_key(key);
+    end_call();
   }
 
-  void write_value(const PrimitiveInt &i) {
-    prepare_for_value();
-    fmt::print(os_, "{}", i);
+  void write_value(const PrimitiveRef &value) override {
+    writer_.write_value(value);
+    end_call();
   }
 
-  void write_value(const PrimitiveBool &b) {
-    prepare_for_value();
-    os_ << (b ? "true" : "false");
-  }
+  SQ_ND std::unique_ptr<ValueCapture> capture() override;
 
-  void write_value(const PrimitiveFloat &f) {
-    prepare_for_value();
-    auto str = fmt::format("{}", f);
-    os_ << str;
-    // Make sure we always either:
-    // * use scientific notation; or
-    // * have at least one digit after the decimal point.
-    // This hints to consumers that the number should be interpreted as a
-    // real number rather than an integer.
-    if (str.find_first_of("e.") == std::string::npos) {
-      os_ << ".0";
-    }
+  SQ_ND std::size_t output_size() const noexcept override {
+    return out_.size();
   }
 
-  void write_value(SQ_MU const PrimitiveNull &pn) {
-    prepare_for_value();
-    os_ << "null";
+  // Write a value rendered by a JsonCapture.
+  void write_rendered(std::string_view json) {
+    writer_.write_rendered(json);
+    end_call();
   }
 
 private:
-  void prepare_for_value() {
-    Expects(!done());
-    if (state_stack_.empty()) {
-      state_stack_.push(State::Done);
-      return;
+  // Write out the buffered output if the flush policy calls for it.
+  void end_call() {
+    if (writer_.done()) {
+      out_.finish();
+    } else if (policy_ == FlushPolicy::EveryTopLevelElement &&
+               writer_.at_top_level_element_boundary()) {
+      out_.sync();
+    } else if (policy_ == FlushPolicy::EveryCall || out_.full()) {
+      out_.flush();
     }
-    auto &state = state_stack_.top();
+  }
 
-    switch (state) {
-    case State::EmptyArray:
-      state = State::NonemptyArray;
-      return;
+  OutputBuffer out_;
+  JsonWriter writer_{out_};
+  FlushPolicy policy_;
+};
 
-    case State::EmptyObject:
-      // There should be a key before a value
-      ASSERT(false);
-      return;
+// Renders a value as JSON as it's captured. The rendered value is the same
+// wherever it's written, apart from the separator before it, which the
+// serializer writes when the value is spliced.
+class JsonCapture : public ValueCapture {
+public:
+  using Serializer::start_array;
+  using Serializer::start_object;
+  using Serializer::write_value;
 
-    case State::NonemptyArray:
-      os_ << ',';
-      return;
+  explicit JsonCapture(JsonSerializer &target) noexcept : target_{&target} {}
 
-    case State::NonemptyObject:
-      return;
+  void start_array() override { writer_.start_array(); }
+  void end_array() override { writer_.end_array(); }
+  void start_object() override { writer_.start_object(); }
+  void end_object() override { writer_.end_object(); }
+  void write_key(std::string_view key) override { writer_.write_key(key); }
+  void write_key(const PreparedKey &key) override { writer_.write_key(key); }
 
-    case State::Done:
-      ASSERT(false);
-      return;
-    }
+  void write_value(const PrimitiveRef &value) override {
+    writer_.write_value(value);
   }
 
-  void prepare_for_key() {
-    Expects(in_object());
-    auto &state = state_stack_.top();
+  void splice() override {
+    ASSERT(writer_.done());
+    target_->write_rendered(
+        std::string_view{rendered_.data(), rendered_.size()});
+    rendered_.clear();
+    writer_.reset();
+  }
 
-    switch (state) {
-    case State::NonemptyObject:
-      os_ << ',';
-      return;
+private:
+  JsonSerializer *target_;
+  fmt::memory_buffer rendered_;
+  JsonWriter writer_{rendered_};
+};
 
-    case State::EmptyObject:
-      state = State::NonemptyObject;
-      return;
+std::unique_ptr<ValueCapture> JsonSerializer::capture() {
+  return std::make_unique<JsonCapture>(*this);
+}
 
-    case State::EmptyArray:
-    case State::NonemptyArray:
-    case State::Done:
-      ASSERT(false);
-    }
-  }
+std::unique_ptr<Serializer> get_serializer(std::ostream &os) {
+  return std::make_unique<JsonSerializer>(os, FlushPolicy::EveryCall);
+}
 
-  SQ_ND bool in_array() const {
-    return !state_stack_.empty() &&
-           (state_stack_.top() == State::EmptyArray ||
-            state_stack_.top() == State::NonemptyArray);
-  }
+std::unique_ptr<Serializer> get_serializer(int fd, FlushPolicy policy) {
+  return std::make_unique<JsonSerializer>(fd, policy);
+}
 
-  SQ_ND bool in_object() const {
-    return !state_stack_.empty() &&
-           (state_stack_.top() == State::EmptyObject ||
-            state_stack_.top() == State::NonemptyObject);
-  }
+namespace {
 
-  SQ_ND bool done() const {
-    return !state_stack_.empty() && state_stack_.top() == State::Done;
+// Get the NDJSON flush interval that matches a flush policy.
+SQ_ND std::chrono::milliseconds ndjson_flush_interval(FlushPolicy policy) {
+  if (policy == FlushPolicy::WhenFull) {
+    return std::chrono::milliseconds::max();
   }
+  return std::chrono::milliseconds::zero();
+}
 
-  void write_string(std::string_view str) {
-    os_ << '\"';
-    for (const char c : str) {
-      switch (c) {
-      case '"':
-        os_ << "\\\"";
-        break;
-      case '\\':
-        os_ << "\\\\";
-        break;
-      case '\b':
-        os_ << "\\b";
-        break;
-      case '\f':
-        os_ << "\\f";
-        break;
-      case '\n':
-        os_ << "\\n";
-        break;
-      case '\r':
-        os_ << "\\r";
-        break;
-      case '\t':
-        os_ << "\\t";
-        break;
-      default:
-        static constexpr char first_control_char = '\x00';
-        static constexpr char last_control_char = '\x1F';
-        if (first_control_char <= c && c <= last_control_char) {
-          fmt::print(os_, "\\u{:04x}", c);
-        } else {
-          os_ << c;
-        }
-      }
-    }
-    os_ << '\"';
+template <typename Destination>
+std::unique_ptr<Serializer> make_serializer(Destination &&destination,
+                                            OutputFormat format,
+                                            FlushPolicy policy,
+                                            const Compression &compression) {
+  switch (format) {
+  case OutputFormat::Json:
+    return std::make_unique<JsonSerializer>(SQ_FWD(destination), policy,
+                                            compression);
+  case OutputFormat::Cbor:
+    return std::make_unique<CborSerializer>(SQ_FWD(destination), policy,
+                                            compression);
+  case OutputFormat::MessagePack:
+    return std::make_unique<MessagePackSerializer>(SQ_FWD(destination),
+                                                   policy, compression);
+  case OutputFormat::Ndjson:
+    return std::make_unique<NdjsonSerializer>(
+        SQ_FWD(destination), std::vector<std::string>{},
+        ndjson_flush_interval(policy), compression);
+  case OutputFormat::Arrow:
+    // Arrow output is written a batch at a time.
+    return std::make_unique<ArrowSerializer>(
+        SQ_FWD(destination), ArrowSerializer::default_batch_size,
+        compression);
   }
+  ASSERT(false);
+  return nullptr;
+}
 
-  std::ostream &os_;
-  StateStack state_stack_;
-};
+} // namespace
 
-std::unique_ptr<Serializer> get_serializer(std::ostream &os) {
-  return std::make_unique<JsonSerializer>(os);
+std::unique_ptr<Serializer> get_serializer(std::ostream &os,
+                                           OutputFormat format,
+                                           FlushPolicy policy,
+                                           const Compression &compression) {
+  return make_serializer(os, format, policy, compression);
+}
+
+std::unique_ptr<Serializer> get_serializer(int fd, OutputFormat format,
+                                           FlushPolicy policy,
+                                           const Compression &compression) {
+  return make_serializer(fd, format, policy, compression);
+}
+
+std::unique_ptr<Serializer>
+get_ndjson_serializer(std::ostream &os, std::vector<std::string> list_path,
+                      std::chrono::milliseconds flush_interval,
+                      const Compression &compression) {
+  return std::make_unique<NdjsonSerializer>(os, std::move(list_path),
+                                            flush_interval, compression);
+}
+
+std::unique_ptr<Serializer>
+get_ndjson_serializer(int fd, std::vector<std::string> list_path,
+                      std::chrono::milliseconds flush_interval,
+                      const Compression &compression) {
+  return std::make_unique<NdjsonSerializer>(fd, std::move(list_path),
+                                            flush_interval, compression);
 }
 
 } // namespace sq::results
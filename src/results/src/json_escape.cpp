@@ -0,0 +1,170 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/json_escape.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define SQ_JSON_ESCAPE_X86
+#endif
+
+namespace sq::results {
+
+namespace {
+
+constexpr auto last_control_char = '\x1F';
+
+SQ_ND constexpr bool needs_escape(char c) noexcept {
+  return c == '"' || c == '\\' ||
+         static_cast<unsigned char>(c) <=
+             static_cast<unsigned char>(last_control_char);
+}
+
+SQ_ND std::size_t find_json_escape_scalar(std::string_view str,
+                                          std::size_t pos) noexcept {
+  for (; pos < str.size(); ++pos) {
+    if (needs_escape(str[pos])) {
+      return pos;
+    }
+  }
+  return pos;
+}
+
+// Scans 8 bytes at a time in a 64 bit word. A block is only checked byte by
+// byte if it contains a character that needs escaping.
+SQ_ND std::size_t find_json_escape_portable(std::string_view str) noexcept {
+  static constexpr auto ones = ~std::uint64_t{0} / 0xFF;
+  static constexpr auto highs = ones * 0x80;
+  // Flag the bytes of a word that are less than n, for n <= 0x80.
+  // Bytes above a flagged byte may also be flagged, which doesn't matter
+  // here because flagged blocks are rescanned.
+  const auto has_less = [](std::uint64_t word, std::uint64_t n) {
+    return (word - ones * n) & ~word & highs;
+  };
+  const auto has_byte = [&](std::uint64_t word, char c) {
+    return has_less(word ^ (ones * static_cast<unsigned char>(c)), 1);
+  };
+
+  auto pos = std::size_t{0};
+  for (; pos + sizeof(std::uint64_t) <= str.size();
+       pos += sizeof(std::uint64_t)) {
+    auto word = std::uint64_t{};
+    std::memcpy(&word, str.data() + pos, sizeof(word));
+    if ((has_less(word, last_control_char + 1) | has_byte(word, '"') |
+         has_byte(word, '\\')) != 0) {
+      return find_json_escape_scalar(str, pos);
+    }
+  }
+  return find_json_escape_scalar(str, pos);
+}
+
+#ifdef SQ_JSON_ESCAPE_X86
+
+// Get a mask of the bytes of a 16 byte block that need escaping. Always
+// inlined so that the AVX2 implementation gets VEX encoded instructions:
+// calling non-VEX SSE code with the upper halves of the AVX registers dirty
+// costs far more than the scan itself.
+__attribute__((always_inline)) inline unsigned
+escape_mask_128(const char *data) noexcept {
+  const auto block =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)); // NOLINT
+  // There's no unsigned byte comparison, but a byte is at most
+  // last_control_char iff the unsigned minimum of the two is the byte.
+  const auto matches = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('"')),
+                   _mm_cmpeq_epi8(block, _mm_set1_epi8('\\'))),
+      _mm_cmpeq_epi8(
+          _mm_min_epu8(block, _mm_set1_epi8(last_control_char)), block));
+  return static_cast<unsigned>(_mm_movemask_epi8(matches));
+}
+
+// SSE2 is part of x86-64 so doesn't need a runtime check.
+SQ_ND std::size_t find_json_escape_sse2(std::string_view str) noexcept {
+  auto pos = std::size_t{0};
+  for (; pos + sizeof(__m128i) <= str.size(); pos += sizeof(__m128i)) {
+    const auto mask = escape_mask_128(str.data() + pos);
+    if (mask != 0) {
+      return pos + static_cast<std::size_t>(std::countr_zero(mask));
+    }
+  }
+  return find_json_escape_scalar(str, pos);
+}
+
+__attribute__((target("avx2"))) SQ_ND std::size_t
+find_json_escape_avx2(std::string_view str) noexcept {
+  const auto quote = _mm256_set1_epi8('"');
+  const auto backslash = _mm256_set1_epi8('\\');
+  const auto control = _mm256_set1_epi8(last_control_char);
+
+  auto pos = std::size_t{0};
+  for (; pos + sizeof(__m256i) <= str.size(); pos += sizeof(__m256i)) {
+    const auto block = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(str.data() + pos)); // NOLINT
+    const auto matches = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(block, quote),
+                        _mm256_cmpeq_epi8(block, backslash)),
+        _mm256_cmpeq_epi8(_mm256_min_epu8(block, control), block));
+    const auto mask = static_cast<unsigned>(_mm256_movemask_epi8(matches));
+    if (mask != 0) {
+      return pos + static_cast<std::size_t>(std::countr_zero(mask));
+    }
+  }
+  if (pos + sizeof(__m128i) <= str.size()) {
+    const auto mask = escape_mask_128(str.data() + pos);
+    if (mask != 0) {
+      return pos + static_cast<std::size_t>(std::countr_zero(mask));
+    }
+    pos += sizeof(__m128i);
+  }
+  return find_json_escape_scalar(str, pos);
+}
+
+SQ_ND bool have_avx2() noexcept {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
+}
+
+#endif // SQ_JSON_ESCAPE_X86
+
+SQ_ND detail::JsonEscapeFinder select_json_escape_finder() noexcept {
+#ifdef SQ_JSON_ESCAPE_X86
+  if (have_avx2()) {
+    return find_json_escape_avx2;
+  }
+  return find_json_escape_sse2;
+#else
+  return find_json_escape_portable;
+#endif
+}
+
+} // namespace
+
+std::size_t find_json_escape(std::string_view str) noexcept {
+  static const auto finder = select_json_escape_finder();
+  return finder(str);
+}
+
+namespace detail {
+
+std::vector<std::pair<std::string_view, JsonEscapeFinder>>
+json_escape_finders() {
+  auto finders = std::vector<std::pair<std::string_view, JsonEscapeFinder>>{
+      {"portable", find_json_escape_portable}};
+#ifdef SQ_JSON_ESCAPE_X86
+  finders.emplace_back("sse2", find_json_escape_sse2);
+  if (have_avx2()) {
+    finders.emplace_back("avx2", find_json_escape_avx2);
+  }
+#endif
+  return finders;
+}
+
+} // namespace detail
+
+} // namespace sq::results
@@ -5,12 +5,36 @@
 
 #include "results/results.h"
 
+#include "core/ASSERT.h"
+#include "core/Executor.h"
+#include "core/FieldCallHints.h"
+#include "core/FieldCallParams.h"
+#include "core/cancellation.h"
 #include "core/errors.h"
+#include "core/narrow.h"
 #include "core/typeutil.h"
 #include "parser/Ast.h"
 #include "results/Filter.h"
 #include "results/Serializer.h"
 
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <gsl/gsl>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <range/v3/algorithm/none_of.hpp>
+#include <range/v3/range/concepts.hpp>
+#include <range/v3/range/primitives.hpp>
+#include <stop_token>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
 namespace sq::results {
 
 namespace {
@@ -19,18 +43,207 @@ bool is_pullup_node(const parser::Ast &ast_node) {
   return ast_node.data().access_type() == parser::FieldAccessType::Pullup;
 }
 
+/**
+ * Get hints about how the results of accessing an AST node's field will be
+ * used.
+ */
+FieldCallHints get_hints(const parser::Ast &ast_node) {
+  auto hints = FieldCallHints{};
+  if (ast_node.children().empty()) {
+    hints.add_primitive();
+  }
+  for (const auto &child : ast_node.children()) {
+    hints.add_field(child.data().name());
+  }
+  const auto *comparison =
+      std::get_if<parser::ComparisonSpec>(&ast_node.data().filter_spec());
+  if (comparison != nullptr) {
+    if (comparison->member_.empty()) {
+      hints.add_primitive();
+    } else {
+      hints.add_field(comparison->member_);
+      hints.add_string_filter(comparison->member_,
+                              string_comparison_predicate(*comparison));
+    }
+  }
+  return hints;
+}
+
+} // namespace
+
+/**
+ * The parts of a field access that don't depend on the object whose field is
+ * being accessed.
+ *
+ * A tree of FieldAccess objects mirrors the AST so that the key, params, hints
+ * and filter for each AST node are only created once, rather than once for
+ * every object in the results.
+ */
+struct FieldAccess {
+  explicit FieldAccess(const parser::Ast &ast_node)
+      : ast_node_{&ast_node}, key_{ast_node.data().name()},
+        params_{ast_node.data().params()},
+        filter_{Filter::create(ast_node.data().filter_spec())} {
+    params_.hints() = get_hints(ast_node);
+    children_.reserve(ast_node.children().size());
+    for (const auto &child : ast_node.children()) {
+      children_.emplace_back(child);
+    }
+  }
+
+  const parser::Ast *ast_node_;
+  PreparedKey key_;
+  FieldCallParams params_;
+  FilterPtr filter_;
+  std::vector<FieldAccess> children_;
+};
+
+namespace {
+
+/**
+ * The resources for evaluating the elements of arrays in parallel.
+ */
+struct ParallelEvaluation {
+  // Get the executor, starting its threads when it is first needed.
+  SQ_ND Executor &executor() {
+    if (!executor_) {
+      executor_.emplace(threads_);
+    }
+    return *executor_;
+  }
+
+  // Get whether an array element may be evaluated by the executor.
+  SQ_ND bool may_evaluate(const Field &element) const noexcept {
+    return !element.is_thread_affine() &&
+           (!prefetch_only_ || element.is_latency_bound());
+  }
+
+  std::size_t threads_;
+  std::size_t max_buffered_elements_;
+  bool unordered_;
+
+  // Whether only latency-bound elements are evaluated by the executor, ahead
+  // of the element being written, and sibling subtrees are evaluated
+  // sequentially.
+  bool prefetch_only_;
+
+  std::optional<Executor> executor_ = std::nullopt;
+};
+
+/**
+ * Collects the IDs of the elements whose evaluation has completed, in the
+ * order that they complete.
+ */
+class CompletionQueue {
+public:
+  void push(std::size_t id) {
+    {
+      const auto lock = std::scoped_lock{mutex_};
+      ids_.push_back(id);
+    }
+    cv_.notify_one();
+  }
+
+  // Wait for an element's evaluation to complete and get its ID.
+  SQ_ND std::size_t pop() {
+    auto lock = std::unique_lock{mutex_};
+    cv_.wait(lock, [this] { return !ids_.empty(); });
+    const auto id = ids_.front();
+    ids_.pop_front();
+    return id;
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::size_t> ids_;
+};
+
+/**
+ * Stops results at the next element boundary once a stop has been requested,
+ * and marks the point where the results stop.
+ *
+ * Each capture of a parallel evaluation has its own Truncation: a capture may
+ * be dropped after a stop, taking its marker with it, so only markers written
+ * by the Truncation of the final output count as truncating the results.
+ */
+class Truncation {
+public:
+  explicit Truncation(std::stop_token token) noexcept
+      : token_{std::move(token)} {}
+
+  SQ_ND bool stop_requested() const noexcept {
+    return token_.stop_requested();
+  }
+
+  // Get whether the results might be truncated. If not, the sizes of arrays
+  // and objects can be known before their elements are written.
+  SQ_ND bool stop_possible() const noexcept { return token_.stop_possible(); }
+
+  SQ_ND const std::stop_token &token() const noexcept { return token_; }
+
+  // Write the truncation marker as an element of an array, unless the marker
+  // has already been written.
+  void mark_array(Serializer &serializer) {
+    if (!marked_) {
+      marked_ = true;
+      serializer.start_object();
+      serializer.write_key(marker_key());
+      serializer.write_value(PrimitiveBool{true});
+      serializer.end_object();
+    }
+  }
+
+  // Write the truncation marker as a member of an object, unless the marker
+  // has already been written.
+  void mark_object(Serializer &serializer) {
+    if (!marked_) {
+      marked_ = true;
+      serializer.write_key(marker_key());
+      serializer.write_value(PrimitiveBool{true});
+    }
+  }
+
+  SQ_ND bool truncated() const noexcept { return marked_; }
+
+private:
+  SQ_ND static const PreparedKey &marker_key() {
+    static const auto key = PreparedKey{truncation_marker_key};
+    return key;
+  }
+
+  std::stop_token token_;
+  bool marked_ = false;
+};
+
 class ResultStreamer {
 public:
-  ResultStreamer(const parser::Ast &ast, Serializer &serializer)
-      : ast_{&ast}, serializer_{&serializer} {}
+  ResultStreamer(const FieldAccess &access, Serializer &serializer,
+                 Truncation &truncation, ParallelEvaluation *parallel = nullptr)
+      : access_{&access}, serializer_{&serializer}, truncation_{&truncation},
+        parallel_{parallel} {}
 
   void operator()(const PrimitiveNull &null);
   void operator()(const FieldPtr &field);
   void operator()(ranges::cpp20::view auto &&rng);
 
 private:
-  const parser::Ast *ast_;
+  void stream_in_parallel(ranges::cpp20::view auto &&rng);
+  void stream_unordered(ranges::cpp20::view auto &&rng);
+  SQ_ND bool can_stream_children_in_parallel(const Field &field) const;
+  void stream_children_in_parallel(const FieldPtr &field);
+  void start_object();
+  SQ_ND static ValueCapturePtr evaluate_element(const FieldAccess &access,
+                                                const FieldPtr &field,
+                                                std::stop_token token,
+                                                ValueCapturePtr capture);
+  static void evaluate_child(const FieldAccess &child, const Field &field,
+                             std::stop_token token, ValueCapture &capture);
+
+  const FieldAccess *access_;
   Serializer *serializer_;
+  Truncation *truncation_;
+  ParallelEvaluation *parallel_;
 };
 
 void ResultStreamer::operator()(const PrimitiveNull &null) {
@@ -38,32 +251,41 @@ void ResultStreamer::operator()(const PrimitiveNull &null) {
 }
 
 void ResultStreamer::operator()(const FieldPtr &field) {
-  if (ast_->children().empty()) {
-    serializer_->write_value(field->to_primitive());
+  const auto &children = access_->children_;
+  if (children.empty()) {
+    auto storage = Primitive{};
+    serializer_->write_value(field->to_primitive_ref(storage));
+    return;
+  }
+  if (can_stream_children_in_parallel(*field)) {
+    stream_children_in_parallel(field);
     return;
   }
 
-  const auto &children = ast_->children();
-  const bool pullup = children.size() == 1 && is_pullup_node(children.front());
+  const bool pullup =
+      children.size() == 1 && is_pullup_node(*children.front().ast_node_);
 
   if (!pullup) {
-    serializer_->start_object();
+    start_object();
   }
 
-  for (const auto &child : ast_->children()) {
+  for (const auto &child : children) {
+    // A pullup access must produce a value, so it can't be cut short.
+    if (!pullup && truncation_->stop_requested()) {
+      break;
+    }
 
-    const auto &field_name = child.data().name();
+    const auto &field_name = child.ast_node_->data().name();
     if (!pullup) {
-      serializer_->write_key(field_name);
+      serializer_->write_key(child.key_);
     }
 
-    const auto &params = child.data().params();
-    const auto filter = Filter::create(child.data().filter_spec());
-    auto visitor = ResultStreamer{child, *serializer_};
-    auto child_results = (*filter)(field->get(field_name, params));
+    auto visitor = ResultStreamer{child, *serializer_, *truncation_, parallel_};
+    auto child_results =
+        (*child.filter_)(field->get(field_name, child.params_));
     std::visit(visitor, std::move(child_results));
 
-    if (!pullup && is_pullup_node(child)) {
+    if (!pullup && is_pullup_node(*child.ast_node_)) {
       throw PullupWithSiblingsError{fmt::format(
           "cannot use pullup access for field \"{}\": it has sibling fields",
           field_name)};
@@ -71,23 +293,271 @@ void ResultStreamer::operator()(const FieldPtr &field) {
   }
 
   if (!pullup) {
+    if (truncation_->stop_requested()) {
+      truncation_->mark_object(*serializer_);
+    }
     serializer_->end_object();
   }
 }
 
 void ResultStreamer::operator()(ranges::cpp20::view auto &&rng) {
-  serializer_->start_array();
-  for (auto field : SQ_FWD(rng)) {
-    (*this)(field);
+  // The size is only written up front if the range knows it and the array
+  // can't be truncated.
+  auto sized = false;
+  if constexpr (ranges::sized_range<decltype(rng)>) {
+    if (!truncation_->stop_possible()) {
+      serializer_->start_array(to_size(ranges::size(rng)));
+      sized = true;
+    }
+  }
+  if (!sized) {
+    serializer_->start_array();
+  }
+  if (parallel_ == nullptr) {
+    for (auto field : SQ_FWD(rng)) {
+      if (truncation_->stop_requested()) {
+        break;
+      }
+      (*this)(field);
+    }
+  } else if (parallel_->unordered_) {
+    stream_unordered(SQ_FWD(rng));
+  } else {
+    stream_in_parallel(SQ_FWD(rng));
+  }
+  if (truncation_->stop_requested()) {
+    truncation_->mark_array(*serializer_);
   }
   serializer_->end_array();
 }
 
+void ResultStreamer::stream_in_parallel(ranges::cpp20::view auto &&rng) {
+  // Futures for the captured results of the elements that are being
+  // evaluated, in the order that they should be written. Elements that were
+  // evaluated ahead are dropped once a stop is requested.
+  auto buffered = std::deque<std::future<ValueCapturePtr>>{};
+  const auto write_next = [&] {
+    auto capture = buffered.front().get();
+    buffered.pop_front();
+    if (!truncation_->stop_requested()) {
+      capture->splice();
+    }
+  };
+
+  for (auto field : SQ_FWD(rng)) {
+    if (truncation_->stop_requested()) {
+      break;
+    }
+    if (!parallel_->may_evaluate(*field)) {
+      while (!buffered.empty()) {
+        write_next();
+      }
+      (*this)(field);
+      continue;
+    }
+    if (buffered.size() == parallel_->max_buffered_elements_) {
+      write_next();
+    }
+    buffered.push_back(parallel_->executor().submit(
+        [access = access_, field = std::move(field),
+         token = truncation_->token(),
+         capture = serializer_->capture()]() mutable {
+          return evaluate_element(*access, field, std::move(token),
+                                  std::move(capture));
+        }));
+  }
+  while (!buffered.empty()) {
+    write_next();
+  }
+}
+
+void ResultStreamer::stream_unordered(ranges::cpp20::view auto &&rng) {
+  // The queue is shared with the tasks so that it outlives them if an
+  // exception stops the stream before all of the tasks have completed.
+  auto completed = std::make_shared<CompletionQueue>();
+  auto running =
+      std::unordered_map<std::size_t, std::future<ValueCapturePtr>>{};
+  auto next_id = std::size_t{0};
+  const auto write_completed = [&] {
+    const auto it = running.find(completed->pop());
+    ASSERT(it != running.end());
+    auto future = std::move(it->second);
+    running.erase(it);
+    auto capture = future.get();
+    if (!truncation_->stop_requested()) {
+      capture->splice();
+    }
+  };
+
+  for (auto field : SQ_FWD(rng)) {
+    if (truncation_->stop_requested()) {
+      break;
+    }
+    if (!parallel_->may_evaluate(*field)) {
+      (*this)(field);
+      continue;
+    }
+    if (running.size() == parallel_->max_buffered_elements_) {
+      write_completed();
+    }
+    const auto id = next_id++;
+    running.emplace(id, parallel_->executor().submit(
+                            [access = access_, field = std::move(field),
+                             token = truncation_->token(),
+                             capture = serializer_->capture(), completed,
+                             id]() mutable {
+                              const auto notify = gsl::finally(
+                                  [&] { completed->push(id); });
+                              return evaluate_element(*access, field,
+                                                      std::move(token),
+                                                      std::move(capture));
+                            }));
+  }
+  while (!running.empty()) {
+    write_completed();
+  }
+}
+
+bool ResultStreamer::can_stream_children_in_parallel(const Field &field) const {
+  const auto &children = access_->children_;
+  return parallel_ != nullptr && !parallel_->prefetch_only_ &&
+         children.size() > 1 && field.allows_concurrent_access() &&
+         ranges::none_of(children, [](const auto &child) {
+           return is_pullup_node(*child.ast_node_);
+         });
+}
+
+void ResultStreamer::stream_children_in_parallel(const FieldPtr &field) {
+  const auto &children = access_->children_;
+
+  // Children that access the same member are evaluated by the same task: they
+  // may get the same cached result, which may not allow concurrent access.
+  auto tasks = std::vector<std::vector<const FieldAccess *>>{};
+  auto task_of_member = std::map<std::string_view, std::size_t>{};
+  for (const auto &child : children) {
+    const auto [it, inserted] = task_of_member.emplace(
+        child.ast_node_->data().name(), tasks.size());
+    if (inserted) {
+      tasks.emplace_back();
+    }
+    tasks[it->second].push_back(&child);
+  }
+
+  auto futures = std::vector<std::future<std::vector<ValueCapturePtr>>>{};
+  futures.reserve(tasks.size());
+  for (auto &task : tasks) {
+    auto captures = std::vector<ValueCapturePtr>(task.size());
+    for (auto &capture : captures) {
+      capture = serializer_->capture();
+    }
+    futures.push_back(parallel_->executor().submit(
+        [task = std::move(task), field, token = truncation_->token(),
+         captures = std::move(captures)]() mutable {
+          for (auto i = std::size_t{0}; i < task.size(); ++i) {
+            evaluate_child(*task[i], *field, token, *captures[i]);
+          }
+          return std::move(captures);
+        }));
+  }
+
+  // Splice the results back together in the order of the children.
+  auto values = std::vector<std::optional<std::vector<ValueCapturePtr>>>(
+      futures.size());
+  auto next_value = std::vector<std::size_t>(futures.size());
+  start_object();
+  for (const auto &child : children) {
+    if (truncation_->stop_requested()) {
+      break;
+    }
+    const auto &field_name = child.ast_node_->data().name();
+    const auto task = task_of_member.at(field_name);
+    if (!values[task]) {
+      values[task] = futures[task].get();
+    }
+    serializer_->write_key(child.key_);
+    (*values[task])[next_value[task]++]->splice();
+  }
+  if (truncation_->stop_requested()) {
+    truncation_->mark_object(*serializer_);
+  }
+  serializer_->end_object();
+}
+
+// Start an object for the children of the current field access, with its
+// size if the results can't be truncated.
+void ResultStreamer::start_object() {
+  if (truncation_->stop_possible()) {
+    serializer_->start_object();
+  } else {
+    serializer_->start_object(access_->children_.size());
+  }
+}
+
+void ResultStreamer::evaluate_child(const FieldAccess &child,
+                                    const Field &field, std::stop_token token,
+                                    ValueCapture &capture) {
+  auto truncation = Truncation{std::move(token)};
+  auto visitor = ResultStreamer{child, capture, truncation};
+  const auto &field_name = child.ast_node_->data().name();
+  auto child_results = (*child.filter_)(field.get(field_name, child.params_));
+  std::visit(visitor, std::move(child_results));
+}
+
+ValueCapturePtr ResultStreamer::evaluate_element(const FieldAccess &access,
+                                                 const FieldPtr &field,
+                                                 std::stop_token token,
+                                                 ValueCapturePtr capture) {
+  auto truncation = Truncation{std::move(token)};
+  ResultStreamer{access, *capture, truncation}(field);
+  return capture;
+}
+
 } // namespace
 
+QueryPlan::QueryPlan(const parser::Ast &ast)
+    : root_access_{std::make_unique<const FieldAccess>(ast)} {}
+
+QueryPlan::QueryPlan(QueryPlan &&) noexcept = default;
+QueryPlan &QueryPlan::operator=(QueryPlan &&) noexcept = default;
+QueryPlan::~QueryPlan() noexcept = default;
+
+const FieldAccess &QueryPlan::root_access() const noexcept {
+  return *root_access_;
+}
+
+bool generate_results(const QueryPlan &plan, const FieldPtr &system_root,
+                      Serializer &serializer, const ResultOptions &options) {
+  const auto scoped_token = ScopedStopToken{options.stop_token_};
+  auto truncation = Truncation{options.stop_token_};
+  const auto stream = [&](ParallelEvaluation *parallel) {
+    ResultStreamer{plan.root_access(), serializer, truncation, parallel}(
+        system_root);
+  };
+
+  if (options.jobs_ <= 1) {
+    if (options.prefetch_depth_ == 0) {
+      stream(nullptr);
+    } else {
+      auto prefetch = ParallelEvaluation{
+          options.prefetch_depth_, options.prefetch_depth_, false, true};
+      stream(&prefetch);
+    }
+  } else {
+    static constexpr auto default_buffered_elements_per_job = std::size_t{4};
+    auto parallel = ParallelEvaluation{
+        options.jobs_,
+        options.max_buffered_elements_ == 0
+            ? default_buffered_elements_per_job * options.jobs_
+            : options.max_buffered_elements_,
+        options.unordered_, false};
+    stream(&parallel);
+  }
+  return !truncation.truncated();
+}
+
 void generate_results(const parser::Ast &ast, const FieldPtr &system_root,
                       Serializer &serializer) {
-  ResultStreamer{ast, serializer}(system_root);
+  generate_results(QueryPlan{ast}, system_root, serializer);
 }
 
 } // namespace sq::results
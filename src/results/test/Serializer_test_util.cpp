@@ -0,0 +1,123 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "test/Serializer_test_util.h"
+
+#include "core/Primitive.h"
+#include "core/narrow.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <variant>
+
+namespace sq::test {
+
+using results::ResultValue;
+
+namespace {
+
+SQ_ND ResultValue int_array(std::size_t size) {
+  auto array = ResultValue::Array{};
+  for (auto i = std::size_t{0}; i < size; ++i) {
+    array.push_back(ResultValue{to_primitive_int(i)});
+  }
+  return ResultValue{std::move(array)};
+}
+
+SQ_ND ResultValue int_object(std::size_t size) {
+  auto object = ResultValue::Object{};
+  for (auto i = std::size_t{0}; i < size; ++i) {
+    object.emplace_back("k" + std::to_string(i),
+                        ResultValue{to_primitive_int(i)});
+  }
+  return ResultValue{std::move(object)};
+}
+
+} // namespace
+
+ResultValue sample_result_value() {
+  using Limits = std::numeric_limits<PrimitiveInt>;
+  auto ints = ResultValue::Array{};
+  for (const auto i :
+       {PrimitiveInt{0}, PrimitiveInt{23}, PrimitiveInt{24}, PrimitiveInt{127},
+        PrimitiveInt{128}, PrimitiveInt{255}, PrimitiveInt{256},
+        PrimitiveInt{65535}, PrimitiveInt{65536}, PrimitiveInt{4294967295},
+        PrimitiveInt{4294967296}, Limits::max(), PrimitiveInt{-1},
+        PrimitiveInt{-24}, PrimitiveInt{-25}, PrimitiveInt{-32},
+        PrimitiveInt{-33}, PrimitiveInt{-128}, PrimitiveInt{-129},
+        PrimitiveInt{-32768}, PrimitiveInt{-32769},
+        PrimitiveInt{-2147483648}, PrimitiveInt{-2147483649},
+        Limits::min()}) {
+    ints.push_back(ResultValue{i});
+  }
+
+  auto strings = ResultValue::Array{};
+  for (const auto size : {0, 1, 23, 24, 31, 32, 255, 256, 65535, 65536}) {
+    strings.push_back(ResultValue{PrimitiveString(to_size(size), 's')});
+  }
+
+  auto object = ResultValue::Object{};
+  object.emplace_back("ints", ResultValue{std::move(ints)});
+  object.emplace_back("strings", ResultValue{std::move(strings)});
+  object.emplace_back(
+      "floats", ResultValue{ResultValue::Array{
+                    ResultValue{PrimitiveFloat{0.0}},
+                    ResultValue{PrimitiveFloat{1.5}},
+                    ResultValue{PrimitiveFloat{-1e300}}}});
+  object.emplace_back("bools",
+                      ResultValue{ResultValue::Array{
+                          ResultValue{PrimitiveBool{true}},
+                          ResultValue{PrimitiveBool{false}}}});
+  object.emplace_back("null", ResultValue{primitive_null});
+  object.emplace_back("empty array", ResultValue{ResultValue::Array{}});
+  object.emplace_back("empty object", ResultValue{ResultValue::Object{}});
+  object.emplace_back("arrays",
+                      ResultValue{ResultValue::Array{
+                          int_array(15), int_array(16), int_array(23),
+                          int_array(24), int_array(65536)}});
+  object.emplace_back("objects",
+                      ResultValue{ResultValue::Array{
+                          int_object(15), int_object(16), int_object(24),
+                          int_object(65536)}});
+  object.emplace_back(
+      "nested",
+      ResultValue{ResultValue::Array{ResultValue{ResultValue::Array{
+          ResultValue{ResultValue::Object{{"a", int_array(2)}}}}}}});
+  return ResultValue{std::move(object)};
+}
+
+void write_unsized_result_value(const ResultValue &value,
+                                results::Serializer &serializer) {
+  if (const auto *primitive = std::get_if<Primitive>(&value.value_)) {
+    serializer.write_value(*primitive);
+  } else if (const auto *array =
+                 std::get_if<ResultValue::Array>(&value.value_)) {
+    serializer.start_array();
+    for (const auto &element : *array) {
+      write_unsized_result_value(element, serializer);
+    }
+    serializer.end_array();
+  } else {
+    serializer.start_object();
+    for (const auto &[key, element] :
+         std::get<ResultValue::Object>(value.value_)) {
+      serializer.write_key(key);
+      write_unsized_result_value(element, serializer);
+    }
+    serializer.end_object();
+  }
+}
+
+std::string to_json(const ResultValue &value) {
+  auto os = std::ostringstream{};
+  results::write_result_value(value, *results::get_serializer(os));
+  return os.str();
+}
+
+} // namespace sq::test
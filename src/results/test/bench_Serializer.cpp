@@ -0,0 +1,228 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+// Benchmark for serializing results.
+//
+// Usage: sq-results-bench [ELEMENTS [REPEATS]]
+//
+// Serializes an array of ELEMENTS objects, each with a path string, an int, a
+// float and a bool, to /dev/null with each kind of serializer output. Built-in
+// compression is compared with piping the output to gzip and zstd commands,
+// which must be in the PATH. Elements rendered on worker threads and spliced
+// into the output, as when they're evaluated in parallel, are compared with
+// elements written directly.
+
+#include "core/Primitive.h"
+#include "results/Compressor.h"
+#include "results/Serializer.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using sq::results::Compression;
+using sq::results::CompressionAlgorithm;
+using sq::results::FlushPolicy;
+using sq::results::Serializer;
+
+constexpr std::size_t default_elements = 1000000;
+constexpr std::size_t default_repeats = 5;
+
+struct Output {
+  const char *name_;
+  std::function<void(std::size_t)> run_;
+  bool compressed_ = false;
+};
+
+void serialize_element(Serializer &serializer, std::size_t i) {
+  // Keys are prepared when a query plan is created.
+  static const auto path_key = sq::results::PreparedKey{"path"};
+  static const auto size_key = sq::results::PreparedKey{"size"};
+  static const auto ratio_key = sq::results::PreparedKey{"ratio"};
+  static const auto regular_key = sq::results::PreparedKey{"regular"};
+
+  serializer.start_object();
+  serializer.write_key(path_key);
+  serializer.write_value(sq::PrimitiveString{
+      "/usr/share/doc/some-package/file-" + std::to_string(i) + ".txt"});
+  serializer.write_key(size_key);
+  serializer.write_value(sq::to_primitive_int(i));
+  serializer.write_key(ratio_key);
+  serializer.write_value(sq::PrimitiveFloat{static_cast<double>(i) / 7});
+  serializer.write_key(regular_key);
+  serializer.write_value(sq::PrimitiveBool{i % 2 == 0});
+  serializer.end_object();
+}
+
+void serialize(Serializer &serializer, std::size_t elements) {
+  serializer.start_array();
+  for (auto i = std::size_t{0}; i < elements; ++i) {
+    serialize_element(serializer, i);
+  }
+  serializer.end_array();
+}
+
+// Capture the elements on worker threads, a slice of each batch of elements
+// per thread, then splice each batch into the output in order.
+void serialize_spliced(Serializer &serializer, std::size_t elements,
+                       std::size_t threads) {
+  static constexpr auto batch_size = std::size_t{4096};
+  auto captures = std::vector<sq::results::ValueCapturePtr>{};
+  serializer.start_array();
+  for (auto start = std::size_t{0}; start < elements; start += batch_size) {
+    const auto end = std::min(start + batch_size, elements);
+    captures.resize(end - start);
+    for (auto &capture : captures) {
+      if (!capture) {
+        capture = serializer.capture();
+      }
+    }
+    {
+      auto workers = std::vector<std::jthread>{};
+      for (auto t = std::size_t{0}; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+          for (auto i = start + t; i < end; i += threads) {
+            serialize_element(*captures[i - start], i);
+          }
+        });
+      }
+    }
+    for (auto &capture : captures) {
+      capture->splice();
+    }
+  }
+  serializer.end_array();
+}
+
+void serialize_to_stream(std::size_t elements) {
+  auto os = std::ofstream{"/dev/null"};
+  serialize(*sq::results::get_serializer(os), elements);
+}
+
+void serialize_to_fd(std::size_t elements, FlushPolicy policy,
+                     const Compression &compression = {}) {
+  const auto fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  if (fd == -1) {
+    throw std::runtime_error{"open() failed"};
+  }
+  serialize(*sq::results::get_serializer(fd, sq::results::OutputFormat::Json,
+                                         policy, compression),
+            elements);
+  close(fd);
+}
+
+void serialize_to_fd_spliced(std::size_t elements, std::size_t threads) {
+  const auto fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+  if (fd == -1) {
+    throw std::runtime_error{"open() failed"};
+  }
+  serialize_spliced(*sq::results::get_serializer(fd, FlushPolicy::WhenFull),
+                    elements, threads);
+  close(fd);
+}
+
+// Serialize to a pipe to a command, like `sq | zstd`.
+void serialize_to_pipe(std::size_t elements, const char *command) {
+  auto *pipe = popen(command, "w");
+  if (pipe == nullptr) {
+    throw std::runtime_error{"popen() failed"};
+  }
+  serialize(*sq::results::get_serializer(fileno(pipe), FlushPolicy::WhenFull),
+            elements);
+  if (pclose(pipe) != 0) {
+    throw std::runtime_error{std::string{command} + " failed"};
+  }
+}
+
+int run(std::size_t elements, std::size_t repeats) {
+  const auto outputs = std::array{
+      Output{"ostream", serialize_to_stream},
+      Output{"fd, flush when full",
+             [](auto n) { serialize_to_fd(n, FlushPolicy::WhenFull); }},
+      Output{"fd, flush each top-level element",
+             [](auto n) {
+               serialize_to_fd(n, FlushPolicy::EveryTopLevelElement);
+             }},
+      Output{"fd, gzip",
+             [](auto n) {
+               serialize_to_fd(n, FlushPolicy::WhenFull,
+                               Compression{CompressionAlgorithm::Gzip, {}});
+             },
+             true},
+      Output{"pipe to gzip",
+             [](auto n) { serialize_to_pipe(n, "gzip -c >/dev/null"); }},
+      Output{"fd, zstd",
+             [](auto n) {
+               serialize_to_fd(n, FlushPolicy::WhenFull,
+                               Compression{CompressionAlgorithm::Zstd, {}});
+             },
+             true},
+      Output{"fd, zstd, sync each top-level element",
+             [](auto n) {
+               serialize_to_fd(n, FlushPolicy::EveryTopLevelElement,
+                               Compression{CompressionAlgorithm::Zstd, {}});
+             },
+             true},
+      Output{"pipe to zstd",
+             [](auto n) { serialize_to_pipe(n, "zstd -q -c >/dev/null"); }},
+      Output{"fd, rendered on 1 thread and spliced",
+             [](auto n) { serialize_to_fd_spliced(n, 1); }},
+      Output{"fd, rendered on 4 threads and spliced",
+             [](auto n) { serialize_to_fd_spliced(n, 4); }},
+  };
+  for (const auto &output : outputs) {
+    if (output.compressed_ && !sq::results::compression_supported) {
+      continue;
+    }
+    auto times = std::vector<double>{};
+    for (auto i = std::size_t{0}; i < repeats; ++i) {
+      const auto start = std::chrono::steady_clock::now();
+      output.run_(elements);
+      const auto end = std::chrono::steady_clock::now();
+      times.push_back(std::chrono::duration<double, std::milli>(end - start)
+                          .count());
+    }
+    std::sort(times.begin(), times.end());
+    std::cout << output.name_ << ": " << elements << " elements, median "
+              << times.at(times.size() / 2) << "ms, min " << times.front()
+              << "ms\n";
+  }
+  return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  try {
+    const auto args = std::vector<std::string>(argv + 1, argv + argc);
+    const auto elements =
+        args.empty() ? default_elements : std::stoul(args.at(0));
+    const auto repeats =
+        args.size() > 1 ? std::stoul(args.at(1)) : default_repeats;
+    if (repeats == 0) {
+      throw std::invalid_argument{"REPEATS must be positive"};
+    }
+    return run(elements, repeats);
+  } catch (const std::exception &e) {
+    std::cerr << "sq-results-bench: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+}
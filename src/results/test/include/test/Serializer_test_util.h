@@ -0,0 +1,38 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_results_test_Serializer_test_util_h_
+#define SQ_INCLUDE_GUARD_results_test_Serializer_test_util_h_
+
+#include "core/typeutil.h"
+#include "results/ResultRecorder.h"
+#include "results/Serializer.h"
+
+#include <string>
+
+namespace sq::test {
+
+/**
+ * Get a result that covers each primitive type, the boundaries between the
+ * different encodings of ints, strings and containers in binary formats, and
+ * nested and empty containers.
+ */
+SQ_ND results::ResultValue sample_result_value();
+
+/**
+ * Write a recorded result to a serializer without giving the sizes of its
+ * arrays and objects up front.
+ */
+void write_unsized_result_value(const results::ResultValue &value,
+                                results::Serializer &serializer);
+
+/**
+ * Get the JSON for a recorded result.
+ */
+SQ_ND std::string to_json(const results::ResultValue &value);
+
+} // namespace sq::test
+
+#endif // SQ_INCLUDE_GUARD_results_test_Serializer_test_util_h_
@@ -0,0 +1,279 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/ArrowSerializer.h"
+
+#include "core/Primitive.h"
+#include "core/errors.h"
+#include "results/ResultRecorder.h"
+#include "results/Serializer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace sq::test {
+namespace {
+
+using results::ArrowSerializer;
+using results::ResultValue;
+
+constexpr auto schema_header = 1;
+constexpr auto record_batch_header = 3;
+constexpr auto null_type = 1;
+constexpr auto int_type = 2;
+constexpr auto utf8_type = 5;
+
+// Reads the fields of the flatbuffer tables in Arrow messages that the tests
+// need.
+class FlatbufferReader {
+public:
+  explicit FlatbufferReader(std::string_view data) : data_{data} {}
+
+  SQ_ND std::size_t root() const { return read(0, 4); }
+
+  // Get the position of a field of a table, if it's present.
+  SQ_ND std::optional<std::size_t> field(std::size_t table,
+                                         std::size_t id) const {
+    const auto vtable = table - read(table, 4);
+    const auto vtable_size = read(vtable, 2);
+    const auto entry = 4 + 2 * id;
+    if (entry >= vtable_size || read(vtable + entry, 2) == 0) {
+      return std::nullopt;
+    }
+    return table + read(vtable + entry, 2);
+  }
+
+  SQ_ND std::uint64_t scalar(std::size_t table, std::size_t id,
+                             std::size_t size) const {
+    const auto pos = field(table, id);
+    return pos ? read(*pos, size) : 0;
+  }
+
+  SQ_ND std::size_t table(std::size_t table, std::size_t id) const {
+    const auto pos = field(table, id).value();
+    return pos + read(pos, 4);
+  }
+
+  // Get the tables in a vector of tables.
+  SQ_ND std::vector<std::size_t> tables(std::size_t table,
+                                        std::size_t id) const {
+    const auto vector = this->table(table, id);
+    auto ret = std::vector<std::size_t>{};
+    for (auto i = std::size_t{0}; i < read(vector, 4); ++i) {
+      const auto pos = vector + 4 + 4 * i;
+      ret.push_back(pos + read(pos, 4));
+    }
+    return ret;
+  }
+
+private:
+  SQ_ND std::size_t read(std::size_t pos, std::size_t size) const {
+    EXPECT_LE(pos + size, data_.size());
+    auto value = std::size_t{0};
+    for (auto i = size; i > 0; --i) {
+      value = (value << 8U) | static_cast<std::uint8_t>(data_[pos + i - 1]);
+    }
+    return value;
+  }
+
+  std::string_view data_;
+};
+
+struct Message {
+  std::uint64_t header_type_;
+  std::uint64_t body_length_;
+  std::uint64_t rows_;
+
+  // The type of each field of a schema.
+  std::vector<std::uint64_t> types_;
+};
+
+// Split an Arrow IPC stream into its messages, checking that it ends with an
+// end-of-stream marker.
+SQ_ND std::vector<Message> read_messages(std::string_view stream) {
+  const auto read32 = [&](std::size_t pos) {
+    auto value = std::uint32_t{0};
+    for (auto i = std::size_t{4}; i > 0; --i) {
+      value = (value << 8U) | static_cast<std::uint8_t>(stream[pos + i - 1]);
+    }
+    return value;
+  };
+  auto messages = std::vector<Message>{};
+  auto pos = std::size_t{0};
+  for (;;) {
+    EXPECT_LE(pos + 8, stream.size());
+    if (pos + 8 > stream.size()) {
+      return messages;
+    }
+    EXPECT_EQ(read32(pos), 0xFFFFFFFF);
+    const auto metadata_size = read32(pos + 4);
+    if (metadata_size == 0) {
+      EXPECT_EQ(pos + 8, stream.size());
+      return messages;
+    }
+    EXPECT_EQ(metadata_size % 8, 0);
+    const auto reader =
+        FlatbufferReader{stream.substr(pos + 8, metadata_size)};
+    const auto message = reader.root();
+    auto m = Message{reader.scalar(message, 1, 1), reader.scalar(message, 3, 8),
+                     0, {}};
+    if (m.header_type_ == record_batch_header) {
+      m.rows_ = reader.scalar(reader.table(message, 2), 0, 8);
+    }
+    if (m.header_type_ == schema_header) {
+      for (const auto field : reader.tables(reader.table(message, 2), 1)) {
+        m.types_.push_back(reader.scalar(field, 2, 1));
+      }
+    }
+    messages.push_back(m);
+    pos += 8 + metadata_size + m.body_length_;
+  }
+}
+
+SQ_ND ResultValue row(PrimitiveInt i) {
+  return ResultValue{ResultValue::Object{
+      {"name", ResultValue{PrimitiveString{"row" + std::to_string(i)}}},
+      {"file", ResultValue{ResultValue::Object{
+                   {"size", ResultValue{PrimitiveInt{i}}}}}}}};
+}
+
+SQ_ND ResultValue::Array rows(PrimitiveInt n) {
+  auto elements = ResultValue::Array{};
+  for (auto i = PrimitiveInt{0}; i < n; ++i) {
+    elements.push_back(row(i));
+  }
+  return elements;
+}
+
+// {"path":{"children":[elements...]}}
+SQ_ND ResultValue children(ResultValue::Array elements) {
+  return ResultValue{ResultValue::Object{
+      {"path", ResultValue{ResultValue::Object{
+                   {"children", ResultValue{std::move(elements)}}}}}}};
+}
+
+SQ_ND std::string to_arrow(const ResultValue &value, std::size_t batch_size) {
+  auto os = std::ostringstream{};
+  auto serializer = ArrowSerializer{os, batch_size};
+  results::write_result_value(value, serializer);
+  return os.str();
+}
+
+TEST(ArrowSerializerTest, TestBatches) {
+  const auto messages = read_messages(to_arrow(children(rows(7)), 3));
+  ASSERT_EQ(messages.size(), 4);
+  EXPECT_EQ(messages[0].header_type_, schema_header);
+  EXPECT_EQ(messages[0].body_length_, 0);
+  for (auto i = std::size_t{1}; i < messages.size(); ++i) {
+    EXPECT_EQ(messages[i].header_type_, record_batch_header);
+    EXPECT_EQ(messages[i].body_length_ % 8, 0);
+  }
+  EXPECT_EQ(messages[1].rows_, 3);
+  EXPECT_EQ(messages[2].rows_, 3);
+  EXPECT_EQ(messages[3].rows_, 1);
+}
+
+TEST(ArrowSerializerTest, TestExactBatches) {
+  const auto messages = read_messages(to_arrow(children(rows(6)), 3));
+  ASSERT_EQ(messages.size(), 3);
+  EXPECT_EQ(messages[1].rows_, 3);
+  EXPECT_EQ(messages[2].rows_, 3);
+}
+
+TEST(ArrowSerializerTest, TestEmptyList) {
+  const auto messages = read_messages(to_arrow(children(rows(0)), 3));
+  ASSERT_EQ(messages.size(), 2);
+  EXPECT_EQ(messages[0].header_type_, schema_header);
+  EXPECT_EQ(messages[1].rows_, 0);
+}
+
+TEST(ArrowSerializerTest, TestTruncationMarker) {
+  auto elements = rows(2);
+  elements.push_back(ResultValue{ResultValue::Object{
+      {std::string{results::truncation_marker_key},
+       ResultValue{PrimitiveBool{true}}}}});
+  const auto value = children(std::move(elements));
+  const auto messages = read_messages(to_arrow(value, 3));
+  ASSERT_EQ(messages.size(), 2);
+  EXPECT_EQ(messages[1].rows_, 2);
+}
+
+TEST(ArrowSerializerTest, TestOutputSizeIncludesBufferedRows) {
+  auto os = std::ostringstream{};
+  auto serializer = ArrowSerializer{os, 3};
+  serializer.start_array();
+  results::write_result_value(row(0), serializer);
+  const auto size = serializer.output_size();
+  EXPECT_GT(size, 0);
+  EXPECT_EQ(os.str().size(), 0);
+  results::write_result_value(row(1), serializer);
+  EXPECT_GT(serializer.output_size(), size);
+  results::write_result_value(row(2), serializer);
+  EXPECT_GE(serializer.output_size(), os.str().size());
+  serializer.end_array();
+  EXPECT_EQ(serializer.output_size(), os.str().size());
+}
+
+TEST(ArrowSerializerTest, TestListInRow) {
+  const auto value = ResultValue{ResultValue::Array{
+      ResultValue{ResultValue::Array{ResultValue{PrimitiveInt{1}}}}}};
+  EXPECT_THROW((void)to_arrow(value, 3), NotAScalarError);
+}
+
+TEST(ArrowSerializerTest, TestNoList) {
+  EXPECT_THROW((void)to_arrow(row(1), 3), NotAnArrayError);
+  EXPECT_THROW((void)to_arrow(ResultValue{PrimitiveInt{1}}, 3),
+               NotAnArrayError);
+}
+
+TEST(ArrowSerializerTest, TestDifferentFields) {
+  const auto value = ResultValue{ResultValue::Array{
+      ResultValue{ResultValue::Object{{"a", ResultValue{PrimitiveInt{1}}}}},
+      ResultValue{ResultValue::Object{{"b", ResultValue{PrimitiveInt{1}}}}}}};
+  EXPECT_THROW((void)to_arrow(value, 3), InvalidConversionError);
+}
+
+TEST(ArrowSerializerTest, TestDifferentTypes) {
+  const auto value = ResultValue{ResultValue::Array{
+      ResultValue{PrimitiveInt{1}}, ResultValue{PrimitiveString{"1"}}}};
+  EXPECT_THROW((void)to_arrow(value, 3), InvalidConversionError);
+}
+
+TEST(ArrowSerializerTest, TestNullColumnTypedInLaterBatch) {
+  const auto value = ResultValue{ResultValue::Array{
+      ResultValue{primitive_null}, ResultValue{PrimitiveInt{1}}}};
+  const auto messages = read_messages(to_arrow(value, 1));
+  ASSERT_EQ(messages.size(), 3);
+  EXPECT_EQ(messages[0].types_, std::vector<std::uint64_t>{int_type});
+  EXPECT_EQ(messages[1].rows_, 1);
+  EXPECT_EQ(messages[2].rows_, 1);
+}
+
+TEST(ArrowSerializerTest, TestNullColumn) {
+  const auto value = ResultValue{ResultValue::Array{
+      ResultValue{primitive_null}, ResultValue{primitive_null}}};
+  const auto messages = read_messages(to_arrow(value, 1));
+  ASSERT_EQ(messages.size(), 3);
+  EXPECT_EQ(messages[0].types_, std::vector<std::uint64_t>{null_type});
+}
+
+TEST(ArrowSerializerTest, TestNullColumnAfterPendingBatches) {
+  auto elements = ResultValue::Array(ArrowSerializer::max_pending_batches + 1,
+                                     ResultValue{primitive_null});
+  elements.push_back(ResultValue{PrimitiveInt{1}});
+  const auto messages = read_messages(to_arrow(ResultValue{elements}, 1));
+  ASSERT_EQ(messages.size(), elements.size() + 1);
+  EXPECT_EQ(messages[0].types_, std::vector<std::uint64_t>{utf8_type});
+}
+
+} // namespace
+} // namespace sq::test
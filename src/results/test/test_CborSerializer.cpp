@@ -0,0 +1,229 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/CborSerializer.h"
+
+#include "core/Primitive.h"
+#include "results/ResultRecorder.h"
+#include "results/Serializer.h"
+#include "test/Serializer_test_util.h"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+namespace sq::test {
+namespace {
+
+using results::CborSerializer;
+using results::FlushPolicy;
+using results::ResultValue;
+
+// Decodes the subset of CBOR written by CborSerializer and replays it into
+// another serializer.
+class CborDecoder {
+public:
+  explicit CborDecoder(std::string_view data) : data_{data} {}
+
+  void decode(results::Serializer &serializer) {
+    const auto initial = byte();
+    const auto major_type = initial >> 5U;
+    const auto info = static_cast<std::uint8_t>(initial & 0x1FU);
+    switch (major_type) {
+    case 0:
+      serializer.write_value(
+          PrimitiveInt{static_cast<std::int64_t>(argument(info))});
+      return;
+    case 1:
+      serializer.write_value(
+          PrimitiveInt{static_cast<std::int64_t>(~argument(info))});
+      return;
+    case 3:
+      serializer.write_value(PrimitiveString{string(info)});
+      return;
+    case 4:
+      decode_container(serializer, info, true);
+      return;
+    case 5:
+      decode_container(serializer, info, false);
+      return;
+    case 7:
+      decode_simple(serializer, info);
+      return;
+    default:
+      FAIL() << "unexpected major type " << major_type;
+    }
+  }
+
+  SQ_ND bool done() const { return pos_ == data_.size(); }
+
+private:
+  static constexpr auto indefinite = std::uint8_t{31};
+  static constexpr auto break_byte = std::uint8_t{0xFF};
+
+  void decode_container(results::Serializer &serializer, std::uint8_t info,
+                        bool array) {
+    const auto member = [&] {
+      if (!array) {
+        const auto key_initial = byte();
+        ASSERT_EQ(key_initial >> 5U, 3);
+        serializer.write_key(
+            string(static_cast<std::uint8_t>(key_initial & 0x1FU)));
+      }
+      decode(serializer);
+    };
+    array ? serializer.start_array() : serializer.start_object();
+    if (info == indefinite) {
+      while (peek() != break_byte) {
+        member();
+      }
+      (void)byte();
+    } else {
+      for (auto n = argument(info); n > 0; --n) {
+        member();
+      }
+    }
+    array ? serializer.end_array() : serializer.end_object();
+  }
+
+  void decode_simple(results::Serializer &serializer, std::uint8_t info) {
+    switch (info) {
+    case 20:
+      serializer.write_value(PrimitiveBool{false});
+      return;
+    case 21:
+      serializer.write_value(PrimitiveBool{true});
+      return;
+    case 22:
+      serializer.write_value(primitive_null);
+      return;
+    case 27:
+      serializer.write_value(
+          PrimitiveFloat{std::bit_cast<double>(big_endian(8))});
+      return;
+    default:
+      FAIL() << "unexpected simple value " << static_cast<unsigned>(info);
+    }
+  }
+
+  SQ_ND std::uint64_t argument(std::uint8_t info) {
+    if (info < 24) {
+      return info;
+    }
+    EXPECT_LE(info, 27);
+    return big_endian(std::size_t{1} << (info - 24U));
+  }
+
+  SQ_ND std::string string(std::uint8_t info) {
+    const auto size = static_cast<std::size_t>(argument(info));
+    EXPECT_LE(pos_ + size, data_.size());
+    auto str = std::string{data_.substr(pos_, size)};
+    pos_ += size;
+    return str;
+  }
+
+  SQ_ND std::uint64_t big_endian(std::size_t size) {
+    auto value = std::uint64_t{0};
+    for (auto i = std::size_t{0}; i < size; ++i) {
+      value = (value << 8U) | byte();
+    }
+    return value;
+  }
+
+  SQ_ND std::uint8_t peek() const {
+    EXPECT_LT(pos_, data_.size());
+    return pos_ < data_.size() ? static_cast<std::uint8_t>(data_[pos_]) : 0;
+  }
+
+  SQ_ND std::uint8_t byte() {
+    const auto b = peek();
+    ++pos_;
+    return b;
+  }
+
+  std::string_view data_;
+  std::size_t pos_ = 0;
+};
+
+SQ_ND std::string decode_to_json(std::string_view cbor) {
+  auto os = std::ostringstream{};
+  auto decoder = CborDecoder{cbor};
+  decoder.decode(*results::get_serializer(os));
+  EXPECT_TRUE(decoder.done());
+  return os.str();
+}
+
+TEST(CborSerializerTest, TestRoundTripSized) {
+  const auto value = sample_result_value();
+  auto os = std::ostringstream{};
+  {
+    auto serializer = CborSerializer{os, FlushPolicy::WhenFull};
+    results::write_result_value(value, serializer);
+  }
+  EXPECT_EQ(decode_to_json(os.str()), to_json(value));
+}
+
+TEST(CborSerializerTest, TestRoundTripUnsized) {
+  const auto value = sample_result_value();
+  auto os = std::ostringstream{};
+  {
+    auto serializer = CborSerializer{os, FlushPolicy::WhenFull};
+    write_unsized_result_value(value, serializer);
+  }
+  EXPECT_EQ(decode_to_json(os.str()), to_json(value));
+}
+
+SQ_ND std::string to_cbor(const Primitive &value) {
+  auto os = std::ostringstream{};
+  results::get_serializer(os, results::OutputFormat::Cbor)->write_value(value);
+  return os.str();
+}
+
+// Examples from RFC 8949 appendix A.
+TEST(CborSerializerTest, TestPrimitiveEncodings) {
+  using namespace std::string_literals;
+  EXPECT_EQ(to_cbor(PrimitiveInt{0}), "\x00"s);
+  EXPECT_EQ(to_cbor(PrimitiveInt{23}), "\x17");
+  EXPECT_EQ(to_cbor(PrimitiveInt{24}), "\x18\x18");
+  EXPECT_EQ(to_cbor(PrimitiveInt{1000}), "\x19\x03\xe8");
+  EXPECT_EQ(to_cbor(PrimitiveInt{1000000}), "\x1a\x00\x0f\x42\x40"s);
+  EXPECT_EQ(to_cbor(PrimitiveInt{1000000000000}),
+            "\x1b\x00\x00\x00\xe8\xd4\xa5\x10\x00"s);
+  EXPECT_EQ(to_cbor(PrimitiveInt{-1}), "\x20");
+  EXPECT_EQ(to_cbor(PrimitiveInt{-100}), "\x38\x63");
+  EXPECT_EQ(to_cbor(PrimitiveInt{-1000}), "\x39\x03\xe7");
+  EXPECT_EQ(to_cbor(std::numeric_limits<PrimitiveInt>::min()),
+            "\x3b\x7f\xff\xff\xff\xff\xff\xff\xff");
+  EXPECT_EQ(to_cbor(PrimitiveFloat{1.1}),
+            "\xfb\x3f\xf1\x99\x99\x99\x99\x99\x9a");
+  EXPECT_EQ(to_cbor(PrimitiveBool{false}), "\xf4");
+  EXPECT_EQ(to_cbor(PrimitiveBool{true}), "\xf5");
+  EXPECT_EQ(to_cbor(primitive_null), "\xf6");
+  EXPECT_EQ(to_cbor(PrimitiveString{""}), "\x60");
+  EXPECT_EQ(to_cbor(PrimitiveString{"IETF"}), "\x64IETF");
+}
+
+TEST(CborSerializerTest, TestContainerEncodings) {
+  const auto value = ResultValue{ResultValue::Array{
+      ResultValue{PrimitiveInt{1}},
+      ResultValue{ResultValue::Object{{"a", ResultValue{PrimitiveInt{2}}}}}}};
+  auto sized = std::ostringstream{};
+  results::write_result_value(
+      value, *results::get_serializer(sized, results::OutputFormat::Cbor));
+  EXPECT_EQ(sized.str(), "\x82\x01\xa1\x61\x61\x02");
+
+  auto unsized = std::ostringstream{};
+  write_unsized_result_value(
+      value, *results::get_serializer(unsized, results::OutputFormat::Cbor));
+  EXPECT_EQ(unsized.str(), "\x9f\x01\xbf\x61\x61\x02\xff\xff");
+}
+
+} // namespace
+} // namespace sq::test
@@ -0,0 +1,186 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/Compressor.h"
+
+#include "core/Primitive.h"
+#include "core/errors.h"
+#include "results/NdjsonSerializer.h"
+#include "results/OutputBuffer.h"
+
+#include <chrono>
+#include <cstddef>
+#include <gtest/gtest.h>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <zlib.h>
+#include <zstd.h>
+
+namespace sq::test {
+namespace {
+
+using results::Compression;
+using results::CompressionAlgorithm;
+using results::OutputBuffer;
+
+// Decompress as much of a gzip stream as possible, which may be incomplete
+// or consist of several members.
+SQ_ND std::string gunzip(std::string_view compressed) {
+  auto stream = z_stream{};
+  // Adding 32 to the window bits makes zlib accept a gzip header.
+  EXPECT_EQ(inflateInit2(&stream, 15 + 32), Z_OK);
+  auto out = std::string{};
+  auto chunk = std::string(4096, '\0');
+  // NOLINTNEXTLINE
+  stream.next_in = reinterpret_cast<Bytef *>(
+      const_cast<char *>(compressed.data())); // NOLINT
+  stream.avail_in = static_cast<uInt>(compressed.size());
+  for (;;) {
+    // NOLINTNEXTLINE
+    stream.next_out = reinterpret_cast<Bytef *>(chunk.data());
+    stream.avail_out = static_cast<uInt>(chunk.size());
+    const auto rc = inflate(&stream, Z_SYNC_FLUSH);
+    out.append(chunk.data(), chunk.size() - stream.avail_out);
+    if (rc == Z_STREAM_END && stream.avail_in > 0) {
+      EXPECT_EQ(inflateReset(&stream), Z_OK);
+      continue;
+    }
+    if (rc != Z_OK || (stream.avail_in == 0 && stream.avail_out != 0)) {
+      EXPECT_TRUE(rc == Z_OK || rc == Z_STREAM_END || rc == Z_BUF_ERROR);
+      break;
+    }
+  }
+  inflateEnd(&stream);
+  return out;
+}
+
+// Decompress as much of a zstd stream as possible, which may be incomplete
+// or consist of several frames.
+SQ_ND std::string unzstd(std::string_view compressed) {
+  auto *context = ZSTD_createDCtx();
+  auto out = std::string{};
+  auto chunk = std::string(4096, '\0');
+  auto in = ZSTD_inBuffer{compressed.data(), compressed.size(), 0};
+  for (;;) {
+    auto zstd_out = ZSTD_outBuffer{chunk.data(), chunk.size(), 0};
+    const auto rc = ZSTD_decompressStream(context, &zstd_out, &in);
+    EXPECT_EQ(ZSTD_isError(rc), 0U);
+    out.append(chunk.data(), zstd_out.pos);
+    if (ZSTD_isError(rc) != 0 ||
+        (in.pos == in.size && zstd_out.pos < zstd_out.size)) {
+      break;
+    }
+  }
+  ZSTD_freeDCtx(context);
+  return out;
+}
+
+SQ_ND std::string decompress(CompressionAlgorithm algorithm,
+                             std::string_view compressed) {
+  return algorithm == CompressionAlgorithm::Gzip ? gunzip(compressed)
+                                                 : unzstd(compressed);
+}
+
+// A highly compressible string that's bigger than an OutputBuffer.
+SQ_ND std::string big_string() {
+  auto str = std::string{};
+  for (auto i = 0; str.size() < 3 * OutputBuffer::default_capacity; ++i) {
+    str += "line " + std::to_string(i % 100) + "\n";
+  }
+  return str;
+}
+
+class CompressorTest : public testing::TestWithParam<CompressionAlgorithm> {
+protected:
+  SQ_ND Compression compression() const {
+    return Compression{GetParam(), std::nullopt};
+  }
+};
+
+TEST_P(CompressorTest, TestRoundTrip) {
+  const auto input = big_string();
+  auto os = std::ostringstream{};
+  {
+    auto out = OutputBuffer{os, compression()};
+    for (auto pos = std::size_t{0}; pos < input.size(); pos += 1000) {
+      out.append(std::string_view{input}.substr(pos, 1000));
+      if (out.full()) {
+        out.flush();
+      }
+    }
+    out.finish();
+  }
+  EXPECT_LT(os.str().size(), input.size() / 10);
+  EXPECT_EQ(decompress(GetParam(), os.str()), input);
+}
+
+TEST_P(CompressorTest, TestSync) {
+  auto os = std::ostringstream{};
+  auto out = OutputBuffer{os, compression()};
+  out.append("{\"a\":1}\n");
+  out.sync();
+  EXPECT_EQ(decompress(GetParam(), os.str()), "{\"a\":1}\n");
+  out.append("{\"a\":2}\n");
+  out.sync();
+  EXPECT_EQ(decompress(GetParam(), os.str()), "{\"a\":1}\n{\"a\":2}\n");
+}
+
+TEST_P(CompressorTest, TestFinishStartsNewStream) {
+  auto os = std::ostringstream{};
+  {
+    auto out = OutputBuffer{os, compression()};
+    out.append("1\n");
+    out.finish();
+    const auto first_size = os.str().size();
+    out.finish();
+    EXPECT_EQ(os.str().size(), first_size);
+    out.append("2\n");
+  }
+  EXPECT_EQ(decompress(GetParam(), os.str()), "1\n2\n");
+}
+
+TEST_P(CompressorTest, TestNothingWritten) {
+  auto os = std::ostringstream{};
+  { auto out = OutputBuffer{os, compression()}; }
+  EXPECT_EQ(os.str(), "");
+}
+
+TEST_P(CompressorTest, TestNdjsonLines) {
+  auto os = std::ostringstream{};
+  auto serializer = results::NdjsonSerializer{
+      os, {}, std::chrono::milliseconds::zero(), compression()};
+  serializer.start_array();
+  serializer.write_value(PrimitiveInt{1});
+  EXPECT_EQ(decompress(GetParam(), os.str()), "1\n");
+  serializer.write_value(PrimitiveInt{2});
+  EXPECT_EQ(decompress(GetParam(), os.str()), "1\n2\n");
+  serializer.end_array();
+  EXPECT_EQ(decompress(GetParam(), os.str()), "1\n2\n");
+}
+
+INSTANTIATE_TEST_SUITE_P(Algorithms, CompressorTest,
+                         testing::Values(CompressionAlgorithm::Gzip,
+                                         CompressionAlgorithm::Zstd));
+
+TEST(MakeCompressorTest, TestLevels) {
+  EXPECT_EQ(results::make_compressor(Compression{}), nullptr);
+  EXPECT_NE(results::make_compressor(
+                Compression{CompressionAlgorithm::Gzip, 9}),
+            nullptr);
+  EXPECT_NE(results::make_compressor(
+                Compression{CompressionAlgorithm::Zstd, 19}),
+            nullptr);
+  EXPECT_THROW((void)results::make_compressor(
+                   Compression{CompressionAlgorithm::Gzip, 10}),
+               OutOfRangeError);
+  EXPECT_THROW((void)results::make_compressor(
+                   Compression{CompressionAlgorithm::Zstd, 1000}),
+               OutOfRangeError);
+}
+
+} // namespace
+} // namespace sq::test
@@ -0,0 +1,114 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/Delta.h"
+
+#include "results/Serializer.h"
+#include "test/results_test_util.h"
+
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <utility>
+
+namespace sq::test {
+namespace {
+
+using results::DeltaWriter;
+using results::ResultRecorder;
+using results::ResultValue;
+
+// Record an array of {"inode": ..., "size": ...} objects.
+ResultValue record_files(
+    std::initializer_list<std::pair<PrimitiveInt, PrimitiveInt>> files) {
+  auto recorder = ResultRecorder{};
+  recorder.start_object();
+  recorder.write_key("files");
+  recorder.start_array();
+  for (const auto &[inode, size] : files) {
+    recorder.start_object();
+    recorder.write_key("inode");
+    recorder.write_value(inode);
+    recorder.write_key("size");
+    recorder.write_value(size);
+    recorder.end_object();
+  }
+  recorder.end_array();
+  recorder.end_object();
+  return recorder.take();
+}
+
+struct DeltaTest : public ::testing::Test {
+  std::string write_delta(const ResultValue &value) {
+    auto os = std::ostringstream{};
+    auto serializer = results::get_serializer(os);
+    written_ = delta_.write_delta(value, *serializer);
+    return os.str();
+  }
+
+  DeltaWriter delta_;
+  bool written_ = false;
+};
+
+TEST(ResultRecorderTest, TestRoundTrip) {
+  const auto value = record_files({{1, 10}, {2, 20}});
+  auto os = std::ostringstream{};
+  auto serializer = results::get_serializer(os);
+  results::write_result_value(value, *serializer);
+  expect_equivalent_json(
+      os.str(),
+      R"({"files": [{"inode": 1, "size": 10}, {"inode": 2, "size": 20}]})");
+}
+
+TEST_F(DeltaTest, TestFirstResultsAreAdded) {
+  expect_equivalent_json(
+      write_delta(record_files({{1, 10}})),
+      R"([{"op": "add", "path": [],
+           "value": {"files": [{"inode": 1, "size": 10}]}}])");
+  EXPECT_TRUE(written_);
+}
+
+TEST_F(DeltaTest, TestNoChanges) {
+  (void)write_delta(record_files({{1, 10}, {2, 20}}));
+  EXPECT_EQ(write_delta(record_files({{1, 10}, {2, 20}})), "");
+  EXPECT_FALSE(written_);
+}
+
+TEST_F(DeltaTest, TestElementsAreIdentifiedByFirstMember) {
+  (void)write_delta(record_files({{1, 10}, {2, 20}, {3, 30}}));
+  expect_equivalent_json(
+      write_delta(record_files({{4, 40}, {2, 21}, {3, 30}})),
+      R"([{"op": "add", "path": ["files", 4],
+           "value": {"inode": 4, "size": 40}},
+          {"op": "change", "path": ["files", 2, "size"], "value": 21},
+          {"op": "remove", "path": ["files", 1]}])");
+  EXPECT_TRUE(written_);
+}
+
+TEST_F(DeltaTest, TestDuplicateIdentitiesUsePositions) {
+  (void)write_delta(record_files({{1, 10}, {1, 20}}));
+  expect_equivalent_json(write_delta(record_files({{1, 10}, {1, 21}})),
+                         R"([{"op": "change", "path": ["files", 1, "size"],
+                              "value": 21}])");
+}
+
+TEST_F(DeltaTest, TestPrimitiveElements) {
+  const auto record = [](std::initializer_list<PrimitiveString> names) {
+    auto recorder = ResultRecorder{};
+    recorder.start_array();
+    for (const auto &name : names) {
+      recorder.write_value(name);
+    }
+    recorder.end_array();
+    return recorder.take();
+  };
+  (void)write_delta(record({"a", "b"}));
+  expect_equivalent_json(write_delta(record({"b", "c"})),
+                         R"([{"op": "add", "path": ["c"], "value": "c"},
+                             {"op": "remove", "path": ["a"]}])");
+}
+
+} // namespace
+} // namespace sq::test
@@ -0,0 +1,100 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/LimitedSerializer.h"
+
+#include "core/Primitive.h"
+#include "results/Serializer.h"
+#include "test/results_test_util.h"
+
+#include <cstddef>
+#include <gtest/gtest.h>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stop_token>
+#include <string>
+
+namespace sq::test {
+namespace {
+
+using results::LimitedSerializer;
+using results::OutputLimits;
+
+struct LimitedSerializerTest : public ::testing::Test {
+  SQ_ND LimitedSerializer limited(const OutputLimits &limits) {
+    return LimitedSerializer{*serializer, limits, source};
+  }
+
+  std::ostringstream os;
+  std::unique_ptr<results::Serializer> serializer =
+      results::get_serializer(os);
+  std::stop_source source;
+};
+
+TEST_F(LimitedSerializerTest, TestElementLimit) {
+  auto serializer = limited(OutputLimits{std::nullopt, 2});
+  serializer.start_array();
+  serializer.write_value(PrimitiveInt{0});
+  EXPECT_FALSE(source.stop_requested());
+  serializer.write_value(PrimitiveInt{1});
+  EXPECT_TRUE(source.stop_requested());
+  EXPECT_TRUE(serializer.limit_reached());
+  serializer.end_array();
+  expect_equivalent_json(os.str(), "[0, 1]");
+}
+
+TEST_F(LimitedSerializerTest, TestNestedElementsAreCounted) {
+  auto serializer = limited(OutputLimits{});
+  serializer.start_array();
+  serializer.start_array(2);
+  serializer.write_value(PrimitiveInt{0});
+  serializer.write_value(PrimitiveInt{1});
+  serializer.end_array();
+  serializer.start_object();
+  serializer.write_key("a");
+  serializer.start_array();
+  serializer.write_value(PrimitiveInt{2});
+  serializer.end_array();
+  serializer.end_object();
+  serializer.end_array();
+  EXPECT_EQ(serializer.elements(), 5U);
+  EXPECT_FALSE(source.stop_requested());
+  expect_equivalent_json(os.str(), R"([[0, 1], {"a": [2]}])");
+}
+
+TEST_F(LimitedSerializerTest, TestByteLimit) {
+  static constexpr auto max_bytes = std::size_t{100};
+  auto serializer = limited(OutputLimits{max_bytes, std::nullopt});
+  serializer.start_array();
+  while (!source.stop_requested()) {
+    EXPECT_LT(serializer.output_size(), max_bytes);
+    serializer.write_value(PrimitiveString{"0123456789"});
+  }
+  EXPECT_GE(serializer.output_size(), max_bytes);
+  EXPECT_EQ(serializer.output_size(), os.str().size());
+}
+
+TEST_F(LimitedSerializerTest, TestCapturedElementsAreCounted) {
+  auto serializer = limited(OutputLimits{std::nullopt, 5});
+  auto capture = serializer.capture();
+  capture->start_array();
+  capture->write_value(PrimitiveInt{0});
+  capture->write_value(PrimitiveInt{1});
+  capture->write_value(PrimitiveInt{2});
+  capture->end_array();
+  EXPECT_EQ(serializer.elements(), 0U);
+
+  serializer.start_array();
+  serializer.write_value(PrimitiveInt{3});
+  capture->splice();
+  EXPECT_EQ(serializer.elements(), 5U);
+  EXPECT_TRUE(source.stop_requested());
+  serializer.end_array();
+  expect_equivalent_json(os.str(), "[3, [0, 1, 2]]");
+}
+
+} // namespace
+} // namespace sq::test
@@ -0,0 +1,310 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/MessagePackSerializer.h"
+
+#include "core/Primitive.h"
+#include "results/ResultRecorder.h"
+#include "results/Serializer.h"
+#include "test/Serializer_test_util.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <gsl/gsl>
+#include <gtest/gtest.h>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+namespace sq::test {
+namespace {
+
+using results::FlushPolicy;
+using results::MessagePackSerializer;
+using results::ResultValue;
+
+// Decodes the subset of MessagePack written by MessagePackSerializer and
+// replays it into another serializer.
+class MessagePackDecoder {
+public:
+  explicit MessagePackDecoder(std::string_view data) : data_{data} {}
+
+  void decode(results::Serializer &serializer) {
+    const auto b = byte();
+    if (b <= 0x7F) {
+      serializer.write_value(PrimitiveInt{b});
+    } else if (b <= 0x8F) {
+      decode_map(serializer, b & 0x0FU);
+    } else if (b <= 0x9F) {
+      decode_array(serializer, b & 0x0FU);
+    } else if (b <= 0xBF) {
+      serializer.write_value(PrimitiveString{string(b & 0x1FU)});
+    } else if (b >= 0xE0) {
+      serializer.write_value(PrimitiveInt{static_cast<std::int8_t>(b)});
+    } else {
+      decode_typed(serializer, b);
+    }
+  }
+
+  SQ_ND bool done() const { return pos_ == data_.size(); }
+
+private:
+  void decode_typed(results::Serializer &serializer, std::uint8_t b) {
+    switch (b) {
+    case 0xC0:
+      serializer.write_value(primitive_null);
+      return;
+    case 0xC2:
+      serializer.write_value(PrimitiveBool{false});
+      return;
+    case 0xC3:
+      serializer.write_value(PrimitiveBool{true});
+      return;
+    case 0xCB:
+      serializer.write_value(
+          PrimitiveFloat{std::bit_cast<double>(big_endian(8))});
+      return;
+    case 0xCC:
+    case 0xCD:
+    case 0xCE:
+    case 0xCF:
+      serializer.write_value(PrimitiveInt{static_cast<std::int64_t>(
+          big_endian(std::size_t{1} << (b - 0xCCU)))});
+      return;
+    case 0xD0:
+      serializer.write_value(
+          PrimitiveInt{static_cast<std::int8_t>(big_endian(1))});
+      return;
+    case 0xD1:
+      serializer.write_value(
+          PrimitiveInt{static_cast<std::int16_t>(big_endian(2))});
+      return;
+    case 0xD2:
+      serializer.write_value(
+          PrimitiveInt{static_cast<std::int32_t>(big_endian(4))});
+      return;
+    case 0xD3:
+      serializer.write_value(
+          PrimitiveInt{static_cast<std::int64_t>(big_endian(8))});
+      return;
+    case 0xD9:
+    case 0xDA:
+    case 0xDB:
+      serializer.write_value(PrimitiveString{
+          string(big_endian(std::size_t{1} << (b - 0xD9U)))});
+      return;
+    case 0xDC:
+      decode_array(serializer, big_endian(2));
+      return;
+    case 0xDD:
+      decode_array(serializer, big_endian(4));
+      return;
+    case 0xDE:
+      decode_map(serializer, big_endian(2));
+      return;
+    case 0xDF:
+      decode_map(serializer, big_endian(4));
+      return;
+    default:
+      FAIL() << "unexpected type byte " << static_cast<unsigned>(b);
+    }
+  }
+
+  void decode_array(results::Serializer &serializer, std::uint64_t size) {
+    serializer.start_array();
+    for (; size > 0; --size) {
+      decode(serializer);
+    }
+    serializer.end_array();
+  }
+
+  void decode_map(results::Serializer &serializer, std::uint64_t size) {
+    serializer.start_object();
+    for (; size > 0; --size) {
+      // Decode the key as a string value into a recorder to get its text.
+      auto recorder = results::ResultRecorder{};
+      decode(recorder);
+      const auto key = recorder.take();
+      serializer.write_key(std::get<PrimitiveString>(
+          std::get<Primitive>(key.value_)));
+      decode(serializer);
+    }
+    serializer.end_object();
+  }
+
+  SQ_ND std::string string(std::uint64_t size) {
+    EXPECT_LE(pos_ + size, data_.size());
+    auto str = std::string{data_.substr(pos_, static_cast<std::size_t>(size))};
+    pos_ += static_cast<std::size_t>(size);
+    return str;
+  }
+
+  SQ_ND std::uint64_t big_endian(std::size_t size) {
+    auto value = std::uint64_t{0};
+    for (auto i = std::size_t{0}; i < size; ++i) {
+      value = (value << 8U) | byte();
+    }
+    return value;
+  }
+
+  SQ_ND std::uint8_t byte() {
+    EXPECT_LT(pos_, data_.size());
+    if (pos_ >= data_.size()) {
+      return 0;
+    }
+    return static_cast<std::uint8_t>(data_[pos_++]);
+  }
+
+  std::string_view data_;
+  std::size_t pos_ = 0;
+};
+
+SQ_ND std::string decode_to_json(std::string_view msgpack) {
+  auto os = std::ostringstream{};
+  auto decoder = MessagePackDecoder{msgpack};
+  decoder.decode(*results::get_serializer(os));
+  EXPECT_TRUE(decoder.done());
+  return os.str();
+}
+
+TEST(MessagePackSerializerTest, TestRoundTripSized) {
+  const auto value = sample_result_value();
+  auto os = std::ostringstream{};
+  {
+    auto serializer = MessagePackSerializer{os, FlushPolicy::WhenFull};
+    results::write_result_value(value, serializer);
+  }
+  EXPECT_EQ(decode_to_json(os.str()), to_json(value));
+}
+
+TEST(MessagePackSerializerTest, TestRoundTripUnsized) {
+  const auto value = sample_result_value();
+  auto os = std::ostringstream{};
+  {
+    auto serializer = MessagePackSerializer{os, FlushPolicy::WhenFull};
+    write_unsized_result_value(value, serializer);
+  }
+  EXPECT_EQ(decode_to_json(os.str()), to_json(value));
+}
+
+SQ_ND std::string to_msgpack(const Primitive &value) {
+  auto os = std::ostringstream{};
+  results::get_serializer(os, results::OutputFormat::MessagePack)
+      ->write_value(value);
+  return os.str();
+}
+
+TEST(MessagePackSerializerTest, TestPrimitiveEncodings) {
+  using namespace std::string_literals;
+  EXPECT_EQ(to_msgpack(PrimitiveInt{0}), "\x00"s);
+  EXPECT_EQ(to_msgpack(PrimitiveInt{127}), "\x7f");
+  EXPECT_EQ(to_msgpack(PrimitiveInt{128}), "\xcc\x80");
+  EXPECT_EQ(to_msgpack(PrimitiveInt{256}), "\xcd\x01\x00"s);
+  EXPECT_EQ(to_msgpack(PrimitiveInt{65536}), "\xce\x00\x01\x00\x00"s);
+  EXPECT_EQ(to_msgpack(PrimitiveInt{4294967296}),
+            "\xcf\x00\x00\x00\x01\x00\x00\x00\x00"s);
+  EXPECT_EQ(to_msgpack(PrimitiveInt{-1}), "\xff");
+  EXPECT_EQ(to_msgpack(PrimitiveInt{-32}), "\xe0");
+  EXPECT_EQ(to_msgpack(PrimitiveInt{-33}), "\xd0\xdf");
+  EXPECT_EQ(to_msgpack(PrimitiveInt{-129}), "\xd1\xff\x7f");
+  EXPECT_EQ(to_msgpack(std::numeric_limits<PrimitiveInt>::min()),
+            "\xd3\x80\x00\x00\x00\x00\x00\x00\x00"s);
+  EXPECT_EQ(to_msgpack(PrimitiveFloat{1.1}),
+            "\xcb\x3f\xf1\x99\x99\x99\x99\x99\x9a");
+  EXPECT_EQ(to_msgpack(PrimitiveBool{false}), "\xc2");
+  EXPECT_EQ(to_msgpack(PrimitiveBool{true}), "\xc3");
+  EXPECT_EQ(to_msgpack(primitive_null), "\xc0");
+  EXPECT_EQ(to_msgpack(PrimitiveString{""}), "\xa0");
+  // Split so that "abc" isn't part of the hex escape.
+  EXPECT_EQ(to_msgpack(PrimitiveString{"abc"}), "\xa3"
+                                                "abc");
+  EXPECT_EQ(to_msgpack(PrimitiveString(32, 's')),
+            "\xd9\x20" + std::string(32, 's'));
+}
+
+TEST(MessagePackSerializerTest, TestContainerEncodings) {
+  using namespace std::string_literals;
+  const auto value = ResultValue{ResultValue::Array{
+      ResultValue{PrimitiveInt{1}},
+      ResultValue{ResultValue::Object{{"a", ResultValue{PrimitiveInt{2}}}}}}};
+  auto sized = std::ostringstream{};
+  results::write_result_value(
+      value,
+      *results::get_serializer(sized, results::OutputFormat::MessagePack));
+  EXPECT_EQ(sized.str(), "\x92\x01\x81\xa1\x61\x02");
+
+  auto unsized = std::ostringstream{};
+  write_unsized_result_value(
+      value,
+      *results::get_serializer(unsized, results::OutputFormat::MessagePack));
+  EXPECT_EQ(unsized.str(),
+            "\xdd\x00\x00\x00\x02\x01\xdf\x00\x00\x00\x01\xa1\x61\x02"s);
+}
+
+std::string file_contents(int fd) {
+  auto str = std::string(4096, '\0');
+  const auto size = pread(fd, str.data(), str.size(), 0);
+  EXPECT_GE(size, 0);
+  str.resize(static_cast<std::size_t>(std::max(size, ssize_t{0})));
+  return str;
+}
+
+TEST(MessagePackSerializerTest, TestUnsizedContainersInFile) {
+  const auto file = std::unique_ptr<std::FILE, decltype(&std::fclose)>{
+      std::tmpfile(), &std::fclose};
+  const auto fd = fileno(file.get());
+  const auto contents = [fd] { return file_contents(fd); };
+
+  // The elements of the list are written before its size is known, and the
+  // size is filled in afterwards.
+  auto serializer =
+      MessagePackSerializer{fd, FlushPolicy::EveryTopLevelElement};
+  serializer.start_array();
+  serializer.start_object();
+  serializer.write_key("a");
+  serializer.write_value(PrimitiveInt{1});
+  serializer.end_object();
+  EXPECT_EQ(contents().size(), 13);
+  serializer.write_value(PrimitiveInt{2});
+  serializer.end_array();
+  EXPECT_EQ(decode_to_json(contents()), R"([{"a":1},2])");
+}
+
+TEST(MessagePackSerializerTest, TestUnsizedContainersInSharedFile) {
+  const auto file = std::unique_ptr<std::FILE, decltype(&std::fclose)>{
+      std::tmpfile(), &std::fclose};
+  const auto fd = fileno(file.get());
+  // Another writer with the same file description, like stderr with 2>&1.
+  const auto other = dup(fd);
+  ASSERT_NE(other, -1);
+  const auto close_other = gsl::finally([other] { close(other); });
+
+  auto serializer = MessagePackSerializer{fd, FlushPolicy::EveryCall};
+  serializer.start_array();
+  serializer.write_value(PrimitiveInt{1});
+  ASSERT_EQ(file_contents(fd).size(), 6);
+  ASSERT_EQ(::write(other, "xyz", 3), 3);
+
+  // The inner array's header is held back until its size is known, rather
+  // than being written after "xyz" and patched over it.
+  serializer.start_array();
+  serializer.write_value(PrimitiveInt{2});
+  serializer.end_array();
+  serializer.end_array();
+  const auto contents = file_contents(fd);
+  ASSERT_EQ(contents.size(), 15);
+  EXPECT_EQ(contents.substr(6, 3), "xyz");
+  EXPECT_EQ(decode_to_json(contents.substr(0, 6) + contents.substr(9)),
+            "[1,[2]]");
+}
+
+} // namespace
+} // namespace sq::test
@@ -0,0 +1,138 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/NdjsonSerializer.h"
+
+#include "core/Primitive.h"
+#include "results/ResultRecorder.h"
+#include "results/Serializer.h"
+
+#include <chrono>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sq::test {
+namespace {
+
+using results::NdjsonSerializer;
+using results::ResultValue;
+
+SQ_ND ResultValue int_value(PrimitiveInt i) { return ResultValue{i}; }
+
+SQ_ND ResultValue array_value(ResultValue::Array elements) {
+  return ResultValue{std::move(elements)};
+}
+
+// {"a":[1,2],"b":{"c":[[3]]},"d":4}
+SQ_ND ResultValue nested_lists_value() {
+  return ResultValue{ResultValue::Object{
+      {"a", array_value({int_value(1), int_value(2)})},
+      {"b", ResultValue{ResultValue::Object{
+                {"c", array_value({array_value({int_value(3)})})}}}},
+      {"d", int_value(4)}}};
+}
+
+SQ_ND std::string to_ndjson(const ResultValue &value,
+                            std::vector<std::string> list_path = {}) {
+  auto os = std::ostringstream{};
+  {
+    auto serializer = NdjsonSerializer{os, std::move(list_path),
+                                       std::chrono::milliseconds::zero()};
+    results::write_result_value(value, serializer);
+  }
+  return os.str();
+}
+
+TEST(NdjsonSerializerTest, TestTopLevelList) {
+  const auto value = array_value(
+      {int_value(1),
+       ResultValue{ResultValue::Object{
+           {"a", array_value({int_value(2), int_value(3)})}}},
+       ResultValue{PrimitiveString{"s\n"}}, array_value({})});
+  EXPECT_EQ(to_ndjson(value), "1\n{\"a\":[2,3]}\n\"s\\n\"\n[]\n");
+}
+
+TEST(NdjsonSerializerTest, TestOutermostLists) {
+  EXPECT_EQ(to_ndjson(nested_lists_value()), "1\n2\n[3]\n");
+}
+
+TEST(NdjsonSerializerTest, TestListPath) {
+  const auto value = nested_lists_value();
+  EXPECT_EQ(to_ndjson(value, {"a"}), "1\n2\n");
+  EXPECT_EQ(to_ndjson(value, {"b", "c"}), "[3]\n");
+}
+
+TEST(NdjsonSerializerTest, TestListPathToNonList) {
+  const auto value = nested_lists_value();
+  EXPECT_EQ(to_ndjson(value, {"d"}), "4\n");
+  EXPECT_EQ(to_ndjson(value, {"b"}), "{\"c\":[[3]]}\n");
+}
+
+TEST(NdjsonSerializerTest, TestMissingListPath) {
+  const auto value = nested_lists_value();
+  EXPECT_EQ(to_ndjson(value, {"x"}), "");
+  EXPECT_EQ(to_ndjson(value, {"a", "x"}), "");
+  EXPECT_EQ(to_ndjson(value, {"c"}), "");
+}
+
+TEST(NdjsonSerializerTest, TestTopLevelPrimitive) {
+  EXPECT_EQ(to_ndjson(int_value(5)), "5\n");
+}
+
+TEST(NdjsonSerializerTest, TestPreparedKeys) {
+  const auto a = results::PreparedKey{"a"};
+  const auto b = results::PreparedKey{"b"};
+  auto os = std::ostringstream{};
+  {
+    auto serializer =
+        NdjsonSerializer{os, {"a"}, std::chrono::milliseconds::zero()};
+    serializer.start_object();
+    serializer.write_key(a);
+    serializer.start_array();
+    for (auto i = 0; i < 2; ++i) {
+      serializer.start_object();
+      serializer.write_key(a);
+      serializer.write_value(PrimitiveInt{i});
+      serializer.write_key(b);
+      serializer.write_value(PrimitiveBool{true});
+      serializer.end_object();
+    }
+    serializer.end_array();
+    serializer.end_object();
+  }
+  EXPECT_EQ(os.str(), "{\"a\":0,\"b\":true}\n{\"a\":1,\"b\":true}\n");
+}
+
+TEST(NdjsonSerializerTest, TestFlushInterval) {
+  auto os = std::ostringstream{};
+  auto serializer =
+      NdjsonSerializer{os, {}, std::chrono::milliseconds::max()};
+  serializer.start_array();
+  serializer.write_value(PrimitiveInt{1});
+  EXPECT_EQ(os.str(), "");
+  serializer.write_value(PrimitiveInt{2});
+  EXPECT_EQ(os.str(), "");
+  serializer.end_array();
+  EXPECT_EQ(os.str(), "1\n2\n");
+}
+
+TEST(NdjsonSerializerTest, TestZeroFlushInterval) {
+  auto os = std::ostringstream{};
+  auto serializer =
+      NdjsonSerializer{os, {}, std::chrono::milliseconds::zero()};
+  serializer.start_array();
+  serializer.start_array();
+  serializer.write_value(PrimitiveInt{1});
+  EXPECT_EQ(os.str(), "");
+  serializer.end_array();
+  EXPECT_EQ(os.str(), "[1]\n");
+  serializer.end_array();
+}
+
+} // namespace
+} // namespace sq::test
@@ -0,0 +1,112 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/OutputPipeline.h"
+
+#include "results/Serializer.h"
+#include "test/results_test_util.h"
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace sq::test {
+namespace {
+
+using results::OutputPipeline;
+
+TEST(OutputPipelineTest, TestDataIsWrittenInOrder) {
+  auto os = std::ostringstream{};
+  auto expected = std::string{};
+  {
+    // Use small chunks so that data is split between many chunks.
+    auto pipeline = OutputPipeline{os, 7, 2};
+    for (auto i = 0; i < 1000; ++i) {
+      pipeline.stream() << i << ',';
+      expected += std::to_string(i) + ',';
+    }
+  }
+  EXPECT_EQ(os.str(), expected);
+}
+
+TEST(OutputPipelineTest, TestFinish) {
+  auto os = std::ostringstream{};
+  auto pipeline = OutputPipeline{os};
+  pipeline.stream() << "abc" << std::flush << "def";
+  pipeline.finish();
+  EXPECT_EQ(os.str(), "abcdef");
+}
+
+TEST(OutputPipelineTest, TestSerializer) {
+  auto os = std::ostringstream{};
+  {
+    auto pipeline = OutputPipeline{os, 4, 2};
+    auto serializer = results::get_serializer(pipeline.stream());
+    serializer->start_object();
+    serializer->write_key("numbers");
+    serializer->start_array();
+    for (auto i = 0; i < 3; ++i) {
+      serializer->write_value(PrimitiveInt{i});
+    }
+    serializer->end_array();
+    serializer->end_object();
+  }
+  expect_equivalent_json(os.str(), R"({"numbers": [0, 1, 2]})");
+}
+
+// A stream that records what had been written to it each time it's flushed.
+class FlushRecordingStream : private std::stringbuf, public std::ostream {
+public:
+  FlushRecordingStream() : std::ostream{this} {}
+
+  SQ_ND const std::vector<std::string> &flushes() const noexcept {
+    return flushes_;
+  }
+
+private:
+  int sync() override {
+    flushes_.push_back(str());
+    return 0;
+  }
+
+  std::vector<std::string> flushes_;
+};
+
+// Serialize [0, 1, 2] through a pipeline with the given flush policy, and get
+// what had been written each time the output stream was flushed.
+std::vector<std::string> pipeline_flushes(results::FlushPolicy policy) {
+  auto os = FlushRecordingStream{};
+  {
+    auto pipeline = OutputPipeline{os};
+    auto serializer = results::get_serializer(
+        pipeline.stream(), results::OutputFormat::Json, policy);
+    serializer->start_array();
+    for (auto i = 0; i < 3; ++i) {
+      serializer->write_value(PrimitiveInt{i});
+    }
+    serializer->end_array();
+  }
+  return os.flushes();
+}
+
+TEST(OutputPipelineTest, TestFlushPolicy) {
+  const auto element_flushes =
+      pipeline_flushes(results::FlushPolicy::EveryTopLevelElement);
+  for (const auto *prefix : {"[0", "[0,1", "[0,1,2"}) {
+    EXPECT_NE(std::find(element_flushes.begin(), element_flushes.end(),
+                        std::string{prefix}),
+              element_flushes.end())
+        << prefix;
+  }
+  for (const auto &flushed : pipeline_flushes(results::FlushPolicy::WhenFull)) {
+    EXPECT_TRUE(flushed.empty() || flushed == "[0,1,2]") << flushed;
+  }
+}
+
+} // namespace
+} // namespace sq::test
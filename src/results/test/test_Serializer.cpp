@@ -5,13 +5,24 @@
 
 #include "results/Serializer.h"
 
+#include "results/ResultRecorder.h"
 #include "results/results.h"
+#include "test/Serializer_test_util.h"
 #include "test/results_test_util.h"
 
+#include <algorithm>
 #include <cctype>
+#include <cstdio>
+#include <functional>
 #include <gtest/gtest.h>
+#include <memory>
 #include <range/v3/action/remove_if.hpp>
+#include <string>
+#include <sstream>
 #include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 namespace sq::test {
 
@@ -66,6 +77,20 @@ INSTANTIATE_TEST_SUITE_P(
         SerializePrimitiveTestCase{"-99.0", PrimitiveFloat{-99.0}},
         SerializePrimitiveTestCase{R"("")", PrimitiveString{""}},
         SerializePrimitiveTestCase{R"("str")", PrimitiveString{"str"}},
+        SerializePrimitiveTestCase{R"("a\"b\\c")",
+                                   PrimitiveString{"a\"b\\c"}},
+        SerializePrimitiveTestCase{R"("a\nb\tc\u0001")",
+                                   PrimitiveString{"a\nb\tc\x01"}},
+        SerializePrimitiveTestCase{R"("\b\f\n\r\t")",
+                                   PrimitiveString{"\b\f\n\r\t"}},
+        SerializePrimitiveTestCase{R"("\u0000\u000b\u001f")",
+                                   PrimitiveString{std::string{"\0\v\x1f", 3}}},
+        SerializePrimitiveTestCase{"\"\x7f/\xc3\xa9\"",
+                                   PrimitiveString{"\x7f/\xc3\xa9"}},
+        SerializePrimitiveTestCase{
+            R"("/usr/share/doc/some-package/long-file-name-\"quoted\".txt")",
+            PrimitiveString{
+                "/usr/share/doc/some-package/long-file-name-\"quoted\".txt"}},
         SerializePrimitiveTestCase{"true", PrimitiveBool{true}},
         SerializePrimitiveTestCase{"false", PrimitiveBool{false}}));
 
@@ -89,4 +114,183 @@ TEST_F(SerializerTest, TestSerializeArray) {
   expect_equivalent_json(ostream.str(), "[0, 1]");
 }
 
+TEST_F(SerializerTest, TestSerializePrimitiveRef) {
+  // A borrowed string only has to live until write_value() returns.
+  auto str = std::string{"a \"string\""};
+  serializer->start_array();
+  serializer->write_value(PrimitiveRef{std::string_view{str}});
+  str = "overwritten";
+  serializer->write_value(PrimitiveRef{PrimitiveInt{1}});
+  serializer->end_array();
+  expect_equivalent_json(ostream.str(), R"(["a \"string\"", 1])");
+}
+
+TEST_F(SerializerTest, TestSerializePreparedKeys) {
+  const auto a = results::PreparedKey{"a"};
+  const auto b = results::PreparedKey{"b\"c"};
+  EXPECT_EQ(b.name(), "b\"c");
+  EXPECT_EQ(b.json(), R"(,"b\"c":)");
+  serializer->start_array();
+  for (auto i = 0; i < 2; ++i) {
+    serializer->start_object();
+    serializer->write_key(a);
+    serializer->start_object();
+    serializer->write_key(b);
+    serializer->write_value(PrimitiveInt{i});
+    serializer->end_object();
+    serializer->write_key(b);
+    serializer->write_value(PrimitiveNull{});
+    serializer->end_object();
+  }
+  serializer->end_array();
+  expect_equivalent_json(ostream.str(), R"([
+    {"a": {"b\"c": 0}, "b\"c": null},
+    {"a": {"b\"c": 1}, "b\"c": null}
+  ])");
+}
+
+TEST_F(SerializerTest, TestSerializeNested) {
+  serializer->start_object();
+  serializer->write_key("a");
+  serializer->start_array();
+  serializer->start_array();
+  serializer->end_array();
+  serializer->start_object();
+  serializer->end_object();
+  serializer->write_value(PrimitiveInt{0});
+  serializer->end_array();
+  serializer->write_key("b");
+  serializer->start_array();
+  serializer->end_array();
+  serializer->end_object();
+  expect_equivalent_json(ostream.str(), R"({"a": [[], {}, 0], "b": []})");
+}
+
+struct SerializerCaptureTest
+    : ::testing::TestWithParam<results::OutputFormat> {
+  // Write an array of copies of a value, and an object with the value as a
+  // member, with the values captured by the given function.
+  SQ_ND std::string
+  write(const results::ResultValue &value,
+        const std::function<void(results::Serializer &,
+                                 const results::ResultValue &)> &write_value) {
+    auto os = std::ostringstream{};
+    auto serializer = results::get_serializer(os, GetParam());
+    serializer->start_array();
+    for (auto i = 0; i < 3; ++i) {
+      write_value(*serializer, value);
+    }
+    serializer->start_object();
+    serializer->write_key("a");
+    write_value(*serializer, value);
+    serializer->end_object();
+    serializer->end_array();
+    serializer.reset();
+    return os.str();
+  }
+};
+
+TEST_P(SerializerCaptureTest, TestSplicedOutputMatchesDirectOutput) {
+  const auto value = sample_result_value();
+  const auto direct =
+      write(value, [](auto &serializer, const auto &v) {
+        results::write_result_value(v, serializer);
+      });
+  const auto spliced =
+      write(value, [](auto &serializer, const auto &v) {
+        auto capture = serializer.capture();
+        std::jthread{[&] { results::write_result_value(v, *capture); }}
+            .join();
+        capture->splice();
+      });
+  EXPECT_EQ(spliced, direct);
+}
+
+TEST_P(SerializerCaptureTest, TestCaptureReuse) {
+  const auto value = results::ResultValue{PrimitiveInt{1}};
+  const auto direct =
+      write(value, [](auto &serializer, const auto &v) {
+        results::write_result_value(v, serializer);
+      });
+  auto captures = std::vector<results::ValueCapturePtr>{};
+  const auto spliced =
+      write(value, [&](auto &serializer, const auto &v) {
+        if (captures.empty()) {
+          captures.push_back(serializer.capture());
+        }
+        results::write_result_value(v, *captures.front());
+        captures.front()->splice();
+      });
+  EXPECT_EQ(spliced, direct);
+}
+
+INSTANTIATE_TEST_SUITE_P(Formats, SerializerCaptureTest,
+                         ::testing::Values(results::OutputFormat::Json,
+                                           results::OutputFormat::Cbor));
+
+// Serializes to a temporary file through its file descriptor.
+struct FdSerializerTest : public ::testing::Test {
+  SQ_ND std::string contents() const {
+    auto str = std::string(4096, '\0');
+    const auto size = pread(fd, str.data(), str.size(), 0);
+    EXPECT_GE(size, 0);
+    str.resize(static_cast<std::size_t>(std::max(size, ssize_t{0})));
+    return str;
+  }
+
+  std::unique_ptr<std::FILE, decltype(&std::fclose)> file{std::tmpfile(),
+                                                          &std::fclose};
+  int fd = fileno(file.get());
+};
+
+TEST_F(FdSerializerTest, TestSerializeObject) {
+  auto serializer = results::get_serializer(fd);
+  serializer->start_object();
+  serializer->write_key("a");
+  serializer->write_value(PrimitiveString{"x"});
+  serializer->write_key("b");
+  serializer->start_array();
+  serializer->write_value(PrimitiveFloat{1.0});
+  serializer->write_value(PrimitiveNull{});
+  serializer->end_array();
+  serializer->end_object();
+  expect_equivalent_json(contents(), R"({"a": "x", "b": [1.0, null]})");
+}
+
+TEST_F(FdSerializerTest, TestFlushWhenFull) {
+  auto serializer = results::get_serializer(fd, results::FlushPolicy::WhenFull);
+  serializer->start_array();
+  serializer->write_value(PrimitiveInt{0});
+  serializer->write_value(PrimitiveInt{1});
+  EXPECT_EQ(contents(), "");
+  serializer->end_array();
+  expect_equivalent_json(contents(), "[0, 1]");
+}
+
+TEST_F(FdSerializerTest, TestFlushEveryTopLevelElement) {
+  auto serializer =
+      results::get_serializer(fd, results::FlushPolicy::EveryTopLevelElement);
+  serializer->start_array();
+  serializer->start_object();
+  serializer->write_key("a");
+  serializer->write_value(PrimitiveInt{0});
+  EXPECT_EQ(contents(), "");
+  serializer->end_object();
+  auto str = contents();
+  std::erase_if(str, isspace);
+  EXPECT_EQ(str, R"([{"a":0})");
+  serializer->end_array();
+  expect_equivalent_json(contents(), R"([{"a": 0}])");
+}
+
+TEST_F(FdSerializerTest, TestFlushOnDestruction) {
+  auto serializer = results::get_serializer(fd, results::FlushPolicy::WhenFull);
+  serializer->start_array();
+  serializer->write_value(PrimitiveInt{0});
+  serializer.reset();
+  auto str = contents();
+  std::erase_if(str, isspace);
+  EXPECT_EQ(str, "[0");
+}
+
 } // namespace sq::test
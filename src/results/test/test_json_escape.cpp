@@ -0,0 +1,79 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "results/json_escape.h"
+
+#include <cstddef>
+#include <gtest/gtest.h>
+#include <string>
+#include <string_view>
+
+namespace sq::test {
+namespace {
+
+using results::detail::JsonEscapeFinder;
+
+constexpr auto max_test_size = std::size_t{80};
+
+bool needs_escape(unsigned char c) { return c == '"' || c == '\\' || c < 0x20; }
+
+// Check a finder against the expected position of the first character that
+// needs escaping, for a string of 'a's with the given character at each
+// position, for strings up to a few blocks long.
+void check_finder(std::string_view name, JsonEscapeFinder finder,
+                  unsigned char c) {
+  for (auto size = std::size_t{1}; size <= max_test_size; ++size) {
+    for (auto pos = std::size_t{0}; pos < size; ++pos) {
+      auto str = std::string(size, 'a');
+      str[pos] = static_cast<char>(c);
+      const auto expected = needs_escape(c) ? pos : size;
+      ASSERT_EQ(finder(str), expected)
+          << name << ": char " << static_cast<unsigned>(c) << " at " << pos
+          << " of " << size;
+    }
+  }
+}
+
+TEST(JsonEscapeTest, TestEveryCharEveryPosition) {
+  for (const auto &[name, finder] : results::detail::json_escape_finders()) {
+    for (auto c = 0U; c <= 0xFFU; ++c) {
+      check_finder(name, finder, static_cast<unsigned char>(c));
+    }
+  }
+}
+
+TEST(JsonEscapeTest, TestFirstOfSeveral) {
+  for (const auto &[name, finder] : results::detail::json_escape_finders()) {
+    for (auto first = std::size_t{0}; first < max_test_size; ++first) {
+      auto str = std::string(max_test_size, 'a');
+      str[first] = '\n';
+      for (auto pos = first + 1; pos < max_test_size; pos += 3) {
+        str[pos] = '"';
+      }
+      EXPECT_EQ(finder(str), first) << name << ": " << first;
+    }
+  }
+}
+
+TEST(JsonEscapeTest, TestEmpty) {
+  for (const auto &[name, finder] : results::detail::json_escape_finders()) {
+    EXPECT_EQ(finder(""), 0) << name;
+  }
+  EXPECT_EQ(results::find_json_escape(""), 0);
+}
+
+TEST(JsonEscapeTest, TestUnaligned) {
+  const auto str = std::string(max_test_size, 'a') + '\\';
+  for (const auto &[name, finder] : results::detail::json_escape_finders()) {
+    for (auto offset = std::size_t{0}; offset < max_test_size; ++offset) {
+      EXPECT_EQ(finder(std::string_view{str}.substr(offset)),
+                max_test_size - offset)
+          << name << ": " << offset;
+    }
+  }
+}
+
+} // namespace
+} // namespace sq::test
@@ -6,6 +6,7 @@
 #include "results/Serializer.h"
 #include "results/results.h"
 
+#include "core/FieldCallHints.h"
 #include "core/errors.h"
 #include "core/narrow.h"
 #include "core/strutil.h"
@@ -13,18 +14,30 @@
 #include "parser/Ast.h"
 #include "parser/Parser.h"
 #include "parser/TokenView.h"
+#include "results/LimitedSerializer.h"
 #include "test/FieldCallParams_test_util.h"
 #include "test/results_test_util.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fmt/format.h>
 #include <fmt/ostream.h>
 #include <gsl/gsl>
 #include <gtest/gtest.h>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <numeric>
 #include <range/v3/view/cartesian_product.hpp>
 #include <range/v3/view/iota.hpp>
 #include <range/v3/view/transform.hpp>
+#include <sstream>
+#include <stop_token>
+#include <string>
+#include <thread>
 #include <utility>
+#include <vector>
 
 namespace sq::test {
 namespace {
@@ -43,10 +56,11 @@ parser::Ast generate_ast(std::string_view query) {
   return parser.parse();
 }
 
-std::string generate_results(const parser::Ast &ast, const FieldPtr &root) {
+std::string generate_results(const parser::Ast &ast, const FieldPtr &root,
+                             const ResultOptions &options = {}) {
   std::ostringstream os{};
   auto serializer = get_serializer(os);
-  generate_results(ast, root, *serializer);
+  generate_results(QueryPlan{ast}, root, *serializer, options);
   return os.str();
 }
 
@@ -264,6 +278,16 @@ TEST_P(SimpleResultsTest, TestSimpleTreeGeneration) {
   expect_equivalent_json(results, expected);
 }
 
+TEST_P(SimpleResultsTest, TestParallelTreeGeneration) {
+  auto [query, expected, root] = GetParam();
+  const auto ast = generate_ast(query);
+  auto options = ResultOptions{};
+  options.jobs_ = 3;
+  options.max_buffered_elements_ = 2;
+  auto results = generate_results(ast, std::move(root), options);
+  expect_equivalent_json(results, expected);
+}
+
 INSTANTIATE_TEST_SUITE_P(
     SimpleQueries, SimpleResultsTest,
     ::testing::Values(
@@ -285,6 +309,297 @@ INSTANTIATE_TEST_SUITE_P(
                                     }));
                               })}));
 
+// A field whose "a" member is an array of the ints [0, size), where the
+// elements' "b" members take longer to evaluate for earlier elements.
+FieldPtr slow_elements_field(int size) {
+  return fake_field([size](auto, auto) {
+    return to_field_range(
+        input, rv::iota(0, size) | rv::transform([size](int i) {
+                 return fake_field(
+                     [size, i](auto, auto) -> Result {
+                       std::this_thread::sleep_for(
+                           std::chrono::milliseconds{size - i});
+                       return fake_field(PrimitiveInt{i});
+                     },
+                     PrimitiveInt{i});
+               }));
+  });
+}
+
+// Get the JSON for an array of the ints [0, size).
+std::string iota_json(int size) {
+  auto json = std::string{"["};
+  for (auto i = 0; i < size; ++i) {
+    json += fmt::format("{}{}", i == 0 ? "" : ",", i);
+  }
+  return json + "]";
+}
+
+TEST(ParallelResultsTest, TestElementOrderIsPreserved) {
+  static constexpr auto size = 20;
+  const auto ast = generate_ast("<a.<b");
+  auto options = ResultOptions{};
+  options.jobs_ = 4;
+  expect_equivalent_json(
+      generate_results(ast, slow_elements_field(size), options),
+      iota_json(size));
+}
+
+TEST(ParallelResultsTest, TestUnorderedElements) {
+  static constexpr auto size = 20;
+  const auto ast = generate_ast("<a.<b");
+  auto options = ResultOptions{};
+  options.jobs_ = 4;
+  options.unordered_ = true;
+  auto results = generate_results(ast, slow_elements_field(size), options);
+
+  // Every element is written, but not necessarily in order.
+  ASSERT_TRUE(results.starts_with('[') && results.ends_with(']'));
+  auto elements = std::vector<int>{};
+  auto stream = std::istringstream{results.substr(1, results.size() - 2)};
+  for (auto element = std::string{}; std::getline(stream, element, ',');) {
+    elements.push_back(std::stoi(element));
+  }
+  std::sort(elements.begin(), elements.end());
+  auto expected = std::vector<int>(static_cast<std::size_t>(size));
+  std::iota(expected.begin(), expected.end(), 0);
+  EXPECT_EQ(elements, expected);
+}
+
+struct ConcurrentFakeField : FakeField {
+  using FakeField::FakeField;
+  SQ_ND bool allows_concurrent_access() const noexcept override {
+    return true;
+  }
+};
+
+TEST(ParallelResultsTest, TestSiblingsAreEvaluatedConcurrently) {
+  auto mutex = std::mutex{};
+  auto running = 0;
+  auto max_running = 0;
+  const auto root = std::make_shared<ConcurrentFakeField>(
+      [&](std::string_view member, auto) -> Result {
+        {
+          const auto lock = std::scoped_lock{mutex};
+          max_running = std::max(max_running, ++running);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds{50});
+        {
+          const auto lock = std::scoped_lock{mutex};
+          --running;
+        }
+        return fake_field(PrimitiveString{member});
+      });
+  const auto ast = generate_ast("a b c.d b");
+  auto options = ResultOptions{};
+  options.jobs_ = 3;
+  expect_equivalent_json(generate_results(ast, root, options),
+                         R"({"a": "a", "b": "b", "c": {"d": "c"}, "b": "b"})");
+  EXPECT_GT(max_running, 1);
+}
+
+struct LatencyBoundFakeField : FakeField {
+  using FakeField::FakeField;
+  SQ_ND bool is_latency_bound() const noexcept override { return true; }
+};
+
+// Generate results for "<a.<b" where "a" is an array of latency-bound fields,
+// and get the maximum number of elements that were evaluated at once.
+int max_prefetched(std::size_t prefetch_depth) {
+  static constexpr auto size = 8;
+  auto mutex = std::mutex{};
+  auto running = 0;
+  auto max_running = 0;
+  const auto root = fake_field([&](auto, auto) {
+    return to_field_range(
+        input, rv::iota(0, size) | rv::transform([&](int i) -> FieldPtr {
+                 return std::make_shared<LatencyBoundFakeField>(
+                     [&, i](auto, auto) -> Result {
+                       {
+                         const auto lock = std::scoped_lock{mutex};
+                         max_running = std::max(max_running, ++running);
+                       }
+                       std::this_thread::sleep_for(
+                           std::chrono::milliseconds{20});
+                       {
+                         const auto lock = std::scoped_lock{mutex};
+                         --running;
+                       }
+                       return fake_field(PrimitiveInt{i});
+                     },
+                     PrimitiveInt{i});
+               }));
+  });
+  const auto ast = generate_ast("<a.<b");
+  auto options = ResultOptions{};
+  options.prefetch_depth_ = prefetch_depth;
+  expect_equivalent_json(generate_results(ast, root, options),
+                         iota_json(size));
+  return max_running;
+}
+
+TEST(ParallelResultsTest, TestLatencyBoundElementsArePrefetched) {
+  EXPECT_GT(max_prefetched(4), 1);
+}
+
+TEST(ParallelResultsTest, TestPrefetchingCanBeDisabled) {
+  EXPECT_EQ(max_prefetched(0), 1);
+}
+
+struct ThreadAffineFakeField : FakeField {
+  using FakeField::FakeField;
+  SQ_ND bool is_thread_affine() const noexcept override { return true; }
+};
+
+TEST(ParallelResultsTest, TestThreadAffineDescendantsStayOnCallingThread) {
+  // The elements are latency bound, but their "b" members are thread affine,
+  // which can't be known until the elements are evaluated.
+  const auto caller = std::this_thread::get_id();
+  auto other_thread = std::atomic<bool>{false};
+  const auto root = fake_field([&](auto, auto) {
+    return to_field_range(
+        input, rv::iota(0, 4) | rv::transform([&](int i) -> FieldPtr {
+                 return std::make_shared<LatencyBoundFakeField>(
+                     [&, i](auto, auto) -> Result {
+                       return std::make_shared<ThreadAffineFakeField>(
+                           [&, i](auto, auto) -> Result {
+                             if (std::this_thread::get_id() != caller) {
+                               other_thread = true;
+                             }
+                             return fake_field(PrimitiveInt{i});
+                           });
+                     });
+               }));
+  });
+  expect_equivalent_json(
+      generate_results(generate_ast("<a.<b.<c"), root, ResultOptions{}),
+      iota_json(4));
+  EXPECT_FALSE(other_thread);
+}
+
+// -----------------------------------------------------------------------------
+// Truncation tests
+// -----------------------------------------------------------------------------
+
+// A field whose "a" member is an array of the ints [0, size), where a stop is
+// requested when the "b" member of element stop_at is accessed.
+FieldPtr stopping_elements_field(int size, int stop_at,
+                                 std::stop_source &source) {
+  return fake_field([size, stop_at, &source](auto, auto) {
+    return to_field_range(
+        input, rv::iota(0, size) | rv::transform([stop_at, &source](int i) {
+                 return fake_field(
+                     [stop_at, &source, i](auto, auto) -> Result {
+                       if (i == stop_at) {
+                         (void)source.request_stop();
+                       }
+                       return fake_field(PrimitiveInt{i});
+                     },
+                     PrimitiveInt{i});
+               }));
+  });
+}
+
+TEST(TruncationTest, TestStopBeforeResults) {
+  auto source = std::stop_source{};
+  (void)source.request_stop();
+  auto options = ResultOptions{};
+  options.stop_token_ = source.get_token();
+  auto os = std::ostringstream{};
+  auto serializer = get_serializer(os);
+  EXPECT_FALSE(generate_results(QueryPlan{generate_ast("a b")},
+                                fake_field(PrimitiveInt{0}), *serializer,
+                                options));
+  expect_equivalent_json(os.str(), R"({"truncated": true})");
+}
+
+TEST(TruncationTest, TestStopAtElementBoundary) {
+  auto source = std::stop_source{};
+  auto options = ResultOptions{};
+  options.stop_token_ = source.get_token();
+  const auto ast = generate_ast("x.<a.<b");
+  const auto root = fake_field([&](auto, auto) -> Result {
+    return stopping_elements_field(5, 2, source);
+  });
+  expect_equivalent_json(generate_results(ast, root, options),
+                         R"({"x": [0, 1, 2, {"truncated": true}]})");
+}
+
+TEST(TruncationTest, TestStopWithParallelElements) {
+  auto source = std::stop_source{};
+  auto options = ResultOptions{};
+  options.stop_token_ = source.get_token();
+  options.jobs_ = 2;
+  const auto ast = generate_ast("<a.<b");
+  const auto results =
+      generate_results(ast, stopping_elements_field(100, 2, source), options);
+  EXPECT_TRUE(results.ends_with(R"({"truncated":true}])"));
+}
+
+TEST(TruncationTest, TestStopWithinParallelElement) {
+  // Element 2 sees the stop while writing its "b" array, so it writes a marker
+  // into its capture, which is then dropped: the outer array must still be
+  // marked.
+  auto source = std::stop_source{};
+  auto options = ResultOptions{};
+  options.stop_token_ = source.get_token();
+  options.jobs_ = 2;
+  const auto root = fake_field([&source](auto, auto) -> Result {
+    return to_field_range(
+        input, rv::iota(0, 100) | rv::transform([&source](int i) {
+                 return fake_field([&source, i](auto, auto) -> Result {
+                   if (i == 2) {
+                     (void)source.request_stop();
+                   }
+                   return fake_field_range(0, 3);
+                 });
+               }));
+  });
+  const auto results = generate_results(generate_ast("<a.b"), root, options);
+  EXPECT_TRUE(results.ends_with(R"({"truncated":true}])"));
+}
+
+TEST(TruncationTest, TestCompleteResults) {
+  auto source = std::stop_source{};
+  auto options = ResultOptions{};
+  options.stop_token_ = source.get_token();
+  auto os = std::ostringstream{};
+  auto serializer = get_serializer(os);
+  EXPECT_TRUE(generate_results(QueryPlan{generate_ast("<a.<b")},
+                               stopping_elements_field(3, 3, source),
+                               *serializer, options));
+  expect_equivalent_json(os.str(), "[0, 1, 2]");
+}
+
+// Generate "<a.<b" for the elements of stopping_elements_field(), with an
+// element limit.
+std::string generate_limited_elements(std::size_t max_elements,
+                                      std::size_t jobs) {
+  auto source = std::stop_source{};
+  auto options = ResultOptions{};
+  options.stop_token_ = source.get_token();
+  options.jobs_ = jobs;
+  auto os = std::ostringstream{};
+  auto serializer = get_serializer(os);
+  auto limited = LimitedSerializer{
+      *serializer, OutputLimits{std::nullopt, max_elements}, source};
+  EXPECT_FALSE(generate_results(QueryPlan{generate_ast("<a.<b")},
+                                stopping_elements_field(100, 100, source),
+                                limited, options));
+  EXPECT_TRUE(limited.limit_reached());
+  return os.str();
+}
+
+TEST(TruncationTest, TestElementLimit) {
+  expect_equivalent_json(generate_limited_elements(2, 1),
+                         R"([0, 1, {"truncated": true}])");
+}
+
+TEST(TruncationTest, TestElementLimitWithParallelElements) {
+  expect_equivalent_json(generate_limited_elements(2, 4),
+                         R"([0, 1, {"truncated": true}])");
+}
+
 // -----------------------------------------------------------------------------
 // Param passing tests
 // -----------------------------------------------------------------------------
@@ -332,6 +647,70 @@ INSTANTIATE_TEST_SUITE_P(
                              params("str", 1, true, named("n1", ""),
                                     named("n2", -1), named("n3", false))}));
 
+// -----------------------------------------------------------------------------
+// Field call hints tests
+// -----------------------------------------------------------------------------
+
+TEST_F(ResultsTest, TestFieldCallHints) {
+  // Record the hints passed for each field access. "d" and "f" return lists
+  // so that they can be filtered.
+  auto hints = std::map<std::string, FieldCallHints, std::less<>>{};
+  auto recorder = FakeField::ResultGenerator{};
+  recorder = [&](std::string_view member,
+                 const FieldCallParams &params) -> Result {
+    hints.insert_or_assign(std::string{member}, params.hints());
+    if (member == "d" || member == "f") {
+      return fake_field_range(0, 1);
+    }
+    return fake_field(recorder);
+  };
+
+  const auto ast = generate_ast("a { b { c } d[e=0] f[=0] }");
+  (void)generate_results(ast, fake_field(recorder));
+
+  ASSERT_EQ(hints.size(), 5U);
+
+  const auto &a = hints.at("a");
+  EXPECT_TRUE(a.known());
+  EXPECT_TRUE(a.may_use_field("b"));
+  EXPECT_TRUE(a.may_use_field("d"));
+  EXPECT_TRUE(a.may_use_field("f"));
+  EXPECT_FALSE(a.may_use_field("c"));
+  EXPECT_FALSE(a.may_use_primitive());
+
+  const auto &b = hints.at("b");
+  EXPECT_TRUE(b.may_use_field("c"));
+  EXPECT_FALSE(b.may_use_field("b"));
+  EXPECT_FALSE(b.may_use_primitive());
+
+  const auto &c = hints.at("c");
+  EXPECT_TRUE(c.known());
+  EXPECT_TRUE(c.may_use_primitive());
+  EXPECT_FALSE(c.may_use_field("c"));
+
+  const auto &d = hints.at("d");
+  EXPECT_TRUE(d.may_use_field("e"));
+  EXPECT_TRUE(d.may_use_primitive());
+
+  const auto &f = hints.at("f");
+  EXPECT_FALSE(f.may_use_field("e"));
+  EXPECT_TRUE(f.may_use_primitive());
+}
+
+TEST(FieldCallHintsTest, TestUnknownHints) {
+  const auto hints = FieldCallHints{};
+  EXPECT_FALSE(hints.known());
+  EXPECT_TRUE(hints.may_use_field("a"));
+  EXPECT_TRUE(hints.may_use_primitive());
+}
+
+TEST(FieldCallHintsTest, TestHintsAreNotCompared) {
+  auto p1 = FieldCallParams{};
+  auto p2 = FieldCallParams{};
+  p1.hints().add_field("a");
+  EXPECT_EQ(p1, p2);
+}
+
 // -----------------------------------------------------------------------------
 // Filter tests
 // -----------------------------------------------------------------------------
@@ -535,6 +914,44 @@ TEST_F(ResultsTest, TestComparisonFilter) {
   }
 }
 
+TEST(StringComparisonPredicateTest, TestMatchesPrimitiveComparison) {
+  const auto strs = {"", "a", "abc", "b"};
+  const auto values = {Primitive{PrimitiveString{"abc"}},
+                       Primitive{PrimitiveString{}},
+                       Primitive{PrimitiveInt{1}}, Primitive{true},
+                       Primitive{primitive_null}};
+
+  for (const auto op : all_comparison_ops) {
+    for (const auto &value : values) {
+      const auto pred =
+          string_comparison_predicate(parser::ComparisonSpec{"m", op, value});
+      for (const auto *str : strs) {
+        SCOPED_TRACE(testing::Message()
+                     << "op=" << op << ", value=" << primitive_to_str(value)
+                     << ", str=" << str);
+        const auto member_value = Primitive{PrimitiveString{str}};
+        const auto expected = [&] {
+          switch (op) {
+          case parser::ComparisonOperator::GreaterThanOrEqualTo:
+            return member_value >= value;
+          case parser::ComparisonOperator::GreaterThan:
+            return member_value > value;
+          case parser::ComparisonOperator::LessThanOrEqualTo:
+            return member_value <= value;
+          case parser::ComparisonOperator::LessThan:
+            return member_value < value;
+          case parser::ComparisonOperator::Equals:
+            return member_value == value;
+          }
+          ASSERT(false);
+          return false;
+        }();
+        EXPECT_EQ(pred(str), expected);
+      }
+    }
+  }
+}
+
 TEST_F(ResultsTest, TestNotAnArrayError) {
   for (const auto &query : {"a[0]", "a[::]"}) {
     SCOPED_TRACE(testing::Message() << "query=" << query);
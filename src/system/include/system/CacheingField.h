@@ -8,8 +8,13 @@
 #include "core/Field.h"
 #include "core/typeutil.h"
 
+#include "core/FieldCallParams.h"
+
 #include <map>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace sq::system {
 
@@ -22,11 +27,15 @@ private:
   SQ_ND virtual Result dispatch(std::string_view member,
                                 const FieldCallParams &params) const = 0;
 
-  // NOTE: currently, don't distinguish between field calls made with
-  // different parameters. That should be okay because there isn't any
-  // query syntax that allows access to the same field with different
-  // parameters. That may change in the future though.
-  mutable std::map<std::string, Result, std::less<>> cache_;
+  // Sibling field accesses in a query can access the same member with
+  // different parameters (e.g. "{path(\"/a\") path(\"/b\")}"), so results
+  // are cached for each set of parameters that a member is accessed with.
+  using CachedResults = std::vector<std::pair<FieldCallParams, Result>>;
+
+  // get() may be called from more than one thread at once, e.g. when sibling
+  // subtrees of a query are evaluated in parallel.
+  mutable std::mutex mutex_;
+  mutable std::map<std::string, CachedResults, std::less<>> cache_;
 };
 
 } // namespace sq::system
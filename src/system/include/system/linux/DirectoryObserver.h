@@ -0,0 +1,51 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_system_linux_DirectoryObserver_h_
+#define SQ_INCLUDE_GUARD_system_linux_DirectoryObserver_h_
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+
+namespace sq::system::linux {
+
+/**
+ * Function called with the path of each directory that is read.
+ */
+using DirectoryObserver = std::function<void(const std::filesystem::path &)>;
+
+/**
+ * Sets the process-wide DirectoryObserver while in scope.
+ *
+ * While set, the observer is called with the path of each directory read by
+ * a DirectoryWalker or IndexedDirectoryWalker, including directories whose
+ * entries are taken from a metadata index rather than read again. The
+ * observer may be called from any thread, and more than once for the same
+ * directory.
+ */
+class ScopedDirectoryObserver {
+public:
+  explicit ScopedDirectoryObserver(DirectoryObserver observer);
+
+  ScopedDirectoryObserver(const ScopedDirectoryObserver &) = delete;
+  ScopedDirectoryObserver(ScopedDirectoryObserver &&) = delete;
+  ScopedDirectoryObserver &operator=(const ScopedDirectoryObserver &) = delete;
+  ScopedDirectoryObserver &operator=(ScopedDirectoryObserver &&) = delete;
+  ~ScopedDirectoryObserver() noexcept;
+
+private:
+  std::shared_ptr<const DirectoryObserver> previous_;
+};
+
+/**
+ * Report that a directory has been read to the current DirectoryObserver, if
+ * there is one.
+ */
+void notify_directory_read(const std::filesystem::path &dir);
+
+} // namespace sq::system::linux
+
+#endif // SQ_INCLUDE_GUARD_system_linux_DirectoryObserver_h_
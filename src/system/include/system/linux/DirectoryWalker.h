@@ -0,0 +1,308 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_system_linux_DirectoryWalker_h_
+#define SQ_INCLUDE_GUARD_system_linux_DirectoryWalker_h_
+
+#include "core/typeutil.h"
+
+#include <cstddef>
+#include <dirent.h>
+#include <filesystem>
+#include <functional>
+#include <gsl/gsl>
+#include <memory>
+#include <optional>
+#include <range/v3/iterator/basic_iterator.hpp>
+#include <range/v3/view/subrange.hpp>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <type_traits>
+#include <vector>
+
+namespace sq::system::linux {
+
+/**
+ * An entry in a directory found by a DirectoryWalker.
+ */
+struct DirectoryEntry {
+  /**
+   * The path of the directory containing the entry.
+   *
+   * The path is shared by all entries in the same directory so that the full
+   * path of each entry only needs to be created if it is used.
+   */
+  std::shared_ptr<const std::filesystem::path> parent_;
+
+  /**
+   * The name of the entry within its directory.
+   */
+  std::string name_;
+
+  /**
+   * The depth of the entry below the directory at the root of the walk.
+   *
+   * Entries in the root directory have depth 1.
+   */
+  std::size_t depth_ = 0;
+
+  /**
+   * The lstat() data for the entry, if DirectoryWalkOptions::lstat_entries_
+   * was set.
+   */
+  std::optional<struct stat> lstat_;
+};
+
+/**
+ * Options for a DirectoryWalker.
+ */
+struct DirectoryWalkOptions {
+  /**
+   * Whether to walk the subdirectories of the root directory.
+   */
+  bool recurse_ = false;
+
+  /**
+   * Whether to walk subdirectories that are reached through symlinks.
+   */
+  bool follow_symlinks_ = false;
+
+  /**
+   * Whether to skip directories that can't be opened due to permissions.
+   */
+  bool skip_permission_denied_ = false;
+
+  /**
+   * The minimum depth of entries to produce.
+   */
+  std::size_t min_depth_ = 0;
+
+  /**
+   * The maximum depth of entries to produce.
+   *
+   * Directories at the maximum depth are not opened.
+   */
+  std::optional<std::size_t> max_depth_;
+
+  /**
+   * Glob patterns for the names of entries to exclude.
+   *
+   * Excluded entries are not produced and, if they are directories, are not
+   * opened.
+   */
+  std::vector<std::string> exclude_;
+
+  /**
+   * Whether to avoid opening subdirectories on a different filesystem to the
+   * root directory. Subdirectories are checked with fstatat() and
+   * AT_NO_AUTOMOUNT, so automount points aren't mounted.
+   */
+  bool one_file_system_ = false;
+
+  /**
+   * Whether to get lstat() data for each entry.
+   *
+   * The data is obtained using fstatat() on the open directory, which avoids
+   * resolving the full path of each entry. Entries that are removed before
+   * their data is obtained are skipped.
+   */
+  bool lstat_entries_ = false;
+
+  /**
+   * Whether to get lstat() data for the entries in each directory in inode
+   * order.
+   *
+   * Only has an effect if lstat_entries_ is set. Each directory is read in
+   * full before any of its entries are produced, and the entries' metadata is
+   * then obtained in order of inode number. On filesystems that store inodes
+   * in tables (e.g. ext4 and xfs) this avoids seeking back and forth through
+   * the tables when the metadata isn't already cached.
+   */
+  bool lstat_in_inode_order_ = false;
+
+  /**
+   * Whether the entries in each directory may be produced in any order.
+   *
+   * With lstat_in_inode_order_, entries are produced in the order that their
+   * metadata was obtained rather than in the order that the directory lists
+   * them.
+   */
+  bool unordered_ = false;
+
+  /**
+   * If set, only entries whose names satisfy the filter are produced.
+   *
+   * The filter doesn't affect which subdirectories are walked: the children
+   * of a directory that doesn't satisfy the filter are still produced if they
+   * satisfy it themselves.
+   */
+  std::function<bool(std::string_view)> name_filter_;
+
+  /**
+   * A token for stopping the walk early.
+   *
+   * Once a stop is requested, the walk finishes as if there were no more
+   * entries.
+   */
+  std::stop_token stop_token_;
+};
+
+/**
+ * Walks the entries in a directory, and optionally its subdirectories.
+ *
+ * Similar to std::filesystem::recursive_directory_iterator, but entries
+ * are produced as a directory path shared between siblings and a name rather
+ * than as full paths, and metadata can be obtained relative to the open
+ * directory.
+ *
+ * The special entries "." and ".." are skipped.
+ */
+class DirectoryWalker {
+public:
+  /**
+   * Start walking the given directory.
+   *
+   * Throws FilesystemError if the directory can't be opened.
+   */
+  DirectoryWalker(const std::filesystem::path &root,
+                  DirectoryWalkOptions options);
+
+  DirectoryWalker(const DirectoryWalker &) = delete;
+  DirectoryWalker(DirectoryWalker &&) = delete;
+  DirectoryWalker &operator=(const DirectoryWalker &) = delete;
+  DirectoryWalker &operator=(DirectoryWalker &&) = delete;
+  ~DirectoryWalker() noexcept = default;
+
+  /**
+   * Get whether all the entries have been walked.
+   */
+  SQ_ND bool done() const noexcept;
+
+  /**
+   * Get the current entry.
+   */
+  SQ_ND const DirectoryEntry &entry() const noexcept;
+
+  /**
+   * Move on to the next entry.
+   *
+   * Throws FilesystemError if a directory can't be read.
+   */
+  void next();
+
+private:
+  struct DirCloser {
+    void operator()(DIR *dir) const noexcept;
+  };
+  using DirPtr = std::unique_ptr<DIR, DirCloser>;
+
+  // An entry that has been read from a directory but not yet produced.
+  struct PendingEntry {
+    std::string name_;
+    ino_t inode_ = 0;
+    unsigned char type_ = DT_UNKNOWN;
+    bool wanted_ = false;
+    // Only set if the entry's lstat() data was obtained in a batch.
+    std::optional<struct stat> lstat_;
+  };
+
+  struct OpenDirectory {
+    DirPtr dir_;
+    std::shared_ptr<const std::filesystem::path> path_;
+    std::size_t depth_;
+    // Set if the directory was read in full when it was opened.
+    bool batched_ = false;
+    std::vector<PendingEntry> batch_;
+    std::size_t batch_pos_ = 0;
+  };
+
+  void push(DirPtr dir, std::filesystem::path path);
+  void descend(gsl::czstring<> name);
+  void advance();
+  void read_batch(OpenDirectory &dir);
+  SQ_ND const PendingEntry *next_pending(OpenDirectory &top);
+  SQ_ND const dirent *read_dirent(const OpenDirectory &dir) const;
+  SQ_ND bool read_entry(const OpenDirectory &top, const PendingEntry &pending);
+  SQ_ND std::optional<struct stat> lstat_entry(const OpenDirectory &dir,
+                                               gsl::czstring<> name) const;
+  SQ_ND bool is_skipped(gsl::czstring<> name) const;
+  SQ_ND bool is_wanted(std::size_t depth, std::string_view name) const;
+  SQ_ND bool is_excluded(gsl::czstring<> name) const;
+  SQ_ND bool may_descend_from(std::size_t depth) const noexcept;
+  SQ_ND bool should_descend(const OpenDirectory &top,
+                            const PendingEntry &pending,
+                            const std::optional<struct stat> &lstat) const;
+  SQ_ND bool permission_denied_is_skipped(int error) const noexcept;
+
+  DirectoryWalkOptions options_;
+  std::vector<OpenDirectory> stack_;
+  PendingEntry pending_;
+  DirectoryEntry entry_;
+  bool descend_pending_ = false;
+  dev_t root_dev_ = 0;
+};
+
+/**
+ * Cursor over the entries produced by a walker.
+ *
+ * For use with ranges::basic_iterator to create an input_iterator.
+ *
+ * Walker must provide the done(), entry() and next() members of
+ * DirectoryWalker.
+ */
+template <typename Walker> class BasicDirectoryCursor {
+public:
+  using single_pass = std::true_type;
+
+  explicit BasicDirectoryCursor(std::shared_ptr<Walker> walker) noexcept;
+  BasicDirectoryCursor() noexcept = default;
+  BasicDirectoryCursor(const BasicDirectoryCursor &) noexcept = default;
+  BasicDirectoryCursor(BasicDirectoryCursor &&) noexcept = default;
+  BasicDirectoryCursor &
+  operator=(const BasicDirectoryCursor &) noexcept = default;
+  BasicDirectoryCursor &operator=(BasicDirectoryCursor &&) noexcept = default;
+  ~BasicDirectoryCursor() noexcept = default;
+
+  SQ_ND DirectoryEntry read() const;
+  SQ_ND bool equal(const BasicDirectoryCursor &other) const noexcept;
+  void next();
+
+private:
+  SQ_ND bool at_end() const noexcept;
+
+  std::shared_ptr<Walker> walker_;
+};
+
+template <typename Walker>
+using BasicDirectoryRange =
+    ranges::subrange<ranges::basic_iterator<BasicDirectoryCursor<Walker>>,
+                     ranges::basic_iterator<BasicDirectoryCursor<Walker>>>;
+
+/**
+ * Create a range of the entries produced by a walker.
+ */
+template <typename Walker>
+SQ_ND BasicDirectoryRange<Walker>
+make_directory_range(std::shared_ptr<Walker> walker);
+
+using DirectoryCursor = BasicDirectoryCursor<DirectoryWalker>;
+using DirectoryIterator = ranges::basic_iterator<DirectoryCursor>;
+using DirectoryRange = BasicDirectoryRange<DirectoryWalker>;
+
+/**
+ * Get a range of the entries in a directory.
+ *
+ * Throws FilesystemError if the directory can't be opened.
+ */
+SQ_ND DirectoryRange walk_directory(const std::filesystem::path &root,
+                                    DirectoryWalkOptions options);
+
+} // namespace sq::system::linux
+
+#include "DirectoryWalker.inl.h"
+
+#endif // SQ_INCLUDE_GUARD_system_linux_DirectoryWalker_h_
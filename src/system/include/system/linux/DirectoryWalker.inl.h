@@ -0,0 +1,54 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_system_linux_DirectoryWalker_inl_h_
+#define SQ_INCLUDE_GUARD_system_linux_DirectoryWalker_inl_h_
+
+#include <gsl/gsl>
+#include <utility>
+
+namespace sq::system::linux {
+
+template <typename Walker>
+BasicDirectoryCursor<Walker>::BasicDirectoryCursor(
+    std::shared_ptr<Walker> walker) noexcept
+    : walker_{std::move(walker)} {}
+
+template <typename Walker>
+DirectoryEntry BasicDirectoryCursor<Walker>::read() const {
+  Expects(!at_end());
+  return walker_->entry();
+}
+
+template <typename Walker>
+bool BasicDirectoryCursor<Walker>::equal(
+    const BasicDirectoryCursor &other) const noexcept {
+  if (at_end() || other.at_end()) {
+    return at_end() == other.at_end();
+  }
+  return walker_ == other.walker_;
+}
+
+template <typename Walker> void BasicDirectoryCursor<Walker>::next() {
+  Expects(!at_end());
+  walker_->next();
+}
+
+template <typename Walker>
+bool BasicDirectoryCursor<Walker>::at_end() const noexcept {
+  return walker_ == nullptr || walker_->done();
+}
+
+template <typename Walker>
+BasicDirectoryRange<Walker>
+make_directory_range(std::shared_ptr<Walker> walker) {
+  using Iterator = ranges::basic_iterator<BasicDirectoryCursor<Walker>>;
+  return BasicDirectoryRange<Walker>{
+      Iterator{BasicDirectoryCursor<Walker>{std::move(walker)}}, Iterator{}};
+}
+
+} // namespace sq::system::linux
+
+#endif // SQ_INCLUDE_GUARD_system_linux_DirectoryWalker_inl_h_
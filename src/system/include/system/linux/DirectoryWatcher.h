@@ -0,0 +1,81 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_system_linux_DirectoryWatcher_h_
+#define SQ_INCLUDE_GUARD_system_linux_DirectoryWatcher_h_
+
+#include "core/typeutil.h"
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace sq::system::linux {
+
+/**
+ * Watches directories for changes using inotify.
+ *
+ * A directory is considered to have changed if an entry is added to, removed
+ * from or renamed within it, if the metadata or contents of one of its
+ * entries changes, or if the directory itself is removed or moved.
+ */
+class DirectoryWatcher {
+public:
+  /**
+   * Throws SystemError if an inotify instance can't be created.
+   */
+  DirectoryWatcher();
+
+  DirectoryWatcher(const DirectoryWatcher &) = delete;
+  DirectoryWatcher(DirectoryWatcher &&) = delete;
+  DirectoryWatcher &operator=(const DirectoryWatcher &) = delete;
+  DirectoryWatcher &operator=(DirectoryWatcher &&) = delete;
+  ~DirectoryWatcher() noexcept;
+
+  /**
+   * Start watching a directory.
+   *
+   * Paths that no longer exist, aren't directories or can't be read are
+   * ignored: they can't be part of the results that are being watched.
+   *
+   * Safe to call from more than one thread at once.
+   *
+   * Throws FilesystemError if the directory can't be watched for another
+   * reason, e.g. if the limit on the number of inotify watches is reached.
+   */
+  void add(const std::filesystem::path &dir);
+
+  /**
+   * Stop watching all directories.
+   */
+  void clear();
+
+  /**
+   * Wait until at least one watched directory changes.
+   *
+   * Changes are often made in bursts, so after the first change, waits until
+   * no more changes have happened for the settle time before returning.
+   *
+   * Returns the paths of the directories that changed.
+   */
+  SQ_ND std::vector<std::filesystem::path>
+  wait(std::chrono::milliseconds settle_time);
+
+private:
+  // Read the pending events and add the paths of the directories that they
+  // are for to changed. Returns false if no events arrived within the timeout.
+  SQ_ND bool read_events(int timeout_ms,
+                         std::vector<std::filesystem::path> &changed);
+
+  int fd_ = -1;
+  std::mutex mutex_;
+  std::map<int, std::filesystem::path> watches_;
+};
+
+} // namespace sq::system::linux
+
+#endif // SQ_INCLUDE_GUARD_system_linux_DirectoryWatcher_h_
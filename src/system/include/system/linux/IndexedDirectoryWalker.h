@@ -0,0 +1,124 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_system_linux_IndexedDirectoryWalker_h_
+#define SQ_INCLUDE_GUARD_system_linux_IndexedDirectoryWalker_h_
+
+#include "core/typeutil.h"
+#include "system/linux/DirectoryWalker.h"
+#include "system/linux/MetadataIndex.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace sq::system::linux {
+
+/**
+ * Bring a metadata index up to date with a directory tree.
+ *
+ * The tree is walked as a DirectoryWalker would walk it with the given
+ * options, except that directories whose mtime, ctime, inode number and
+ * device are the same as those recorded in the index aren't read again: the
+ * entries recorded in the index are used instead. Subdirectories are still
+ * checked individually, so only the parts of the tree that have changed are
+ * read.
+ *
+ * The index only records the parts of the tree that are walked, so e.g. the
+ * subdirectories at DirectoryWalkOptions::max_depth_ aren't recorded.
+ * Entries matching DirectoryWalkOptions::exclude_ are recorded, but excluded
+ * directories aren't read, so the index can still be used by a walk without
+ * the exclude patterns. DirectoryWalkOptions::follow_symlinks_ is ignored:
+ * symlinks are never followed. DirectoryWalkOptions::min_depth_ and
+ * DirectoryWalkOptions::name_filter_ don't affect the index.
+ *
+ * The index file is only written if the index has changed. If the index file
+ * doesn't exist, isn't a valid index, or records a different root directory,
+ * then the whole tree is read and a new index is written.
+ *
+ * Throws FilesystemError if the tree can't be read or the index can't be
+ * written.
+ */
+SQ_ND MetadataIndex refresh_metadata_index(
+    const std::filesystem::path &index_file, const std::filesystem::path &root,
+    const DirectoryWalkOptions &options);
+
+/**
+ * Walks the entries in a directory using a metadata index.
+ *
+ * The index is brought up to date using refresh_metadata_index() before the
+ * walk starts, and then entries are produced from the index in the same order
+ * that a DirectoryWalker would produce them.
+ *
+ * Entries always have DirectoryEntry::lstat_ set. The lstat() data for an
+ * entry that isn't a directory is the data recorded when the entry's
+ * directory was last read, so it won't reflect changes to a file that
+ * don't also change its directory (e.g. writing to the file).
+ *
+ * DirectoryWalkOptions::stop_token_ only stops the walk of the index: the
+ * refresh always completes so that a partial index isn't written.
+ */
+class IndexedDirectoryWalker {
+public:
+  /**
+   * Refresh the index in index_file and start walking the given directory.
+   */
+  IndexedDirectoryWalker(const std::filesystem::path &index_file,
+                         const std::filesystem::path &root,
+                         DirectoryWalkOptions options);
+
+  IndexedDirectoryWalker(const IndexedDirectoryWalker &) = delete;
+  IndexedDirectoryWalker(IndexedDirectoryWalker &&) = delete;
+  IndexedDirectoryWalker &operator=(const IndexedDirectoryWalker &) = delete;
+  IndexedDirectoryWalker &operator=(IndexedDirectoryWalker &&) = delete;
+  ~IndexedDirectoryWalker() noexcept = default;
+
+  /**
+   * Get whether all the entries have been walked.
+   */
+  SQ_ND bool done() const noexcept;
+
+  /**
+   * Get the current entry.
+   */
+  SQ_ND const DirectoryEntry &entry() const noexcept;
+
+  /**
+   * Move on to the next entry.
+   */
+  void next();
+
+private:
+  struct Position {
+    std::size_t next_entry_;
+    std::size_t end_entry_;
+    std::shared_ptr<const std::filesystem::path> path_;
+    std::size_t depth_;
+  };
+
+  void push(std::size_t directory, std::filesystem::path path);
+  void advance();
+  SQ_ND bool is_wanted(std::size_t depth, std::string_view name) const;
+
+  MetadataIndex index_;
+  DirectoryWalkOptions options_;
+  std::vector<Position> stack_;
+  DirectoryEntry entry_;
+  std::optional<std::size_t> descend_pending_;
+};
+
+/**
+ * Get a range of the entries in a directory using a metadata index.
+ */
+SQ_ND BasicDirectoryRange<IndexedDirectoryWalker>
+walk_indexed_directory(const std::filesystem::path &index_file,
+                       const std::filesystem::path &root,
+                       DirectoryWalkOptions options);
+
+} // namespace sq::system::linux
+
+#endif // SQ_INCLUDE_GUARD_system_linux_IndexedDirectoryWalker_h_
@@ -0,0 +1,240 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_system_linux_MetadataIndex_h_
+#define SQ_INCLUDE_GUARD_system_linux_MetadataIndex_h_
+
+#include "core/typeutil.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <gsl/gsl>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <vector>
+
+namespace sq::system::linux {
+
+/**
+ * The metadata recorded for a directory in a MetadataIndex.
+ *
+ * The metadata is used to tell whether the directory's entries may have
+ * changed since the index was written.
+ */
+struct IndexedDirectory {
+  timespec mtime_ = {};
+  timespec ctime_ = {};
+  ino_t inode_ = 0;
+  dev_t dev_ = 0;
+  std::size_t first_entry_ = 0;
+  std::size_t entry_count_ = 0;
+};
+
+/**
+ * Get whether a directory's current metadata matches the metadata recorded in
+ * an index.
+ */
+SQ_ND bool is_unchanged(const IndexedDirectory &indexed,
+                        const struct stat &current) noexcept;
+
+/**
+ * The columns of a metadata index.
+ *
+ * Column is a template for the container used for a column of values of a
+ * given type. All of the directory columns have one element per directory
+ * and all of the entry columns have one element per entry.
+ */
+template <template <typename> typename Column> struct MetadataIndexColumns {
+  Column<std::int64_t> dir_mtime_sec_;
+  Column<std::int64_t> dir_mtime_nsec_;
+  Column<std::int64_t> dir_ctime_sec_;
+  Column<std::int64_t> dir_ctime_nsec_;
+  Column<std::uint64_t> dir_inode_;
+  Column<std::uint64_t> dir_dev_;
+  Column<std::uint64_t> dir_first_entry_;
+  Column<std::uint64_t> dir_entry_count_;
+
+  Column<std::uint64_t> name_offset_;
+  Column<std::uint32_t> name_length_;
+  Column<std::uint32_t> child_directory_;
+  Column<std::uint64_t> inode_;
+  Column<std::uint64_t> dev_;
+  Column<std::uint64_t> hard_link_count_;
+  Column<std::int64_t> size_;
+  Column<std::int64_t> block_count_;
+  Column<std::uint32_t> mode_;
+  Column<std::uint32_t> uid_;
+  Column<std::uint32_t> gid_;
+  Column<std::int64_t> atime_sec_;
+  Column<std::int64_t> atime_nsec_;
+  Column<std::int64_t> mtime_sec_;
+  Column<std::int64_t> mtime_nsec_;
+  Column<std::int64_t> ctime_sec_;
+  Column<std::int64_t> ctime_nsec_;
+};
+
+/**
+ * Call a function on each of the directory columns of a MetadataIndexColumns,
+ * in file order.
+ */
+template <typename Columns, typename F>
+void for_each_directory_column(Columns &columns, F &&f);
+
+/**
+ * Call a function on each of the entry columns of a MetadataIndexColumns, in
+ * file order.
+ */
+template <typename Columns, typename F>
+void for_each_entry_column(Columns &columns, F &&f);
+
+/**
+ * An index of the metadata of the entries in a directory tree.
+ *
+ * The index is stored in a file as a header followed by a column for each
+ * piece of metadata, and a table of the entries' names. The file is
+ * memory-mapped when the index is opened, so an index can be used without
+ * reading all of it.
+ *
+ * The entries of each directory are stored contiguously, in the order that
+ * they were read from the directory. Entries that are directories may refer
+ * to the directory's own record in the index. The first directory in the
+ * index is the root of the tree.
+ */
+class MetadataIndex {
+public:
+  /**
+   * Open an existing index file.
+   *
+   * Returns std::nullopt if the file doesn't exist.
+   *
+   * Throws FilesystemError if the file can't be read and IndexFormatError if
+   * the file isn't a valid index.
+   */
+  SQ_ND static std::optional<MetadataIndex>
+  open(const std::filesystem::path &file);
+
+  /**
+   * Get the absolute path of the root of the indexed tree.
+   */
+  SQ_ND std::string_view root() const;
+
+  SQ_ND std::size_t directory_count() const noexcept;
+  SQ_ND std::size_t entry_count() const noexcept;
+  SQ_ND IndexedDirectory directory(std::size_t index) const;
+
+  /**
+   * Get the name of an entry within its directory.
+   */
+  SQ_ND std::string_view name(std::size_t entry) const;
+
+  /**
+   * Get the lstat() data recorded for an entry.
+   *
+   * Only the fields used by SqFile are recorded.
+   */
+  SQ_ND struct stat lstat(std::size_t entry) const;
+
+  /**
+   * Get the index of the directory record for an entry.
+   *
+   * Returns std::nullopt if the entry isn't a directory or if its entries
+   * weren't recorded.
+   */
+  SQ_ND std::optional<std::size_t> child_directory(std::size_t entry) const;
+
+  /**
+   * Get the contents of the index file.
+   */
+  SQ_ND gsl::span<const std::byte> bytes() const noexcept;
+
+private:
+  struct Unmapper {
+    std::size_t size_;
+    void operator()(const std::byte *p) const noexcept;
+  };
+  using MappingPtr = std::unique_ptr<const std::byte, Unmapper>;
+  template <typename T> using Span = gsl::span<const T>;
+
+  MetadataIndex(MappingPtr mapping, std::size_t size,
+                const std::filesystem::path &file);
+  void validate(const std::filesystem::path &file) const;
+
+  MappingPtr mapping_;
+  gsl::span<const std::byte> bytes_;
+  std::size_t directory_count_ = 0;
+  std::size_t entry_count_ = 0;
+  std::string_view root_;
+  gsl::span<const char> names_;
+  MetadataIndexColumns<Span> columns_;
+};
+
+/**
+ * Creates the contents of a MetadataIndex file.
+ */
+class MetadataIndexBuilder {
+public:
+  /**
+   * @param root the absolute path of the root of the indexed tree.
+   */
+  explicit MetadataIndexBuilder(std::string_view root);
+
+  /**
+   * Add a directory to the index and get its index.
+   *
+   * Entries added by add_entry() are added to the most recently added
+   * directory.
+   */
+  std::size_t add_directory(const struct stat &dir_stat);
+
+  /**
+   * Add an entry to the most recently added directory and get its index.
+   */
+  std::size_t add_entry(std::string_view name, const struct stat &lstat);
+
+  /**
+   * Replace the lstat() data recorded for an entry.
+   */
+  void set_lstat(std::size_t entry, const struct stat &lstat);
+
+  /**
+   * Record that an entry is the directory with the given index.
+   */
+  void set_child_directory(std::size_t entry, std::size_t directory);
+
+  /**
+   * Get the contents of the index file.
+   */
+  SQ_ND std::vector<std::byte> serialize() const;
+
+private:
+  template <typename T> using Vector = std::vector<T>;
+
+  std::string root_;
+  std::string names_;
+  MetadataIndexColumns<Vector> columns_;
+};
+
+/**
+ * Write the contents of an index file.
+ *
+ * The data is written to a temporary file in the same directory first, and
+ * then synced and renamed, so that readers never see a partly written index.
+ * The file is created with mode 0666, less the umask.
+ *
+ * Throws FilesystemError if the file can't be written.
+ */
+void write_metadata_index(const std::filesystem::path &file,
+                          gsl::span<const std::byte> data);
+
+} // namespace sq::system::linux
+
+#include "MetadataIndex.inl.h"
+
+#endif // SQ_INCLUDE_GUARD_system_linux_MetadataIndex_h_
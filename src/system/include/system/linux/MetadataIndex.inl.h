@@ -0,0 +1,46 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_system_linux_MetadataIndex_inl_h_
+#define SQ_INCLUDE_GUARD_system_linux_MetadataIndex_inl_h_
+
+namespace sq::system::linux {
+
+template <typename Columns, typename F>
+void for_each_directory_column(Columns &columns, F &&f) {
+  f(columns.dir_mtime_sec_);
+  f(columns.dir_mtime_nsec_);
+  f(columns.dir_ctime_sec_);
+  f(columns.dir_ctime_nsec_);
+  f(columns.dir_inode_);
+  f(columns.dir_dev_);
+  f(columns.dir_first_entry_);
+  f(columns.dir_entry_count_);
+}
+
+template <typename Columns, typename F>
+void for_each_entry_column(Columns &columns, F &&f) {
+  f(columns.name_offset_);
+  f(columns.name_length_);
+  f(columns.child_directory_);
+  f(columns.inode_);
+  f(columns.dev_);
+  f(columns.hard_link_count_);
+  f(columns.size_);
+  f(columns.block_count_);
+  f(columns.mode_);
+  f(columns.uid_);
+  f(columns.gid_);
+  f(columns.atime_sec_);
+  f(columns.atime_nsec_);
+  f(columns.mtime_sec_);
+  f(columns.mtime_nsec_);
+  f(columns.ctime_sec_);
+  f(columns.ctime_nsec_);
+}
+
+} // namespace sq::system::linux
+
+#endif // SQ_INCLUDE_GUARD_system_linux_MetadataIndex_inl_h_
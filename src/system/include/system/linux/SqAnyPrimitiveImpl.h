@@ -16,6 +16,7 @@ public:
   explicit SqAnyPrimitiveImpl(const Primitive &prim);
 
   SQ_ND Primitive to_primitive() const override;
+  SQ_ND PrimitiveRef to_primitive_ref(Primitive &storage) const override;
 
 private:
   Primitive prim_;
@@ -16,6 +16,7 @@ public:
   explicit SqBoolImpl(PrimitiveBool value);
 
   SQ_ND Primitive to_primitive() const override;
+  SQ_ND PrimitiveRef to_primitive_ref(Primitive &storage) const override;
 
 private:
   PrimitiveBool value_;
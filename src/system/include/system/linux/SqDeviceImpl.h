@@ -22,6 +22,9 @@ public:
   SQ_ND Result get_subsystem() const;
   SQ_ND Result get_dev_node() const;
   SQ_ND Primitive to_primitive() const override;
+  SQ_ND PrimitiveRef to_primitive_ref(Primitive &storage) const override;
+
+  SQ_ND bool is_thread_affine() const noexcept override;
 
 private:
   UdevPtr<UdevDevice> dev_;
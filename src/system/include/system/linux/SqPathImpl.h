@@ -6,10 +6,16 @@
 #ifndef SQ_INCLUDE_GUARD_system_linux_SqPathImpl_h_
 #define SQ_INCLUDE_GUARD_system_linux_SqPathImpl_h_
 
+#include "core/FieldCallHints.h"
 #include "core/typeutil.h"
 #include "system/SqPath.gen.h"
+#include "system/linux/DirectoryWalker.h"
+#include "system/linux/StatCache.h"
 
 #include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
 
 namespace sq::system::linux {
 
@@ -18,6 +24,14 @@ public:
   explicit SqPathImpl(const std::filesystem::path &value);
   explicit SqPathImpl(std::filesystem::path &&value);
 
+  /**
+   * Create an SqPathImpl for an entry found when walking a directory.
+   *
+   * The full path of the entry is only created if it is needed, and any
+   * lstat() data in the entry is used to seed the stat cache.
+   */
+  explicit SqPathImpl(DirectoryEntry &&entry);
+
   SQ_ND Result get_string() const;
   SQ_ND Result get_parent() const;
   SQ_ND Result get_filename() const;
@@ -25,7 +39,15 @@ public:
   SQ_ND Result get_stem() const;
   SQ_ND Result get_children(PrimitiveBool recurse,
                             PrimitiveBool follow_symlinks,
-                            PrimitiveBool skip_permission_denied) const;
+                            PrimitiveBool skip_permission_denied,
+                            PrimitiveInt min_depth,
+                            const std::optional<PrimitiveInt> &max_depth,
+                            const PrimitiveString &exclude,
+                            PrimitiveBool one_file_system,
+                            PrimitiveBool inode_order,
+                            PrimitiveBool unordered,
+                            const std::optional<PrimitiveString> &index,
+                            const FieldCallHints &hints) const;
   SQ_ND Result get_parts() const;
   SQ_ND Result get_absolute() const;
   SQ_ND Result get_canonical() const;
@@ -33,9 +55,20 @@ public:
   SQ_ND Result get_exists(PrimitiveBool follow_symlinks) const;
   SQ_ND Result get_file(PrimitiveBool follow_symlinks) const;
   SQ_ND Primitive to_primitive() const override;
+  SQ_ND PrimitiveRef to_primitive_ref(Primitive &storage) const override;
+
+  SQ_ND bool is_latency_bound() const noexcept override;
 
 private:
-  std::filesystem::path value_;
+  SQ_ND const std::filesystem::path &value() const;
+  SQ_ND std::string string() const;
+
+  // For directory entries, parent_ and name_ are set and value_ is only
+  // filled in when needed. Otherwise, only value_ is set.
+  std::shared_ptr<const std::filesystem::path> parent_;
+  std::string name_;
+  mutable std::optional<std::filesystem::path> value_;
+  mutable StatCache stat_cache_;
 };
 
 } // namespace sq::system::linux
@@ -24,6 +24,7 @@ public:
   SQ_ND static Result get_data_size(PrimitiveInt bytes);
   SQ_ND static Result get_devices();
   SQ_ND Primitive to_primitive() const override;
+  SQ_ND bool allows_concurrent_access() const noexcept override;
 };
 
 } // namespace sq::system::linux
@@ -18,6 +18,7 @@ public:
   explicit SqStringImpl(std::string_view value);
 
   SQ_ND Primitive to_primitive() const override;
+  SQ_ND PrimitiveRef to_primitive_ref(Primitive &storage) const override;
 
 private:
   PrimitiveString value_;
@@ -29,6 +29,8 @@ public:
   SQ_ND Result get_shell() const;
   SQ_ND Primitive to_primitive() const override;
 
+  SQ_ND bool is_latency_bound() const noexcept override;
+
 private:
   void ensure_fully_initialized() const;
 
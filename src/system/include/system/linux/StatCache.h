@@ -0,0 +1,87 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_system_linux_StatCache_h_
+#define SQ_INCLUDE_GUARD_system_linux_StatCache_h_
+
+#include "core/typeutil.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <sys/stat.h>
+
+namespace sq::system::linux {
+
+/**
+ * Caches the results of stat() and lstat() calls for a single path.
+ *
+ * Failed calls are cached as well as successful ones so that, for example,
+ * finding out twice that a path doesn't exist only costs one system call.
+ *
+ * lstat() results are also used to answer stat() requests where possible:
+ * stat() and lstat() only differ for symlinks, so if lstat() has already
+ * shown that the path is not a symlink (or doesn't exist at all) then a call
+ * to stat() would be redundant.
+ *
+ * A StatCache doesn't store the path it's caching results for; the owner of
+ * the cache must pass the same path to every call.
+ */
+class StatCache {
+public:
+  /**
+   * Counts of the stat()-like system calls made by all StatCaches, and of
+   * the calls that were avoided by using cached results.
+   */
+  struct Counters {
+    std::uint64_t stat_calls = 0;
+    std::uint64_t lstat_calls = 0;
+    std::uint64_t hits = 0;
+  };
+
+  /**
+   * Get the stat() or lstat() data for the path.
+   *
+   * Throws FilesystemError if the system call fails.
+   */
+  SQ_ND const struct stat &get(const std::filesystem::path &path,
+                               bool follow_symlinks);
+
+  /**
+   * Get whether the path exists.
+   *
+   * Returns false if the system call fails with ENOENT or ENOTDIR; throws
+   * FilesystemError if it fails for any other reason.
+   */
+  SQ_ND bool exists(const std::filesystem::path &path, bool follow_symlinks);
+
+  /**
+   * Store lstat() data for the path that was obtained elsewhere.
+   *
+   * E.g. when the data was obtained using fstatat() during a directory scan.
+   */
+  void set_lstat(const struct stat &s);
+
+  /**
+   * Get the system call counts for all StatCaches in the process.
+   */
+  SQ_ND static Counters counters();
+
+private:
+  struct Entry {
+    struct stat stat_;
+    int error_;
+  };
+
+  SQ_ND const Entry &entry(const std::filesystem::path &path,
+                           bool follow_symlinks);
+
+  std::optional<Entry> stat_;
+  std::optional<Entry> lstat_;
+};
+
+} // namespace sq::system::linux
+
+#endif // SQ_INCLUDE_GUARD_system_linux_StatCache_h_
@@ -0,0 +1,44 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_system_linux_pathutil_h_
+#define SQ_INCLUDE_GUARD_system_linux_pathutil_h_
+
+#include "core/typeutil.h"
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace sq::system::linux {
+
+/**
+ * Get the stem of a filename.
+ *
+ * Gives the same result as std::filesystem::path{filename}.stem() for a
+ * filename without any directory separators, but without creating a path.
+ */
+SQ_ND std::string_view filename_stem(std::string_view filename) noexcept;
+
+/**
+ * Get the extension of a filename.
+ *
+ * Gives the same result as std::filesystem::path{filename}.extension() for a
+ * filename without any directory separators, but without creating a path.
+ */
+SQ_ND std::string_view filename_extension(std::string_view filename) noexcept;
+
+/**
+ * Get the string form of the path of an entry in a directory.
+ *
+ * Gives the same result as (dir / filename).string() without creating a new
+ * path.
+ */
+SQ_ND std::string join_path(const std::filesystem::path &dir,
+                            std::string_view filename);
+
+} // namespace sq::system::linux
+
+#endif // SQ_INCLUDE_GUARD_system_linux_pathutil_h_
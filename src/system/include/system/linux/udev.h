@@ -11,6 +11,7 @@
 #include <range/v3/iterator/basic_iterator.hpp>
 #include <range/v3/view/subrange.hpp>
 #include <string>
+#include <string_view>
 #include <utility>
 
 namespace sq::system::linux {
@@ -129,9 +130,10 @@ public:
   /**
    * Get the name in the /sys filesystem for this device.
    *
-   * Always returns a valid name or throws.
+   * Always returns a valid name or throws. The name is owned by the device,
+   * so it's only valid while the device exists.
    */
-  std::string sys_name() const;
+  std::string_view sys_name() const;
 
   /**
    * Get the name of the kernel subsystem to which this device belongs.
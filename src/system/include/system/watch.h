@@ -0,0 +1,57 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_system_watch_h_
+#define SQ_INCLUDE_GUARD_system_watch_h_
+
+#include "core/typeutil.h"
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace sq::system {
+
+namespace linux {
+class DirectoryWatcher;
+} // namespace linux
+
+/**
+ * Watches the parts of the system that are read while generating results, so
+ * that the results can be generated again when they change.
+ *
+ * Currently only directories read by SqPath.children are watched.
+ */
+class Watch {
+public:
+  Watch();
+
+  Watch(const Watch &) = delete;
+  Watch(Watch &&) = delete;
+  Watch &operator=(const Watch &) = delete;
+  Watch &operator=(Watch &&) = delete;
+  ~Watch() noexcept;
+
+  /**
+   * Call a function and watch the parts of the system that are read during
+   * the call, instead of the parts that were watched before.
+   */
+  void record(const std::function<void()> &f);
+
+  /**
+   * Wait until one of the watched parts of the system changes.
+   *
+   * Returns the paths of the directories that changed.
+   */
+  SQ_ND std::vector<std::filesystem::path> wait();
+
+private:
+  std::unique_ptr<linux::DirectoryWatcher> watcher_;
+};
+
+} // namespace sq::system
+
+#endif // SQ_INCLUDE_GUARD_system_watch_h_
@@ -23,6 +23,22 @@ sq_expand_for_each_type(
 add_library(sq_system_linux
     ${SQ_SYSTEM_LINUX_TYPE_HEADERS}
     ${SQ_SYSTEM_LINUX_TYPE_SRC}
+    "${SQ_SYSTEM_LINUX_HEADERS_DIR}/DirectoryObserver.h"
+    "${SQ_SYSTEM_LINUX_SRC_DIR}/DirectoryObserver.cpp"
+    "${SQ_SYSTEM_LINUX_HEADERS_DIR}/DirectoryWalker.h"
+    "${SQ_SYSTEM_LINUX_HEADERS_DIR}/DirectoryWalker.inl.h"
+    "${SQ_SYSTEM_LINUX_SRC_DIR}/DirectoryWalker.cpp"
+    "${SQ_SYSTEM_LINUX_HEADERS_DIR}/DirectoryWatcher.h"
+    "${SQ_SYSTEM_LINUX_SRC_DIR}/DirectoryWatcher.cpp"
+    "${SQ_SYSTEM_LINUX_HEADERS_DIR}/IndexedDirectoryWalker.h"
+    "${SQ_SYSTEM_LINUX_SRC_DIR}/IndexedDirectoryWalker.cpp"
+    "${SQ_SYSTEM_LINUX_HEADERS_DIR}/MetadataIndex.h"
+    "${SQ_SYSTEM_LINUX_HEADERS_DIR}/MetadataIndex.inl.h"
+    "${SQ_SYSTEM_LINUX_SRC_DIR}/MetadataIndex.cpp"
+    "${SQ_SYSTEM_LINUX_HEADERS_DIR}/pathutil.h"
+    "${SQ_SYSTEM_LINUX_SRC_DIR}/pathutil.cpp"
+    "${SQ_SYSTEM_LINUX_HEADERS_DIR}/StatCache.h"
+    "${SQ_SYSTEM_LINUX_SRC_DIR}/StatCache.cpp"
     "${SQ_SYSTEM_LINUX_HEADERS_DIR}/udev.h"
     "${SQ_SYSTEM_LINUX_HEADERS_DIR}/udev.inl.h"
     "${SQ_SYSTEM_LINUX_SRC_DIR}/udev.cpp"
@@ -29,18 +29,46 @@ struct ShouldCache {
 
 Result CacheingField::get(std::string_view member,
                           const FieldCallParams &params) const {
-  if (auto it = cache_.find(member); it != cache_.end()) {
-    return it->second;
-    ;
+  const auto find = [&]() -> const Result * {
+    const auto it = cache_.find(member);
+    if (it == cache_.end()) {
+      return nullptr;
+    }
+    for (const auto &[cached_params, result] : it->second) {
+      if (cached_params == params) {
+        return &result;
+      }
+    }
+    return nullptr;
+  };
+
+  {
+    const auto lock = std::scoped_lock{mutex_};
+    if (const auto *cached = find()) {
+      return *cached;
+    }
   }
+
+  // Don't hold the lock while dispatching: dispatching may be slow, and
+  // other members may be accessed at the same time.
   auto result = dispatch(member, params);
   if (!ShouldCache{}(result)) {
     return result;
   }
-  const auto [it, inserted] = cache_.emplace(member, std::move(result));
-  ASSERT(inserted);
+
+  const auto lock = std::scoped_lock{mutex_};
+  // Another thread may have cached a result for the same access while this
+  // one was dispatching. Use that result so that all callers see the same
+  // object.
+  if (const auto *cached = find()) {
+    return *cached;
+  }
+  auto it = cache_.find(member);
+  if (it == cache_.end()) {
+    it = cache_.emplace(member, CachedResults{}).first;
+  }
   ASSERT(it != cache_.end());
-  return it->second;
+  return it->second.emplace_back(params, std::move(result)).second;
 }
 
 } // namespace sq::system
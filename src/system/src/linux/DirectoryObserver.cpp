@@ -0,0 +1,52 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "system/linux/DirectoryObserver.h"
+
+#include <mutex>
+#include <utility>
+
+namespace sq::system::linux {
+
+namespace {
+
+std::mutex &observer_mutex() {
+  static auto mutex = std::mutex{};
+  return mutex;
+}
+
+std::shared_ptr<const DirectoryObserver> &current_observer() {
+  static auto observer = std::shared_ptr<const DirectoryObserver>{};
+  return observer;
+}
+
+std::shared_ptr<const DirectoryObserver>
+exchange_observer(std::shared_ptr<const DirectoryObserver> observer) {
+  const auto lock = std::scoped_lock{observer_mutex()};
+  return std::exchange(current_observer(), std::move(observer));
+}
+
+} // namespace
+
+ScopedDirectoryObserver::ScopedDirectoryObserver(DirectoryObserver observer)
+    : previous_{exchange_observer(
+          std::make_shared<const DirectoryObserver>(std::move(observer)))} {}
+
+ScopedDirectoryObserver::~ScopedDirectoryObserver() noexcept {
+  (void)exchange_observer(std::move(previous_));
+}
+
+void notify_directory_read(const std::filesystem::path &dir) {
+  auto observer = std::shared_ptr<const DirectoryObserver>{};
+  {
+    const auto lock = std::scoped_lock{observer_mutex()};
+    observer = current_observer();
+  }
+  if (observer) {
+    (*observer)(dir);
+  }
+}
+
+} // namespace sq::system::linux
@@ -0,0 +1,327 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "system/linux/DirectoryWalker.h"
+
+#include "core/errors.h"
+#include "system/linux/DirectoryObserver.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <gsl/gsl>
+#include <range/v3/algorithm/any_of.hpp>
+#include <range/v3/algorithm/sort.hpp>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+
+namespace sq::system::linux {
+
+namespace fs = std::filesystem;
+
+DirectoryWalker::DirectoryWalker(const fs::path &root,
+                                 DirectoryWalkOptions options)
+    : options_{std::move(options)} {
+  auto dir = DirPtr{opendir(root.c_str())};
+  if (dir == nullptr) {
+    const auto error = errno;
+    if (permission_denied_is_skipped(error)) {
+      return;
+    }
+    throw FilesystemError{"opendir()", root, make_error_code(error)};
+  }
+  if (options_.one_file_system_) {
+    struct stat s = {};
+    if (fstat(dirfd(dir.get()), &s) == -1) {
+      throw FilesystemError{"fstat()", root, make_error_code(errno)};
+    }
+    root_dev_ = s.st_dev;
+  }
+  push(std::move(dir), root);
+  advance();
+}
+
+bool DirectoryWalker::done() const noexcept { return stack_.empty(); }
+
+const DirectoryEntry &DirectoryWalker::entry() const noexcept {
+  return entry_;
+}
+
+void DirectoryWalker::next() {
+  Expects(!done());
+  if (descend_pending_) {
+    descend_pending_ = false;
+    descend(entry_.name_.c_str());
+  }
+  advance();
+}
+
+void DirectoryWalker::DirCloser::operator()(DIR *dir) const noexcept {
+  closedir(dir);
+}
+
+void DirectoryWalker::push(DirPtr dir, fs::path path) {
+  const auto depth = stack_.empty() ? 1 : stack_.back().depth_ + 1;
+  auto &top = stack_.emplace_back(OpenDirectory{
+      std::move(dir), std::make_shared<const fs::path>(std::move(path)),
+      depth, false, {}, 0});
+  notify_directory_read(*top.path_);
+  if (options_.lstat_entries_ && options_.lstat_in_inode_order_) {
+    read_batch(top);
+  }
+}
+
+void DirectoryWalker::descend(gsl::czstring<> name) {
+  const auto &top = stack_.back();
+  auto path = *top.path_ / name;
+
+  // Check the filesystem before opening the directory: opening it would
+  // trigger an automount.
+  if (options_.one_file_system_) {
+    auto stat_flags = AT_NO_AUTOMOUNT;
+    if (!options_.follow_symlinks_) {
+      stat_flags |= AT_SYMLINK_NOFOLLOW;
+    }
+    struct stat s = {};
+    if (fstatat(dirfd(top.dir_.get()), name, &s, stat_flags) == -1) {
+      const auto error = errno;
+      if (permission_denied_is_skipped(error)) {
+        return;
+      }
+      throw FilesystemError{"fstatat()", path, make_error_code(error)};
+    }
+    if (s.st_dev != root_dev_) {
+      return;
+    }
+  }
+
+  auto flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+  if (!options_.follow_symlinks_) {
+    flags |= O_NOFOLLOW;
+  }
+  const auto fd = openat(dirfd(top.dir_.get()), name, flags);
+  if (fd == -1) {
+    const auto error = errno;
+    if (permission_denied_is_skipped(error)) {
+      return;
+    }
+    throw FilesystemError{"openat()", path, make_error_code(error)};
+  }
+
+  auto dir = DirPtr{fdopendir(fd)};
+  if (dir == nullptr) {
+    const auto error = errno;
+    close(fd);
+    throw FilesystemError{"fdopendir()", path, make_error_code(error)};
+  }
+  push(std::move(dir), std::move(path));
+}
+
+void DirectoryWalker::advance() {
+  while (!stack_.empty()) {
+    if (options_.stop_token_.stop_requested()) {
+      stack_.clear();
+      return;
+    }
+    auto &top = stack_.back();
+    const auto *pending = next_pending(top);
+    if (pending == nullptr) {
+      stack_.pop_back();
+      continue;
+    }
+    if (pending->wanted_) {
+      if (read_entry(top, *pending)) {
+        return;
+      }
+    } else if (may_descend_from(top.depth_) &&
+               should_descend(top, *pending, std::nullopt)) {
+      // The entry itself isn't wanted, but its children might be.
+      descend(pending->name_.c_str());
+    }
+  }
+}
+
+void DirectoryWalker::read_batch(OpenDirectory &dir) {
+  while (const auto *ent = read_dirent(dir)) {
+    if (is_skipped(ent->d_name)) {
+      continue;
+    }
+    auto &pending = dir.batch_.emplace_back(
+        PendingEntry{ent->d_name, ent->d_ino, ent->d_type, false, {}});
+    pending.wanted_ = is_wanted(dir.depth_, pending.name_);
+  }
+  dir.batched_ = true;
+
+  const auto read_lstat = [&](PendingEntry &pending) {
+    if (pending.wanted_) {
+      pending.lstat_ = lstat_entry(dir, pending.name_.c_str());
+    }
+  };
+  if (options_.unordered_) {
+    ranges::sort(dir.batch_, std::less<>{}, &PendingEntry::inode_);
+    for (auto &pending : dir.batch_) {
+      read_lstat(pending);
+    }
+  } else {
+    auto by_inode = std::vector<PendingEntry *>{};
+    by_inode.reserve(dir.batch_.size());
+    for (auto &pending : dir.batch_) {
+      by_inode.push_back(&pending);
+    }
+    ranges::sort(by_inode, std::less<>{},
+                 [](const auto *pending) { return pending->inode_; });
+    for (auto *pending : by_inode) {
+      read_lstat(*pending);
+    }
+  }
+
+  // Drop entries that were removed before their metadata could be read.
+  std::erase_if(dir.batch_, [](const auto &pending) {
+    return pending.wanted_ && !pending.lstat_;
+  });
+}
+
+const DirectoryWalker::PendingEntry *
+DirectoryWalker::next_pending(OpenDirectory &top) {
+  if (top.batched_) {
+    if (top.batch_pos_ == top.batch_.size()) {
+      return nullptr;
+    }
+    return &top.batch_[top.batch_pos_++];
+  }
+  while (const auto *ent = read_dirent(top)) {
+    if (is_skipped(ent->d_name)) {
+      continue;
+    }
+    pending_.name_ = ent->d_name;
+    pending_.inode_ = ent->d_ino;
+    pending_.type_ = ent->d_type;
+    pending_.wanted_ = is_wanted(top.depth_, pending_.name_);
+    return &pending_;
+  }
+  return nullptr;
+}
+
+const dirent *DirectoryWalker::read_dirent(const OpenDirectory &dir) const {
+  errno = 0;
+  const auto *ent = readdir(dir.dir_.get());
+  if (ent == nullptr && errno != 0) {
+    throw FilesystemError{"readdir()", *dir.path_, make_error_code(errno)};
+  }
+  return ent;
+}
+
+bool DirectoryWalker::read_entry(const OpenDirectory &top,
+                                 const PendingEntry &pending) {
+  entry_.parent_ = top.path_;
+  entry_.name_ = pending.name_;
+  entry_.depth_ = top.depth_;
+  entry_.lstat_.reset();
+
+  if (options_.lstat_entries_) {
+    entry_.lstat_ = pending.lstat_ ? pending.lstat_
+                                   : lstat_entry(top, pending.name_.c_str());
+    if (!entry_.lstat_) {
+      return false;
+    }
+  }
+
+  descend_pending_ = may_descend_from(top.depth_) &&
+                     should_descend(top, pending, entry_.lstat_);
+  return true;
+}
+
+std::optional<struct stat>
+DirectoryWalker::lstat_entry(const OpenDirectory &dir,
+                             gsl::czstring<> name) const {
+  struct stat s = {};
+  if (fstatat(dirfd(dir.dir_.get()), name, &s, AT_SYMLINK_NOFOLLOW) == -1) {
+    // The entry may have been removed since the directory was read.
+    if (errno == ENOENT) {
+      return std::nullopt;
+    }
+    throw FilesystemError{"fstatat()", *dir.path_ / name,
+                          make_error_code(errno)};
+  }
+  return s;
+}
+
+bool DirectoryWalker::is_skipped(gsl::czstring<> name) const {
+  const auto sv = std::string_view{name};
+  return sv == "." || sv == ".." || is_excluded(name);
+}
+
+bool DirectoryWalker::is_wanted(std::size_t depth,
+                                std::string_view name) const {
+  if (depth < options_.min_depth_) {
+    return false;
+  }
+  if (options_.max_depth_ && depth > options_.max_depth_.value()) {
+    return false;
+  }
+  return !options_.name_filter_ || options_.name_filter_(name);
+}
+
+bool DirectoryWalker::is_excluded(gsl::czstring<> name) const {
+  return ranges::any_of(options_.exclude_, [&](const auto &pattern) {
+    return fnmatch(pattern.c_str(), name, 0) == 0;
+  });
+}
+
+bool DirectoryWalker::may_descend_from(std::size_t depth) const noexcept {
+  return options_.recurse_ &&
+         (!options_.max_depth_ || depth < options_.max_depth_.value());
+}
+
+bool DirectoryWalker::should_descend(
+    const OpenDirectory &top, const PendingEntry &pending,
+    const std::optional<struct stat> &lstat) const {
+  switch (pending.type_) {
+  case DT_DIR:
+    return true;
+  case DT_LNK:
+    if (!options_.follow_symlinks_) {
+      return false;
+    }
+    break;
+  case DT_UNKNOWN:
+    break;
+  default:
+    return false;
+  }
+
+  // The type of the entry (or of the target of a symlink) isn't known from
+  // the directory entry alone.
+  if (lstat && !(options_.follow_symlinks_ && S_ISLNK(lstat->st_mode))) {
+    return S_ISDIR(lstat->st_mode);
+  }
+  struct stat s = {};
+  const auto flags = options_.follow_symlinks_ ? 0 : AT_SYMLINK_NOFOLLOW;
+  if (fstatat(dirfd(top.dir_.get()), pending.name_.c_str(), &s, flags) ==
+      -1) {
+    const auto error = errno;
+    // Broken symlinks and entries that have been removed since the directory
+    // was read aren't directories.
+    if (error == ENOENT || permission_denied_is_skipped(error)) {
+      return false;
+    }
+    throw FilesystemError{"fstatat()", *top.path_ / pending.name_,
+                          make_error_code(error)};
+  }
+  return S_ISDIR(s.st_mode);
+}
+
+bool DirectoryWalker::permission_denied_is_skipped(int error) const noexcept {
+  return error == EACCES && options_.skip_permission_denied_;
+}
+
+DirectoryRange walk_directory(const fs::path &root,
+                              DirectoryWalkOptions options) {
+  return make_directory_range(
+      std::make_shared<DirectoryWalker>(root, std::move(options)));
+}
+
+} // namespace sq::system::linux
@@ -0,0 +1,127 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "system/linux/DirectoryWatcher.h"
+
+#include "core/errors.h"
+#include "core/narrow.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace sq::system::linux {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr std::uint32_t watch_mask =
+    IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_DELETE_SELF |
+    IN_MODIFY | IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+constexpr std::size_t event_buffer_size = 64 * 1024;
+
+} // namespace
+
+DirectoryWatcher::DirectoryWatcher() : fd_{inotify_init1(IN_CLOEXEC)} {
+  if (fd_ == -1) {
+    throw SystemError{"inotify_init1()", make_error_code(errno)};
+  }
+}
+
+DirectoryWatcher::~DirectoryWatcher() noexcept { close(fd_); }
+
+void DirectoryWatcher::add(const fs::path &dir) {
+  const auto wd = inotify_add_watch(fd_, dir.c_str(), watch_mask);
+  if (wd == -1) {
+    const auto error = errno;
+    if (error == ENOENT || error == ENOTDIR || error == EACCES) {
+      return;
+    }
+    throw FilesystemError{"inotify_add_watch()", dir, make_error_code(error)};
+  }
+  const auto lock = std::scoped_lock{mutex_};
+  watches_.insert_or_assign(wd, dir);
+}
+
+void DirectoryWatcher::clear() {
+  const auto lock = std::scoped_lock{mutex_};
+  for (const auto &[wd, dir] : watches_) {
+    inotify_rm_watch(fd_, wd);
+  }
+  watches_.clear();
+}
+
+std::vector<fs::path>
+DirectoryWatcher::wait(std::chrono::milliseconds settle_time) {
+  auto changed = std::vector<fs::path>{};
+  while (changed.empty()) {
+    (void)read_events(-1, changed);
+  }
+  const auto settle_ms = narrow<int>(settle_time.count(), "settle time");
+  while (read_events(settle_ms, changed)) {
+  }
+  std::sort(changed.begin(), changed.end());
+  changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+  return changed;
+}
+
+bool DirectoryWatcher::read_events(int timeout_ms,
+                                   std::vector<fs::path> &changed) {
+  auto pfd = pollfd{fd_, POLLIN, 0};
+  const auto ready = poll(&pfd, 1, timeout_ms);
+  if (ready == -1) {
+    if (errno == EINTR) {
+      return true;
+    }
+    throw SystemError{"poll()", make_error_code(errno)};
+  }
+  if (ready == 0) {
+    return false;
+  }
+
+  alignas(inotify_event) auto buf = std::array<char, event_buffer_size>{};
+  const auto len = read(fd_, buf.data(), buf.size());
+  if (len == -1) {
+    if (errno == EINTR || errno == EAGAIN) {
+      return true;
+    }
+    throw SystemError{"read() from inotify", make_error_code(errno)};
+  }
+
+  const auto lock = std::scoped_lock{mutex_};
+  const auto events = gsl::span{buf}.first(to_size(len));
+  auto offset = std::size_t{0};
+  while (offset + sizeof(inotify_event) <= events.size()) {
+    auto event = inotify_event{};
+    std::memcpy(&event, &events[offset], sizeof(event));
+    offset += sizeof(event) + event.len;
+
+    if ((event.mask & IN_Q_OVERFLOW) != 0) {
+      // Events were lost, so any of the directories may have changed.
+      for (const auto &[wd, dir] : watches_) {
+        changed.push_back(dir);
+      }
+      continue;
+    }
+    const auto it = watches_.find(event.wd);
+    if (it == watches_.end()) {
+      continue;
+    }
+    if ((event.mask & IN_IGNORED) != 0) {
+      watches_.erase(it);
+      continue;
+    }
+    changed.push_back(it->second);
+  }
+  return true;
+}
+
+} // namespace sq::system::linux
@@ -0,0 +1,291 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "system/linux/IndexedDirectoryWalker.h"
+
+#include "core/errors.h"
+#include "system/linux/DirectoryObserver.h"
+
+#include <cerrno>
+#include <fnmatch.h>
+#include <gsl/gsl>
+#include <optional>
+#include <range/v3/algorithm/any_of.hpp>
+#include <range/v3/algorithm/equal.hpp>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace sq::system::linux {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+SQ_ND bool is_excluded(const DirectoryWalkOptions &options,
+                       std::string_view name) {
+  if (options.exclude_.empty()) {
+    return false;
+  }
+  // Names in an index aren't null-terminated.
+  const auto str = std::string{name};
+  return ranges::any_of(options.exclude_, [&](const auto &pattern) {
+    return fnmatch(pattern.c_str(), str.c_str(), 0) == 0;
+  });
+}
+
+// Entries whose names match DirectoryWalkOptions::exclude_ are recorded, so
+// that the index can be used by walks with different exclude patterns, but
+// excluded directories aren't read.
+class IndexRefresher {
+public:
+  IndexRefresher(const std::optional<MetadataIndex> &old,
+                 const DirectoryWalkOptions &options)
+      : old_{old}, options_{options} {
+    list_options_.skip_permission_denied_ = options.skip_permission_denied_;
+    list_options_.lstat_entries_ = true;
+    list_options_.lstat_in_inode_order_ = options.lstat_in_inode_order_;
+    list_options_.unordered_ = options.unordered_;
+  }
+
+  SQ_ND MetadataIndexBuilder refresh(const fs::path &root) {
+    const auto abs_root = fs::absolute(root);
+    struct stat s = {};
+    if (stat(abs_root.c_str(), &s) == -1) {
+      throw FilesystemError{"stat()", root, make_error_code(errno)};
+    }
+    root_dev_ = s.st_dev;
+
+    auto builder = MetadataIndexBuilder{abs_root.string()};
+    builder_ = &builder;
+    auto old_root = std::optional<std::size_t>{};
+    if (old_ && old_->root() == abs_root.string()) {
+      old_root = 0;
+    }
+    (void)refresh_directory(abs_root, s, old_root, 1);
+    builder_ = nullptr;
+    return builder;
+  }
+
+private:
+  struct Child {
+    std::string name_;
+    struct stat lstat_;
+    std::optional<std::size_t> old_directory_;
+  };
+
+  // Record a directory, whose entries have the given depth, and its
+  // subdirectories. Returns the index of the directory's record.
+  std::size_t refresh_directory(const fs::path &path,
+                                const struct stat &dir_stat,
+                                std::optional<std::size_t> old_directory,
+                                std::size_t depth) {
+    const auto children = list_directory(path, dir_stat, old_directory);
+
+    const auto directory = builder_->add_directory(dir_stat);
+    auto entries = std::vector<std::size_t>{};
+    entries.reserve(children.size());
+    for (const auto &child : children) {
+      entries.push_back(builder_->add_entry(child.name_, child.lstat_));
+    }
+
+    if (!may_descend_from(depth)) {
+      return directory;
+    }
+    for (auto i = std::size_t{0}; i < children.size(); ++i) {
+      const auto &child = children[i];
+      if (!S_ISDIR(child.lstat_.st_mode) ||
+          is_excluded(options_, child.name_)) {
+        continue;
+      }
+      // The recorded metadata of a subdirectory in an unchanged directory may
+      // be out of date, so get the current metadata before checking whether
+      // the subdirectory has changed.
+      auto child_path = path / child.name_;
+      struct stat s = {};
+      if (lstat(child_path.c_str(), &s) == -1) {
+        // The subdirectory may have been removed since it was listed.
+        if (errno == ENOENT) {
+          continue;
+        }
+        throw FilesystemError{"lstat()", child_path, make_error_code(errno)};
+      }
+      builder_->set_lstat(entries[i], s);
+      if (!S_ISDIR(s.st_mode) ||
+          (options_.one_file_system_ && s.st_dev != root_dev_)) {
+        continue;
+      }
+      builder_->set_child_directory(
+          entries[i], refresh_directory(child_path, s, child.old_directory_,
+                                        depth + 1));
+    }
+    return directory;
+  }
+
+  SQ_ND std::vector<Child>
+  list_directory(const fs::path &path, const struct stat &dir_stat,
+                 std::optional<std::size_t> old_directory) const {
+    auto children = std::vector<Child>{};
+    if (old_directory &&
+        is_unchanged(old_->directory(*old_directory), dir_stat)) {
+      // The directory isn't read again, but it is still part of the walk.
+      notify_directory_read(path);
+      const auto dir = old_->directory(*old_directory);
+      for (auto e = dir.first_entry_; e < dir.first_entry_ + dir.entry_count_;
+           ++e) {
+        children.push_back(Child{std::string{old_->name(e)}, old_->lstat(e),
+                                 old_->child_directory(e)});
+      }
+      return children;
+    }
+
+    // The directory has changed, so read it again, but keep track of the
+    // records of its subdirectories so that they can be reused if they
+    // haven't changed.
+    auto old_children = std::unordered_map<std::string_view, std::size_t>{};
+    if (old_directory) {
+      const auto dir = old_->directory(*old_directory);
+      for (auto e = dir.first_entry_; e < dir.first_entry_ + dir.entry_count_;
+           ++e) {
+        if (const auto child = old_->child_directory(e)) {
+          old_children.emplace(old_->name(e), *child);
+        }
+      }
+    }
+    for (auto walker = DirectoryWalker{path, list_options_}; !walker.done();
+         walker.next()) {
+      const auto &entry = walker.entry();
+      const auto it = old_children.find(entry.name_);
+      children.push_back(Child{
+          entry.name_, entry.lstat_.value(),
+          it == old_children.end() ? std::nullopt
+                                   : std::optional<std::size_t>{it->second}});
+    }
+    return children;
+  }
+
+  SQ_ND bool may_descend_from(std::size_t depth) const noexcept {
+    return options_.recurse_ &&
+           (!options_.max_depth_ || depth < options_.max_depth_.value());
+  }
+
+  const std::optional<MetadataIndex> &old_;
+  const DirectoryWalkOptions &options_;
+  DirectoryWalkOptions list_options_;
+  MetadataIndexBuilder *builder_ = nullptr;
+  dev_t root_dev_ = 0;
+};
+
+} // namespace
+
+MetadataIndex refresh_metadata_index(const fs::path &index_file,
+                                     const fs::path &root,
+                                     const DirectoryWalkOptions &options) {
+  auto old = std::optional<MetadataIndex>{};
+  try {
+    old = MetadataIndex::open(index_file);
+  } catch (const IndexFormatError &) {
+    // E.g. an index written by a different version of sq: just replace it.
+  }
+  const auto data = IndexRefresher{old, options}.refresh(root).serialize();
+  if (old && ranges::equal(old->bytes(), data)) {
+    return std::move(*old);
+  }
+  old.reset();
+
+  write_metadata_index(index_file, data);
+  auto index = MetadataIndex::open(index_file);
+  if (!index) {
+    throw FilesystemError{"open()", index_file, make_error_code(ENOENT)};
+  }
+  return std::move(*index);
+}
+
+IndexedDirectoryWalker::IndexedDirectoryWalker(const fs::path &index_file,
+                                               const fs::path &root,
+                                               DirectoryWalkOptions options)
+    : index_{refresh_metadata_index(index_file, root, options)},
+      options_{std::move(options)} {
+  push(0, root);
+  advance();
+}
+
+bool IndexedDirectoryWalker::done() const noexcept { return stack_.empty(); }
+
+const DirectoryEntry &IndexedDirectoryWalker::entry() const noexcept {
+  return entry_;
+}
+
+void IndexedDirectoryWalker::next() {
+  Expects(!done());
+  if (descend_pending_) {
+    const auto directory = descend_pending_.value();
+    descend_pending_.reset();
+    push(directory, *entry_.parent_ / entry_.name_);
+  }
+  advance();
+}
+
+void IndexedDirectoryWalker::push(std::size_t directory, fs::path path) {
+  const auto dir = index_.directory(directory);
+  const auto depth = stack_.empty() ? 1 : stack_.back().depth_ + 1;
+  stack_.push_back(Position{dir.first_entry_,
+                            dir.first_entry_ + dir.entry_count_,
+                            std::make_shared<const fs::path>(std::move(path)),
+                            depth});
+}
+
+void IndexedDirectoryWalker::advance() {
+  while (!stack_.empty()) {
+    if (options_.stop_token_.stop_requested()) {
+      stack_.clear();
+      return;
+    }
+    auto &top = stack_.back();
+    if (top.next_entry_ == top.end_entry_) {
+      stack_.pop_back();
+      continue;
+    }
+    const auto entry = top.next_entry_++;
+    const auto name = index_.name(entry);
+    if (is_excluded(options_, name)) {
+      // Excluded entries are skipped along with their children.
+      continue;
+    }
+    const auto child = index_.child_directory(entry);
+    if (is_wanted(top.depth_, name)) {
+      entry_.parent_ = top.path_;
+      entry_.name_ = name;
+      entry_.depth_ = top.depth_;
+      entry_.lstat_ = index_.lstat(entry);
+      descend_pending_ = child;
+      return;
+    }
+    if (child) {
+      // The entry itself isn't wanted, but its children might be.
+      push(child.value(), *top.path_ / name);
+    }
+  }
+}
+
+bool IndexedDirectoryWalker::is_wanted(std::size_t depth,
+                                       std::string_view name) const {
+  if (depth < options_.min_depth_) {
+    return false;
+  }
+  return !options_.name_filter_ || options_.name_filter_(name);
+}
+
+BasicDirectoryRange<IndexedDirectoryWalker>
+walk_indexed_directory(const fs::path &index_file, const fs::path &root,
+                       DirectoryWalkOptions options) {
+  return make_directory_range(std::make_shared<IndexedDirectoryWalker>(
+      index_file, root, std::move(options)));
+}
+
+} // namespace sq::system::linux
@@ -0,0 +1,414 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "system/linux/MetadataIndex.h"
+
+#include "core/errors.h"
+#include "core/narrow.h"
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace sq::system::linux {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr auto index_magic = std::array{'S', 'Q', 'I', 'N', 'D', 'E', 'X', '\0'};
+constexpr std::uint32_t index_version = 1;
+constexpr std::uint32_t index_byte_order = 0x01020304;
+constexpr std::size_t column_alignment = 8;
+constexpr auto no_child_directory = std::numeric_limits<std::uint32_t>::max();
+constexpr mode_t index_file_mode =
+    S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
+
+struct Header {
+  std::array<char, index_magic.size()> magic_;
+  std::uint32_t version_;
+  std::uint32_t byte_order_;
+  std::uint64_t directory_count_;
+  std::uint64_t entry_count_;
+  std::uint64_t root_length_;
+  std::uint64_t names_length_;
+};
+
+std::size_t padded(std::size_t size) {
+  return (size + column_alignment - 1) / column_alignment * column_alignment;
+}
+
+void append(std::vector<std::byte> &out, const void *data, std::size_t size) {
+  const auto offset = out.size();
+  out.resize(offset + padded(size));
+  if (size > 0) {
+    std::memcpy(&out.at(offset), data, size);
+  }
+}
+
+timespec to_timespec(std::int64_t sec, std::int64_t nsec) {
+  auto ts = timespec{};
+  ts.tv_sec = static_cast<time_t>(sec);
+  ts.tv_nsec = static_cast<long>(nsec);
+  return ts;
+}
+
+bool operator==(const timespec &lhs, const timespec &rhs) noexcept {
+  return lhs.tv_sec == rhs.tv_sec && lhs.tv_nsec == rhs.tv_nsec;
+}
+
+// Reads the sections of an index file in order, checking that they are
+// within the file.
+class SectionReader {
+public:
+  SectionReader(gsl::span<const std::byte> bytes, const fs::path &file)
+      : bytes_{bytes}, file_{file} {}
+
+  template <typename T> gsl::span<const T> read(std::size_t count) {
+    if (count > (bytes_.size() - offset_) / sizeof(T)) {
+      throw IndexFormatError{file_, "file is truncated"};
+    }
+    const auto *data = bytes_.subspan(offset_).data();
+    offset_ += padded(count * sizeof(T));
+    offset_ = std::min(offset_, bytes_.size());
+    // Sections are aligned within the file, and the file is mapped at a page
+    // boundary, so the data is suitably aligned for T.
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return {reinterpret_cast<const T *>(data), count};
+  }
+
+  SQ_ND bool at_end() const noexcept { return offset_ == bytes_.size(); }
+
+private:
+  gsl::span<const std::byte> bytes_;
+  const fs::path &file_;
+  std::size_t offset_ = padded(sizeof(Header));
+};
+
+// Create a new file next to the given file to write its contents to before
+// renaming it. Unlike mkostemp(), which always uses mode 0600, this lets the
+// umask decide who can read the file, as it would for any other new file.
+std::pair<int, std::string> create_temporary_file(const fs::path &file) {
+  static auto counter = std::atomic<unsigned>{0};
+  while (true) {
+    auto name = fmt::format("{}.{}.{}", file.string(), getpid(), counter++);
+    const auto fd = open(name.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                         index_file_mode);
+    if (fd != -1) {
+      return {fd, std::move(name)};
+    }
+    if (errno != EEXIST) {
+      throw FilesystemError{"open()", name, make_error_code(errno)};
+    }
+  }
+}
+
+} // namespace
+
+bool is_unchanged(const IndexedDirectory &indexed,
+                  const struct stat &current) noexcept {
+  return indexed.inode_ == current.st_ino && indexed.dev_ == current.st_dev &&
+         indexed.mtime_ == current.st_mtim && indexed.ctime_ == current.st_ctim;
+}
+
+void MetadataIndex::Unmapper::operator()(const std::byte *p) const noexcept {
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+  munmap(const_cast<std::byte *>(p), size_);
+}
+
+std::optional<MetadataIndex> MetadataIndex::open(const fs::path &file) {
+  const auto fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    if (errno == ENOENT) {
+      return std::nullopt;
+    }
+    throw FilesystemError{"open()", file, make_error_code(errno)};
+  }
+  auto close_fd = gsl::finally([&] { close(fd); });
+
+  struct stat s = {};
+  if (fstat(fd, &s) == -1) {
+    throw FilesystemError{"fstat()", file, make_error_code(errno)};
+  }
+  const auto size = to_size(s.st_size, "index file size");
+  if (size < sizeof(Header)) {
+    throw IndexFormatError{file, "file is too small"};
+  }
+  auto *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-cstyle-cast)
+  if (p == MAP_FAILED) {
+    throw FilesystemError{"mmap()", file, make_error_code(errno)};
+  }
+  return MetadataIndex{MappingPtr{static_cast<const std::byte *>(p),
+                                  Unmapper{size}},
+                       size, file};
+}
+
+MetadataIndex::MetadataIndex(MappingPtr mapping, std::size_t size,
+                             const fs::path &file)
+    : mapping_{std::move(mapping)}, bytes_{mapping_.get(), size} {
+  auto header = Header{};
+  std::memcpy(&header, bytes_.data(), sizeof(header));
+  if (header.magic_ != index_magic) {
+    throw IndexFormatError{file, "not an sq index file"};
+  }
+  if (header.version_ != index_version) {
+    throw IndexFormatError{file, "unsupported index version"};
+  }
+  if (header.byte_order_ != index_byte_order) {
+    throw IndexFormatError{file, "index was written with another byte order"};
+  }
+  directory_count_ = to_size(header.directory_count_, "directory count");
+  entry_count_ = to_size(header.entry_count_, "entry count");
+
+  auto reader = SectionReader{bytes_, file};
+  const auto root = reader.read<char>(to_size(header.root_length_, "root"));
+  root_ = std::string_view{root.data(), root.size()};
+  names_ = reader.read<char>(to_size(header.names_length_, "names"));
+  for_each_directory_column(columns_, [&]<typename T>(Span<T> &column) {
+    column = reader.read<T>(directory_count_);
+  });
+  for_each_entry_column(columns_, [&]<typename T>(Span<T> &column) {
+    column = reader.read<T>(entry_count_);
+  });
+  if (!reader.at_end()) {
+    throw IndexFormatError{file, "unexpected data at end of file"};
+  }
+  validate(file);
+}
+
+void MetadataIndex::validate(const fs::path &file) const {
+  // Check the references between records once here so that the accessors
+  // don't need to.
+  if (directory_count_ == 0) {
+    throw IndexFormatError{file, "index has no root directory"};
+  }
+  for (auto dir = std::size_t{0}; dir < directory_count_; ++dir) {
+    const auto first = columns_.dir_first_entry_[dir];
+    const auto count = columns_.dir_entry_count_[dir];
+    if (first > entry_count_ || count > entry_count_ - first) {
+      throw IndexFormatError{file, "directory entries out of range"};
+    }
+    for (auto entry = first; entry < first + count; ++entry) {
+      // Directories are always recorded after their parents, which also
+      // ensures that walking the index terminates.
+      const auto child = columns_.child_directory_[entry];
+      if (child != no_child_directory &&
+          (child <= dir || child >= directory_count_)) {
+        throw IndexFormatError{file, "invalid directory reference"};
+      }
+    }
+  }
+  for (auto entry = std::size_t{0}; entry < entry_count_; ++entry) {
+    const auto offset = columns_.name_offset_[entry];
+    const auto length = columns_.name_length_[entry];
+    if (offset > names_.size() || length > names_.size() - offset) {
+      throw IndexFormatError{file, "entry name out of range"};
+    }
+  }
+}
+
+std::string_view MetadataIndex::root() const { return root_; }
+
+std::size_t MetadataIndex::directory_count() const noexcept {
+  return directory_count_;
+}
+
+std::size_t MetadataIndex::entry_count() const noexcept {
+  return entry_count_;
+}
+
+IndexedDirectory MetadataIndex::directory(std::size_t index) const {
+  auto dir = IndexedDirectory{};
+  dir.mtime_ = to_timespec(columns_.dir_mtime_sec_[index],
+                           columns_.dir_mtime_nsec_[index]);
+  dir.ctime_ = to_timespec(columns_.dir_ctime_sec_[index],
+                           columns_.dir_ctime_nsec_[index]);
+  dir.inode_ = static_cast<ino_t>(columns_.dir_inode_[index]);
+  dir.dev_ = static_cast<dev_t>(columns_.dir_dev_[index]);
+  dir.first_entry_ = to_size(columns_.dir_first_entry_[index]);
+  dir.entry_count_ = to_size(columns_.dir_entry_count_[index]);
+  return dir;
+}
+
+std::string_view MetadataIndex::name(std::size_t entry) const {
+  const auto offset = to_size(columns_.name_offset_[entry]);
+  const auto length = std::size_t{columns_.name_length_[entry]};
+  return std::string_view{&names_[offset], length};
+}
+
+struct stat MetadataIndex::lstat(std::size_t entry) const {
+  struct stat s = {};
+  s.st_ino = static_cast<ino_t>(columns_.inode_[entry]);
+  s.st_dev = static_cast<dev_t>(columns_.dev_[entry]);
+  s.st_nlink = static_cast<nlink_t>(columns_.hard_link_count_[entry]);
+  s.st_size = static_cast<off_t>(columns_.size_[entry]);
+  s.st_blocks = static_cast<blkcnt_t>(columns_.block_count_[entry]);
+  s.st_mode = static_cast<mode_t>(columns_.mode_[entry]);
+  s.st_uid = static_cast<uid_t>(columns_.uid_[entry]);
+  s.st_gid = static_cast<gid_t>(columns_.gid_[entry]);
+  s.st_atim =
+      to_timespec(columns_.atime_sec_[entry], columns_.atime_nsec_[entry]);
+  s.st_mtim =
+      to_timespec(columns_.mtime_sec_[entry], columns_.mtime_nsec_[entry]);
+  s.st_ctim =
+      to_timespec(columns_.ctime_sec_[entry], columns_.ctime_nsec_[entry]);
+  return s;
+}
+
+std::optional<std::size_t>
+MetadataIndex::child_directory(std::size_t entry) const {
+  const auto child = columns_.child_directory_[entry];
+  if (child == no_child_directory) {
+    return std::nullopt;
+  }
+  return std::size_t{child};
+}
+
+gsl::span<const std::byte> MetadataIndex::bytes() const noexcept {
+  return bytes_;
+}
+
+MetadataIndexBuilder::MetadataIndexBuilder(std::string_view root)
+    : root_{root} {}
+
+std::size_t MetadataIndexBuilder::add_directory(const struct stat &dir_stat) {
+  const auto index = columns_.dir_inode_.size();
+  columns_.dir_mtime_sec_.push_back(dir_stat.st_mtim.tv_sec);
+  columns_.dir_mtime_nsec_.push_back(dir_stat.st_mtim.tv_nsec);
+  columns_.dir_ctime_sec_.push_back(dir_stat.st_ctim.tv_sec);
+  columns_.dir_ctime_nsec_.push_back(dir_stat.st_ctim.tv_nsec);
+  columns_.dir_inode_.push_back(dir_stat.st_ino);
+  columns_.dir_dev_.push_back(dir_stat.st_dev);
+  columns_.dir_first_entry_.push_back(columns_.inode_.size());
+  columns_.dir_entry_count_.push_back(0);
+  return index;
+}
+
+std::size_t MetadataIndexBuilder::add_entry(std::string_view name,
+                                            const struct stat &lstat) {
+  Expects(!columns_.dir_entry_count_.empty());
+  const auto index = columns_.inode_.size();
+  columns_.name_offset_.push_back(names_.size());
+  columns_.name_length_.push_back(
+      narrow<std::uint32_t>(name.size(), "name length"));
+  columns_.child_directory_.push_back(no_child_directory);
+  names_.append(name);
+  columns_.inode_.emplace_back();
+  columns_.dev_.emplace_back();
+  columns_.hard_link_count_.emplace_back();
+  columns_.size_.emplace_back();
+  columns_.block_count_.emplace_back();
+  columns_.mode_.emplace_back();
+  columns_.uid_.emplace_back();
+  columns_.gid_.emplace_back();
+  columns_.atime_sec_.emplace_back();
+  columns_.atime_nsec_.emplace_back();
+  columns_.mtime_sec_.emplace_back();
+  columns_.mtime_nsec_.emplace_back();
+  columns_.ctime_sec_.emplace_back();
+  columns_.ctime_nsec_.emplace_back();
+  set_lstat(index, lstat);
+  ++columns_.dir_entry_count_.back();
+  return index;
+}
+
+void MetadataIndexBuilder::set_lstat(std::size_t entry,
+                                     const struct stat &lstat) {
+  columns_.inode_.at(entry) = lstat.st_ino;
+  columns_.dev_.at(entry) = lstat.st_dev;
+  columns_.hard_link_count_.at(entry) = lstat.st_nlink;
+  columns_.size_.at(entry) = lstat.st_size;
+  columns_.block_count_.at(entry) = lstat.st_blocks;
+  columns_.mode_.at(entry) = lstat.st_mode;
+  columns_.uid_.at(entry) = lstat.st_uid;
+  columns_.gid_.at(entry) = lstat.st_gid;
+  columns_.atime_sec_.at(entry) = lstat.st_atim.tv_sec;
+  columns_.atime_nsec_.at(entry) = lstat.st_atim.tv_nsec;
+  columns_.mtime_sec_.at(entry) = lstat.st_mtim.tv_sec;
+  columns_.mtime_nsec_.at(entry) = lstat.st_mtim.tv_nsec;
+  columns_.ctime_sec_.at(entry) = lstat.st_ctim.tv_sec;
+  columns_.ctime_nsec_.at(entry) = lstat.st_ctim.tv_nsec;
+}
+
+void MetadataIndexBuilder::set_child_directory(std::size_t entry,
+                                               std::size_t directory) {
+  Expects(directory < columns_.dir_inode_.size());
+  columns_.child_directory_.at(entry) =
+      narrow<std::uint32_t>(directory, "directory index");
+}
+
+std::vector<std::byte> MetadataIndexBuilder::serialize() const {
+  auto header = Header{};
+  header.magic_ = index_magic;
+  header.version_ = index_version;
+  header.byte_order_ = index_byte_order;
+  header.directory_count_ = columns_.dir_inode_.size();
+  header.entry_count_ = columns_.inode_.size();
+  header.root_length_ = root_.size();
+  header.names_length_ = names_.size();
+
+  auto out = std::vector<std::byte>{};
+  append(out, &header, sizeof(header));
+  append(out, root_.data(), root_.size());
+  append(out, names_.data(), names_.size());
+  const auto append_column = [&]<typename T>(const Vector<T> &column) {
+    append(out, column.data(), column.size() * sizeof(T));
+  };
+  for_each_directory_column(columns_, append_column);
+  for_each_entry_column(columns_, append_column);
+  return out;
+}
+
+void write_metadata_index(const fs::path &file,
+                          gsl::span<const std::byte> data) {
+  const auto [fd, tmpl] = create_temporary_file(file);
+  auto renamed = false;
+  auto remove_tmp = gsl::finally([&] {
+    if (!renamed) {
+      unlink(tmpl.c_str());
+    }
+  });
+
+  const auto fail = [&](const char *op) {
+    const auto error = errno;
+    close(fd);
+    throw FilesystemError{op, tmpl, make_error_code(error)};
+  };
+
+  auto remaining = data;
+  while (!remaining.empty()) {
+    const auto written = ::write(fd, remaining.data(), remaining.size());
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fail("write()");
+    }
+    remaining = remaining.subspan(to_size(written));
+  }
+  // Make sure that the data reaches the disk before the rename, so that a
+  // crash can't leave an empty or partly written file in place of the index.
+  if (fsync(fd) == -1) {
+    fail("fsync()");
+  }
+  if (close(fd) == -1) {
+    throw FilesystemError{"close()", tmpl, make_error_code(errno)};
+  }
+  if (rename(tmpl.c_str(), file.c_str()) == -1) {
+    throw FilesystemError{"rename()", file, make_error_code(errno)};
+  }
+  renamed = true;
+}
+
+} // namespace sq::system::linux
@@ -10,4 +10,9 @@ namespace sq::system::linux {
 SqAnyPrimitiveImpl::SqAnyPrimitiveImpl(const Primitive &prim) : prim_{prim} {}
 Primitive SqAnyPrimitiveImpl::to_primitive() const { return prim_; }
 
+PrimitiveRef
+SqAnyPrimitiveImpl::to_primitive_ref(SQ_MU Primitive &storage) const {
+  return primitive_ref(prim_);
+}
+
 } // namespace sq::system::linux
@@ -11,4 +11,8 @@ SqBoolImpl::SqBoolImpl(PrimitiveBool value) : value_{value} {}
 
 Primitive SqBoolImpl::to_primitive() const { return value_; }
 
+PrimitiveRef SqBoolImpl::to_primitive_ref(SQ_MU Primitive &storage) const {
+  return value_;
+}
+
 } // namespace sq::system::linux
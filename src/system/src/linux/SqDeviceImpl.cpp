@@ -42,4 +42,15 @@ Primitive SqDeviceImpl::to_primitive() const {
   return PrimitiveString{dev_->sys_name()};
 }
 
+PrimitiveRef SqDeviceImpl::to_primitive_ref(SQ_MU Primitive &storage) const {
+  Expects(dev_ != nullptr);
+  return dev_->sys_name();
+}
+
+bool SqDeviceImpl::is_thread_affine() const noexcept {
+  // Devices share a udev context, which libudev doesn't allow to be used from
+  // more than one thread.
+  return true;
+}
+
 } // namespace sq::system::linux
@@ -11,4 +11,8 @@ SqFloatImpl::SqFloatImpl(PrimitiveFloat value) : value_{value} {}
 
 Primitive SqFloatImpl::to_primitive() const { return value_; }
 
+PrimitiveRef SqFloatImpl::to_primitive_ref(SQ_MU Primitive &storage) const {
+  return value_;
+}
+
 } // namespace sq::system::linux
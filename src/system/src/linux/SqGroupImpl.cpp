@@ -11,13 +11,27 @@
 #include "system/linux/SqUserImpl.h"
 
 #include <cerrno>
+#include <cstddef>
 #include <fmt/format.h>
 #include <grp.h>
 #include <gsl/gsl>
 #include <range/v3/view/transform.hpp>
+#include <unistd.h>
+#include <vector>
 
 namespace sq::system::linux {
 
+namespace {
+
+// Get the initial size of the buffer for a reentrant group database lookup.
+SQ_ND std::size_t lookup_buffer_size(int sysconf_name) {
+  static constexpr auto default_size = std::size_t{1024};
+  const auto size = sysconf(sysconf_name);
+  return size > 0 ? static_cast<std::size_t>(size) : default_size;
+}
+
+} // namespace
+
 SqGroupImpl::SqGroupImpl(gid_t gid) : gid_{gid} {}
 SqGroupImpl::SqGroupImpl(std::string_view name) : name_{name} {}
 
@@ -52,6 +66,11 @@ Primitive SqGroupImpl::to_primitive() const {
   return to_primitive_int(gid_, "GID");
 }
 
+bool SqGroupImpl::is_latency_bound() const noexcept {
+  // Group database lookups may go through NSS to e.g. LDAP.
+  return true;
+}
+
 void SqGroupImpl::ensure_fully_initialized() const {
   Expects(gid_ != invalid_gid_ || !name_.empty());
   if (fully_initialized_) {
@@ -59,16 +78,30 @@ void SqGroupImpl::ensure_fully_initialized() const {
   }
   const auto have_gid = gid_ != invalid_gid_;
 
-  errno = 0;
-  const auto *const grp = have_gid ? getgrgid(gid_) : getgrnam(name_.c_str());
+  // Use the reentrant functions so that groups can be used on more than one
+  // thread.
+  auto entry = group{};
+  group *grp = nullptr;
+  auto buffer = std::vector<char>(lookup_buffer_size(_SC_GETGR_R_SIZE_MAX));
+  auto error = 0;
+  do {
+    error = have_gid ? getgrgid_r(gid_, &entry, buffer.data(), buffer.size(),
+                                  &grp)
+                     : getgrnam_r(name_.c_str(), &entry, buffer.data(),
+                                  buffer.size(), &grp);
+    if (error == ERANGE) {
+      buffer.resize(buffer.size() * 2);
+    }
+  } while (error == ERANGE);
+
   if (grp == nullptr) {
     auto operation = have_gid
-                         ? fmt::format("getgrgid for GID {}", gid_)
-                         : fmt::format("getgrnam for group name {}", name_);
-    if (errno == 0) {
+                         ? fmt::format("getgrgid_r for GID {}", gid_)
+                         : fmt::format("getgrnam_r for group name {}", name_);
+    if (error == 0) {
       throw SystemError{fmt::format("{} failed: entry not found", operation)};
     }
-    throw SystemError{operation, make_error_code(errno)};
+    throw SystemError{operation, make_error_code(error)};
   }
 
   if (have_gid) {
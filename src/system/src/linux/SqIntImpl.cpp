@@ -11,4 +11,8 @@ SqIntImpl::SqIntImpl(PrimitiveInt value) : value_{value} {}
 
 Primitive SqIntImpl::to_primitive() const { return value_; }
 
+PrimitiveRef SqIntImpl::to_primitive_ref(SQ_MU Primitive &storage) const {
+  return value_;
+}
+
 } // namespace sq::system::linux
@@ -5,18 +5,25 @@
 
 #include "system/linux/SqPathImpl.h"
 
+#include "core/cancellation.h"
 #include "core/errors.h"
+#include "core/narrow.h"
+#include "system/linux/IndexedDirectoryWalker.h"
 #include "system/linux/SqBoolImpl.h"
 #include "system/linux/SqDataSizeImpl.h"
 #include "system/linux/SqFileImpl.h"
 #include "system/linux/SqFileModeImpl.h"
 #include "system/linux/SqIntImpl.h"
 #include "system/linux/SqStringImpl.h"
+#include "system/linux/pathutil.h"
 
 #include <cerrno>
-#include <range/v3/iterator_range.hpp>
+#include <functional>
+#include <range/v3/algorithm/all_of.hpp>
 #include <range/v3/view/transform.hpp>
-#include <sys/stat.h>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace sq::system::linux {
 
@@ -24,30 +31,57 @@ namespace fs = std::filesystem;
 
 namespace {
 
-struct stat get_stat(const fs::path &path, bool follow_symlinks,
-                     bool throw_if_not_exists = true) {
-  struct stat s = {};
-  errno = 0;
-  const int ret =
-      follow_symlinks ? stat(path.c_str(), &s) : lstat(path.c_str(), &s);
-  if (ret == -1) {
-    if (!throw_if_not_exists && (errno == ENOTDIR || errno == ENOENT)) {
-      s.st_ino = 0;
-      return s;
+/**
+ * Get a function that checks a child's name against any filters in the hints
+ * on the child's name-derived fields.
+ *
+ * Returns an empty function if there are no such filters.
+ */
+std::function<bool(std::string_view)>
+get_name_filter(const FieldCallHints &hints) {
+  auto filters = std::vector<std::function<bool(std::string_view)>>{};
+  for (const auto &filter : hints.string_filters()) {
+    const auto &pred = filter.predicate_;
+    if (filter.field_ == "filename") {
+      filters.emplace_back(pred);
+    } else if (filter.field_ == "stem") {
+      filters.emplace_back([pred](std::string_view name) {
+        return pred(filename_stem(name));
+      });
+    } else if (filter.field_ == "extension") {
+      filters.emplace_back([pred](std::string_view name) {
+        return pred(filename_extension(name));
+      });
     }
-    const auto *const operation = follow_symlinks ? "stat()" : "lstat()";
-    throw FilesystemError{operation, path, make_error_code(errno)};
   }
-  return s;
+
+  if (filters.empty()) {
+    return {};
+  }
+  if (filters.size() == 1) {
+    return std::move(filters.front());
+  }
+  return [filters = std::move(filters)](std::string_view name) {
+    return ranges::all_of(filters, [&](const auto &f) { return f(name); });
+  };
 }
 
-template <typename DirIt>
-Result get_child_range(const fs::path &path, fs::directory_options opts) {
-  return FieldRange<ranges::category::input>{
-      ranges::iterator_range{DirIt{path, opts}, DirIt{}} |
-      ranges::views::transform([](const auto &dirent) {
-        return std::make_shared<SqPathImpl>(dirent.path());
-      })};
+/**
+ * Split a colon separated list of glob patterns.
+ */
+std::vector<std::string> split_patterns(std::string_view patterns) {
+  auto ret = std::vector<std::string>{};
+  while (!patterns.empty()) {
+    const auto pos = patterns.find(':');
+    if (const auto pattern = patterns.substr(0, pos); !pattern.empty()) {
+      ret.emplace_back(pattern);
+    }
+    if (pos == std::string_view::npos) {
+      break;
+    }
+    patterns.remove_prefix(pos + 1);
+  }
+  return ret;
 }
 
 } // namespace
@@ -56,72 +90,143 @@ SqPathImpl::SqPathImpl(const fs::path &value) : value_{value} {}
 
 SqPathImpl::SqPathImpl(fs::path &&value) : value_{std::move(value)} {}
 
+SqPathImpl::SqPathImpl(DirectoryEntry &&entry)
+    : parent_{std::move(entry.parent_)}, name_{std::move(entry.name_)} {
+  if (entry.lstat_) {
+    stat_cache_.set_lstat(entry.lstat_.value());
+  }
+}
+
 Result SqPathImpl::get_string() const {
-  return std::make_shared<SqStringImpl>(value_.string());
+  return std::make_shared<SqStringImpl>(string());
 }
 
 Result SqPathImpl::get_parent() const {
-  return std::make_shared<SqPathImpl>(value_.parent_path());
+  return std::make_shared<SqPathImpl>(value().parent_path());
 }
 
 Result SqPathImpl::get_filename() const {
-  return std::make_shared<SqStringImpl>(value_.filename().string());
+  if (parent_) {
+    return std::make_shared<SqStringImpl>(name_);
+  }
+  return std::make_shared<SqStringImpl>(value().filename().string());
 }
 
 Result SqPathImpl::get_extension() const {
-  return std::make_shared<SqStringImpl>(value_.extension().string());
+  if (parent_) {
+    return std::make_shared<SqStringImpl>(
+        std::string{filename_extension(name_)});
+  }
+  return std::make_shared<SqStringImpl>(value().extension().string());
 }
 
 Result SqPathImpl::get_stem() const {
-  return std::make_shared<SqStringImpl>(value_.stem().string());
+  if (parent_) {
+    return std::make_shared<SqStringImpl>(std::string{filename_stem(name_)});
+  }
+  return std::make_shared<SqStringImpl>(value().stem().string());
 }
 
 Result SqPathImpl::get_children(PrimitiveBool recurse,
                                 PrimitiveBool follow_symlinks,
-                                PrimitiveBool skip_permission_denied) const {
-
-  auto opts = fs::directory_options::none;
-  if (follow_symlinks) {
-    opts |= fs::directory_options::follow_directory_symlink;
+                                PrimitiveBool skip_permission_denied,
+                                PrimitiveInt min_depth,
+                                const std::optional<PrimitiveInt> &max_depth,
+                                const PrimitiveString &exclude,
+                                PrimitiveBool one_file_system,
+                                PrimitiveBool inode_order,
+                                PrimitiveBool unordered,
+                                const std::optional<PrimitiveString> &index,
+                                const FieldCallHints &hints) const {
+  auto options = DirectoryWalkOptions{};
+  options.recurse_ = recurse;
+  options.follow_symlinks_ = follow_symlinks;
+  options.skip_permission_denied_ = skip_permission_denied;
+  options.min_depth_ = to_size(min_depth, "min_depth");
+  if (max_depth) {
+    options.max_depth_ = to_size(max_depth.value(), "max_depth");
   }
-  if (skip_permission_denied) {
-    opts |= fs::directory_options::skip_permission_denied;
+  options.exclude_ = split_patterns(exclude);
+  options.one_file_system_ = one_file_system;
+
+  // If the children's metadata is going to be used then get it while the
+  // directory is open rather than stat()ing each child's full path later.
+  options.lstat_entries_ =
+      hints.known() &&
+      (hints.may_use_field("file") || hints.may_use_field("exists"));
+  options.lstat_in_inode_order_ = inode_order;
+  options.unordered_ = unordered;
+  options.name_filter_ = get_name_filter(hints);
+  options.stop_token_ = current_stop_token();
+
+  const auto to_path = [](DirectoryEntry entry) {
+    return std::make_shared<SqPathImpl>(std::move(entry));
+  };
+  if (index && !follow_symlinks) {
+    return FieldRange<ranges::category::input>{
+        walk_indexed_directory(index.value(), value(), std::move(options)) |
+        ranges::views::transform(to_path)};
   }
-
-  return recurse
-             ? get_child_range<fs::recursive_directory_iterator>(value_, opts)
-             : get_child_range<fs::directory_iterator>(value_, opts);
+  return FieldRange<ranges::category::input>{
+      walk_directory(value(), std::move(options)) |
+      ranges::views::transform(to_path)};
 }
 
 Result SqPathImpl::get_parts() const {
   return FieldRange<ranges::category::bidirectional>{
-      value_ | ranges::views::transform([](const auto &part) {
+      value() | ranges::views::transform([](const auto &part) {
         return std::make_shared<SqStringImpl>(part.string());
       })};
 }
 
 Result SqPathImpl::get_absolute() const {
-  return std::make_shared<SqPathImpl>(fs::absolute(value_));
+  return std::make_shared<SqPathImpl>(fs::absolute(value()));
 }
 
 Result SqPathImpl::get_canonical() const {
-  return std::make_shared<SqPathImpl>(fs::canonical(value_));
+  return std::make_shared<SqPathImpl>(fs::canonical(value()));
 }
 
 Result SqPathImpl::get_is_absolute() const {
-  return std::make_shared<SqBoolImpl>(value_.is_absolute());
+  return std::make_shared<SqBoolImpl>(value().is_absolute());
 }
 
 Result SqPathImpl::get_exists(PrimitiveBool follow_symlinks) const {
-  const auto s = get_stat(value_, follow_symlinks, false);
-  return std::make_shared<SqBoolImpl>(s.st_ino != 0);
+  return std::make_shared<SqBoolImpl>(
+      stat_cache_.exists(value(), follow_symlinks));
 }
 
 Result SqPathImpl::get_file(PrimitiveBool follow_symlinks) const {
-  return std::make_shared<SqFileImpl>(get_stat(value_, follow_symlinks),
-                                      value_.c_str());
+  return std::make_shared<SqFileImpl>(
+      stat_cache_.get(value(), follow_symlinks), value().c_str());
 }
 
-Primitive SqPathImpl::to_primitive() const { return value_.string(); }
+Primitive SqPathImpl::to_primitive() const { return string(); }
+
+PrimitiveRef SqPathImpl::to_primitive_ref(SQ_MU Primitive &storage) const {
+  // The full path of a directory entry is created, and kept, so that it
+  // doesn't have to be copied.
+  return std::string_view{value().native()};
+}
+
+bool SqPathImpl::is_latency_bound() const noexcept {
+  // Most members need a stat() of the path, which can be slow e.g. on
+  // network filesystems.
+  return true;
+}
+
+const fs::path &SqPathImpl::value() const {
+  if (!value_) {
+    value_ = join_path(*parent_, name_);
+  }
+  return value_.value();
+}
+
+std::string SqPathImpl::string() const {
+  if (value_) {
+    return value_->string();
+  }
+  return join_path(*parent_, name_);
+}
 
 } // namespace sq::system::linux
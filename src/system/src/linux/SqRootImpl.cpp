@@ -77,4 +77,10 @@ Result SqRootImpl::get_devices() {
 
 Primitive SqRootImpl::to_primitive() const { return PrimitiveString("ROOT"); }
 
+bool SqRootImpl::allows_concurrent_access() const noexcept {
+  // The root has no state of its own, and CacheingField synchronizes access
+  // to its cache.
+  return true;
+}
+
 } // namespace sq::system::linux
@@ -11,4 +11,8 @@ SqStringImpl::SqStringImpl(std::string_view value) : value_{value} {}
 
 Primitive SqStringImpl::to_primitive() const { return value_; }
 
+PrimitiveRef SqStringImpl::to_primitive_ref(SQ_MU Primitive &storage) const {
+  return std::string_view{value_};
+}
+
 } // namespace sq::system::linux
@@ -14,6 +14,7 @@
 #include "system/linux/SqStringImpl.h"
 
 #include <cerrno>
+#include <cstddef>
 #include <fmt/format.h>
 #include <gsl/gsl>
 #include <pwd.h>
@@ -22,9 +23,21 @@
 #include <range/v3/view/transform.hpp>
 #include <sys/types.h>
 #include <unistd.h>
+#include <vector>
 
 namespace sq::system::linux {
 
+namespace {
+
+// Get the initial size of the buffer for a reentrant user database lookup.
+SQ_ND std::size_t lookup_buffer_size(int sysconf_name) {
+  static constexpr auto default_size = std::size_t{1024};
+  const auto size = sysconf(sysconf_name);
+  return size > 0 ? static_cast<std::size_t>(size) : default_size;
+}
+
+} // namespace
+
 SqUserImpl::SqUserImpl(uid_t uid) : uid_{uid} {}
 SqUserImpl::SqUserImpl(std::string_view username) : username_{username} {}
 
@@ -89,6 +102,11 @@ Primitive SqUserImpl::to_primitive() const {
   return to_primitive_int(uid_, "UID");
 }
 
+bool SqUserImpl::is_latency_bound() const noexcept {
+  // User database lookups may go through NSS to e.g. LDAP.
+  return true;
+}
+
 void SqUserImpl::ensure_fully_initialized() const {
   Expects(uid_ != invalid_uid_ || !username_.empty());
 
@@ -97,18 +115,30 @@ void SqUserImpl::ensure_fully_initialized() const {
   }
   const auto have_uid = uid_ != invalid_uid_;
 
-  errno = 0;
-  const auto *const pwd =
-      have_uid ? getpwuid(uid_) : getpwnam(username_.c_str());
+  // Use the reentrant functions so that users can be used on more than one
+  // thread.
+  auto entry = passwd{};
+  passwd *pwd = nullptr;
+  auto buffer = std::vector<char>(lookup_buffer_size(_SC_GETPW_R_SIZE_MAX));
+  auto error = 0;
+  do {
+    error = have_uid ? getpwuid_r(uid_, &entry, buffer.data(), buffer.size(),
+                                  &pwd)
+                     : getpwnam_r(username_.c_str(), &entry, buffer.data(),
+                                  buffer.size(), &pwd);
+    if (error == ERANGE) {
+      buffer.resize(buffer.size() * 2);
+    }
+  } while (error == ERANGE);
 
   if (pwd == nullptr) {
     const auto operation =
-        have_uid ? fmt::format("getpwuid for UID {}", uid_)
-                 : fmt::format("getpwnam for username {}", username_);
-    if (errno == 0) {
+        have_uid ? fmt::format("getpwuid_r for UID {}", uid_)
+                 : fmt::format("getpwnam_r for username {}", username_);
+    if (error == 0) {
       throw SystemError{fmt::format("{} failed: entry not found", operation)};
     }
-    throw SystemError{operation, make_error_code(errno)};
+    throw SystemError{operation, make_error_code(error)};
   }
 
   if (have_uid) {
@@ -0,0 +1,92 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "system/linux/StatCache.h"
+
+#include "core/errors.h"
+
+#include <atomic>
+#include <cerrno>
+
+namespace sq::system::linux {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::atomic<std::uint64_t> g_stat_calls{0};
+std::atomic<std::uint64_t> g_lstat_calls{0};
+std::atomic<std::uint64_t> g_hits{0};
+
+const char *operation_name(bool follow_symlinks) {
+  return follow_symlinks ? "stat()" : "lstat()";
+}
+
+} // namespace
+
+const struct stat &StatCache::get(const fs::path &path, bool follow_symlinks) {
+  const auto &e = entry(path, follow_symlinks);
+  if (e.error_ != 0) {
+    throw FilesystemError{operation_name(follow_symlinks), path,
+                          make_error_code(e.error_)};
+  }
+  return e.stat_;
+}
+
+bool StatCache::exists(const fs::path &path, bool follow_symlinks) {
+  const auto &e = entry(path, follow_symlinks);
+  if (e.error_ == ENOENT || e.error_ == ENOTDIR) {
+    return false;
+  }
+  if (e.error_ != 0) {
+    throw FilesystemError{operation_name(follow_symlinks), path,
+                          make_error_code(e.error_)};
+  }
+  return true;
+}
+
+void StatCache::set_lstat(const struct stat &s) { lstat_ = Entry{s, 0}; }
+
+StatCache::Counters StatCache::counters() {
+  return Counters{g_stat_calls.load(std::memory_order_relaxed),
+                  g_lstat_calls.load(std::memory_order_relaxed),
+                  g_hits.load(std::memory_order_relaxed)};
+}
+
+const StatCache::Entry &StatCache::entry(const fs::path &path,
+                                         bool follow_symlinks) {
+  auto &cached = follow_symlinks ? stat_ : lstat_;
+  if (cached) {
+    g_hits.fetch_add(1, std::memory_order_relaxed);
+    return cached.value();
+  }
+
+  // If lstat() has already failed, or found something that isn't a symlink,
+  // then stat() would give the same result.
+  if (follow_symlinks && lstat_ &&
+      (lstat_->error_ != 0 || !S_ISLNK(lstat_->stat_.st_mode))) {
+    g_hits.fetch_add(1, std::memory_order_relaxed);
+    cached = lstat_;
+    return cached.value();
+  }
+
+  auto e = Entry{{}, 0};
+  errno = 0;
+  int ret = 0;
+  if (follow_symlinks) {
+    g_stat_calls.fetch_add(1, std::memory_order_relaxed);
+    ret = stat(path.c_str(), &e.stat_);
+  } else {
+    g_lstat_calls.fetch_add(1, std::memory_order_relaxed);
+    ret = lstat(path.c_str(), &e.stat_);
+  }
+  if (ret == -1) {
+    e.error_ = errno;
+  }
+  cached = e;
+  return cached.value();
+}
+
+} // namespace sq::system::linux
@@ -0,0 +1,45 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "system/linux/pathutil.h"
+
+namespace sq::system::linux {
+
+namespace {
+
+SQ_ND std::string_view::size_type
+extension_pos(std::string_view filename) noexcept {
+  // "." and ".." have no extension, and neither do names like ".bashrc"
+  // where the only dot is at the start.
+  if (filename == "..") {
+    return std::string_view::npos;
+  }
+  const auto pos = filename.rfind('.');
+  return pos == 0 ? std::string_view::npos : pos;
+}
+
+} // namespace
+
+std::string_view filename_stem(std::string_view filename) noexcept {
+  return filename.substr(0, extension_pos(filename));
+}
+
+std::string_view filename_extension(std::string_view filename) noexcept {
+  const auto pos = extension_pos(filename);
+  return pos == std::string_view::npos ? std::string_view{}
+                                       : filename.substr(pos);
+}
+
+std::string join_path(const std::filesystem::path &dir,
+                      std::string_view filename) {
+  auto ret = dir.string();
+  if (!ret.empty() && ret.back() != '/') {
+    ret += '/';
+  }
+  ret += filename;
+  return ret;
+}
+
+} // namespace sq::system::linux
@@ -37,13 +37,13 @@ std::string UdevDevice::sys_path() const {
   return std::string{syspath};
 }
 
-std::string UdevDevice::sys_name() const {
+std::string_view UdevDevice::sys_name() const {
   Expects(p_ != nullptr);
   const gsl::czstring<> sysname = udev_device_get_sysname(p_);
   if (sysname == nullptr) {
     throw UdevError{"NULL returned from udev_device_get_sysname()"};
   }
-  return std::string{sysname};
+  return std::string_view{sysname};
 }
 
 std::string UdevDevice::subsystem() const {
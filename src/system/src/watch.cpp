@@ -0,0 +1,38 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "system/watch.h"
+
+#include "system/linux/DirectoryObserver.h"
+#include "system/linux/DirectoryWatcher.h"
+
+#include <chrono>
+
+namespace sq::system {
+
+namespace {
+
+// How long to wait for a burst of changes to finish before generating the
+// results again.
+constexpr auto settle_time = std::chrono::milliseconds{100};
+
+} // namespace
+
+Watch::Watch() : watcher_{std::make_unique<linux::DirectoryWatcher>()} {}
+
+Watch::~Watch() noexcept = default;
+
+void Watch::record(const std::function<void()> &f) {
+  watcher_->clear();
+  const auto observer = linux::ScopedDirectoryObserver{
+      [this](const std::filesystem::path &dir) { watcher_->add(dir); }};
+  f();
+}
+
+std::vector<std::filesystem::path> Watch::wait() {
+  return watcher_->wait(settle_time);
+}
+
+} // namespace sq::system
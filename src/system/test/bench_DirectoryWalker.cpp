@@ -0,0 +1,136 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+// Benchmark for getting the metadata of directory entries in inode order.
+//
+// Usage: sq-system-bench [DIR [REPEATS]]
+//
+// Walks DIR recursively, getting lstat() data for every entry, with each
+// DirectoryWalker lstat ordering. If DIR isn't given, a tree of files is
+// created in a temporary directory and removed afterwards.
+//
+// The page cache is dropped before each walk if the process has permission
+// to write to /proc/sys/vm/drop_caches (i.e. usually when run as root).
+// Otherwise the walks are run with a warm cache, which mostly measures the
+// overhead of reading each directory in full.
+
+#include "system/linux/DirectoryWalker.h"
+#include "test/system_test_util.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+namespace fs = std::filesystem;
+using sq::system::linux::DirectoryWalker;
+using sq::system::linux::DirectoryWalkOptions;
+
+constexpr std::size_t default_repeats = 5;
+constexpr std::size_t generated_dirs = 100;
+constexpr std::size_t generated_files_per_dir = 200;
+
+struct Mode {
+  const char *name_;
+  bool inode_order_;
+  bool unordered_;
+};
+
+constexpr auto modes = std::array{
+    Mode{"directory order", false, false},
+    Mode{"inode order", true, false},
+    Mode{"inode order, unordered", true, true},
+};
+
+void generate_tree(const fs::path &root) {
+  for (auto d = std::size_t{0}; d < generated_dirs; ++d) {
+    const auto dir = root / std::to_string(d);
+    fs::create_directory(dir);
+    for (auto f = std::size_t{0}; f < generated_files_per_dir; ++f) {
+      std::ofstream{dir / std::to_string(f)} << f;
+    }
+  }
+}
+
+bool drop_caches() {
+  sync();
+  auto out = std::ofstream{"/proc/sys/vm/drop_caches"};
+  out << "3\n";
+  out.flush();
+  return out.good();
+}
+
+std::size_t walk(const fs::path &root, const Mode &mode) {
+  auto options = DirectoryWalkOptions{};
+  options.recurse_ = true;
+  options.lstat_entries_ = true;
+  options.lstat_in_inode_order_ = mode.inode_order_;
+  options.unordered_ = mode.unordered_;
+
+  auto count = std::size_t{0};
+  for (auto walker = DirectoryWalker{root, std::move(options)}; !walker.done();
+       walker.next()) {
+    ++count;
+  }
+  return count;
+}
+
+int run(const fs::path &root, std::size_t repeats) {
+  auto dropped = true;
+  for (const auto &mode : modes) {
+    auto times = std::vector<double>{};
+    auto count = std::size_t{0};
+    for (auto i = std::size_t{0}; i < repeats; ++i) {
+      dropped = drop_caches() && dropped;
+      const auto start = std::chrono::steady_clock::now();
+      count = walk(root, mode);
+      const auto end = std::chrono::steady_clock::now();
+      times.push_back(std::chrono::duration<double, std::milli>(end - start)
+                          .count());
+    }
+    std::sort(times.begin(), times.end());
+    std::cout << mode.name_ << ": " << count << " entries, median "
+              << times.at(times.size() / 2) << "ms, min " << times.front()
+              << "ms\n";
+  }
+  if (!dropped) {
+    std::cout << "Note: the page cache could not be dropped, so the results "
+                 "are for a warm cache\n";
+  }
+  return EXIT_SUCCESS;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  try {
+    const auto args = std::vector<std::string>(argv + 1, argv + argc);
+    const auto repeats =
+        args.size() > 1 ? std::stoul(args.at(1)) : default_repeats;
+    if (repeats == 0) {
+      throw std::invalid_argument{"REPEATS must be positive"};
+    }
+    if (!args.empty()) {
+      return run(args.at(0), repeats);
+    }
+    const auto root = sq::test::TempDir{"sq-bench"};
+    generate_tree(root.path());
+    return run(root.path(), repeats);
+  } catch (const std::exception &e) {
+    std::cerr << "sq-system-bench: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,44 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#ifndef SQ_INCLUDE_GUARD_system_test_system_test_util_h_
+#define SQ_INCLUDE_GUARD_system_test_system_test_util_h_
+
+#include "core/typeutil.h"
+
+#include <filesystem>
+#include <string_view>
+
+namespace sq::test {
+
+/**
+ * A temporary directory that is removed, along with its contents, when the
+ * TempDir is destroyed.
+ */
+class TempDir {
+public:
+  /**
+   * Create a directory in the system's temporary directory whose name starts
+   * with the given prefix.
+   *
+   * Throws std::runtime_error if the directory can't be created.
+   */
+  explicit TempDir(std::string_view prefix = "sq-test");
+
+  TempDir(const TempDir &) = delete;
+  TempDir(TempDir &&) = delete;
+  TempDir &operator=(const TempDir &) = delete;
+  TempDir &operator=(TempDir &&) = delete;
+  ~TempDir() noexcept;
+
+  SQ_ND const std::filesystem::path &path() const noexcept { return path_; }
+
+private:
+  std::filesystem::path path_;
+};
+
+} // namespace sq::test
+
+#endif // SQ_INCLUDE_GUARD_system_test_system_test_util_h_
@@ -0,0 +1,30 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "test/system_test_util.h"
+
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+namespace sq::test {
+
+namespace fs = std::filesystem;
+
+TempDir::TempDir(std::string_view prefix) {
+  auto tmpl = (fs::temp_directory_path() / prefix).string() + "-XXXXXX";
+  if (mkdtemp(tmpl.data()) == nullptr) {
+    throw std::runtime_error{"mkdtemp() failed"};
+  }
+  path_ = tmpl;
+}
+
+TempDir::~TempDir() noexcept {
+  auto ec = std::error_code{};
+  fs::remove_all(path_, ec);
+}
+
+} // namespace sq::test
@@ -0,0 +1,184 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "system/linux/DirectoryWalker.h"
+
+#include "core/errors.h"
+#include "test/system_test_util.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace sq::test {
+namespace {
+
+namespace fs = std::filesystem;
+using system::linux::DirectoryWalker;
+using system::linux::DirectoryWalkOptions;
+
+class DirectoryWalkerTest : public ::testing::Test {
+protected:
+  DirectoryWalkerTest() {
+    fs::create_directories(dir_ / "sub" / "subsub");
+    std::ofstream{dir_ / "file"} << "data";
+    std::ofstream{dir_ / "sub" / "subfile"};
+    fs::create_directory_symlink(dir_ / "sub", dir_ / "link");
+  }
+
+  DirectoryWalkerTest(const DirectoryWalkerTest &) = delete;
+  DirectoryWalkerTest(DirectoryWalkerTest &&) = delete;
+  DirectoryWalkerTest &operator=(const DirectoryWalkerTest &) = delete;
+  DirectoryWalkerTest &operator=(DirectoryWalkerTest &&) = delete;
+
+  SQ_ND std::vector<std::string> walk(DirectoryWalkOptions options) const {
+    auto paths = std::vector<std::string>{};
+    for (auto walker = DirectoryWalker{dir_, options}; !walker.done();
+         walker.next()) {
+      const auto &entry = walker.entry();
+      paths.push_back(
+          (*entry.parent_ / entry.name_).lexically_relative(dir_).string());
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+  }
+
+  TempDir temp_dir_;
+  fs::path dir_ = temp_dir_.path();
+};
+
+TEST_F(DirectoryWalkerTest, TestNonRecursiveWalk) {
+  EXPECT_EQ(walk(DirectoryWalkOptions{}),
+            (std::vector<std::string>{"file", "link", "sub"}));
+}
+
+TEST_F(DirectoryWalkerTest, TestStop) {
+  auto source = std::stop_source{};
+  auto options = DirectoryWalkOptions{};
+  options.recurse_ = true;
+  options.stop_token_ = source.get_token();
+  auto walker = DirectoryWalker{dir_, options};
+  ASSERT_FALSE(walker.done());
+  (void)source.request_stop();
+  walker.next();
+  EXPECT_TRUE(walker.done());
+
+  EXPECT_EQ(walk(options), std::vector<std::string>{});
+}
+
+TEST_F(DirectoryWalkerTest, TestRecursiveWalk) {
+  auto options = DirectoryWalkOptions{};
+  options.recurse_ = true;
+  EXPECT_EQ(walk(options),
+            (std::vector<std::string>{"file", "link", "sub", "sub/subfile",
+                                      "sub/subsub"}));
+
+  options.follow_symlinks_ = true;
+  EXPECT_EQ(walk(options), (std::vector<std::string>{
+                               "file", "link", "link/subfile", "link/subsub",
+                               "sub", "sub/subfile", "sub/subsub"}));
+}
+
+TEST_F(DirectoryWalkerTest, TestNameFilter) {
+  auto options = DirectoryWalkOptions{};
+  options.recurse_ = true;
+  options.name_filter_ = [](std::string_view name) {
+    return name.find("file") != std::string_view::npos;
+  };
+  // "sub" doesn't match the filter but its children are still walked.
+  EXPECT_EQ(walk(options), (std::vector<std::string>{"file", "sub/subfile"}));
+}
+
+TEST_F(DirectoryWalkerTest, TestDepthLimits) {
+  auto options = DirectoryWalkOptions{};
+  options.recurse_ = true;
+  options.min_depth_ = 2;
+  EXPECT_EQ(walk(options),
+            (std::vector<std::string>{"sub/subfile", "sub/subsub"}));
+
+  options.min_depth_ = 0;
+  options.max_depth_ = 1;
+  EXPECT_EQ(walk(options), (std::vector<std::string>{"file", "link", "sub"}));
+
+  options.max_depth_ = 0;
+  EXPECT_EQ(walk(options), (std::vector<std::string>{}));
+}
+
+TEST_F(DirectoryWalkerTest, TestExclude) {
+  auto options = DirectoryWalkOptions{};
+  options.recurse_ = true;
+  options.exclude_ = {"su*", "l?nk"};
+  EXPECT_EQ(walk(options), (std::vector<std::string>{"file"}));
+}
+
+TEST_F(DirectoryWalkerTest, TestOneFileSystem) {
+  auto options = DirectoryWalkOptions{};
+  options.recurse_ = true;
+  options.one_file_system_ = true;
+  EXPECT_EQ(walk(options),
+            (std::vector<std::string>{"file", "link", "sub", "sub/subfile",
+                                      "sub/subsub"}));
+}
+
+TEST_F(DirectoryWalkerTest, TestLstatEntries) {
+  auto options = DirectoryWalkOptions{};
+  options.lstat_entries_ = true;
+  for (auto walker = DirectoryWalker{dir_, options}; !walker.done();
+       walker.next()) {
+    const auto &entry = walker.entry();
+    ASSERT_TRUE(entry.lstat_.has_value());
+    EXPECT_EQ(entry.depth_, 1U);
+    if (entry.name_ == "file") {
+      EXPECT_EQ(entry.lstat_->st_size, 4);
+    } else if (entry.name_ == "link") {
+      EXPECT_TRUE(S_ISLNK(entry.lstat_->st_mode));
+    }
+  }
+}
+
+TEST_F(DirectoryWalkerTest, TestLstatInInodeOrder) {
+  auto options = DirectoryWalkOptions{};
+  options.recurse_ = true;
+  options.lstat_entries_ = true;
+  const auto expected = walk(options);
+
+  // Entries are still produced in the order that the directory lists them.
+  auto names = [&](const DirectoryWalkOptions &opts) {
+    auto ret = std::vector<std::string>{};
+    for (auto walker = DirectoryWalker{dir_, opts}; !walker.done();
+         walker.next()) {
+      const auto &entry = walker.entry();
+      EXPECT_TRUE(entry.lstat_.has_value());
+      ret.push_back(entry.name_);
+    }
+    return ret;
+  };
+  auto inode_order = options;
+  inode_order.lstat_in_inode_order_ = true;
+  EXPECT_EQ(names(inode_order), names(options));
+  EXPECT_EQ(walk(inode_order), expected);
+
+  inode_order.unordered_ = true;
+  EXPECT_EQ(walk(inode_order), expected);
+
+  inode_order.name_filter_ = [](std::string_view name) {
+    return name.starts_with("sub");
+  };
+  EXPECT_EQ(walk(inode_order),
+            (std::vector<std::string>{"sub", "sub/subfile", "sub/subsub"}));
+}
+
+TEST_F(DirectoryWalkerTest, TestMissingDirectory) {
+  EXPECT_THROW(DirectoryWalker(dir_ / "missing", DirectoryWalkOptions{}),
+               FilesystemError);
+}
+
+} // namespace
+} // namespace sq::test
@@ -0,0 +1,249 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "system/linux/IndexedDirectoryWalker.h"
+#include "system/linux/MetadataIndex.h"
+
+#include "core/errors.h"
+#include "test/system_test_util.h"
+
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <utility>
+#include <vector>
+
+namespace sq::test {
+namespace {
+
+namespace fs = std::filesystem;
+using system::linux::DirectoryWalker;
+using system::linux::DirectoryWalkOptions;
+using system::linux::IndexedDirectoryWalker;
+using system::linux::MetadataIndex;
+using system::linux::MetadataIndexBuilder;
+using system::linux::write_metadata_index;
+
+class MetadataIndexTest : public ::testing::Test {
+protected:
+  MetadataIndexTest() {
+    tree_ = dir_ / "tree";
+    index_file_ = dir_ / "index";
+    fs::create_directories(tree_ / "sub" / "subsub");
+    std::ofstream{tree_ / "file"} << "data";
+    std::ofstream{tree_ / "sub" / "subfile"};
+    fs::create_directory_symlink(tree_ / "sub", tree_ / "link");
+  }
+
+  MetadataIndexTest(const MetadataIndexTest &) = delete;
+  MetadataIndexTest(MetadataIndexTest &&) = delete;
+  MetadataIndexTest &operator=(const MetadataIndexTest &) = delete;
+  MetadataIndexTest &operator=(MetadataIndexTest &&) = delete;
+
+  // Get the paths and sizes of the entries produced by a walker.
+  template <typename Walker>
+  SQ_ND static std::vector<std::pair<std::string, off_t>>
+  walk(Walker &walker) {
+    auto ret = std::vector<std::pair<std::string, off_t>>{};
+    for (; !walker.done(); walker.next()) {
+      const auto &entry = walker.entry();
+      EXPECT_TRUE(entry.lstat_.has_value());
+      ret.emplace_back((*entry.parent_ / entry.name_).string(),
+                       entry.lstat_->st_size);
+    }
+    return ret;
+  }
+
+  SQ_ND std::vector<std::pair<std::string, off_t>>
+  walk_live(DirectoryWalkOptions options) const {
+    options.lstat_entries_ = true;
+    auto walker = DirectoryWalker{tree_, std::move(options)};
+    return walk(walker);
+  }
+
+  SQ_ND std::vector<std::pair<std::string, off_t>>
+  walk_indexed(DirectoryWalkOptions options) const {
+    auto walker =
+        IndexedDirectoryWalker{index_file_, tree_, std::move(options)};
+    return walk(walker);
+  }
+
+  SQ_ND ino_t index_inode() const {
+    struct stat s = {};
+    if (stat(index_file_.c_str(), &s) == -1) {
+      throw std::runtime_error{"stat() failed"};
+    }
+    return s.st_ino;
+  }
+
+  TempDir temp_dir_;
+  fs::path dir_ = temp_dir_.path();
+  fs::path tree_;
+  fs::path index_file_;
+};
+
+TEST_F(MetadataIndexTest, TestRoundTrip) {
+  struct stat dir_stat = {};
+  dir_stat.st_ino = 1;
+  dir_stat.st_mtim.tv_sec = 2;
+  dir_stat.st_mtim.tv_nsec = 3;
+  struct stat file_stat = {};
+  file_stat.st_ino = 4;
+  file_stat.st_size = 5;
+  file_stat.st_mode = S_IFREG | 0644;
+  file_stat.st_uid = 6;
+  file_stat.st_gid = 7;
+  file_stat.st_mtim.tv_sec = 8;
+
+  auto builder = MetadataIndexBuilder{"/root"};
+  const auto root = builder.add_directory(dir_stat);
+  const auto sub = builder.add_entry("sub", dir_stat);
+  (void)builder.add_entry("file", file_stat);
+  const auto sub_dir = builder.add_directory(dir_stat);
+  (void)builder.add_entry("subfile", file_stat);
+  builder.set_child_directory(sub, sub_dir);
+  write_metadata_index(index_file_, builder.serialize());
+
+  const auto index = MetadataIndex::open(index_file_);
+  ASSERT_TRUE(index.has_value());
+  EXPECT_EQ(index->root(), "/root");
+  ASSERT_EQ(index->directory_count(), 2U);
+  ASSERT_EQ(index->entry_count(), 3U);
+
+  const auto root_dir = index->directory(root);
+  EXPECT_EQ(root_dir.first_entry_, 0U);
+  EXPECT_EQ(root_dir.entry_count_, 2U);
+  EXPECT_TRUE(system::linux::is_unchanged(root_dir, dir_stat));
+
+  EXPECT_EQ(index->name(0), "sub");
+  EXPECT_EQ(index->child_directory(0), sub_dir);
+  EXPECT_EQ(index->name(1), "file");
+  EXPECT_EQ(index->child_directory(1), std::nullopt);
+  const auto s = index->lstat(1);
+  EXPECT_EQ(s.st_ino, 4U);
+  EXPECT_EQ(s.st_size, 5);
+  EXPECT_EQ(s.st_mode, S_IFREG | 0644);
+  EXPECT_EQ(s.st_uid, 6U);
+  EXPECT_EQ(s.st_gid, 7U);
+  EXPECT_EQ(s.st_mtim.tv_sec, 8);
+
+  const auto sub_record = index->directory(sub_dir);
+  EXPECT_EQ(sub_record.first_entry_, 2U);
+  EXPECT_EQ(sub_record.entry_count_, 1U);
+  EXPECT_EQ(index->name(2), "subfile");
+}
+
+TEST_F(MetadataIndexTest, TestMissingIndex) {
+  EXPECT_FALSE(MetadataIndex::open(index_file_).has_value());
+}
+
+TEST_F(MetadataIndexTest, TestInvalidIndex) {
+  std::ofstream{index_file_} << "not an index";
+  EXPECT_THROW((void)MetadataIndex::open(index_file_), IndexFormatError);
+
+  auto data = MetadataIndexBuilder{"/root"}.serialize();
+  data.resize(data.size() / 2);
+  write_metadata_index(index_file_, data);
+  EXPECT_THROW((void)MetadataIndex::open(index_file_), IndexFormatError);
+}
+
+TEST_F(MetadataIndexTest, TestInvalidIndexIsReplaced) {
+  std::ofstream{index_file_} << "not an index";
+  auto options = DirectoryWalkOptions{};
+  options.recurse_ = true;
+  EXPECT_EQ(walk_indexed(options), walk_live(options));
+  EXPECT_NO_THROW((void)MetadataIndex::open(index_file_));
+}
+
+TEST_F(MetadataIndexTest, TestIndexFileModeFollowsUmask) {
+  const auto old_umask = umask(S_IWGRP | S_IWOTH);
+  write_metadata_index(index_file_, MetadataIndexBuilder{"/root"}.serialize());
+  EXPECT_EQ(fs::status(index_file_).permissions(),
+            fs::perms::owner_read | fs::perms::owner_write |
+                fs::perms::group_read | fs::perms::others_read);
+
+  (void)umask(S_IRWXG | S_IRWXO);
+  write_metadata_index(index_file_, MetadataIndexBuilder{"/root"}.serialize());
+  EXPECT_EQ(fs::status(index_file_).permissions(),
+            fs::perms::owner_read | fs::perms::owner_write);
+  (void)umask(old_umask);
+}
+
+TEST_F(MetadataIndexTest, TestIndexedWalkMatchesLiveWalk) {
+  auto options = DirectoryWalkOptions{};
+  options.recurse_ = true;
+  EXPECT_EQ(walk_indexed(options), walk_live(options));
+  EXPECT_TRUE(fs::exists(index_file_));
+
+  // Once with the index created, and again with it being used.
+  EXPECT_EQ(walk_indexed(options), walk_live(options));
+
+  options.min_depth_ = 2;
+  options.exclude_ = {"subsub"};
+  options.name_filter_ = [](std::string_view name) {
+    return name.starts_with("sub");
+  };
+  EXPECT_EQ(walk_indexed(options), walk_live(options));
+}
+
+TEST_F(MetadataIndexTest, TestExcludedEntriesAreStillIndexed) {
+  auto options = DirectoryWalkOptions{};
+  options.recurse_ = true;
+  options.exclude_ = {"file", "subsub"};
+  EXPECT_EQ(walk_indexed(options), walk_live(options));
+  EXPECT_EQ(walk_indexed(options), walk_live(options));
+
+  // The entries excluded by the earlier walks are found by walks without the
+  // exclude patterns.
+  options.exclude_.clear();
+  EXPECT_EQ(walk_indexed(options), walk_live(options));
+  EXPECT_EQ(walk_indexed(options), walk_live(options));
+}
+
+TEST_F(MetadataIndexTest, TestOnlyChangedDirectoriesAreRead) {
+  auto options = DirectoryWalkOptions{};
+  options.recurse_ = true;
+  (void)walk_indexed(options);
+  // Reading the directories the first time may have updated their atimes.
+  (void)walk_indexed(options);
+  const auto inode = index_inode();
+
+  // The index isn't rewritten if nothing has changed.
+  EXPECT_EQ(walk_indexed(options), walk_live(options));
+  EXPECT_EQ(index_inode(), inode);
+
+  // Adding a file changes its directory.
+  std::ofstream{tree_ / "sub" / "subsub" / "new"} << "new data";
+  EXPECT_EQ(walk_indexed(options), walk_live(options));
+  EXPECT_NE(index_inode(), inode);
+
+  // Writing to a file doesn't change its directory, so the index still has
+  // the size of the file from when its directory was last read.
+  std::ofstream{tree_ / "file"} << "more data";
+  const auto indexed = walk_indexed(options);
+  const auto file = (tree_ / "file").string();
+  for (const auto &[path, size] : indexed) {
+    if (path == file) {
+      EXPECT_EQ(size, 4);
+    }
+  }
+}
+
+TEST_F(MetadataIndexTest, TestIndexOfAnotherTreeIsReplaced) {
+  auto options = DirectoryWalkOptions{};
+  options.recurse_ = true;
+  auto walker = IndexedDirectoryWalker{index_file_, tree_ / "sub", options};
+  (void)walk(walker);
+  EXPECT_EQ(walk_indexed(options), walk_live(options));
+  const auto index = MetadataIndex::open(index_file_);
+  ASSERT_TRUE(index.has_value());
+  EXPECT_EQ(index->root(), fs::absolute(tree_).string());
+}
+
+} // namespace
+} // namespace sq::test
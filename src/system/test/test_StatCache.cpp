@@ -0,0 +1,139 @@
+/* -----------------------------------------------------------------------------
+ * Copyright 2021 Jonathan Haigh
+ * SPDX-License-Identifier: MIT
+ * ---------------------------------------------------------------------------*/
+
+#include "system/linux/StatCache.h"
+
+#include "core/FieldCallParams.h"
+#include "core/errors.h"
+#include "system/linux/SqPathImpl.h"
+#include "test/system_test_util.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+
+namespace sq::test {
+namespace {
+
+namespace fs = std::filesystem;
+using system::linux::SqPathImpl;
+using system::linux::StatCache;
+
+/**
+ * Counts of system calls made since the fixture was created.
+ */
+struct StatCallCounts {
+  std::uint64_t stat_calls;
+  std::uint64_t lstat_calls;
+  std::uint64_t hits;
+};
+
+class StatCacheTest : public ::testing::Test {
+protected:
+  StatCacheTest() : start_{StatCache::counters()} {
+    file_ = dir_ / "file";
+    std::ofstream{file_} << "data";
+    link_ = dir_ / "link";
+    fs::create_symlink(file_, link_);
+    missing_ = dir_ / "missing";
+  }
+
+  StatCacheTest(const StatCacheTest &) = delete;
+  StatCacheTest(StatCacheTest &&) = delete;
+  StatCacheTest &operator=(const StatCacheTest &) = delete;
+  StatCacheTest &operator=(StatCacheTest &&) = delete;
+
+  SQ_ND StatCallCounts calls() const {
+    const auto now = StatCache::counters();
+    return StatCallCounts{now.stat_calls - start_.stat_calls,
+                          now.lstat_calls - start_.lstat_calls,
+                          now.hits - start_.hits};
+  }
+
+  TempDir temp_dir_;
+  fs::path dir_ = temp_dir_.path();
+  fs::path file_;
+  fs::path link_;
+  fs::path missing_;
+
+private:
+  StatCache::Counters start_;
+};
+
+TEST_F(StatCacheTest, TestRepeatedStatIsCached) {
+  auto cache = StatCache{};
+  EXPECT_TRUE(cache.exists(file_, true));
+  EXPECT_EQ(cache.get(file_, true).st_size, 4);
+  EXPECT_TRUE(cache.exists(file_, true));
+
+  const auto c = calls();
+  EXPECT_EQ(c.stat_calls, 1U);
+  EXPECT_EQ(c.lstat_calls, 0U);
+  EXPECT_EQ(c.hits, 2U);
+}
+
+TEST_F(StatCacheTest, TestLstatOfNonSymlinkAnswersStat) {
+  auto cache = StatCache{};
+  const auto ino = cache.get(file_, false).st_ino;
+  EXPECT_EQ(cache.get(file_, true).st_ino, ino);
+
+  const auto c = calls();
+  EXPECT_EQ(c.stat_calls, 0U);
+  EXPECT_EQ(c.lstat_calls, 1U);
+}
+
+TEST_F(StatCacheTest, TestLstatOfSymlinkDoesNotAnswerStat) {
+  auto cache = StatCache{};
+  EXPECT_TRUE(S_ISLNK(cache.get(link_, false).st_mode));
+  EXPECT_TRUE(S_ISREG(cache.get(link_, true).st_mode));
+
+  const auto c = calls();
+  EXPECT_EQ(c.stat_calls, 1U);
+  EXPECT_EQ(c.lstat_calls, 1U);
+}
+
+TEST_F(StatCacheTest, TestNegativeResultsAreCached) {
+  auto cache = StatCache{};
+  EXPECT_FALSE(cache.exists(missing_, false));
+  EXPECT_FALSE(cache.exists(missing_, true));
+  EXPECT_THROW((void)cache.get(missing_, true), FilesystemError);
+
+  const auto c = calls();
+  EXPECT_EQ(c.stat_calls, 0U);
+  EXPECT_EQ(c.lstat_calls, 1U);
+  EXPECT_EQ(c.hits, 2U);
+}
+
+TEST_F(StatCacheTest, TestSetLstat) {
+  auto cache = StatCache{};
+  struct stat s = {};
+  ASSERT_EQ(lstat(file_.c_str(), &s), 0);
+  cache.set_lstat(s);
+  EXPECT_TRUE(cache.exists(file_, false));
+  EXPECT_EQ(cache.get(file_, true).st_ino, s.st_ino);
+
+  const auto c = calls();
+  EXPECT_EQ(c.stat_calls, 0U);
+  EXPECT_EQ(c.lstat_calls, 0U);
+}
+
+TEST_F(StatCacheTest, TestPathFieldsShareStatCalls) {
+  // Equivalent to the query: path(<file>) { exists file { size } }
+  const auto path = std::make_shared<SqPathImpl>(file_);
+  const auto params = FieldCallParams{};
+  auto exists = std::get<FieldPtr>(path->get("exists", params));
+  auto file = std::get<FieldPtr>(path->get("file", params));
+  EXPECT_EQ(exists->to_primitive(), Primitive{true});
+  auto size = std::get<FieldPtr>(file->get("size", params));
+  EXPECT_EQ(size->to_primitive(), Primitive{PrimitiveInt{4}});
+
+  const auto c = calls();
+  EXPECT_EQ(c.stat_calls + c.lstat_calls, 1U);
+}
+
+} // namespace
+} // namespace sq::test
@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+# ------------------------------------------------------------------------------
+# Copyright 2021 Jonathan Haigh
+# SPDX-License-Identifier: MIT
+# ------------------------------------------------------------------------------
+
+import json
+import subprocess
+
+import util
+
+
+def test_poll_delta(tmp_path):
+    (tmp_path / "a").touch()
+    query = "<path.<children{inode filename}"
+    with subprocess.Popen(
+        [util.sq_binary(), "--poll=1", "--delta", query],
+        cwd=tmp_path,
+        stdout=subprocess.PIPE,
+        text=True,
+    ) as proc:
+        try:
+            a_inode = (tmp_path / "a").stat().st_ino
+            assert json.loads(proc.stdout.readline()) == [
+                {
+                    "op": "add",
+                    "path": [],
+                    "value": [{"inode": a_inode, "filename": "a"}],
+                }
+            ]
+
+            (tmp_path / "b").touch()
+            b_inode = (tmp_path / "b").stat().st_ino
+            assert json.loads(proc.stdout.readline()) == [
+                {
+                    "op": "add",
+                    "path": [b_inode],
+                    "value": {"inode": b_inode, "filename": "b"},
+                }
+            ]
+
+            (tmp_path / "a").unlink()
+            assert json.loads(proc.stdout.readline()) == [
+                {"op": "remove", "path": [a_inode]}
+            ]
+        finally:
+            proc.kill()
+
+
+def test_delta_needs_repetition():
+    proc = subprocess.run(
+        [util.sq_binary(), "--delta", "<path"],
+        capture_output=True,
+        text=True,
+    )
+    assert proc.returncode != 0
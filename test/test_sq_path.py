@@ -3,9 +3,13 @@
 # SPDX-License-Identifier: MIT
 # ------------------------------------------------------------------------------
 
+import gzip
 import itertools
+import json
+import os
 import pathlib
 import pytest
+import subprocess
 import util
 
 relative_path_infos = [
@@ -224,6 +228,169 @@ def test_children(tmp_path, recurse, follow_symlinks):
     assert result == expected
 
 
+def test_children_fields(tmp_path):
+    names = ("f1", "file.tar.gz", ".hidden")
+    for i, name in enumerate(names):
+        (tmp_path / name).write_text("x" * i)
+    (tmp_path / "dangling").symlink_to(tmp_path / "missing")
+
+    query = (
+        "<path.<children "
+        "{ string filename stem extension exists file(false) { <size } }"
+    )
+    result = sorted(util.sq(query, cwd=tmp_path), key=lambda c: c["string"])
+    expected = sorted(
+        [
+            {
+                "string": str(p),
+                "filename": p.name,
+                "stem": p.stem,
+                "extension": p.suffix,
+                "exists": p.exists(),
+                "file": p.lstat().st_size,
+            }
+            for p in tmp_path.iterdir()
+        ],
+        key=lambda c: c["string"],
+    )
+    assert result == expected
+
+
+@pytest.mark.parametrize(
+    "member,value,expected",
+    [
+        ("filename", "b.txt", ["b.txt", "sub/b.txt"]),
+        ("stem", "a", ["a.log", "a.txt"]),
+        ("extension", ".log", ["a.log", "sub/c.log"]),
+        ("filename", "sub", ["sub"]),
+        ("filename", "missing", []),
+    ],
+)
+def test_children_comparison_filter(tmp_path, member, value, expected):
+    for f in ("a.log", "a.txt", "b.txt", "sub/b.txt", "sub/c.log"):
+        path = tmp_path / f
+        path.parent.mkdir(exist_ok=True)
+        path.touch()
+
+    query = f"<path.<children(recurse=true)[{member}=\"{value}\"]"
+    result = sorted(util.sq(query, cwd=tmp_path))
+    assert result == [str(tmp_path / f) for f in expected]
+
+
+@pytest.mark.parametrize(
+    "params,expected",
+    [
+        ("min_depth=2", ["d/e", "d/f", "d/f/g", "d/f/g/h"]),
+        ("max_depth=2", ["a", "b.git", "b.git/c", "d", "d/e", "d/f"]),
+        ("min_depth=2,max_depth=2", ["d/e", "d/f"]),
+        ('exclude="*.git:f"', ["a", "d", "d/e"]),
+    ],
+)
+def test_children_pruning(tmp_path, params, expected):
+    for f in ("a", "b.git/c", "d/e", "d/f/g/h"):
+        path = tmp_path / f
+        path.parent.mkdir(parents=True, exist_ok=True)
+        path.touch()
+
+    query = f"<path.<children(recurse=true,{params})"
+    result = sorted(util.sq(query, cwd=tmp_path))
+    assert result == [str(tmp_path / f) for f in expected]
+
+
+def test_children_one_file_system():
+    # Walk / far enough to see inside a filesystem mounted on a directory in
+    # /. /proc is excluded because its entries come and go during the walk.
+    root_dev = os.stat("/").st_dev
+    mounts = [
+        p
+        for p in ("/sys", "/dev")
+        if os.path.ismount(p) and os.stat(p).st_dev != root_dev
+        and os.listdir(p)
+    ]
+    if not mounts:
+        pytest.skip("no filesystem is mounted on /sys or /dev")
+    mount = mounts[0]
+
+    def children(params):
+        query = (
+            "<path(\"/\").<children(recurse=true,max_depth=2,"
+            f'skip_permission_denied=true,exclude="proc"{params})'
+        )
+        return util.sq(query)
+
+    inside = [p for p in children("") if p.startswith(f"{mount}/")]
+    assert inside
+    result = children(",one_file_system=true")
+    assert mount in result
+    assert not [p for p in result if p.startswith(f"{mount}/")]
+
+
+@pytest.mark.parametrize(
+    "params",
+    ("inode_order=true", "inode_order=true,unordered=true", "unordered=true"),
+)
+def test_children_inode_order(tmp_path, params):
+    for f in ("a", "b/c", "b/d", "e"):
+        path = tmp_path / f
+        path.parent.mkdir(parents=True, exist_ok=True)
+        path.write_text(f)
+
+    def children(extra_params):
+        query = (
+            f"<path.children(recurse=true{extra_params})"
+            " { path file { size } }"
+        )
+        return util.sq(query, cwd=tmp_path)
+
+    expected = children("")
+    result = children(f",{params}")
+    if "unordered" in params:
+        result = sorted(result, key=lambda c: c["path"])
+        expected = sorted(expected, key=lambda c: c["path"])
+    assert result == expected
+
+
+def test_children_index(tmp_path):
+    tree = tmp_path / "tree"
+    for f in ("a", "b/c", "b/d/e"):
+        path = tree / f
+        path.parent.mkdir(parents=True, exist_ok=True)
+        path.write_text(f)
+    index = util.quote(str(tmp_path / "index"))
+
+    def children(extra_params):
+        query = (
+            f"<path.children(recurse=true{extra_params})"
+            " { path file { size } }"
+        )
+        return util.sq(query, cwd=tree)
+
+    assert children(f",index={index}") == children("")
+    assert (tmp_path / "index").exists()
+
+    (tree / "b" / "f").write_text("new")
+    assert children(f",index={index}") == children("")
+
+
+def test_children_jobs(tmp_path):
+    for i in range(20):
+        path = tmp_path / f"dir{i}" / "file"
+        path.parent.mkdir(parents=True, exist_ok=True)
+        path.write_text(str(i))
+
+    query = (
+        "<path.children(recurse=true)"
+        " { path file { size user { username } } }"
+    )
+    expected = util.sq(query, cwd=tmp_path)
+    assert util.sq(query, options=("--jobs=4",), cwd=tmp_path) == expected
+
+    result = util.sq(query, options=("--jobs=4", "--unordered"), cwd=tmp_path)
+    assert sorted(result, key=lambda c: c["path"]) == sorted(
+        expected, key=lambda c: c["path"]
+    )
+
+
 @pytest.mark.parametrize(
     "symlink,follow_symlinks,exists",
     itertools.product((True, False), repeat=3)
@@ -259,3 +426,127 @@ def test_file(tmp_path, symlink, follow_symlinks):
     quoted_path = util.quote(str(path))
     query = f"<path({quoted_path}).<file({follow_symlinks_param})"
     assert util.sq(query) == expected
+
+
+def test_children_pipeline(tmp_path):
+    for i in range(100):
+        (tmp_path / f"file{i}").write_text(str(i))
+
+    query = "<path.children { path file { size } }"
+    expected = util.sq(query, cwd=tmp_path)
+    assert util.sq(query, options=("--pipeline",), cwd=tmp_path) == expected
+
+
+@pytest.mark.parametrize("flush", ("--flush=element", "--flush=full"))
+def test_children_flush(tmp_path, flush):
+    for i in range(100):
+        (tmp_path / f"file{i}").write_text(str(i))
+
+    query = "<path.children { path file { size } }"
+    expected = util.sq(query, options=("--pipeline",), cwd=tmp_path)
+    assert util.sq(query, options=(flush,), cwd=tmp_path) == expected
+
+
+@pytest.mark.parametrize(
+    "options",
+    ((), ("--ndjson-path=path.children",), ("--flush-interval=0",), ("--pipeline",)),
+)
+def test_children_ndjson(tmp_path, options):
+    for i in range(100):
+        (tmp_path / f"file{i}").write_text(str(i))
+
+    query = "path.children { path file { size } }"
+    expected = util.sq(query, cwd=tmp_path)["path"]["children"]
+    assert util.sq_ndjson(query, options=options, cwd=tmp_path) == expected
+
+
+def test_children_arrow(tmp_path):
+    ipc = pytest.importorskip("pyarrow.ipc")
+    for i in range(100):
+        (tmp_path / f"file{i}").write_text(str(i))
+
+    query = "path.children { path file { size { B } } }"
+    expected = [
+        {"path": child["path"], "file.size.B": child["file"]["size"]["B"]}
+        for child in util.sq(query, cwd=tmp_path)["path"]["children"]
+    ]
+    output = util.sq_output(
+        query, options=("--format=arrow",), text=False, cwd=tmp_path
+    )
+    assert ipc.open_stream(output).read_all().to_pylist() == expected
+
+
+@pytest.mark.parametrize(
+    "option", ("--timeout=10", "--max-elements=10", "--max-output-bytes=500")
+)
+def test_arrow_cant_be_truncated(option):
+    proc = subprocess.run(
+        [util.sq_binary(), "--format=arrow", option, "<path.children"],
+        capture_output=True,
+        text=True,
+    )
+    assert proc.returncode != 0
+
+
+@pytest.mark.parametrize(
+    "options",
+    (
+        (),
+        ("--compress-level=9",),
+        ("--flush=element",),
+        ("--pipeline",),
+        ("--format=ndjson", "--flush-interval=0"),
+    ),
+)
+def test_children_gzip(tmp_path, options):
+    for i in range(100):
+        (tmp_path / f"file{i}").write_text(str(i))
+
+    query = "path.children { path file { size } }"
+    expected = util.sq_output(
+        query, options=options, text=False, cwd=tmp_path
+    )
+    output = util.sq_output(
+        query, options=("--compress=gzip", *options), text=False, cwd=tmp_path
+    )
+    assert gzip.decompress(output) == expected
+
+
+@pytest.mark.parametrize("prefetch", ("--prefetch=0", "--prefetch=1", "--prefetch=8"))
+def test_children_prefetch(tmp_path, prefetch):
+    for i in range(20):
+        (tmp_path / f"file{i}").write_text(str(i))
+
+    query = "<path.children { path file { size user { username } } }"
+    expected = util.sq(query, options=("--prefetch=0",), cwd=tmp_path)
+    assert util.sq(query, options=(prefetch,), cwd=tmp_path) == expected
+
+
+@pytest.mark.parametrize(
+    "options",
+    (
+        ("--max-elements=10",),
+        ("--max-output-bytes=500",),
+        ("--max-elements=10", "--jobs=4"),
+    ),
+)
+def test_children_output_limit(tmp_path, options):
+    for i in range(100):
+        (tmp_path / f"file{i}").write_text(str(i))
+
+    query = "<path.children { path file { size } }"
+    expected = util.sq(query, cwd=tmp_path)
+    proc = subprocess.run(
+        [util.sq_binary(), *options, query],
+        capture_output=True,
+        text=True,
+        cwd=tmp_path,
+    )
+    assert proc.returncode != 0
+    assert "limit reached" in proc.stderr
+    result = json.loads(proc.stdout)
+    assert result[-1] == {"truncated": True}
+    assert 0 < len(result) - 1 < len(expected)
+    assert result[:-1] == expected[: len(result) - 1]
+    if "--max-elements=10" in options:
+        assert len(result) == 11
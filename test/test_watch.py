@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+# ------------------------------------------------------------------------------
+# Copyright 2021 Jonathan Haigh
+# SPDX-License-Identifier: MIT
+# ------------------------------------------------------------------------------
+
+import json
+import subprocess
+
+import util
+
+
+def test_watch_children(tmp_path):
+    (tmp_path / "sub").mkdir()
+    (tmp_path / "a").touch()
+    query = "<path.<children(recurse=true).<filename"
+    with subprocess.Popen(
+        [util.sq_binary(), "--watch", query],
+        cwd=tmp_path,
+        stdout=subprocess.PIPE,
+        text=True,
+    ) as proc:
+        try:
+            assert sorted(json.loads(proc.stdout.readline())) == ["a", "sub"]
+
+            (tmp_path / "sub" / "b").touch()
+            assert sorted(json.loads(proc.stdout.readline())) == [
+                "a", "b", "sub"
+            ]
+
+            (tmp_path / "a").unlink()
+            assert sorted(json.loads(proc.stdout.readline())) == ["b", "sub"]
+        finally:
+            proc.kill()
+
+
+def test_watch_needs_query():
+    proc = subprocess.run(
+        [util.sq_binary(), "--watch"], capture_output=True, text=True
+    )
+    assert proc.returncode != 0
@@ -90,17 +90,27 @@ def sq_binary():
     raise RuntimeError("Could not find SQ binary")
 
 
-def sq(query, **kwargs):
+def sq_output(query, options=(), text=True, **kwargs):
     log(f"SQ query: {query}")
     output = subprocess.run(
-            [sq_binary(), query],
+            [sq_binary(), *options, query],
             capture_output=True,
             check=True,
-            text=True,
+            text=text,
             **kwargs,
         ).stdout
-    log(f"SQ output: {output}")
-    return json.loads(output)
+    if text:
+        log(f"SQ output: {output}")
+    return output
+
+
+def sq(query, options=(), **kwargs):
+    return json.loads(sq_output(query, options=options, **kwargs))
+
+
+def sq_ndjson(query, options=(), **kwargs):
+    output = sq_output(query, options=("--format=ndjson", *options), **kwargs)
+    return [json.loads(line) for line in output.splitlines()]
 
 
 def sq_error(query, pattern=None, flags=re.I):